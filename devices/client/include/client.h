@@ -5,6 +5,7 @@
 #define CLIENT_H
 
 #include "../../common/common.h"
+#include "../../common/protocol.h"
 
 // Client-specific constants
 #define CLIENT_VERSION "1.0.0"
@@ -17,6 +18,7 @@ typedef struct {
     int nm_port;
     int client_port;
     int nm_socket;
+    FrameConn nm_conn;          // Reassembles replies read from nm_socket
     int is_connected;
     time_t connected_time;
 } Client;
@@ -26,13 +28,14 @@ int client_init(Client *client, const char *nm_ip, int nm_port, const char *user
 void client_cleanup(Client *client);
 int send_to_nameserver(Client *client, const char *message, char *response, size_t response_size);
 int connect_to_storage_server(const char *ss_ip, int ss_port);
+void close_storage_server(FrameConn *ss);
 
 // Command handlers
 void handle_view(Client *client, const char *flags);
-void handle_read(Client *client, const char *filename);
+void handle_read(Client *client, const char *filename, const char *view);
 void handle_create(Client *client, const char *filename);
-void handle_write(Client *client, const char *filename, int sentence_num);
-void handle_undo(Client *client, const char *filename);
+void handle_write(Client *client, const char *filename, const char *sentence, int wait_sec);
+void handle_undo(Client *client, const char *filename, int levels);
 void handle_info(Client *client, const char *filename);
 void handle_delete(Client *client, const char *filename);
 void handle_stream(Client *client, const char *filename);
@@ -40,6 +43,7 @@ void handle_list(Client *client);
 void handle_addaccess(Client *client, const char *access_type, const char *filename, const char *target_user);
 void handle_remaccess(Client *client, const char *filename, const char *target_user);
 void handle_exec(Client *client, const char *filename);
+void handle_batch(Client *client, int pipelined);
 
 
 // Utility functions
@@ -47,8 +51,10 @@ void parse_command(char *input, char **tokens, int *token_count);
 void print_error(const char *message);
 void print_success(const char *message);
 void print_help(void);
-int receive_full_message(int socket_fd, char *buffer, size_t buffer_size);
-int send_full_message(int socket_fd, const char *message);
+int receive_full_message(FrameConn *conn, char *buffer, size_t buffer_size);
+int receive_until_stop(FrameConn *conn, DynamicBuffer *out);
+int send_full_message(FrameConn *conn, const char *message);
+int send_word_update(FrameConn *conn, int word_index, const char *content);
 
 #endif // CLIENT_H
 
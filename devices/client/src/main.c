@@ -82,6 +82,7 @@ int client_init(Client *client, const char *nm_ip, int nm_port, const char *user
     }
     
     client->is_connected = 1;
+    frame_conn_init(&client->nm_conn, client->nm_socket);
     
     // Send registration message using MSG_REGISTER_CLIENT
     // Format: REGISTER_CLIENT|username|client_ip|client_port
@@ -122,8 +123,9 @@ void client_cleanup(Client *client) {
         char disconnect_msg[BUFFER_SIZE];
         snprintf(disconnect_msg, BUFFER_SIZE, "%s%s%s",
                  MSG_DISCONNECT, PROTOCOL_DELIMITER, client->username);
-        send(client->nm_socket, disconnect_msg, strlen(disconnect_msg), 0);
+        send_full_message(&client->nm_conn, disconnect_msg);
         close(client->nm_socket);
+        frame_conn_free(&client->nm_conn);
         client->is_connected = 0;
     }
 }
@@ -137,11 +139,11 @@ int send_to_nameserver(Client *client, const char *message, char *response, size
         return ERR_CONNECTION_FAILED;
     }
     
-    if (send_full_message(client->nm_socket, message) < 0) {
+    if (send_full_message(&client->nm_conn, message) < 0) {
         return ERR_SEND_FAILED;
     }
     
-    if (receive_full_message(client->nm_socket, response, response_size) < 0) {
+    if (receive_full_message(&client->nm_conn, response, response_size) < 0) {
         return ERR_RECV_FAILED;
     }
     
@@ -184,45 +186,76 @@ int connect_to_storage_server(const char *ss_ip, int ss_port) {
     return ss_socket;
 }
 
-int send_full_message(int socket_fd, const char *message) {
-    size_t total_sent = 0;
-    size_t message_len = strlen(message);
-    
-    while (total_sent < message_len) {
-        ssize_t bytes_sent = send(socket_fd, message + total_sent, 
-                                   message_len - total_sent, 0);
-        if (bytes_sent < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            perror("Send failed");
-            return -1;
-        }
-        total_sent += bytes_sent;
+void close_storage_server(FrameConn *ss) {
+    close(ss->fd);
+    frame_conn_free(ss);
+}
+
+// Requests go out as frames (common/protocol.h), so a server can tell where
+// each ends however TCP splits them
+int send_full_message(FrameConn *conn, const char *message) {
+    if (frame_conn_request(conn, message) != ERR_SUCCESS) {
+        perror("Send failed");
+        return -1;
     }
-    
-    return total_sent;
+    return 0;
 }
 
-int receive_full_message(int socket_fd, char *buffer, size_t buffer_size) {
-    memset(buffer, 0, buffer_size);
-    ssize_t bytes_received = recv(socket_fd, buffer, buffer_size - 1, 0);
-    
-    if (bytes_received < 0) {
-        if (errno == EINTR) {
-            return receive_full_message(socket_fd, buffer, buffer_size);
-        }
-        perror("Receive failed");
+// A WRITE session's word update, with the index and content as typed
+// fields so the content may hold any character
+int send_word_update(FrameConn *conn, int word_index, const char *content) {
+    DynamicBuffer frame = {0};
+    long start = frame_begin(&frame, OP_WORD_UPDATE, 0);
+    int result = start < 0 ? ERR_OUT_OF_MEMORY : frame_add_int(&frame, word_index);
+    if (result == ERR_SUCCESS) result = frame_add_str(&frame, content, strlen(content));
+    if (result == ERR_SUCCESS) {
+        frame_end(&frame, start);
+        result = frame_conn_send(conn, &frame);
+    }
+    dynbuf_free(&frame);
+    
+    if (result != ERR_SUCCESS) {
+        perror("Send failed");
+        return -1;
+    }
+    return 0;
+}
+
+// The next reply to the last request, whole, as the text the server would
+// have sent a text-mode client. Cut short to fit the buffer.
+int receive_full_message(FrameConn *conn, char *buffer, size_t buffer_size) {
+    DynamicBuffer reply = {0};
+    
+    errno = 0;
+    if (frame_conn_reply(conn, &reply) != ERR_SUCCESS) {
+        if (errno != 0) perror("Receive failed");
+        else fprintf(stderr, "Connection closed by peer\n");
+        dynbuf_free(&reply);
         return -1;
     }
     
-    if (bytes_received == 0) {
-        fprintf(stderr, "Connection closed by peer\n");
+    size_t length = reply.length < buffer_size - 1 ? reply.length : buffer_size - 1;
+    memcpy(buffer, reply.data ? reply.data : "", length);
+    buffer[length] = '\0';
+    dynbuf_free(&reply);
+    return (int)length;
+}
+
+// Receive a response of any size that ends with a STOP line (or a single
+// ERROR message). The STOP line is not kept in the buffer.
+int receive_until_stop(FrameConn *conn, DynamicBuffer *out) {
+    if (frame_conn_reply(conn, out) != ERR_SUCCESS) {
+        perror("Receive failed");
         return -1;
     }
     
-    buffer[bytes_received] = '\0';
-    return bytes_received;
+    if (out->length >= 5 &&
+        strcmp(out->data + out->length - 5, "STOP\n") == 0 &&
+        (out->length == 5 || out->data[out->length - 6] == '\n')) {
+        out->length -= 5;
+        out->data[out->length] = '\0';
+    }
+    return out->length;
 }
 
 // ============================================================================
@@ -342,7 +375,9 @@ void handle_view(Client *client, const char *flags) {
 
 
 
-void handle_read(Client *client, const char *filename) {
+// view: NULL for the whole file, "ids" to show sentence IDs, or an index
+// or @id to read one sentence
+void handle_read(Client *client, const char *filename, const char *view) {
     char request[BUFFER_SIZE];
     char response[BUFFER_SIZE];
     
@@ -393,24 +428,33 @@ void handle_read(Client *client, const char *filename) {
         print_error("Failed to connect to storage server");
         return;
     }
+    FrameConn ss;
+    frame_conn_init(&ss, ss_socket);
     
-    // Send read request to storage server: READ|filename
+    // Send read request to storage server: READ|filename[|view]
     snprintf(request, BUFFER_SIZE, "%s%s%s", MSG_READ, PROTOCOL_DELIMITER, filename);
-    if (send_full_message(ss_socket, request) < 0) {
+    if (view) {
+        size_t len = strlen(request);
+        snprintf(request + len, BUFFER_SIZE - len, "%s%s", PROTOCOL_DELIMITER, view);
+    }
+    if (send_full_message(&ss, request) < 0) {
         print_error("Failed to send read request to storage server");
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
     
-    // Receive file content
-    char content[LARGE_BUFFER_SIZE];
-    if (receive_full_message(ss_socket, content, sizeof(content)) < 0) {
+    // Receive file content (terminated by STOP)
+    DynamicBuffer received;
+    if (dynbuf_init(&received, BUFFER_SIZE) != ERR_SUCCESS ||
+        receive_until_stop(&ss, &received) < 0) {
         print_error("Failed to receive file content");
-        close(ss_socket);
+        dynbuf_free(&received);
+        close_storage_server(&ss);
         return;
     }
     
-    close(ss_socket);
+    close_storage_server(&ss);
+    char *content = received.data;
     
     // Parse response: SUCCESS|content or ERROR|message
     if (strncmp(content, MSG_SUCCESS, strlen(MSG_SUCCESS)) == 0) {
@@ -424,6 +468,7 @@ void handle_read(Client *client, const char *filename) {
         // If no prefix, assume it's the content
         printf("%s\n", content);
     }
+    dynbuf_free(&received);
 }
 
 void handle_create(Client *client, const char *filename) {
@@ -454,7 +499,8 @@ void handle_create(Client *client, const char *filename) {
     }
 }
 
-void handle_write(Client *client, const char *filename, int sentence_num) {
+// sentence is an index or @id, the stable ID READ <file> ids shows
+void handle_write(Client *client, const char *filename, const char *sentence, int wait_sec) {
     char request[BUFFER_SIZE];
     char response[BUFFER_SIZE];
     
@@ -464,14 +510,15 @@ void handle_write(Client *client, const char *filename, int sentence_num) {
         return;
     }
     
-    if (sentence_num < 0) {
+    const char *digits = sentence[0] == '@' ? sentence + 1 : sentence;
+    if (*digits == '\0' || strspn(digits, "0123456789") != strlen(digits)) {
         print_error(get_error_message(ERR_SENTENCE_INDEX_OUT_OF_RANGE));
         return;
     }
     
-    // Request lock from nameserver: WRITE|filename|sentence_num
-    snprintf(request, BUFFER_SIZE, "%s%s%s%s%d",
-             MSG_WRITE, PROTOCOL_DELIMITER, filename, PROTOCOL_DELIMITER, sentence_num);
+    // Request lock from nameserver: WRITE|filename|sentence
+    snprintf(request, BUFFER_SIZE, "%s%s%s%s%s",
+             MSG_WRITE, PROTOCOL_DELIMITER, filename, PROTOCOL_DELIMITER, sentence);
     
     if (send_to_nameserver(client, request, response, BUFFER_SIZE) < 0) {
         print_error("Failed to send write request");
@@ -509,30 +556,50 @@ void handle_write(Client *client, const char *filename, int sentence_num) {
         print_error("Failed to connect to storage server");
         return;
     }
+    FrameConn ss;
+    frame_conn_init(&ss, ss_socket);
     
-    // Send write initialization to storage server: WRITE|filename|sentence_num|username
-    snprintf(request, BUFFER_SIZE, "%s%s%s%s%d%s%s",
+    // Send write initialization to storage server: WRITE|filename|sentence|username[|wait_ms]
+    snprintf(request, BUFFER_SIZE, "%s%s%s%s%s%s%s",
              MSG_WRITE, PROTOCOL_DELIMITER, filename, 
-             PROTOCOL_DELIMITER, sentence_num, PROTOCOL_DELIMITER, client->username);
+             PROTOCOL_DELIMITER, sentence, PROTOCOL_DELIMITER, client->username);
+    if (wait_sec > 0) {
+        size_t len = strlen(request);
+        snprintf(request + len, BUFFER_SIZE - len, "%s%d", PROTOCOL_DELIMITER, wait_sec * 1000);
+
+        // The acknowledgment only comes once the lock is ours
+        struct timeval timeout;
+        timeout.tv_sec = wait_sec + CONNECTION_TIMEOUT_SEC;
+        timeout.tv_usec = 0;
+        setsockopt(ss_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        printf("Waiting up to %d second(s) for the sentence lock...\n", wait_sec);
+    }
     
-    if (send_full_message(ss_socket, request) < 0) {
+    if (send_full_message(&ss, request) < 0) {
         print_error("Failed to send write request to storage server");
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
     
     // Receive acknowledgment
-    if (receive_full_message(ss_socket, response, BUFFER_SIZE) < 0) {
+    if (receive_full_message(&ss, response, BUFFER_SIZE) < 0) {
         print_error("Failed to receive acknowledgment");
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
     
     if (strncmp(response, MSG_ERROR, strlen(MSG_ERROR)) == 0) {
         print_error(response + strlen(MSG_ERROR) + 1);
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
+
+    if (wait_sec > 0) {
+        struct timeval timeout;
+        timeout.tv_sec = CONNECTION_TIMEOUT_SEC;
+        timeout.tv_usec = 0;
+        setsockopt(ss_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
     
     // Accept write commands from user
     char input[MAX_COMMAND_LENGTH];
@@ -553,16 +620,16 @@ void handle_write(Client *client, const char *filename, int sentence_num) {
         
         if (strcmp(input, MSG_WRITE_END) == 0) {
             // Send finish signal
-            if (send_full_message(ss_socket, MSG_WRITE_END) < 0) {
+            if (send_full_message(&ss, MSG_WRITE_END) < 0) {
                 print_error("Failed to send finish signal");
-                close(ss_socket);
+                close_storage_server(&ss);
                 return;
             }
             
             // Receive final response
-            if (receive_full_message(ss_socket, response, BUFFER_SIZE) < 0) {
+            if (receive_full_message(&ss, response, BUFFER_SIZE) < 0) {
                 print_error("Failed to receive response");
-                close(ss_socket);
+                close_storage_server(&ss);
                 return;
             }
             
@@ -574,18 +641,25 @@ void handle_write(Client *client, const char *filename, int sentence_num) {
             break;
         }
         
-        char *p = strchr(input, ' ');  
-        if (p != NULL) *p = '|';                
-        if (send_full_message(ss_socket, input) < 0) {
+        // word_index content
+        char *p = strchr(input, ' ');
+        int sent;
+        if (p != NULL) {
+            *p = '\0';
+            sent = send_word_update(&ss, atoi(input), p + 1);
+        } else {
+            sent = send_full_message(&ss, input);
+        }
+        if (sent < 0) {
             print_error("Failed to send write command");
-            close(ss_socket);
+            close_storage_server(&ss);
             return;
         }
         
         // Receive acknowledgment for each command
-        if (receive_full_message(ss_socket, response, BUFFER_SIZE) < 0) {
+        if (receive_full_message(&ss, response, BUFFER_SIZE) < 0) {
             print_error("Failed to receive acknowledgment");
-            close(ss_socket);
+            close_storage_server(&ss);
             return;
         }
         
@@ -595,10 +669,10 @@ void handle_write(Client *client, const char *filename, int sentence_num) {
         }
     }
     
-    close(ss_socket);
+    close_storage_server(&ss);
 }
 
-void handle_undo(Client *client, const char *filename) {
+void handle_undo(Client *client, const char *filename, int levels) {
     char request[BUFFER_SIZE];
     char response[BUFFER_SIZE];
     
@@ -606,6 +680,10 @@ void handle_undo(Client *client, const char *filename) {
         print_error(get_error_message(ERR_INVALID_FILENAME));
         return;
     }
+    if (levels < 1) {
+        print_error("Undo level count must be at least 1");
+        return;
+    }
     
     // Request format: UNDO|filename
     snprintf(request, BUFFER_SIZE, "%s%s%s",
@@ -648,20 +726,24 @@ void handle_undo(Client *client, const char *filename) {
         print_error("Failed to connect to storage server");
         return;
     }
+    FrameConn ss;
+    frame_conn_init(&ss, ss_socket);
     
-    snprintf(request, BUFFER_SIZE, "%s%s%s", MSG_UNDO, PROTOCOL_DELIMITER, filename);
-    if (send_full_message(ss_socket, request) < 0) {
+    // Request format: UNDO|filename|levels
+    snprintf(request, BUFFER_SIZE, "%s%s%s%s%d", MSG_UNDO, PROTOCOL_DELIMITER, filename,
+             PROTOCOL_DELIMITER, levels);
+    if (send_full_message(&ss, request) < 0) {
         print_error("Failed to send undo request to storage server");
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
     
-    if (receive_full_message(ss_socket, response, BUFFER_SIZE) < 0) {
+    if (receive_full_message(&ss, response, BUFFER_SIZE) < 0) {
         print_error("Failed to receive acknowledgment");
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
-    close(ss_socket);
+    close_storage_server(&ss);
     
     // Parse response: SUCCESS|content or ERROR|message
     
@@ -776,26 +858,28 @@ void handle_stream(Client *client, const char *filename) {
         print_error("Failed to connect to storage server");
         return;
     }
+    FrameConn ss;
+    frame_conn_init(&ss, ss_socket);
     
     // Send stream request: STREAM|filename
     snprintf(request, BUFFER_SIZE, "%s%s%s%s%s", MSG_STREAM, PROTOCOL_DELIMITER, filename, PROTOCOL_DELIMITER, client -> username);
-    if (send_full_message(ss_socket, request) < 0) {
+    if (send_full_message(&ss, request) < 0) {
         print_error("Failed to send stream request to storage server");
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
     
     // Receive initial response
-    if (receive_full_message(ss_socket, response, BUFFER_SIZE) < 0) {
+    if (receive_full_message(&ss, response, BUFFER_SIZE) < 0) {
         print_error("Failed to receive response");
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
     
     // Check if streaming started successfully
     if (strncmp(response, MSG_ERROR, strlen(MSG_ERROR)) == 0) {
         print_error(response + strlen(MSG_ERROR) + 1);
-        close(ss_socket);
+        close_storage_server(&ss);
         return;
     }
     
@@ -806,9 +890,9 @@ void handle_stream(Client *client, const char *filename) {
     
     while (1) {
         memset(word, 0, sizeof(word));
-        if (receive_full_message(ss_socket, word, sizeof(word)) < 0) {
+        if (receive_full_message(&ss, word, sizeof(word)) < 0) {
             print_error("\nStorage server disconnected during streaming");
-            close(ss_socket);
+            close_storage_server(&ss);
             return;
         }
         
@@ -848,7 +932,7 @@ void handle_stream(Client *client, const char *filename) {
         }
     }
     
-    close(ss_socket);
+    close_storage_server(&ss);
 }
 
 void handle_list(Client *client) {
@@ -961,6 +1045,156 @@ void handle_exec(Client *client, const char *filename) {
     }
 }
 
+// ============================================================================
+// BATCHES
+// ============================================================================
+// A block of name server commands typed one per line, ended by END. BATCH
+// sends them as BATCH requests of up to BATCH_MAX_COMMANDS each, checked
+// and run by the name server in one pass; PIPELINE sends each as its own
+// request without waiting for the one before. Either way the requests are
+// pipelined, so a long script costs bandwidth rather than a round trip per
+// command.
+
+static void print_batch_reply(const char *line, const char *reply) {
+    printf("[%s] ", line);
+    fflush(stdout);
+    if (strncmp(reply, MSG_SUCCESS, strlen(MSG_SUCCESS)) == 0) {
+        print_success(reply + strlen(MSG_SUCCESS) + 1);
+    } else if (strncmp(reply, MSG_ERROR, strlen(MSG_ERROR)) == 0) {
+        print_error(reply + strlen(MSG_ERROR) + 1);
+    } else {
+        printf("%s\n", reply);
+    }
+}
+
+static void show_rendered_reply(const char *line, WireMessage *reply) {
+    DynamicBuffer text = {0};
+    message_render_reply(reply, &text);
+    while (text.length > 0 && text.data[text.length - 1] == '\n') {
+        text.data[--text.length] = '\0';
+    }
+    print_batch_reply(line, text.data ? text.data : "");
+    dynbuf_free(&text);
+}
+
+// arg is the commands as typed
+static void show_pipelined_reply(int index, WireMessage *reply, void *arg) {
+    char **lines = arg;
+    show_rendered_reply(lines[index], reply);
+}
+
+static void show_batch_reply(int index, WireMessage *reply, void *arg) {
+    char **lines = arg;
+    int first = index * BATCH_MAX_COMMANDS;
+
+    if (reply->opcode != OP_REPLY_BATCH) {
+        show_rendered_reply(lines[first], reply);
+        return;
+    }
+
+    WireMessage item;
+    size_t offset = 0;
+    int status;
+    while ((status = message_next_batched(reply, &offset, &item)) > 0) {
+        if (item.request_id < BATCH_MAX_COMMANDS) {
+            show_rendered_reply(lines[first + (int)item.request_id], &item);
+        }
+    }
+    if (status < 0) print_error("Malformed BATCH reply");
+}
+
+// A typed command as a request line: "ADDACCESS -R f bob" → "ADDACCESS|-R|f|bob"
+static void batch_request_line(const char *input, char *request, size_t size) {
+    char copy[MAX_COMMAND_LENGTH];
+    char *tokens[10];
+    int token_count;
+
+    strncpy(copy, input, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+    parse_command(copy, tokens, &token_count);
+
+    size_t used = 0;
+    request[0] = '\0';
+    for (int i = 0; i < token_count && used < size; i++) {
+        used += (size_t)snprintf(request + used, size - used, "%s%s",
+                                 i > 0 ? PROTOCOL_DELIMITER : "", tokens[i]);
+    }
+}
+
+void handle_batch(Client *client, int pipelined) {
+    char input[MAX_COMMAND_LENGTH];
+    char request[MAX_COMMAND_LENGTH];
+    char **lines = NULL;
+    int count = 0, capacity = 0;
+
+    printf("Enter name server commands, one per line. Type 'END' to send them:\n");
+    while (1) {
+        printf("%s: ", pipelined ? "PIPELINE" : "BATCH");
+        fflush(stdout);
+
+        if (fgets(input, sizeof(input), stdin) == NULL) break;
+        input[strcspn(input, "\n")] = 0;
+        trim_whitespace(input);
+        if (strcmp(input, "END") == 0) break;
+        if (input[0] == '\0') continue;
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **grown = realloc(lines, (size_t)capacity * sizeof(char*));
+            if (!grown) break;
+            lines = grown;
+        }
+        lines[count] = strdup(input);
+        if (!lines[count]) break;
+        count++;
+    }
+
+    if (count == 0) {
+        free(lines);
+        return;
+    }
+
+    // One request per command, or per BATCH_MAX_COMMANDS of them
+    int request_count = pipelined ? count : (count + BATCH_MAX_COMMANDS - 1) / BATCH_MAX_COMMANDS;
+    DynamicBuffer *requests = calloc((size_t)request_count, sizeof(DynamicBuffer));
+    int result = requests ? ERR_SUCCESS : ERR_OUT_OF_MEMORY;
+
+    for (int r = 0; r < request_count && result == ERR_SUCCESS; r++) {
+        if (pipelined) {
+            batch_request_line(lines[r], request, sizeof(request));
+            result = frame_encode_request(&requests[r], 0, request);
+            continue;
+        }
+
+        long start = frame_batch_begin(&requests[r], OP_BATCH, 0);
+        int first = r * BATCH_MAX_COMMANDS;
+        int last = first + BATCH_MAX_COMMANDS < count ? first + BATCH_MAX_COMMANDS : count;
+        if (start < 0) result = ERR_OUT_OF_MEMORY;
+        for (int i = first; i < last && result == ERR_SUCCESS; i++) {
+            batch_request_line(lines[i], request, sizeof(request));
+            result = frame_encode_request(&requests[r], (uint32_t)(i - first), request);
+        }
+        if (result == ERR_SUCCESS) frame_batch_end(&requests[r], start);
+    }
+
+    if (result == ERR_SUCCESS) {
+        result = frame_conn_pipeline(&client->nm_conn, requests, request_count,
+                                     FRAME_PIPELINE_WINDOW,
+                                     pipelined ? show_pipelined_reply : show_batch_reply,
+                                     lines);
+        if (result != ERR_SUCCESS) print_error("Lost the name server connection");
+    } else {
+        print_error(get_error_message(result));
+    }
+
+    if (requests) {
+        for (int r = 0; r < request_count; r++) dynbuf_free(&requests[r]);
+        free(requests);
+    }
+    for (int i = 0; i < count; i++) free(lines[i]);
+    free(lines);
+}
+
 // ============================================================================
 // UTILITY FUNCTIONS
 // ============================================================================
@@ -989,12 +1223,14 @@ void print_help(void) {
     printf("╠═══════════════════════════════════════════════════════════════════╣\n");
     printf("║ File Operations:                                                  ║\n");
     printf("║   VIEW [-a] [-l]            List files                           ║\n");
-    printf("║   READ <filename>           Read file content                    ║\n");
+    printf("║   READ <file> [ids|n|@id]   Read file content, with sentence     ║\n");
+    printf("║                             IDs, or one sentence                 ║\n");
     printf("║   CREATE <filename>         Create new file                      ║\n");
-    printf("║   WRITE <file> <sent#>      Write to file at sentence level     ║\n");
+    printf("║   WRITE <file> <n|@id> [wait]  Write at sentence level; wait    ║\n");
+    printf("║                             up to <wait> s if it is locked      ║\n");
     printf("║   DELETE <filename>         Delete file (owner only)             ║\n");
     printf("║   INFO <filename>           Get file information                 ║\n");
-    printf("║   UNDO <filename>           Undo last change                     ║\n");
+    printf("║   UNDO <filename> [levels]  Undo last change(s)                  ║\n");
     printf("║   STREAM <filename>         Stream file content word-by-word     ║\n");
     printf("║                                                                   ║\n");
     printf("║ Access Control:                                                   ║\n");
@@ -1005,6 +1241,13 @@ void print_help(void) {
     printf("║ Execution:                                                        ║\n");
     printf("║   EXEC <filename>           Execute file as shell commands       ║\n");
     printf("║                                                                   ║\n");
+    printf("║ Scripting:                                                        ║\n");
+    printf("║   BATCH ... END             Send the commands between as one     ║\n");
+    printf("║                             request (ADDACCESS, REMACCESS,      ║\n");
+    printf("║                             INFO, READ, WRITE, STREAM, UNDO)    ║\n");
+    printf("║   PIPELINE ... END          Send each command without waiting    ║\n");
+    printf("║                             for the one before                  ║\n");
+    printf("║                                                                   ║\n");
     printf("║ System:                                                           ║\n");
     printf("║   help                      Show this help message               ║\n");
     printf("║   quit/exit                 Exit client                          ║\n");
@@ -1122,9 +1365,9 @@ int main(int argc, char *argv[]) {
         }
         else if (strcmp(tokens[0], "READ") == 0) {
             if (token_count < 2) {
-                print_error("Usage: READ <filename>");
+                print_error("Usage: READ <filename> [ids|sentence_number|@id]");
             } else {
-                handle_read(&g_client, tokens[1]);
+                handle_read(&g_client, tokens[1], token_count > 2 ? tokens[2] : NULL);
             }
         }
         else if (strcmp(tokens[0], "CREATE") == 0) {
@@ -1136,17 +1379,18 @@ int main(int argc, char *argv[]) {
         }
         else if (strcmp(tokens[0], "WRITE") == 0) {
             if (token_count < 3) {
-                print_error("Usage: WRITE <filename> <sentence_number>");
+                print_error("Usage: WRITE <filename> <sentence_number|@id> [wait_seconds]");
             } else {
-                int sentence_num = atoi(tokens[2]);
-                handle_write(&g_client, tokens[1], sentence_num);
+                int wait_sec = token_count >= 4 ? atoi(tokens[3]) : 0;
+                handle_write(&g_client, tokens[1], tokens[2], wait_sec);
             }
         }
         else if (strcmp(tokens[0], "UNDO") == 0) {
             if (token_count < 2) {
-                print_error("Usage: UNDO <filename>");
+                print_error("Usage: UNDO <filename> [levels]");
             } else {
-                handle_undo(&g_client, tokens[1]);
+                int levels = token_count >= 3 ? atoi(tokens[2]) : 1;
+                handle_undo(&g_client, tokens[1], levels);
             }
         }
         else if (strcmp(tokens[0], "INFO") == 0) {
@@ -1187,6 +1431,9 @@ int main(int argc, char *argv[]) {
                 handle_remaccess(&g_client, tokens[1], tokens[2]);
             }
         }
+        else if (strcmp(tokens[0], "BATCH") == 0 || strcmp(tokens[0], "PIPELINE") == 0) {
+            handle_batch(&g_client, strcmp(tokens[0], "PIPELINE") == 0);
+        }
         else if (strcmp(tokens[0], "EXEC") == 0) {
             if (token_count < 2) {
                 print_error("Usage: EXEC <filename>");
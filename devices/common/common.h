@@ -19,6 +19,8 @@
 #include <ctype.h>
 #include <stdarg.h>
 
+#include "tokenizer.h"
+
 // ============================================================================
 // SYSTEM-WIDE CONSTANTS
 // ============================================================================
@@ -172,6 +174,7 @@
 #define ERR_OPERATION_FAILED 506
 #define ERR_NOTHING_TO_UNDO 507
 #define ERR_UNDO_FAILED 508
+#define ERR_WRITE_CONFLICT 509
 
 // Resource errors (6xx)
 #define ERR_OUT_OF_MEMORY 600
@@ -251,7 +254,6 @@ typedef enum {
 typedef struct {
     char filename[MAX_FILENAME_LENGTH];
     char owner[MAX_USERNAME_LENGTH];
-    char path[MAX_PATH_LENGTH];
     size_t size;
     int word_count;
     int char_count;
@@ -259,8 +261,6 @@ typedef struct {
     time_t created_time;
     time_t modified_time;
     time_t accessed_time;
-    int access_rights[MAX_USERS];
-    int locked_sentences[1000];  // Bitmap for locked sentences
     int is_folder;
 } FileMetadata;
 
@@ -337,7 +337,9 @@ static inline const char* get_error_message(int error_code) {
         case ERR_INVALID_PARAMETER: return "Invalid parameter";
         case ERR_SENTENCE_INDEX_OUT_OF_RANGE: return "Sentence index out of range";
         case ERR_WORD_INDEX_OUT_OF_RANGE: return "Word index out of range";
-        case ERR_NOTHING_TO_UNDO: return "Nothing to undo";
+        case ERR_NOTHING_TO_UNDO: return "Not enough undo history";
+        case ERR_UNDO_FAILED: return "Undo history no longer matches the file";
+        case ERR_WRITE_CONFLICT: return "File was replaced or deleted during the write session";
         
         // Resource errors
         case ERR_OUT_OF_MEMORY: return "Out of memory";
@@ -422,38 +424,16 @@ static inline void get_timestamp_string(char *buffer, size_t size) {
     strftime(buffer, size, "%Y-%m-%d %H:%M:%S", tm_info);
 }
 
-// Get sentence count from content
+// Get sentence count from content (delimiters, plus trailing words without one)
 static inline int get_sentence_count(const char *content) {
     if (content == NULL) return 0;
-    
-    int count = 0;
-    for (const char *p = content; *p; p++) {
-        if (is_sentence_delimiter(*p)) {
-            count++;
-        }
-    }
-    return count;
+    return (int)text_stats(content, strlen(content)).sentences;
 }
 
 // Get word count from content
 static inline int get_word_count(const char *content) {
-    if (content == NULL || strlen(content) == 0) return 0;
-    
-    int count = 0;
-    int in_word = 0;
-    
-    for (const char *p = content; *p; p++) {
-        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
-            in_word = 0;
-        } else {
-            if (!in_word) {
-                count++;
-                in_word = 1;
-            }
-        }
-    }
-    
-    return count;
+    if (content == NULL) return 0;
+    return (int)text_stats(content, strlen(content)).words;
 }
 
 // Split string into tokens
@@ -536,6 +516,95 @@ static inline time_t parse_timestamp(const char *timestamp_str) {
     return 0;
 }
 
+// ============================================================================
+// GROWABLE BUFFER AND SOCKET HELPERS
+// ============================================================================
+
+// Heap buffer that doubles as it fills; data is always NUL-terminated
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} DynamicBuffer;
+
+static inline int dynbuf_init(DynamicBuffer *buf, size_t initial_capacity) {
+    if (initial_capacity < 64) initial_capacity = 64;
+    buf->data = malloc(initial_capacity);
+    buf->length = 0;
+    buf->capacity = buf->data ? initial_capacity : 0;
+    if (!buf->data) return ERR_OUT_OF_MEMORY;
+    buf->data[0] = '\0';
+    return ERR_SUCCESS;
+}
+
+// Make room for at least `extra` more bytes plus the terminator
+static inline int dynbuf_reserve(DynamicBuffer *buf, size_t extra) {
+    if (buf->length + extra + 1 <= buf->capacity) return ERR_SUCCESS;
+
+    size_t new_capacity = buf->capacity ? buf->capacity : 64;
+    while (new_capacity < buf->length + extra + 1) {
+        new_capacity *= 2;
+    }
+
+    char *grown = realloc(buf->data, new_capacity);
+    if (!grown) return ERR_OUT_OF_MEMORY;
+    buf->data = grown;
+    buf->capacity = new_capacity;
+    return ERR_SUCCESS;
+}
+
+static inline int dynbuf_append(DynamicBuffer *buf, const char *data, size_t len) {
+    if (dynbuf_reserve(buf, len) != ERR_SUCCESS) return ERR_OUT_OF_MEMORY;
+    // An empty buffer's data may be NULL, which memcpy may not be given
+    if (len > 0) memcpy(buf->data + buf->length, data, len);
+    buf->length += len;
+    buf->data[buf->length] = '\0';
+    return ERR_SUCCESS;
+}
+
+static inline int dynbuf_append_str(DynamicBuffer *buf, const char *str) {
+    return dynbuf_append(buf, str, strlen(str));
+}
+
+static inline int dynbuf_append_char(DynamicBuffer *buf, char c) {
+    return dynbuf_append(buf, &c, 1);
+}
+
+static inline void dynbuf_free(DynamicBuffer *buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->length = 0;
+    buf->capacity = 0;
+}
+
+// send() until every byte is written; returns 0 on success, -1 on error
+static inline int send_all(int socket_fd, const char *data, size_t len) {
+    size_t total_sent = 0;
+    while (total_sent < len) {
+        ssize_t sent = send(socket_fd, data + total_sent, len - total_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total_sent += (size_t)sent;
+    }
+    return 0;
+}
+
+// Write a whole buffer to a file descriptor, retrying short writes
+static inline int write_all(int fd, const char *data, size_t len) {
+    size_t total_written = 0;
+    while (total_written < len) {
+        ssize_t written = write(fd, data + total_written, len - total_written);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total_written += (size_t)written;
+    }
+    return 0;
+}
+
 // Log error with error code
 static inline void log_error(const char *component, int error_code, const char *details) {
     char timestamp[64];
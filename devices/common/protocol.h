@@ -0,0 +1,649 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "common.h"
+#include <stdint.h>
+
+// ============================================================================
+// WIRE PROTOCOL
+// ============================================================================
+// Client, name server and storage server ports all speak two encodings:
+//
+//   Text   "VERB|arg|arg\n", the original protocol, kept so a server can be
+//          driven by hand with nc. An argument can't hold '|' or '\n'.
+//   Frame  a fixed header and typed fields. A frame carries its length, so
+//          the reader knows when a message is complete however the bytes
+//          arrive, and each field carries its own, so it may hold anything.
+//
+// A frame starts with FRAME_MAGIC, which no text command starts with, so a
+// server tells the two apart message by message and answers in the form it
+// was asked in. Everything a server sends for a request during one handler
+// call becomes one reply frame tagged with the request's ID; a STREAM sends
+// one per word, all with the STREAM's ID.
+//
+// Header, integers big-endian:
+//   0  u8   FRAME_MAGIC
+//   1  u8   FRAME_VERSION
+//   2  u16  opcode
+//   4  u32  request ID, echoed by the reply
+//   8  u32  payload length
+// The payload is a sequence of fields, each a type byte and then
+//   FIELD_INT  8-byte signed integer
+//   FIELD_STR  u32 length and that many bytes
+//
+// A request's opcode names its verb (protocol_verbs[]) and its fields are
+// the text arguments; OP_VERB carries an unlisted verb as its first field.
+// A reply's opcode is its status ("SUCCESS|..."): the rest of the text is
+// one string field, except that REDIRECT carries [ip, port] and STOP none.
+// Rendering a reply frame gives back exactly the text a text-mode client
+// would have been sent, so callers keep parsing replies the way they did.
+//
+// BATCH exists only as a frame. Its one string field holds whole request
+// frames back to back, each tagged with its position in the batch; the
+// OP_REPLY_BATCH reply holds one reply frame per command, tagged the same.
+// Nesting frames keeps every command's fields typed, and a batch isn't
+// held to FRAME_MAX_FIELDS.
+
+#define FRAME_MAGIC 0xD5
+#define FRAME_VERSION 1
+#define FRAME_HEADER_SIZE 12
+#define FRAME_MAX_FIELDS 16
+#define FRAME_MAX_PAYLOAD (256 * 1024 * 1024)
+
+#define FIELD_INT 1
+#define FIELD_STR 2
+
+// Request opcodes
+#define OP_VERB         0x0000  // Field 0 is the verb
+#define OP_INIT         0x0001
+#define OP_QUIT         0x0002
+#define OP_EXIT         0x0003
+#define OP_CREATE       0x0004
+#define OP_VIEW         0x0005
+#define OP_READ         0x0006
+#define OP_CLEANREAD    0x0007
+#define OP_WRITE        0x0008
+#define OP_WORD_UPDATE  0x0009  // In a WRITE session: [INT word index, STR content]
+#define OP_WRITE_END    0x000A
+#define OP_UNDO         0x000B
+#define OP_DELETE       0x000C
+#define OP_INFO         0x000D
+#define OP_STREAM       0x000E
+#define OP_EXEC         0x000F
+#define OP_LIST         0x0010
+#define OP_ADDACCESS    0x0011
+#define OP_REMACCESS    0x0012
+#define OP_STATS        0x0013
+#define OP_BATCH        0x0014  // [STR request frames]
+
+// Reply opcodes
+#define OP_REPLY_TEXT     0x8000  // Anything without a known status: [raw text]
+#define OP_REPLY_SUCCESS  0x8001
+#define OP_REPLY_ERROR    0x8002
+#define OP_REPLY_REDIRECT 0x8003
+#define OP_REPLY_INFO     0x8004
+#define OP_REPLY_WORD     0x8005
+#define OP_REPLY_ACK      0x8006
+#define OP_REPLY_STOP     0x8007
+#define OP_REPLY_BATCH    0x8008  // [STR reply frames]
+
+// Commands one BATCH may carry. The name server holds its ACL lock while it
+// checks them all, so batches are kept short; send more as several.
+#define BATCH_MAX_COMMANDS 1024
+
+typedef struct {
+    uint16_t opcode;
+    const char *verb;
+} ProtocolVerb;
+
+static const ProtocolVerb protocol_verbs[] = {
+    { OP_INIT, MSG_INIT },
+    { OP_QUIT, "QUIT" },
+    { OP_EXIT, "EXIT" },
+    { OP_CREATE, MSG_CREATE },
+    { OP_VIEW, MSG_VIEW },
+    { OP_READ, MSG_READ },
+    { OP_CLEANREAD, "CLEANREAD" },
+    { OP_WRITE, MSG_WRITE },
+    { OP_WORD_UPDATE, "WORD_UPDATE" },
+    { OP_WRITE_END, MSG_WRITE_END },
+    { OP_UNDO, MSG_UNDO },
+    { OP_DELETE, MSG_DELETE },
+    { OP_INFO, MSG_INFO },
+    { OP_STREAM, MSG_STREAM },
+    { OP_EXEC, MSG_EXEC },
+    { OP_LIST, MSG_LIST },
+    { OP_ADDACCESS, MSG_ADDACCESS },
+    { OP_REMACCESS, MSG_REMACCESS },
+    { OP_STATS, "STATS" },
+    { OP_BATCH, "BATCH" },
+    { OP_REPLY_SUCCESS, MSG_SUCCESS },
+    { OP_REPLY_ERROR, MSG_ERROR },
+    { OP_REPLY_REDIRECT, MSG_REDIRECT },
+    { OP_REPLY_INFO, MSG_INFO },
+    { OP_REPLY_WORD, "WORD" },
+    { OP_REPLY_ACK, MSG_ACK },
+    { OP_REPLY_STOP, MSG_STOP },
+    { OP_REPLY_BATCH, "BATCH" },
+};
+
+#define PROTOCOL_VERB_COUNT (sizeof(protocol_verbs) / sizeof(protocol_verbs[0]))
+
+// Request opcodes and reply opcodes are looked up separately, since INFO
+// is both
+static inline uint16_t protocol_opcode(const char *verb, size_t length, int reply) {
+    for (size_t i = 0; i < PROTOCOL_VERB_COUNT; i++) {
+        if (((protocol_verbs[i].opcode & OP_REPLY_TEXT) != 0) != (reply != 0)) continue;
+        if (strlen(protocol_verbs[i].verb) == length &&
+            memcmp(protocol_verbs[i].verb, verb, length) == 0) {
+            return protocol_verbs[i].opcode;
+        }
+    }
+    return reply ? OP_REPLY_TEXT : OP_VERB;
+}
+
+static inline const char* protocol_verb(uint16_t opcode) {
+    for (size_t i = 0; i < PROTOCOL_VERB_COUNT; i++) {
+        if (protocol_verbs[i].opcode == opcode) return protocol_verbs[i].verb;
+    }
+    return NULL;
+}
+
+// ============================================================================
+// MESSAGES
+// ============================================================================
+// One request or reply as it arrived, in either encoding. Strings point into
+// the receive buffer and stay valid until the next message is taken from it.
+// Arguments are read in order with message_next_arg(), which for a text line
+// is strtok_r() on '|', so handlers read both encodings the same way.
+
+typedef struct {
+    int framed;                 // Arrived as a frame
+    uint16_t opcode;
+    uint32_t request_id;
+    const char *verb;           // NULL for an empty text line
+    char *line;                 // Text: the line as received, until parsed
+
+    // Frame fields
+    int argc;
+    char *argv[FRAME_MAX_FIELDS];
+    size_t lengths[FRAME_MAX_FIELDS];
+    uint8_t types[FRAME_MAX_FIELDS];
+    int64_t ints[FRAME_MAX_FIELDS];
+    char numbers[FRAME_MAX_FIELDS][24];     // INT fields as text
+
+    int next;                   // Next field for message_next_arg()
+    char *saveptr;              // Text: strtok_r() position
+} WireMessage;
+
+static inline uint32_t protocol_get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void protocol_put32(unsigned char *p, uint32_t value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static inline void message_from_line(WireMessage *msg, char *line) {
+    msg->framed = 0;
+    msg->opcode = OP_VERB;
+    msg->request_id = 0;
+    msg->verb = NULL;
+    msg->line = line;
+    msg->argc = 0;
+    msg->next = 0;
+    msg->saveptr = NULL;
+}
+
+// Split off a text message's verb. The line is cut up in place, so log it
+// first. Frames arrive parsed.
+static inline void message_parse(WireMessage *msg) {
+    if (msg->framed || !msg->line) return;
+    msg->verb = strtok_r(msg->line, "|", &msg->saveptr);
+    msg->line = NULL;
+}
+
+static inline int message_is(const WireMessage *msg, const char *verb) {
+    return msg->verb && strcmp(msg->verb, verb) == 0;
+}
+
+// The message as a text line, for logs; call before message_parse()
+static inline void message_describe(const WireMessage *msg, char *out, size_t size) {
+    if (!msg->framed) {
+        snprintf(out, size, "%s", msg->line ? msg->line : "");
+        return;
+    }
+    if (msg->opcode == OP_BATCH || msg->opcode == OP_REPLY_BATCH) {
+        snprintf(out, size, "BATCH|(%zu bytes of frames)", msg->argc > 0 ? msg->lengths[0] : 0);
+        return;
+    }
+    size_t used = (size_t)snprintf(out, size, "%s", msg->verb ? msg->verb : "");
+    for (int i = msg->opcode == OP_VERB ? 1 : 0; i < msg->argc && used < size; i++) {
+        used += (size_t)snprintf(out + used, size - used, "|%s", msg->argv[i]);
+    }
+}
+
+// Next argument, or NULL when there are no more
+static inline char* message_next_arg(WireMessage *msg) {
+    if (!msg->framed) {
+        return msg->saveptr ? strtok_r(NULL, "|", &msg->saveptr) : NULL;
+    }
+    return msg->next < msg->argc ? msg->argv[msg->next++] : NULL;
+}
+
+// Everything after the arguments read so far, '|' included: the text
+// "idx|content" of a word update. A frame's fields are whole already.
+static inline char* message_rest(WireMessage *msg) {
+    if (!msg->framed) {
+        return msg->saveptr ? strtok_r(NULL, "", &msg->saveptr) : NULL;
+    }
+    return message_next_arg(msg);
+}
+
+// Copy a message taken from a receive buffer, before it is parsed, so it
+// outlives the buffer. The copy's strings live in one block, returned for
+// the caller to free; NULL if out of memory.
+static inline char* message_copy(WireMessage *copy, const WireMessage *msg) {
+    *copy = *msg;
+    if (!msg->framed) {
+        char *line = strdup(msg->line ? msg->line : "");
+        message_from_line(copy, line);
+        return line;
+    }
+
+    size_t total = 1;
+    for (int i = 0; i < msg->argc; i++) total += msg->lengths[i] + 1;
+    char *block = malloc(total);
+    if (!block) return NULL;
+
+    char *next = block;
+    for (int i = 0; i < msg->argc; i++) {
+        if (msg->types[i] == FIELD_INT) {
+            copy->argv[i] = copy->numbers[i];
+            continue;
+        }
+        memcpy(next, msg->argv[i], msg->lengths[i]);
+        next[msg->lengths[i]] = '\0';
+        copy->argv[i] = next;
+        next += msg->lengths[i] + 1;
+    }
+    if (msg->opcode == OP_VERB && msg->argc > 0) copy->verb = copy->argv[0];
+    return block;
+}
+
+// Decode the frame at data in place: string fields are moved over their
+// headers and NUL-terminated. Returns the bytes it took, 0 if it hasn't all
+// arrived (nothing is touched), or -1 if it is malformed.
+static inline long frame_decode(char *data, size_t available, WireMessage *msg) {
+    const unsigned char *header = (const unsigned char*)data;
+    if (available < FRAME_HEADER_SIZE) {
+        return (available > 0 && header[0] != FRAME_MAGIC) ||
+               (available > 1 && header[1] != FRAME_VERSION) ? -1 : 0;
+    }
+    if (header[0] != FRAME_MAGIC || header[1] != FRAME_VERSION) return -1;
+
+    uint32_t payload = protocol_get32(header + 8);
+    if (payload > FRAME_MAX_PAYLOAD) return -1;
+    if (available - FRAME_HEADER_SIZE < payload) return 0;
+
+    msg->framed = 1;
+    msg->opcode = (uint16_t)((header[2] << 8) | header[3]);
+    msg->request_id = protocol_get32(header + 4);
+    msg->line = NULL;
+    msg->argc = 0;
+    msg->next = 0;
+    msg->saveptr = NULL;
+
+    char *field = data + FRAME_HEADER_SIZE;
+    char *end = field + payload;
+    while (field < end) {
+        if (msg->argc == FRAME_MAX_FIELDS) return -1;
+        int i = msg->argc++;
+        unsigned char type = (unsigned char)field[0];
+        msg->types[i] = type;
+
+        if (type == FIELD_INT && end - field >= 9) {
+            const unsigned char *p = (const unsigned char*)field + 1;
+            uint64_t value = ((uint64_t)protocol_get32(p) << 32) | protocol_get32(p + 4);
+            msg->ints[i] = (int64_t)value;
+            msg->lengths[i] = (size_t)snprintf(msg->numbers[i], sizeof(msg->numbers[i]),
+                                               "%lld", (long long)msg->ints[i]);
+            msg->argv[i] = msg->numbers[i];
+            field += 9;
+        } else if (type == FIELD_STR && end - field >= 5) {
+            size_t length = protocol_get32((const unsigned char*)field + 1);
+            if ((size_t)(end - field - 5) < length) return -1;
+            memmove(field, field + 5, length);
+            field[length] = '\0';
+            msg->argv[i] = field;
+            msg->lengths[i] = length;
+            msg->ints[i] = 0;
+            field += 5 + length;
+        } else {
+            return -1;
+        }
+    }
+
+    msg->verb = protocol_verb(msg->opcode);
+    if (msg->opcode == OP_VERB) {
+        msg->verb = message_next_arg(msg);
+    } else if (!msg->verb) {
+        msg->verb = "";
+    }
+    return (long)(FRAME_HEADER_SIZE + payload);
+}
+
+// Next command of a BATCH request, or reply of a BATCH reply, decoded in
+// place; *offset starts at 0. Returns 1, 0 after the last, or -1 if the
+// batch is malformed.
+static inline int message_next_batched(WireMessage *batch, size_t *offset, WireMessage *item) {
+    if (!batch->framed || batch->argc != 1 || batch->types[0] != FIELD_STR) return -1;
+    if (*offset >= batch->lengths[0]) return 0;
+    long used = frame_decode(batch->argv[0] + *offset, batch->lengths[0] - *offset, item);
+    if (used <= 0) return -1;
+    *offset += (size_t)used;
+    return 1;
+}
+
+// Take the next message from a receive buffer: a frame, or a text line
+// (NUL-terminated in place, "\r\n" dropped). Returns the bytes it took, 0
+// if it hasn't all arrived, or -1 if it is malformed.
+static inline long message_take(char *data, size_t available, WireMessage *msg) {
+    if (available == 0) return 0;
+    if ((unsigned char)data[0] == FRAME_MAGIC) {
+        return frame_decode(data, available, msg);
+    }
+
+    char *newline = memchr(data, '\n', available);
+    if (!newline) return 0;
+    *newline = '\0';
+    if (newline > data && newline[-1] == '\r') newline[-1] = '\0';
+    message_from_line(msg, data);
+    return (long)(newline + 1 - data);
+}
+
+// ============================================================================
+// ENCODING
+// ============================================================================
+
+// Start a frame in buf; frame_end() fills in its length. Returns the
+// frame's offset, or -1 if out of memory.
+static inline long frame_begin(DynamicBuffer *buf, uint16_t opcode, uint32_t request_id) {
+    if (dynbuf_reserve(buf, FRAME_HEADER_SIZE) != ERR_SUCCESS) return -1;
+    size_t start = buf->length;
+    unsigned char *header = (unsigned char*)buf->data + start;
+    header[0] = FRAME_MAGIC;
+    header[1] = FRAME_VERSION;
+    header[2] = (unsigned char)(opcode >> 8);
+    header[3] = (unsigned char)opcode;
+    protocol_put32(header + 4, request_id);
+    protocol_put32(header + 8, 0);
+    buf->length += FRAME_HEADER_SIZE;
+    buf->data[buf->length] = '\0';
+    return (long)start;
+}
+
+static inline int frame_add_int(DynamicBuffer *buf, int64_t value) {
+    unsigned char field[9];
+    field[0] = FIELD_INT;
+    protocol_put32(field + 1, (uint32_t)((uint64_t)value >> 32));
+    protocol_put32(field + 5, (uint32_t)value);
+    return dynbuf_append(buf, (const char*)field, sizeof(field));
+}
+
+static inline int frame_add_str(DynamicBuffer *buf, const char *data, size_t length) {
+    unsigned char field[5];
+    field[0] = FIELD_STR;
+    protocol_put32(field + 1, (uint32_t)length);
+    if (dynbuf_reserve(buf, sizeof(field) + length) != ERR_SUCCESS) return ERR_OUT_OF_MEMORY;
+    dynbuf_append(buf, (const char*)field, sizeof(field));
+    return dynbuf_append(buf, data, length);
+}
+
+static inline void frame_end(DynamicBuffer *buf, long start) {
+    protocol_put32((unsigned char*)buf->data + start + 8,
+                   (uint32_t)(buf->length - (size_t)start - FRAME_HEADER_SIZE));
+}
+
+// Start a BATCH (or BATCH reply) frame in buf. Append its commands (or
+// replies) with frame_encode_request() (or frame_encode_reply()), then
+// close it with frame_batch_end().
+static inline long frame_batch_begin(DynamicBuffer *buf, uint16_t opcode, uint32_t request_id) {
+    long start = frame_begin(buf, opcode, request_id);
+    if (start < 0) return -1;
+    if (frame_add_str(buf, "", 0) != ERR_SUCCESS) return -1;
+    return start;
+}
+
+static inline void frame_batch_end(DynamicBuffer *buf, long start) {
+    protocol_put32((unsigned char*)buf->data + start + FRAME_HEADER_SIZE + 1,
+                   (uint32_t)(buf->length - (size_t)start - FRAME_HEADER_SIZE - 5));
+    frame_end(buf, start);
+}
+
+// A text request line ("VERB|a|b", newline optional) as a frame. Empty
+// arguments are dropped, as strtok_r() would on the server.
+static inline int frame_encode_request(DynamicBuffer *buf, uint32_t request_id, const char *line) {
+    size_t length = strcspn(line, "\r\n");
+    const char *end = line + length;
+    const char *bar = memchr(line, '|', length);
+    size_t verb_length = bar ? (size_t)(bar - line) : length;
+    uint16_t opcode = protocol_opcode(line, verb_length, 0);
+
+    long start = frame_begin(buf, opcode, request_id);
+    if (start < 0) return ERR_OUT_OF_MEMORY;
+    int result = ERR_SUCCESS;
+    if (opcode == OP_VERB) result = frame_add_str(buf, line, verb_length);
+
+    const char *arg = line + verb_length;
+    while (result == ERR_SUCCESS && arg < end) {
+        arg++;
+        const char *next = memchr(arg, '|', (size_t)(end - arg));
+        if (!next) next = end;
+        if (next > arg) result = frame_add_str(buf, arg, (size_t)(next - arg));
+        arg = next;
+    }
+    frame_end(buf, start);
+    return result;
+}
+
+// A reply's text as a frame: "STATUS|rest\n" becomes the status's opcode
+// and rest, and anything else is carried whole
+static inline int frame_encode_reply(DynamicBuffer *buf, uint32_t request_id,
+                                     const char *text, size_t length) {
+    uint16_t opcode = OP_REPLY_TEXT;
+    const char *rest = text;
+    size_t rest_length = length;
+
+    if (length == 5 && memcmp(text, "STOP\n", 5) == 0) {
+        opcode = OP_REPLY_STOP;
+        rest_length = 0;
+    } else if (length > 0 && text[length - 1] == '\n') {
+        const char *bar = memchr(text, '|', length);
+        if (bar) {
+            opcode = protocol_opcode(text, (size_t)(bar - text), 1);
+            if (opcode == OP_REPLY_STOP) opcode = OP_REPLY_TEXT;
+        }
+        if (opcode != OP_REPLY_TEXT) {
+            rest = bar + 1;
+            rest_length = (size_t)(text + length - 1 - rest);
+        }
+    }
+
+    // REDIRECT|ip|port with a plain port number goes out typed
+    const char *port = NULL;
+    if (opcode == OP_REPLY_REDIRECT) {
+        port = memchr(rest, '|', rest_length);
+        if (port) {
+            const char *digit = port + 1;
+            while (digit < rest + rest_length && isdigit((unsigned char)*digit)) digit++;
+            if (digit == port + 1 || digit != rest + rest_length || digit - port > 6) port = NULL;
+        }
+    }
+
+    long start = frame_begin(buf, opcode, request_id);
+    if (start < 0) return ERR_OUT_OF_MEMORY;
+    int result = ERR_SUCCESS;
+    if (port) {
+        result = frame_add_str(buf, rest, (size_t)(port - rest));
+        if (result == ERR_SUCCESS) result = frame_add_int(buf, atoi(port + 1));
+    } else if (opcode != OP_REPLY_STOP) {
+        result = frame_add_str(buf, rest, rest_length);
+    }
+    frame_end(buf, start);
+    return result;
+}
+
+// Append a reply message as the text a text-mode peer would have received
+static inline int message_render_reply(const WireMessage *msg, DynamicBuffer *out) {
+    if (!msg->framed) {
+        int result = dynbuf_append_str(out, msg->line ? msg->line : "");
+        return result == ERR_SUCCESS ? dynbuf_append_char(out, '\n') : result;
+    }
+    if (msg->opcode == OP_REPLY_STOP) return dynbuf_append(out, "STOP\n", 5);
+    if (msg->opcode == OP_REPLY_TEXT || msg->opcode < OP_REPLY_TEXT) {
+        return msg->argc > 0 ? dynbuf_append(out, msg->argv[0], msg->lengths[0]) : ERR_SUCCESS;
+    }
+
+    const char *status = protocol_verb(msg->opcode);
+    int result = dynbuf_append_str(out, status ? status : "");
+    for (int i = 0; i < msg->argc && result == ERR_SUCCESS; i++) {
+        result = dynbuf_append_char(out, '|');
+        if (result == ERR_SUCCESS) result = dynbuf_append(out, msg->argv[i], msg->lengths[i]);
+    }
+    if (msg->argc == 0 && result == ERR_SUCCESS) result = dynbuf_append_char(out, '|');
+    return result == ERR_SUCCESS ? dynbuf_append_char(out, '\n') : result;
+}
+
+// ============================================================================
+// BLOCKING CONNECTIONS
+// ============================================================================
+// A client-side socket (the client, and the name server's calls to storage
+// servers): requests go out as frames, and bytes read past a reply wait in
+// the buffer for the next one. Calls are one request at a time;
+// frame_conn_pipeline() keeps many in flight.
+
+typedef struct {
+    int fd;
+    uint32_t request_id;        // Of the last request sent
+    DynamicBuffer in;
+    size_t in_start;            // Bytes of in already taken
+} FrameConn;
+
+static inline void frame_conn_init(FrameConn *conn, int fd) {
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = fd;
+}
+
+// Frees the buffer; the socket is the caller's
+static inline void frame_conn_free(FrameConn *conn) {
+    dynbuf_free(&conn->in);
+    conn->in_start = 0;
+}
+
+// Send a frame built with frame_begin() at offset 0 as the next request,
+// giving it the next request ID
+static inline int frame_conn_send(FrameConn *conn, DynamicBuffer *frame) {
+    if (++conn->request_id == 0) conn->request_id = 1;
+    protocol_put32((unsigned char*)frame->data + 4, conn->request_id);
+    return send_all(conn->fd, frame->data, frame->length) == 0 ? ERR_SUCCESS : ERR_SEND_FAILED;
+}
+
+// Send a text request line as a frame
+static inline int frame_conn_request(FrameConn *conn, const char *line) {
+    DynamicBuffer frame = {0};
+    int result = frame_encode_request(&frame, 0, line);
+    if (result == ERR_SUCCESS) result = frame_conn_send(conn, &frame);
+    dynbuf_free(&frame);
+    return result;
+}
+
+// Next message from the socket, waiting for all of it. Returns ERR_SUCCESS,
+// or ERR_RECV_FAILED on error, end of stream or a malformed frame.
+static inline int frame_conn_next(FrameConn *conn, WireMessage *msg) {
+    while (1) {
+        long used = conn->in_start < conn->in.length ?
+                    message_take(conn->in.data + conn->in_start,
+                                 conn->in.length - conn->in_start, msg) : 0;
+        if (used < 0) return ERR_RECV_FAILED;
+        if (used > 0) {
+            conn->in_start += (size_t)used;
+            return ERR_SUCCESS;
+        }
+
+        // Drop what's been taken before reading more
+        if (conn->in_start > 0) {
+            size_t left = conn->in.length - conn->in_start;
+            memmove(conn->in.data, conn->in.data + conn->in_start, left);
+            conn->in.length = left;
+            conn->in_start = 0;
+        }
+        if (dynbuf_reserve(&conn->in, BUFFER_SIZE) != ERR_SUCCESS) return ERR_RECV_FAILED;
+        ssize_t bytes = recv(conn->fd, conn->in.data + conn->in.length,
+                             conn->in.capacity - conn->in.length - 1, 0);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return ERR_RECV_FAILED;
+        conn->in.length += (size_t)bytes;
+        conn->in.data[conn->in.length] = '\0';
+    }
+}
+
+// Next reply to the last request, rendered as text into reply (replacing
+// what it held). Replies left over from an earlier request are skipped.
+static inline int frame_conn_reply(FrameConn *conn, DynamicBuffer *reply) {
+    WireMessage msg;
+    reply->length = 0;
+    if (reply->data) reply->data[0] = '\0';
+
+    while (1) {
+        int result = frame_conn_next(conn, &msg);
+        if (result != ERR_SUCCESS) return result;
+        if (msg.framed && msg.request_id != conn->request_id) continue;
+        return message_render_reply(&msg, reply);
+    }
+}
+
+static inline int frame_conn_call(FrameConn *conn, const char *line, DynamicBuffer *reply) {
+    int result = frame_conn_request(conn, line);
+    return result == ERR_SUCCESS ? frame_conn_reply(conn, reply) : result;
+}
+
+// Unanswered requests frame_conn_pipeline() allows. The server stops
+// reading a connection whose replies aren't being taken, so a sender that
+// never reads would wedge both sides.
+#define FRAME_PIPELINE_WINDOW 64
+
+typedef void (*FrameReplyHandler)(int index, WireMessage *reply, void *arg);
+
+// Send count requests (frames built with frame_begin() at offset 0) without
+// waiting for each reply, keeping up to window unanswered. on_reply gets
+// each reply with its request's index, in the order they come back. Every
+// request must get exactly one reply, so no STREAM.
+static inline int frame_conn_pipeline(FrameConn *conn, DynamicBuffer *requests, int count,
+                                      int window, FrameReplyHandler on_reply, void *arg) {
+    uint32_t first = conn->request_id + 1;
+    int sent = 0, answered = 0;
+    if (window < 1) window = 1;
+
+    while (answered < count) {
+        while (sent < count && sent - answered < window) {
+            int result = frame_conn_send(conn, &requests[sent]);
+            if (result != ERR_SUCCESS) return result;
+            sent++;
+        }
+
+        WireMessage msg;
+        int result = frame_conn_next(conn, &msg);
+        if (result != ERR_SUCCESS) return result;
+        uint32_t index = msg.request_id - first;
+        if (!msg.framed || index >= (uint32_t)sent) continue;  // Left from an earlier call
+        on_reply((int)index, &msg, arg);
+        answered++;
+    }
+    return ERR_SUCCESS;
+}
+
+#endif // PROTOCOL_H
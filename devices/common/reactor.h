@@ -0,0 +1,777 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "common.h"
+#include "protocol.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+
+// ============================================================================
+// EPOLL REACTOR WITH WORKER POOL
+// ============================================================================
+// One thread waits in epoll (edge-triggered) on the listening socket and on
+// every connection, and keeps a heap of per-connection timers. A connection
+// with something to do is queued for a fixed pool of workers; a worker reads
+// what arrived, calls the server's handler, and sends what the handler
+// queued. A connection is run by at most one worker at a time, so handlers
+// need no locking for per-connection state.
+//
+// Requests are text lines or binary frames (common/protocol.h), told apart
+// per message. A handler that is not ready for more (a WRITE waiting for a
+// lock, a STREAM in progress) simply leaves them in the input buffer and
+// picks them up on a later call. Output for a framed request is gathered
+// while the handler runs and goes out as one reply frame when it returns
+// or takes the next request. Idle connections cost
+// a small struct and an epoll registration: no thread, no buffers.
+//
+// The epoll registration carries the fd, not the connection; the fd table
+// maps it back under the reactor mutex, so a stale event for a closed (or
+// reused) fd never touches freed memory.
+
+#define REACTOR_MIN_WORKERS 4
+#define REACTOR_MAX_EVENTS 256
+#define REACTOR_MAX_INPUT (1024 * 1024)         // Unframed input before we give up
+#define REACTOR_OUTPUT_HIGH_WATER (256 * 1024)  // Stop reading requests above this
+#define REACTOR_KEEP_BUFFER 16384               // Larger idle buffers are freed
+#define REACTOR_ACCEPT_RETRY_MS 100             // Out of fds: pause accepting
+
+// Events passed to a handler
+#define REACTOR_EVENT_INPUT   0x01  // New bytes arrived
+#define REACTOR_EVENT_TIMER   0x02  // reactor_set_timer() deadline passed
+#define REACTOR_EVENT_WAKE    0x04  // reactor_wake() from another thread
+#define REACTOR_EVENT_DRAINED 0x08  // All queued output has been sent
+#define REACTOR_EVENT_CLOSED  0x10  // Last call: free the connection's state
+
+// Raw readiness from epoll, turned into the above by the worker
+#define REACTOR_READABLE 0x100
+#define REACTOR_WRITABLE 0x200
+#define REACTOR_HANGUP   0x400
+
+typedef struct ReactorConn {
+    int fd;
+    char peer[INET_ADDRSTRLEN + 8];
+    void *state;                // The server's; NULL until it needs some
+    struct Reactor *reactor;
+
+    // Owned by the worker running the connection
+    DynamicBuffer in;
+    size_t in_start;            // Bytes of in already handed out as lines
+    DynamicBuffer out;
+    size_t out_start;           // Bytes of out already sent
+    int blocked;                // Output waits for the socket; EPOLLOUT watched
+    int closing;
+    int framed;                 // The request being answered came as a frame
+    uint32_t request_id;        // ...and its ID
+    DynamicBuffer reply;        // Its reply so far
+
+    // Guarded by the reactor mutex
+    unsigned pending;           // Events not yet given to a worker
+    int queued;
+    int running;
+    long long deadline_ms;      // Timer, 0 if none
+    int timer_index;            // Position in the heap, -1 if none
+    struct ReactorConn *run_next;
+} ReactorConn;
+
+typedef void (*ReactorHandler)(ReactorConn *conn, unsigned events);
+
+typedef struct Reactor {
+    int epoll_fd;
+    int listen_fd;
+    int wake_fd;                // eventfd: the timer heap changed
+    ReactorHandler handler;
+    void *server;
+    FILE *log;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work;
+    ReactorConn *run_head;
+    ReactorConn *run_tail;
+    ReactorConn **conns;        // By fd
+    int conn_capacity;
+    ReactorConn **timers;       // Min-heap on deadline_ms
+    int timer_count;
+    int timer_capacity;
+    long long accept_paused_until;
+
+    pthread_t *workers;
+    int worker_count;
+    int stopping;               // reactor_stop(): workers take no more turns
+    int connection_count;
+    unsigned long accepted;
+} Reactor;
+
+typedef struct {
+    int connections;
+    unsigned long accepted;
+    int workers;
+} ReactorStats;
+
+static inline long long reactor_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Workers to start: one per CPU, but at least REACTOR_MIN_WORKERS, since a
+// worker still blocks while a file is read from disk or a log is synced
+static inline int reactor_default_workers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > REACTOR_MIN_WORKERS ? (int)cpus : REACTOR_MIN_WORKERS;
+}
+
+// Raise the open file limit to the hard limit, so idle connections are not
+// capped by the usual soft limit of 1024. Returns the limit in effect.
+static inline long reactor_raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return -1;
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return (long)limit.rlim_cur;
+}
+
+static inline int reactor_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// ---------------------------------------------------------------------------
+// Run queue and timers (reactor mutex held)
+// ---------------------------------------------------------------------------
+
+static inline void reactor_schedule_locked(Reactor *reactor, ReactorConn *conn) {
+    if (conn->queued || conn->running) return;
+    conn->queued = 1;
+    conn->run_next = NULL;
+    if (reactor->run_tail) {
+        reactor->run_tail->run_next = conn;
+    } else {
+        reactor->run_head = conn;
+    }
+    reactor->run_tail = conn;
+    pthread_cond_signal(&reactor->work);
+}
+
+static inline void reactor_timer_swap(Reactor *reactor, int a, int b) {
+    ReactorConn *tmp = reactor->timers[a];
+    reactor->timers[a] = reactor->timers[b];
+    reactor->timers[b] = tmp;
+    reactor->timers[a]->timer_index = a;
+    reactor->timers[b]->timer_index = b;
+}
+
+static inline void reactor_timer_sift(Reactor *reactor, int i) {
+    while (i > 0 && reactor->timers[(i - 1) / 2]->deadline_ms > reactor->timers[i]->deadline_ms) {
+        reactor_timer_swap(reactor, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < reactor->timer_count &&
+            reactor->timers[left]->deadline_ms < reactor->timers[smallest]->deadline_ms) {
+            smallest = left;
+        }
+        if (right < reactor->timer_count &&
+            reactor->timers[right]->deadline_ms < reactor->timers[smallest]->deadline_ms) {
+            smallest = right;
+        }
+        if (smallest == i) break;
+        reactor_timer_swap(reactor, i, smallest);
+        i = smallest;
+    }
+}
+
+static inline void reactor_timer_remove_locked(Reactor *reactor, ReactorConn *conn) {
+    int i = conn->timer_index;
+    if (i < 0) return;
+
+    reactor->timer_count--;
+    if (i != reactor->timer_count) {
+        reactor->timers[i] = reactor->timers[reactor->timer_count];
+        reactor->timers[i]->timer_index = i;
+        reactor_timer_sift(reactor, i);
+    }
+    conn->timer_index = -1;
+    conn->deadline_ms = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Calls for handlers
+// ---------------------------------------------------------------------------
+
+// Run the handler with REACTOR_EVENT_TIMER after delay_ms, replacing any
+// earlier timer. Only the thread running the connection may call this.
+static inline int reactor_set_timer(ReactorConn *conn, long long delay_ms) {
+    Reactor *reactor = conn->reactor;
+
+    pthread_mutex_lock(&reactor->mutex);
+    if (conn->timer_index < 0) {
+        if (reactor->timer_count == reactor->timer_capacity) {
+            int capacity = reactor->timer_capacity ? reactor->timer_capacity * 2 : 64;
+            ReactorConn **grown = realloc(reactor->timers, (size_t)capacity * sizeof(ReactorConn*));
+            if (!grown) {
+                pthread_mutex_unlock(&reactor->mutex);
+                return ERR_OUT_OF_MEMORY;
+            }
+            reactor->timers = grown;
+            reactor->timer_capacity = capacity;
+        }
+        conn->timer_index = reactor->timer_count++;
+        reactor->timers[conn->timer_index] = conn;
+    }
+    conn->deadline_ms = reactor_now_ms() + (delay_ms > 0 ? delay_ms : 0);
+    reactor_timer_sift(reactor, conn->timer_index);
+    int earliest = conn->timer_index == 0;
+    pthread_mutex_unlock(&reactor->mutex);
+
+    // The reactor may be sleeping until a later deadline
+    if (earliest) {
+        uint64_t one = 1;
+        ssize_t written = write(reactor->wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+    return ERR_SUCCESS;
+}
+
+static inline void reactor_cancel_timer(ReactorConn *conn) {
+    pthread_mutex_lock(&conn->reactor->mutex);
+    reactor_timer_remove_locked(conn->reactor, conn);
+    pthread_mutex_unlock(&conn->reactor->mutex);
+}
+
+// Make reactor_run() recheck its running flag. Only writes the eventfd,
+// so a signal handler may call it; does nothing before reactor_init().
+static inline void reactor_interrupt(Reactor *reactor) {
+    if (reactor->wake_fd > 0) {
+        uint64_t one = 1;
+        ssize_t written = write(reactor->wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+// Run the handler with REACTOR_EVENT_WAKE. Any thread may call this while
+// the connection is open; must not be called once its handler has seen
+// REACTOR_EVENT_CLOSED.
+static inline void reactor_wake(ReactorConn *conn) {
+    Reactor *reactor = conn->reactor;
+    pthread_mutex_lock(&reactor->mutex);
+    conn->pending |= REACTOR_EVENT_WAKE;
+    reactor_schedule_locked(reactor, conn);
+    pthread_mutex_unlock(&reactor->mutex);
+}
+
+// Queue output; it is sent when the handler returns
+static inline int reactor_send(ReactorConn *conn, const char *data, size_t length) {
+    return dynbuf_append(conn->framed ? &conn->reply : &conn->out, data, length);
+}
+
+static inline int reactor_send_str(ReactorConn *conn, const char *text) {
+    return reactor_send(conn, text, strlen(text));
+}
+
+// Queue a whole buffer, taking it over (buf is left empty)
+static inline int reactor_send_buffer(ReactorConn *conn, DynamicBuffer *buf) {
+    if (conn->framed && conn->reply.length == 0) {
+        dynbuf_free(&conn->reply);
+        conn->reply = *buf;
+        buf->data = NULL;
+        buf->length = buf->capacity = 0;
+        return ERR_SUCCESS;
+    }
+    if (conn->framed) {
+        int result = dynbuf_append(&conn->reply, buf->data, buf->length);
+        dynbuf_free(buf);
+        return result;
+    }
+    if (conn->out.length == conn->out_start) {
+        dynbuf_free(&conn->out);
+        conn->out = *buf;
+        conn->out_start = 0;
+        buf->data = NULL;
+        buf->length = buf->capacity = 0;
+        return ERR_SUCCESS;
+    }
+    int result = dynbuf_append(&conn->out, buf->data, buf->length);
+    dynbuf_free(buf);
+    return result;
+}
+
+// Bytes queued but not yet taken by the socket
+static inline size_t reactor_output_pending(const ReactorConn *conn) {
+    return conn->out.length - conn->out_start + conn->reply.length;
+}
+
+// Send what was gathered for a framed request as its reply frame
+static inline void reactor_end_reply(ReactorConn *conn) {
+    if (conn->reply.length == 0) return;
+    if (frame_encode_reply(&conn->out, conn->request_id,
+                           conn->reply.data, conn->reply.length) != ERR_SUCCESS) {
+        conn->closing = 1;
+    }
+    conn->reply.length = 0;
+    if (conn->reply.capacity > REACTOR_KEEP_BUFFER) {
+        dynbuf_free(&conn->reply);
+    }
+}
+
+// Queue a frame built with frame_begin() as the reply to the current
+// framed request, as is. Anything gathered before it goes out first.
+static inline int reactor_send_frame(ReactorConn *conn, DynamicBuffer *frame) {
+    reactor_end_reply(conn);
+    protocol_put32((unsigned char*)frame->data + 4, conn->request_id);
+    return dynbuf_append(&conn->out, frame->data, frame->length);
+}
+
+// Next complete request line, NUL-terminated in place without its "\r\n",
+// or NULL if none has fully arrived. Valid until the handler returns.
+static inline char* reactor_next_line(ReactorConn *conn) {
+    if (conn->in_start >= conn->in.length) return NULL;
+
+    char *line = conn->in.data + conn->in_start;
+    char *newline = memchr(line, '\n', conn->in.length - conn->in_start);
+    if (!newline) return NULL;
+
+    *newline = '\0';
+    if (newline > line && newline[-1] == '\r') newline[-1] = '\0';
+    conn->in_start = (size_t)(newline + 1 - conn->in.data);
+    return line;
+}
+
+// Next complete request, a text line or a frame, or 0 if none has fully
+// arrived. Its strings are valid until the handler returns. Replies sent
+// from here on answer it. A malformed frame closes the connection.
+static inline int reactor_next_message(ReactorConn *conn, WireMessage *msg) {
+    if (conn->in_start >= conn->in.length) return 0;
+
+    long used = message_take(conn->in.data + conn->in_start,
+                             conn->in.length - conn->in_start, msg);
+    if (used < 0) {
+        log_message(conn->reactor->log, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Malformed frame from %s (fd=%d), closing", conn->peer, conn->fd);
+        conn->closing = 1;
+        return 0;
+    }
+    if (used == 0) return 0;
+
+    reactor_end_reply(conn);
+    conn->in_start += (size_t)used;
+    conn->framed = msg->framed;
+    conn->request_id = msg->request_id;
+    return 1;
+}
+
+// Close once the handler returns; queued output is sent first if the
+// socket takes it
+static inline void reactor_close(ReactorConn *conn) {
+    conn->closing = 1;
+}
+
+static inline void reactor_get_stats(Reactor *reactor, ReactorStats *stats) {
+    pthread_mutex_lock(&reactor->mutex);
+    stats->connections = reactor->connection_count;
+    stats->accepted = reactor->accepted;
+    stats->workers = reactor->worker_count;
+    pthread_mutex_unlock(&reactor->mutex);
+}
+
+// ---------------------------------------------------------------------------
+// Workers
+// ---------------------------------------------------------------------------
+
+// Read everything the socket has. Returns 1 if bytes arrived, 0 if none,
+// -1 on end of stream or error. A short read means the socket is empty,
+// unless a hangup was reported: then read on to see the end of stream.
+static inline int reactor_fill_input(ReactorConn *conn, int hangup) {
+    // Drop lines already handed out
+    if (conn->in_start > 0) {
+        size_t left = conn->in.length - conn->in_start;
+        memmove(conn->in.data, conn->in.data + conn->in_start, left);
+        conn->in.length = left;
+        conn->in.data[left] = '\0';
+        conn->in_start = 0;
+    }
+
+    int got = 0;
+    while (1) {
+        if (dynbuf_reserve(&conn->in, BUFFER_SIZE) != ERR_SUCCESS) return -1;
+        ssize_t bytes = recv(conn->fd, conn->in.data + conn->in.length,
+                             conn->in.capacity - conn->in.length - 1, 0);
+        if (bytes > 0) {
+            conn->in.length += (size_t)bytes;
+            conn->in.data[conn->in.length] = '\0';
+            got = 1;
+            if (conn->in.length > REACTOR_MAX_INPUT) return -1;
+            if (!hangup && conn->in.length + 1 < conn->in.capacity) break;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return -1;
+    }
+
+    if (conn->in.length == 0 && conn->in.capacity > REACTOR_KEEP_BUFFER) {
+        dynbuf_free(&conn->in);
+    }
+    return got;
+}
+
+// Send queued output until done or the socket is full. Returns -1 if the
+// peer is gone.
+static inline int reactor_flush_output(ReactorConn *conn) {
+    while (conn->out_start < conn->out.length) {
+        ssize_t sent = send(conn->fd, conn->out.data + conn->out_start,
+                            conn->out.length - conn->out_start, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            conn->out_start += (size_t)sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+
+    conn->out.length = 0;
+    conn->out_start = 0;
+    if (conn->out.capacity > REACTOR_KEEP_BUFFER) {
+        dynbuf_free(&conn->out);
+    }
+    return 0;
+}
+
+// Watch for writability only while output is held up, so the reactor
+// isn't woken by every acknowledgment. Adding EPOLLOUT reports a socket
+// that is already writable again at once.
+static inline void reactor_want_write(Reactor *reactor, ReactorConn *conn, int want) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (want ? EPOLLOUT : 0);
+    event.data.fd = conn->fd;
+    conn->blocked = want;
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+static inline int reactor_flush_or_block(Reactor *reactor, ReactorConn *conn) {
+    if (reactor_flush_output(conn) < 0) return -1;
+    if (reactor_output_pending(conn) > 0 && !conn->blocked) {
+        reactor_want_write(reactor, conn, 1);
+    }
+    return 0;
+}
+
+static inline void reactor_destroy_conn(Reactor *reactor, ReactorConn *conn) {
+    pthread_mutex_lock(&reactor->mutex);
+    reactor->conns[conn->fd] = NULL;
+    reactor_timer_remove_locked(reactor, conn);
+    reactor->connection_count--;
+    pthread_mutex_unlock(&reactor->mutex);
+
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    dynbuf_free(&conn->in);
+    dynbuf_free(&conn->out);
+    dynbuf_free(&conn->reply);
+    free(conn);
+}
+
+// Handle one turn of a connection's events
+static inline void reactor_run_conn(Reactor *reactor, ReactorConn *conn, unsigned events) {
+    unsigned ready = events & (REACTOR_EVENT_TIMER | REACTOR_EVENT_WAKE);
+    int gone = 0;
+
+    if (events & REACTOR_READABLE) {
+        int got = reactor_fill_input(conn, (events & REACTOR_HANGUP) != 0);
+        if (got > 0) ready |= REACTOR_EVENT_INPUT;
+        if (got < 0) gone = 1;
+    }
+    if ((events & REACTOR_WRITABLE) && reactor_output_pending(conn) > 0) {
+        if (reactor_flush_or_block(reactor, conn) < 0) gone = 1;
+        else if (reactor_output_pending(conn) == 0) ready |= REACTOR_EVENT_DRAINED;
+    }
+
+    // Lines that arrived just before a hangup are still served
+    while (1) {
+        if (ready) {
+            reactor->handler(conn, ready);
+            reactor_end_reply(conn);
+        }
+        size_t queued = reactor_output_pending(conn);
+        if (queued > 0 && reactor_flush_or_block(reactor, conn) < 0) {
+            gone = 1;
+            break;
+        }
+        // The handler may have stopped at the high-water mark with
+        // requests left; nothing else will call it once the output is gone
+        if (queued > 0 && reactor_output_pending(conn) == 0 && !conn->closing &&
+            conn->in_start < conn->in.length) {
+            ready = REACTOR_EVENT_DRAINED;
+            continue;
+        }
+        break;
+    }
+
+    if (gone || conn->closing) {
+        reactor->handler(conn, REACTOR_EVENT_CLOSED);
+        reactor_destroy_conn(reactor, conn);
+        return;
+    }
+
+    if (conn->blocked && reactor_output_pending(conn) == 0) {
+        reactor_want_write(reactor, conn, 0);
+    }
+
+    pthread_mutex_lock(&reactor->mutex);
+    conn->running = 0;
+    if (conn->pending) {
+        reactor_schedule_locked(reactor, conn);
+    }
+    pthread_mutex_unlock(&reactor->mutex);
+}
+
+static inline void* reactor_worker(void *arg) {
+    Reactor *reactor = (Reactor*)arg;
+
+    pthread_mutex_lock(&reactor->mutex);
+    while (1) {
+        while (!reactor->run_head && !reactor->stopping) {
+            pthread_cond_wait(&reactor->work, &reactor->mutex);
+        }
+        if (reactor->stopping) break;
+
+        ReactorConn *conn = reactor->run_head;
+        reactor->run_head = conn->run_next;
+        if (!reactor->run_head) reactor->run_tail = NULL;
+        conn->queued = 0;
+        conn->running = 1;
+        unsigned events = conn->pending;
+        conn->pending = 0;
+        pthread_mutex_unlock(&reactor->mutex);
+
+        reactor_run_conn(reactor, conn, events);
+
+        pthread_mutex_lock(&reactor->mutex);
+    }
+    pthread_mutex_unlock(&reactor->mutex);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Event loop
+// ---------------------------------------------------------------------------
+
+static inline void reactor_accept(Reactor *reactor) {
+    while (1) {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept(reactor->listen_fd, (struct sockaddr*)&addr, &addr_len);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                // The backlog keeps them until fds free up
+                log_message(reactor->log, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                           "accept(): out of file descriptors, pausing for %d ms",
+                           REACTOR_ACCEPT_RETRY_MS);
+                epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, reactor->listen_fd, NULL);
+                reactor->accept_paused_until = reactor_now_ms() + REACTOR_ACCEPT_RETRY_MS;
+            }
+            return;
+        }
+
+        int one = 1;
+        reactor_set_nonblocking(fd);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ReactorConn *conn = calloc(1, sizeof(ReactorConn));
+        pthread_mutex_lock(&reactor->mutex);
+        if (conn && fd >= reactor->conn_capacity) {
+            int capacity = reactor->conn_capacity ? reactor->conn_capacity : 1024;
+            while (capacity <= fd) capacity *= 2;
+            ReactorConn **grown = realloc(reactor->conns, (size_t)capacity * sizeof(ReactorConn*));
+            if (grown) {
+                memset(grown + reactor->conn_capacity, 0,
+                       (size_t)(capacity - reactor->conn_capacity) * sizeof(ReactorConn*));
+                reactor->conns = grown;
+                reactor->conn_capacity = capacity;
+            }
+        }
+        if (!conn || fd >= reactor->conn_capacity) {
+            pthread_mutex_unlock(&reactor->mutex);
+            log_message(reactor->log, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Dropping connection: out of memory (fd=%d)", fd);
+            free(conn);
+            close(fd);
+            continue;
+        }
+
+        conn->fd = fd;
+        conn->reactor = reactor;
+        conn->timer_index = -1;
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        snprintf(conn->peer, sizeof(conn->peer), "%s:%d", ip, ntohs(addr.sin_port));
+        reactor->conns[fd] = conn;
+        int open_count = ++reactor->connection_count;
+        reactor->accepted++;
+        pthread_mutex_unlock(&reactor->mutex);
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            log_message(reactor->log, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "epoll_ctl(ADD) failed for fd=%d (errno=%d)", fd, errno);
+            pthread_mutex_lock(&reactor->mutex);
+            conn->running = 1;  // Nobody else may run it now
+            pthread_mutex_unlock(&reactor->mutex);
+            reactor_destroy_conn(reactor, conn);
+            continue;
+        }
+
+        log_message(reactor->log, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                   "Connection accepted from %s (fd=%d, %d open)",
+                   conn->peer, fd, open_count);
+    }
+}
+
+static inline int reactor_watch_listener(Reactor *reactor) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = reactor->listen_fd;
+    return epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_fd, &event);
+}
+
+// Set up the reactor on a listening socket and start its workers
+static inline int reactor_init(Reactor *reactor, int listen_fd, ReactorHandler handler,
+                               void *server, int workers, FILE *log) {
+    memset(reactor, 0, sizeof(*reactor));
+    reactor->listen_fd = listen_fd;
+    reactor->handler = handler;
+    reactor->server = server;
+    reactor->log = log;
+    pthread_mutex_init(&reactor->mutex, NULL);
+    pthread_cond_init(&reactor->work, NULL);
+
+    reactor->epoll_fd = epoll_create1(0);
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (reactor->epoll_fd < 0 || reactor->wake_fd < 0 ||
+        reactor_set_nonblocking(listen_fd) != 0 || reactor_watch_listener(reactor) != 0) {
+        return ERR_SOCKET_CREATE_FAILED;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = reactor->wake_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &event) != 0) {
+        return ERR_SOCKET_CREATE_FAILED;
+    }
+
+    reactor->workers = calloc((size_t)(workers > 0 ? workers : 1), sizeof(pthread_t));
+    if (!reactor->workers) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&reactor->workers[reactor->worker_count], NULL,
+                           reactor_worker, reactor) != 0) {
+            break;
+        }
+        reactor->worker_count++;
+    }
+    return reactor->worker_count > 0 ? ERR_SUCCESS : ERR_OUT_OF_MEMORY;
+}
+
+// Call once reactor_run() has returned: let handlers that are running
+// finish, then join the workers. Connections still queued are not run
+// again; they are left open for process exit to close.
+static inline void reactor_stop(Reactor *reactor) {
+    pthread_mutex_lock(&reactor->mutex);
+    reactor->stopping = 1;
+    pthread_cond_broadcast(&reactor->work);
+    pthread_mutex_unlock(&reactor->mutex);
+
+    for (int i = 0; i < reactor->worker_count; i++) {
+        pthread_join(reactor->workers[i], NULL);
+    }
+    free(reactor->workers);
+    reactor->workers = NULL;
+    reactor->worker_count = 0;
+}
+
+// Dispatch events and timers until *running is cleared
+static inline void reactor_run(Reactor *reactor, volatile int *running) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (*running) {
+        pthread_mutex_lock(&reactor->mutex);
+        long long now = reactor_now_ms();
+        long long wake = reactor->timer_count > 0 ? reactor->timers[0]->deadline_ms : -1;
+        if (reactor->accept_paused_until &&
+            (wake < 0 || reactor->accept_paused_until < wake)) {
+            wake = reactor->accept_paused_until;
+        }
+        pthread_mutex_unlock(&reactor->mutex);
+
+        int timeout = -1;
+        if (wake >= 0) {
+            timeout = wake > now ? (int)(wake - now) : 0;
+        }
+        int count = epoll_wait(reactor->epoll_fd, events, REACTOR_MAX_EVENTS, timeout);
+        if (count < 0 && errno != EINTR) {
+            log_message(reactor->log, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "epoll_wait failed (errno=%d)", errno);
+            continue;
+        }
+
+        int accept_ready = 0;
+        pthread_mutex_lock(&reactor->mutex);
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == reactor->listen_fd) {
+                accept_ready = 1;
+                continue;
+            }
+            if (fd == reactor->wake_fd) {
+                uint64_t value;
+                while (read(reactor->wake_fd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+
+            ReactorConn *conn = fd < reactor->conn_capacity ? reactor->conns[fd] : NULL;
+            if (!conn) continue;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                conn->pending |= REACTOR_READABLE;
+            }
+            if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                conn->pending |= REACTOR_HANGUP;
+            }
+            if (events[i].events & EPOLLOUT) {
+                conn->pending |= REACTOR_WRITABLE;
+            }
+            reactor_schedule_locked(reactor, conn);
+        }
+
+        now = reactor_now_ms();
+        while (reactor->timer_count > 0 && reactor->timers[0]->deadline_ms <= now) {
+            ReactorConn *conn = reactor->timers[0];
+            reactor_timer_remove_locked(reactor, conn);
+            conn->pending |= REACTOR_EVENT_TIMER;
+            reactor_schedule_locked(reactor, conn);
+        }
+
+        if (reactor->accept_paused_until && reactor->accept_paused_until <= now) {
+            reactor->accept_paused_until = 0;
+            reactor_watch_listener(reactor);
+        }
+        pthread_mutex_unlock(&reactor->mutex);
+
+        if (accept_ready) {
+            reactor_accept(reactor);
+        }
+    }
+}
+
+#endif // REACTOR_H
@@ -0,0 +1,277 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEXT_SCAN_X86 1
+#endif
+
+// ============================================================================
+// SENTENCE AND WORD TOKENIZER
+// ============================================================================
+// Text is classified 64 bytes at a time into two bitmasks, whitespace
+// (space, \t \n \v \f \r) and sentence delimiters (. ! ?), using AVX2 or
+// SSE2 when the CPU has them and a scalar loop otherwise. Counting works
+// on the masks directly with popcount; the tokenizer walks them with
+// count-trailing-zeros to emit word and delimiter boundaries in one pass.
+// Nothing is copied out of the caller's buffer, which needs no terminator.
+//
+// A word is a run of characters that are neither whitespace nor, when
+// delimiters are split, sentence delimiters. This is the document model
+// the storage server uses: "end.Next" is the word "end", a delimiter, and
+// the word "Next" of the following sentence.
+
+#define TEXT_SCAN_BLOCK 64
+
+typedef void (*TextScanFn)(const unsigned char *block, uint64_t *whitespace, uint64_t *delimiters);
+
+static inline void text_scan_block_scalar(const unsigned char *block,
+                                          uint64_t *whitespace, uint64_t *delimiters) {
+    uint64_t ws = 0;
+    uint64_t delim = 0;
+
+    for (int i = 0; i < TEXT_SCAN_BLOCK; i++) {
+        unsigned char c = block[i];
+        ws |= (uint64_t)(c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t') << i;
+        delim |= (uint64_t)(c == '.' || c == '!' || c == '?') << i;
+    }
+
+    *whitespace = ws;
+    *delimiters = delim;
+}
+
+#ifdef TEXT_SCAN_X86
+__attribute__((target("sse2")))
+static void text_scan_block_sse2(const unsigned char *block,
+                                 uint64_t *whitespace, uint64_t *delimiters) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i control_span = _mm_set1_epi8('\r' - '\t');
+    const __m128i period = _mm_set1_epi8('.');
+    const __m128i exclamation = _mm_set1_epi8('!');
+    const __m128i question = _mm_set1_epi8('?');
+    uint64_t ws = 0;
+    uint64_t delim = 0;
+
+    for (int i = 0; i < TEXT_SCAN_BLOCK / 16; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(block + 16 * i));
+
+        // \t..\r is one range: (c - '\t') <= 4 unsigned, i.e. min() == itself
+        __m128i shifted = _mm_sub_epi8(v, tab);
+        __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, control_span), shifted);
+        __m128i is_ws = _mm_or_si128(_mm_cmpeq_epi8(v, space), is_control);
+        __m128i is_delim = _mm_or_si128(_mm_cmpeq_epi8(v, period),
+                                        _mm_or_si128(_mm_cmpeq_epi8(v, exclamation),
+                                                     _mm_cmpeq_epi8(v, question)));
+
+        ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(is_ws) << (16 * i);
+        delim |= (uint64_t)(uint16_t)_mm_movemask_epi8(is_delim) << (16 * i);
+    }
+
+    *whitespace = ws;
+    *delimiters = delim;
+}
+
+__attribute__((target("avx2")))
+static void text_scan_block_avx2(const unsigned char *block,
+                                 uint64_t *whitespace, uint64_t *delimiters) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i control_span = _mm256_set1_epi8('\r' - '\t');
+    const __m256i period = _mm256_set1_epi8('.');
+    const __m256i exclamation = _mm256_set1_epi8('!');
+    const __m256i question = _mm256_set1_epi8('?');
+    uint64_t ws = 0;
+    uint64_t delim = 0;
+
+    for (int i = 0; i < TEXT_SCAN_BLOCK / 32; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(block + 32 * i));
+
+        __m256i shifted = _mm256_sub_epi8(v, tab);
+        __m256i is_control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, control_span), shifted);
+        __m256i is_ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), is_control);
+        __m256i is_delim = _mm256_or_si256(_mm256_cmpeq_epi8(v, period),
+                                           _mm256_or_si256(_mm256_cmpeq_epi8(v, exclamation),
+                                                           _mm256_cmpeq_epi8(v, question)));
+
+        ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(is_ws) << (32 * i);
+        delim |= (uint64_t)(uint32_t)_mm256_movemask_epi8(is_delim) << (32 * i);
+    }
+
+    *whitespace = ws;
+    *delimiters = delim;
+}
+#endif
+
+// Best block scanner for the running CPU
+static inline TextScanFn text_scan_select(void) {
+#ifdef TEXT_SCAN_X86
+    if (__builtin_cpu_supports("avx2")) return text_scan_block_avx2;
+    if (__builtin_cpu_supports("sse2")) return text_scan_block_sse2;
+#endif
+    return text_scan_block_scalar;
+}
+
+// Classify the block starting at offset. The last, partial block is
+// padded with spaces so bits past the end read as whitespace.
+static inline void text_scan_at(TextScanFn scan, const char *data, size_t length, size_t offset,
+                                uint64_t *whitespace, uint64_t *delimiters) {
+    if (offset + TEXT_SCAN_BLOCK <= length) {
+        scan((const unsigned char *)data + offset, whitespace, delimiters);
+        return;
+    }
+
+    unsigned char padded[TEXT_SCAN_BLOCK];
+    memset(padded, ' ', sizeof(padded));
+    memcpy(padded, data + offset, length - offset);
+    scan(padded, whitespace, delimiters);
+}
+
+// ============================================================================
+// COUNTING
+// ============================================================================
+
+typedef struct {
+    size_t words;
+    size_t sentences;   // Delimiters, plus trailing words without one
+} TextStats;
+
+static inline TextStats text_stats(const char *data, size_t length) {
+    TextScanFn scan = text_scan_select();
+    TextStats stats = {0, 0};
+    uint64_t carry = 1;         // The start of the text acts as a boundary
+    int trailing_words = 0;     // Words seen since the last delimiter
+
+    for (size_t offset = 0; offset < length; offset += TEXT_SCAN_BLOCK) {
+        uint64_t ws, delim;
+        text_scan_at(scan, data, length, offset, &ws, &delim);
+
+        uint64_t boundary = ws | delim;
+        uint64_t word_starts = ~boundary & ((boundary << 1) | carry);
+        carry = boundary >> 63;
+
+        stats.words += (size_t)__builtin_popcountll(word_starts);
+        stats.sentences += (size_t)__builtin_popcountll(delim);
+
+        if (word_starts | delim) {
+            int last_word = word_starts ? 63 - __builtin_clzll(word_starts) : -1;
+            int last_delim = delim ? 63 - __builtin_clzll(delim) : -1;
+            trailing_words = last_word > last_delim;
+        }
+    }
+
+    stats.sentences += (size_t)trailing_words;
+    return stats;
+}
+
+// ============================================================================
+// TOKENIZING
+// ============================================================================
+
+typedef enum {
+    TEXT_TOKEN_WORD,
+    TEXT_TOKEN_DELIMITER,
+    TEXT_TOKEN_END
+} TextTokenType;
+
+typedef struct {
+    TextTokenType type;
+    size_t start;       // Offset into the tokenized buffer
+    size_t length;
+} TextToken;
+
+typedef struct {
+    const char *data;
+    size_t length;
+    int split_delimiters;   // 0: words are whitespace-separated only
+    TextScanFn scan;
+
+    // Boundaries in the block at block_offset not handed out yet, as
+    // text_stats() finds them: word starts, the byte after each word, and
+    // delimiters
+    size_t block_offset;
+    size_t next_offset;     // Block to scan next
+    uint64_t starts;
+    uint64_t ends;
+    uint64_t delimiters;
+    uint64_t carry;         // The byte before next_offset is a boundary
+} TextTokenizer;
+
+static inline void text_tokenizer_init(TextTokenizer *tok, const char *data, size_t length,
+                                       int split_delimiters) {
+    tok->data = data;
+    tok->length = length;
+    tok->split_delimiters = split_delimiters;
+    tok->scan = text_scan_select();
+    tok->block_offset = 0;
+    tok->next_offset = 0;
+    tok->starts = 0;
+    tok->ends = 0;
+    tok->delimiters = 0;
+    tok->carry = 1;         // The start of the text acts as a boundary
+}
+
+// Scan the next block into the masks. Returns 0 past the end of the text.
+static inline int text_tokenizer_load(TextTokenizer *tok) {
+    if (tok->next_offset >= tok->length) return 0;
+
+    uint64_t ws, delim;
+    text_scan_at(tok->scan, tok->data, tok->length, tok->next_offset, &ws, &delim);
+    if (!tok->split_delimiters) delim = 0;
+
+    uint64_t boundary = ws | delim;
+    uint64_t after_boundary = (boundary << 1) | tok->carry;
+    tok->starts = ~boundary & after_boundary;
+    tok->ends = boundary & ~after_boundary;
+    tok->delimiters = delim;
+    tok->carry = boundary >> 63;
+    tok->block_offset = tok->next_offset;
+    tok->next_offset += TEXT_SCAN_BLOCK;
+    return 1;
+}
+
+// Next word or delimiter. Returns 0 (and a TEXT_TOKEN_END token) once the
+// text is exhausted.
+static inline int text_tokenizer_next(TextTokenizer *tok, TextToken *token) {
+    uint64_t pending;
+    while (!(pending = tok->starts | tok->delimiters)) {
+        if (!text_tokenizer_load(tok)) {
+            token->type = TEXT_TOKEN_END;
+            token->start = tok->length;
+            token->length = 0;
+            return 0;
+        }
+    }
+
+    uint64_t bit = pending & -pending;
+    size_t at = tok->block_offset + (size_t)__builtin_ctzll(pending);
+    if (tok->delimiters & bit) {
+        tok->delimiters &= ~bit;
+        token->type = TEXT_TOKEN_DELIMITER;
+        token->start = at;
+        token->length = 1;
+        return 1;
+    }
+
+    // Ends before this word's start were taken with earlier words, so the
+    // lowest one left is this word's, unless it runs into later blocks
+    tok->starts &= ~bit;
+    token->type = TEXT_TOKEN_WORD;
+    token->start = at;
+    while (!tok->ends) {
+        if (!text_tokenizer_load(tok)) {
+            // A full last block has no padding to end the word
+            token->length = tok->length - at;
+            return 1;
+        }
+    }
+    token->length = tok->block_offset + (size_t)__builtin_ctzll(tok->ends) - at;
+    tok->ends &= tok->ends - 1;
+    return 1;
+}
+
+#endif // TOKENIZER_H
@@ -0,0 +1,280 @@
+#include "../include/nameserver.h"
+#include <time.h>
+
+// ============================================================================
+// NAME TABLE AND CATALOG BENCHMARK
+// ============================================================================
+// Interns generated file names and reports the worst single intern (a
+// stripe resize lands on one of them), then lookup throughput with 1, 2,
+// 4 and 8 threads looking up random interned names, then the worst lookup
+// stall seen by 3 reader threads while another thread interns new names.
+//
+// Then the catalog: every interned name is created as a file the way a
+// CREATE records it, and 1, 2, 4 and 8 threads each resolve that many
+// random files for READ (resolve_file, as READ/WRITE/STREAM run it) while
+// another thread keeps creating new files. Reports resolve throughput, the
+// worst single resolve, and how many files were created meanwhile.
+// Thread scaling only shows with as many CPUs as threads.
+//
+// Usage: names_bench [names] [lookups per thread]   (default 1000000 2000000)
+
+FILE* log_file;
+
+#define READER_THREADS 3
+#define BENCH_SS_ID 1
+
+static char **names;
+static int name_count;
+static int lookups_per_thread;
+static int writer_done;
+
+static NameServerConfig config;
+static uint32_t owner;
+static int resolvers_left;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// xorshift32, one state per thread
+static uint32_t next_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+typedef struct {
+    pthread_t thread;
+    uint32_t seed;
+    int misses;
+    double worst;       // Slowest single lookup, seconds
+    int created;        // Creator: files created
+} BenchThread;
+
+static void* lookup_thread(void *arg) {
+    BenchThread *self = arg;
+    for (int i = 0; i < lookups_per_thread; i++) {
+        const char *name = names[next_random(&self->seed) % (uint32_t)name_count];
+        if (name_lookup(name) == NAME_NONE) self->misses++;
+    }
+    return NULL;
+}
+
+// Looks up already interned names, timing each, until the writer finishes
+static void* stall_thread(void *arg) {
+    BenchThread *self = arg;
+    while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+        const char *name = names[next_random(&self->seed) % (uint32_t)name_count];
+        double start = now_seconds();
+        if (name_lookup(name) == NAME_NONE) self->misses++;
+        double elapsed = now_seconds() - start;
+        if (elapsed > self->worst) self->worst = elapsed;
+    }
+    return NULL;
+}
+
+// As CREATE records a file once its SS made it
+static int create_file(const char *filename, const FileLocation *location) {
+    if (catalog_set_location(&config, filename, location) != ERR_SUCCESS) return -1;
+    return add_file_access(&config.catalog, filename, "owner") == ERR_SUCCESS ? 0 : -1;
+}
+
+// Resolves random files for READ, timing each
+static void* resolve_thread(void *arg) {
+    BenchThread *self = arg;
+    FileLocation location;
+    for (int i = 0; i < lookups_per_thread; i++) {
+        const char *name = names[next_random(&self->seed) % (uint32_t)name_count];
+        double start = now_seconds();
+        if (resolve_file(&config.catalog, name, owner, ACCESS_READ, &location) != ERR_SUCCESS) {
+            self->misses++;
+        }
+        double elapsed = now_seconds() - start;
+        if (elapsed > self->worst) self->worst = elapsed;
+    }
+    __atomic_sub_fetch(&resolvers_left, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Creates new files until the resolvers finish
+static void* create_thread(void *arg) {
+    BenchThread *self = arg;
+    FileLocation location;
+    if (ss_session_location(&config, BENCH_SS_ID, &location) != ERR_SUCCESS) return NULL;
+
+    static int next_file = 0;   // Only one creator runs at a time
+    while (__atomic_load_n(&resolvers_left, __ATOMIC_ACQUIRE) > 0) {
+        char name[64];
+        snprintf(name, sizeof(name), "new%d/file_%d.txt", next_file % 1000, next_file);
+        next_file++;
+        if (create_file(name, &location) != 0) {
+            self->misses++;
+            break;
+        }
+        self->created++;
+    }
+    return NULL;
+}
+
+static int intern_range(int from, int to, double *worst) {
+    *worst = 0;
+    for (int i = from; i < to; i++) {
+        double start = now_seconds();
+        uint32_t id = name_intern(names[i]);
+        double elapsed = now_seconds() - start;
+        if (id == NAME_NONE) return -1;
+        if (elapsed > *worst) *worst = elapsed;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    name_count = argc > 1 ? atoi(argv[1]) : 1000000;
+    lookups_per_thread = argc > 2 ? atoi(argv[2]) : 2000000;
+    if (name_count <= 0 || lookups_per_thread <= 0) {
+        fprintf(stderr, "Usage: %s [names] [lookups per thread]\n", argv[0]);
+        return 1;
+    }
+
+    // The first name_count are interned up front, the rest while readers run
+    int total = name_count + name_count / 2;
+    names = malloc((size_t)total * sizeof(char*));
+    for (int i = 0; names && i < total; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "dir%d/file_%d.txt", i % 1000, i);
+        names[i] = strdup(name);
+        if (!names[i]) {
+            fprintf(stderr, "Out of memory generating names\n");
+            return 1;
+        }
+    }
+    if (!names || init_names() != ERR_SUCCESS) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("Name table, %d names, %ld CPU(s)\n", name_count, sysconf(_SC_NPROCESSORS_ONLN));
+
+    double worst;
+    double start = now_seconds();
+    if (intern_range(0, name_count, &worst) != 0) {
+        fprintf(stderr, "name_intern failed\n");
+        return 1;
+    }
+    printf("  intern        %9.1f ms   (worst single %.2f ms)\n",
+           (now_seconds() - start) * 1e3, worst * 1e3);
+
+    static const int thread_counts[] = {1, 2, 4, 8};
+    BenchThread threads[8];
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int count = thread_counts[t];
+        memset(threads, 0, sizeof(threads));
+        start = now_seconds();
+        for (int i = 0; i < count; i++) {
+            threads[i].seed = 2463534242u + (uint32_t)i;
+            pthread_create(&threads[i].thread, NULL, lookup_thread, &threads[i]);
+        }
+        int misses = 0;
+        for (int i = 0; i < count; i++) {
+            pthread_join(threads[i].thread, NULL);
+            misses += threads[i].misses;
+        }
+        double elapsed = now_seconds() - start;
+        printf("  lookup x%d     %9.2f M lookups/s%s\n", count,
+               (double)count * lookups_per_thread / elapsed / 1e6, misses ? "   (MISSES)" : "");
+    }
+
+    memset(threads, 0, sizeof(threads));
+    for (int i = 0; i < READER_THREADS; i++) {
+        threads[i].seed = 88675123u + (uint32_t)i;
+        pthread_create(&threads[i].thread, NULL, stall_thread, &threads[i]);
+    }
+    start = now_seconds();
+    int result = intern_range(name_count, total, &worst);
+    double writer_seconds = now_seconds() - start;
+    __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+
+    double worst_stall = 0;
+    int misses = 0;
+    for (int i = 0; i < READER_THREADS; i++) {
+        pthread_join(threads[i].thread, NULL);
+        if (threads[i].worst > worst_stall) worst_stall = threads[i].worst;
+        misses += threads[i].misses;
+    }
+    if (result != 0) {
+        fprintf(stderr, "name_intern failed\n");
+        return 1;
+    }
+    printf("  %d readers while %d more names are interned:\n", READER_THREADS, total - name_count);
+    printf("    worst lookup  %9.2f ms%s\n", worst_stall * 1e3, misses ? "   (MISSES)" : "");
+    printf("    writer        %9.1f ms   (worst single intern %.2f ms)\n",
+           writer_seconds * 1e3, worst * 1e3);
+
+    // The catalog, with one SS registered to hold every file. The server's
+    // console lines (one per file created) go to /dev/null; results go to
+    // what was stdout.
+    fflush(stdout);
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "Can't silence the console\n");
+        return 1;
+    }
+    pthread_mutex_init(&config.ss_session_lock, NULL);
+    SSSession *ss = create_ss_session(-1, BENCH_SS_ID, "127.0.0.1", 0, 0);
+    if (!ss || init_catalog(&config.catalog) != ERR_SUCCESS) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    add_ss_session(&config, ss);
+    owner = name_intern("owner");
+
+    FileLocation location;
+    ss_session_location(&config, BENCH_SS_ID, &location);
+    start = now_seconds();
+    for (int i = 0; i < name_count; i++) {
+        if (create_file(names[i], &location) != 0) {
+            fprintf(stderr, "Catalog insert failed\n");
+            return 1;
+        }
+    }
+    fprintf(report, "Catalog, %d files\n", name_count);
+    fprintf(report, "  create        %9.1f ms\n", (now_seconds() - start) * 1e3);
+
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int count = thread_counts[t];
+        BenchThread creator = {0};
+        memset(threads, 0, sizeof(threads));
+        resolvers_left = count;
+        start = now_seconds();
+        for (int i = 0; i < count; i++) {
+            threads[i].seed = 3141592653u + (uint32_t)i;
+            pthread_create(&threads[i].thread, NULL, resolve_thread, &threads[i]);
+        }
+        pthread_create(&creator.thread, NULL, create_thread, &creator);
+        double worst_resolve = 0;
+        misses = 0;
+        for (int i = 0; i < count; i++) {
+            pthread_join(threads[i].thread, NULL);
+            if (threads[i].worst > worst_resolve) worst_resolve = threads[i].worst;
+            misses += threads[i].misses;
+        }
+        double elapsed = now_seconds() - start;
+        pthread_join(creator.thread, NULL);
+        fprintf(report, "  resolve x%d    %9.2f M resolves/s   worst %.2f ms   %d creates%s\n", count,
+               (double)count * lookups_per_thread / elapsed / 1e6, worst_resolve * 1e3,
+               creator.created, misses || creator.misses ? "   (MISSES)" : "");
+    }
+
+    fclose(report);
+    cleanup_catalog(&config.catalog);
+    remove_ss_session(&config, BENCH_SS_ID);
+    pthread_mutex_destroy(&config.ss_session_lock);
+    cleanup_names();
+    for (int i = 0; i < total; i++) free(names[i]);
+    free(names);
+    return 0;
+}
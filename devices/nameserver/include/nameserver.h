@@ -3,30 +3,109 @@
 #include<sys/time.h>
 
 #include "../../common/common.h"
+#include "../../common/reactor.h"
 
 #define LOG_FILE ".nslogs"
 extern FILE* log_file;
 
 
+// ============================================================================
+// NAME TABLE STRUCTURES
+// ============================================================================
+
+#define NAME_NONE 0                  // No name; IDs start at 1
+#define NAME_CHUNK_SIZE 4096         // Strings per chunk of the ID -> string table
+#define NAME_MAX_CHUNKS 4096         // So up to 16M names
+#define NAME_STRIPE_BITS 4           // Top hash bits pick the stripe
+#define NAME_STRIPES (1 << NAME_STRIPE_BITS)
+#define NAME_STRIPE_INITIAL_SIZE 64  // Power of two; doubles before it is half full
+
+// One slot of an open-addressing index: a key's hash and the position it
+// maps to
+typedef struct {
+    uint32_t hash;
+    int position;               // Index + 1 (or an ID); 0 for an empty slot
+} NameSlot;
+
+// A slice of the string -> ID index with its own lock, grown on its own
+typedef struct {
+    NameSlot *index;
+    int index_size;             // Power of two
+    int used;
+    pthread_rwlock_t lock;
+} NameStripe;
+
+// Filenames and usernames, each stored once under a dense 32-bit ID
+typedef struct {
+    char **chunks[NAME_MAX_CHUNKS];     // ID -> string; a chunk never moves
+    uint32_t count;             // IDs handed out
+    pthread_mutex_t id_lock;    // Guards count and chunk allocation
+    NameStripe stripes[NAME_STRIPES];
+} NameTable;
+
 // ============================================================================
 // CLIENT SESSION STRUCTURES
 // ============================================================================
 
+struct PendingCommand;
+
 typedef struct ClientSession {
     int socket_fd;
     char username[MAX_USERNAME_LENGTH];
+    uint32_t user;              // Interned username
     char ip[INET_ADDRSTRLEN];
     int port;
     int is_active;
     time_t connected_time;
-    pthread_t thread;
+    ReactorConn *conn;          // Owned by the client reactor
+    DynamicBuffer *capture;     // While running a BATCH: replies go here
+    int captured_frame;         // capture holds a whole reply frame
+    struct PendingCommand *pending; // Running on the command pool
     struct ClientSession *next;
 } ClientSession;
 
+// ============================================================================
+// COMMAND POOL
+// ============================================================================
+// Commands that block - a round trip to a storage server, or EXEC - run on
+// their own bounded pool rather than the client reactor's workers, so a
+// hung SS or a long command never holds up other clients' lookups. The
+// session takes no more commands until its pending one has replied.
+
+#define COMMAND_POOL_WORKERS 8         // Blocking commands run at once
+#define COMMAND_POOL_QUEUE 256         // Waiting for a worker; more are refused as busy
+#define SS_CALL_CONNECT_TIMEOUT_MS 3000 // Connecting to an SS for a forwarded command
+#define SS_CALL_TIMEOUT_SEC 10         // Each send or receive of one
+
+typedef struct PendingCommand {
+    ClientSession *session;
+    WireMessage msg;            // Copied off the connection's input
+    char *storage;              // Its strings
+    char line[BUFFER_SIZE];     // As received, for logs
+    DynamicBuffer output;       // Its replies, gathered through session->capture
+    int done;
+    int abandoned;              // The client left; drop the session when done
+    struct PendingCommand *next;
+} PendingCommand;
+
+typedef struct {
+    pthread_t threads[COMMAND_POOL_WORKERS];
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    PendingCommand *head;
+    PendingCommand *tail;
+    int queued;
+    int stopping;
+} CommandPool;
+
 // ============================================================================
 // STORAGE SERVER SESSION STRUCTURES
 // ============================================================================
 
+#define SS_HEARTBEAT_INTERVAL_SEC 5    // Idle time before we ask for a HEARTBEAT_ACK
+#define SS_HEARTBEAT_TIMEOUT_SEC 15    // Silence after which the SS is failed
+
 typedef struct SSSession {
     int ss_id;
     int socket_fd;
@@ -34,45 +113,77 @@ typedef struct SSSession {
     int nm_port;
     int client_port;
     int is_active;
-    time_t last_heartbeat;
-    pthread_t thread;
+    time_t last_heartbeat;      // Last time anything arrived from the SS
+    ReactorConn *conn;          // Owned by the SS reactor
     struct SSSession *next;
 } SSSession;
 
 // ============================================================================
-// FILE MAPPING STRUCTURES
+// FILE CATALOG STRUCTURES
 // ============================================================================
 
-typedef struct FileMapping {
-    char filename[MAX_FILENAME_LENGTH];
-    int primary_ss_id;
-    struct FileMapping *next;
-} FileMapping;
-
-#define HASH_TABLE_SIZE 1009
+#define ACL_INITIAL_USERS 4          // Grant slots a file starts with
+#define ACL_USER_SCAN_LIMIT 8        // Users a file may have before it gets a user index
 
+// Everything the name server knows about one file. Names are name table
+// IDs.
 typedef struct {
-    FileMapping *buckets[HASH_TABLE_SIZE];
-    pthread_mutex_t lock;
-} FileHashTable;
+    uint32_t name;
 
-// ============================================================================
-// ACCESS CONTROL STRUCTURES
-// ============================================================================
-
-typedef struct {
-    char filename[MAX_FILENAME_LENGTH];
-    char owner[MAX_USERNAME_LENGTH];
-    char users[MAX_USERS][MAX_USERNAME_LENGTH];
-    int access_levels[MAX_USERS];
+    // Access control. owner is NAME_NONE for a file an SS reported that
+    // has no ACL yet.
+    uint32_t owner;
+    uint32_t *users;            // Grown by doubling; users[0] is the owner
+    int *access_levels;
     int user_count;
-} FileAccessControl;
+    int user_capacity;
+    NameSlot *user_index;       // User ID -> users[], once past ACL_USER_SCAN_LIMIT
+    int user_index_size;        // Power of two
+
+    // Location: the SS holding the file, and its client endpoint, so a
+    // redirect needs no session lookup
+    int primary_ss_id;          // -1 while no SS holds the file
+    char ss_ip[INET_ADDRSTRLEN];
+    int ss_client_port;
+
+    // Bumped whenever the name server learns the file changed
+    uint32_t version;
+
+    // From the last INFO; valid while stats_version == version
+    uint32_t stats_version;     // 0: nothing cached
+    size_t cached_size;
+    int cached_words;
+    int cached_chars;
+} FileRecord;
+
+#define CATALOG_STRIPE_BITS 4        // Top filename hash bits pick the stripe
+#define CATALOG_STRIPES (1 << CATALOG_STRIPE_BITS)
+
+// The records of the filenames that hash to one stripe, under that
+// stripe's lock
+typedef struct {
+    FileRecord **records;       // For walking the catalog
+    int record_count;
+    int record_capacity;
+    pthread_rwlock_t lock;      // Shared for lookups, exclusive for changes
+} CatalogStripe;
+
+// Records are allocated one at a time, so a FileRecord* stays valid while
+// the lists grow. Records are never removed: a deleted file loses its
+// location and keeps its ACL.
+typedef struct {
+    CatalogStripe stripes[CATALOG_STRIPES];
+    FileRecord **by_name[NAME_MAX_CHUNKS];  // Filename ID -> record; a chunk never moves
+    pthread_mutex_t chunk_lock;             // Guards chunk allocation
+} FileCatalog;
 
+// A file's location as resolved for one request
 typedef struct {
-    FileAccessControl acl_list[MAX_FILES_PER_SS * MAX_STORAGE_SERVERS];
-    int acl_count;
-    pthread_mutex_t acl_lock;
-} AccessControlManager;
+    int ss_id;
+    char ip[INET_ADDRSTRLEN];
+    int client_port;
+    uint32_t version;
+} FileLocation;
 
 // ============================================================================
 // NAME SERVER CONFIGURATION
@@ -91,22 +202,21 @@ typedef struct {
     int client_session_count;
     pthread_mutex_t client_session_lock;
     
-    FileHashTable file_table;
-    AccessControlManager acl_manager;
+    FileCatalog catalog;
     
     int nm_socket;
     int client_socket;
     
+    // Each listener runs its own reactor, so a flood of clients never
+    // delays storage server heartbeats
+    Reactor ss_reactor;
+    Reactor client_reactor;
+    CommandPool command_pool;
+    
     pthread_t nm_accept_thread;
     pthread_t client_accept_thread;
-    pthread_t heartbeat_thread;
 } NameServerConfig;
 
-typedef struct {
-    ClientSession *session;
-    NameServerConfig *config;
-} ClientThreadArg;
-
 // ============================================================================
 // SS SESSION MANAGEMENT
 // ============================================================================
@@ -115,11 +225,10 @@ SSSession* create_ss_session(int socket_fd, int ss_id, const char *ip,
                              int nm_port, int client_port);
 int add_ss_session(NameServerConfig *config, SSSession *session);
 int remove_ss_session(NameServerConfig *config, int ss_id);
-SSSession* find_ss_session(NameServerConfig *config, int ss_id);
+int ss_session_location(NameServerConfig *config, int ss_id, FileLocation *location);
+int ss_session_registered(NameServerConfig *config, int ss_id);
 int find_available_ss(NameServerConfig *config);
 void handle_ss_failure(NameServerConfig *config, int failed_ss_id);
-void* monitor_ss_heartbeats(void *arg);
-void* handle_ss_session(void *arg);
 void handle_ss_session_command(SSSession *session, NameServerConfig *config, const char *command);
 
 // ============================================================================
@@ -132,9 +241,22 @@ int add_client_session(NameServerConfig *config, ClientSession *session);
 int remove_client_session(NameServerConfig *config, const char *username);
 ClientSession* find_client_session(NameServerConfig *config, const char *username);
 void cleanup_all_sessions(NameServerConfig *config);
-void* handle_client_session(void *arg);
+int session_send(ClientSession *session, const char *data, size_t length);
+int session_send_frame(ClientSession *session, DynamicBuffer *frame);
 void handle_session_command(ClientSession *session, NameServerConfig *config, 
-                           const char *command);
+                           WireMessage *msg, const char *command);
+int command_blocks(const WireMessage *msg);
+
+// ============================================================================
+// COMMAND POOL
+// ============================================================================
+
+int command_pool_start(NameServerConfig *config);
+void command_pool_stop(NameServerConfig *config);
+int command_pool_submit(NameServerConfig *config, ClientSession *session,
+                        const WireMessage *msg, const char *line);
+int command_pool_finish(NameServerConfig *config, ClientSession *session);
+int command_pool_abandon(NameServerConfig *config, ClientSession *session);
 
 // ============================================================================
 // INITIALIZATION
@@ -144,41 +266,91 @@ int init_nameserver(NameServerConfig *config, int nm_port, int client_port);
 void cleanup_nameserver(NameServerConfig *config);
 
 // ============================================================================
-// HASH TABLE OPERATIONS
+// NAME TABLE
+// ============================================================================
+
+extern NameTable name_table;
+
+int init_names(void);
+void cleanup_names(void);
+uint32_t name_hash(const char *name);
+uint32_t name_lookup(const char *name);     // NAME_NONE if never interned
+uint32_t name_intern(const char *name);     // NAME_NONE without memory
+const char* name_of(uint32_t id);           // "" for NAME_NONE
+
+// ============================================================================
+// FILE CATALOG
 // ============================================================================
 
-unsigned int hash_filename(const char *filename);
-int add_file_mapping(FileHashTable *table, const char *filename, int primary_ss_id);
-int get_file_primary_ss(FileHashTable *table, const char *filename);
-int remove_file_mapping(FileHashTable *table, const char *filename);
-void init_hash_table(FileHashTable *table);
-void cleanup_hash_table(FileHashTable *table);
+int init_catalog(FileCatalog *catalog);
+void cleanup_catalog(FileCatalog *catalog);
+
+// A file's record is guarded by its stripe's lock. A BATCH locks the
+// stripes of all its files at once, in stripe order.
+CatalogStripe* catalog_stripe(FileCatalog *catalog, const char *filename);
+uint32_t catalog_stripe_bit(const char *filename);
+void catalog_lock_stripes(FileCatalog *catalog, uint32_t stripes, int exclusive);
+void catalog_unlock_stripes(FileCatalog *catalog, uint32_t stripes);
+
+// With the filename's stripe locked (for writing, to insert). name is the
+// interned filename; intern it before taking the lock.
+FileRecord* catalog_find_locked(FileCatalog *catalog, const char *filename);
+FileRecord* catalog_record_locked(FileCatalog *catalog, uint32_t name);
+FileRecord* catalog_insert_locked(FileCatalog *catalog, uint32_t name);
+
+// ERR_SS_NOT_REGISTERED if location's SS has failed since it was copied
+int catalog_set_location(NameServerConfig *config, const char *filename,
+                         const FileLocation *location);
+int catalog_clear_location(FileCatalog *catalog, const char *filename);
+int catalog_drop_ss(FileCatalog *catalog, int ss_id);
+void catalog_file_updated(FileCatalog *catalog, const char *filename);
+void catalog_cache_stats(FileCatalog *catalog, const char *filename, uint32_t version,
+                         size_t size, int words, int chars);
+
+// Access check and location in one lookup: ERR_SUCCESS,
+// ERR_PERMISSION_DENIED or ERR_FILE_NOT_FOUND. user is an interned
+// username; ACCESS_NONE skips the check.
+int resolve_file(FileCatalog *catalog, const char *filename, uint32_t user,
+                 int required_level, FileLocation *location);
+int resolve_file_locked(FileCatalog *catalog, const char *filename, uint32_t user,
+                        int required_level, FileLocation *location);
 
 // ============================================================================
 // ACCESS CONTROL
 // ============================================================================
 
-int init_access_control(AccessControlManager *acl_mgr);
-int add_file_access(AccessControlManager *acl_mgr, const char *filename, 
+int add_file_access(FileCatalog *catalog, const char *filename, 
                    const char *owner);
-int grant_access(AccessControlManager *acl_mgr, const char *filename, 
+int grant_access(FileCatalog *catalog, const char *filename, 
                 const char *username, int access_level);
-int revoke_access(AccessControlManager *acl_mgr, const char *filename, 
+int revoke_access(FileCatalog *catalog, const char *filename, 
                  const char *username);
-int check_access(AccessControlManager *acl_mgr, const char *filename, 
+int check_access(FileCatalog *catalog, const char *filename, 
                 const char *username, int required_level);
-FileAccessControl* get_file_acl(AccessControlManager *acl_mgr, const char *filename);
+FileRecord* get_file_acl(FileCatalog *catalog, const char *filename);
+
+// As above, with the filename's stripe already locked by the caller (for
+// writing, to grant or revoke)
+int grant_access_locked(FileCatalog *catalog, const char *filename, 
+                        const char *username, int access_level);
+int revoke_access_locked(FileCatalog *catalog, const char *filename, 
+                         const char *username);
+int check_access_locked(FileCatalog *catalog, const char *filename, 
+                        const char *username, int required_level);
+FileRecord* get_file_acl_locked(FileCatalog *catalog, const char *filename);
+int user_access_level(const FileRecord *acl, uint32_t user);
 
 // ============================================================================
 // NETWORK THREADS
 // ============================================================================
+// Each runs its listener's reactor until the server stops
 
 void* accept_storage_server_connections(void *arg);
 void* accept_client_connections(void *arg);
 
 // ACL persistence
-int save_acl_cache(AccessControlManager *acl_mgr);
-int load_acl_cache(AccessControlManager *acl_mgr);
+int save_acl_cache(FileCatalog *catalog);
+int load_acl_cache(FileCatalog *catalog);
 
 
 #endif // NAMESERVER_H
\ No newline at end of file
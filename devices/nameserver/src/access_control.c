@@ -3,81 +3,156 @@
 // External log file handle
 extern FILE* log_file;
 
-int init_access_control(AccessControlManager *acl_mgr) {
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Initializing access control manager");
-    
-    acl_mgr->acl_count = 0;
-    pthread_mutex_init(&acl_mgr->acl_lock, NULL);
-    
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Access control manager initialized: acl_count=0");
-    
+// ============================================================================
+// USER INDEXES
+// ============================================================================
+// A file's ACL lives in its catalog record (catalog.c). A file whose users
+// outgrow ACL_USER_SCAN_LIMIT gets a table of its own from user ID to
+// users[]; below that a scan of the IDs is as quick. A revoke rebuilds the table,
+// since the users after it move up. A file's grants start with
+// ACL_INITIAL_USERS slots and double as they fill.
+
+// User IDs are dense, so a multiplicative mix spreads them over the table
+static inline uint32_t user_hash(uint32_t user) {
+    return user * 2654435761u;
+}
+
+static void user_index_insert(FileRecord *acl, int position, uint32_t hash) {
+    int mask = acl->user_index_size - 1;
+    int slot = (int)(hash & (uint32_t)mask);
+    while (acl->user_index[slot].position != 0) slot = (slot + 1) & mask;
+    acl->user_index[slot].hash = hash;
+    acl->user_index[slot].position = position + 1;
+}
+
+// (Re)build a file's user table for its current users, at least twice as
+// big as needed. Without memory the file goes back to being scanned.
+static void user_index_rebuild(FileRecord *acl) {
+    int size = acl->user_index_size > 0 ? acl->user_index_size : 32;
+    while (size < acl->user_count * 2 + 2) size *= 2;
+
+    NameSlot *slots = calloc((size_t)size, sizeof(NameSlot));
+    free(acl->user_index);
+    acl->user_index = slots;
+    acl->user_index_size = slots ? size : 0;
+    if (!slots) return;
+
+    for (int i = 0; i < acl->user_count; i++) {
+        user_index_insert(acl, i, user_hash(acl->users[i]));
+    }
+}
+
+// Position of user in acl->users, or -1
+static int find_user(const FileRecord *acl, uint32_t user) {
+    if (user == NAME_NONE) return -1;
+    if (!acl->user_index) {
+        for (int i = 0; i < acl->user_count; i++) {
+            if (acl->users[i] == user) return i;
+        }
+        return -1;
+    }
+
+    int mask = acl->user_index_size - 1;
+    for (int slot = (int)(user_hash(user) & (uint32_t)mask); acl->user_index[slot].position != 0;
+         slot = (slot + 1) & mask) {
+        int i = acl->user_index[slot].position - 1;
+        if (acl->users[i] == user) return i;
+    }
+    return -1;
+}
+
+// Make room for one more grant in acl->users
+static int reserve_user(FileRecord *acl) {
+    if (acl->user_count < acl->user_capacity) return ERR_SUCCESS;
+
+    int capacity = acl->user_capacity > 0 ? acl->user_capacity * 2 : ACL_INITIAL_USERS;
+    uint32_t *users = realloc(acl->users, (size_t)capacity * sizeof(uint32_t));
+    if (!users) return ERR_OUT_OF_MEMORY;
+    acl->users = users;
+
+    int *levels = realloc(acl->access_levels, (size_t)capacity * sizeof(int));
+    if (!levels) return ERR_OUT_OF_MEMORY;
+    acl->access_levels = levels;
+
+    acl->user_capacity = capacity;
     return ERR_SUCCESS;
 }
 
-int add_file_access(AccessControlManager *acl_mgr, const char *filename, 
+// Highest level user has on the file, ACCESS_NONE if none
+int user_access_level(const FileRecord *acl, uint32_t user) {
+    int i = find_user(acl, user);
+    return i < 0 ? ACCESS_NONE : acl->access_levels[i];
+}
+
+int add_file_access(FileCatalog *catalog, const char *filename, 
                    const char *owner) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Adding file access: filename='%s', owner='%s'", filename, owner);
     
-    pthread_mutex_lock(&acl_mgr->acl_lock);
+    // Both names are interned before the stripe is locked
+    uint32_t name = name_intern(filename);
+    uint32_t owner_id = name_intern(owner);
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_wrlock(&stripe->lock);
     
-    int current_count = acl_mgr->acl_count;
-    int max_capacity = MAX_FILES_PER_SS * MAX_STORAGE_SERVERS;
-    
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "ACL capacity check: current=%d, max=%d", current_count, max_capacity);
-    
-    if (current_count >= max_capacity) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "ACL capacity exceeded: filename='%s', current=%d, max=%d", 
-                   filename, current_count, max_capacity);
-        pthread_mutex_unlock(&acl_mgr->acl_lock);
-        return ERR_MAX_FILES_REACHED;
+    // Check if already exists. A file its SS reported before it had an
+    // ACL is claimed by its creator.
+    FileRecord *acl = catalog_record_locked(catalog, name);
+    if (acl && acl->owner != NAME_NONE) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "ACL already exists: filename='%s', existing_owner='%s', requested_owner='%s'", 
+                   filename, name_of(acl->owner), owner);
+        pthread_rwlock_unlock(&stripe->lock);
+        return ERR_FILE_ALREADY_EXISTS;
     }
     
-    // Check if already exists
-    for (int i = 0; i < current_count; i++) {
-        if (strcmp(acl_mgr->acl_list[i].filename, filename) == 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "ACL already exists: filename='%s', existing_owner='%s', requested_owner='%s'", 
-                       filename, acl_mgr->acl_list[i].owner, owner);
-            pthread_mutex_unlock(&acl_mgr->acl_lock);
-            return ERR_FILE_ALREADY_EXISTS;
-        }
+    if (!acl) {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                   "No existing ACL found, creating new entry: filename='%s'", filename);
+        acl = catalog_insert_locked(catalog, name);
     }
     
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "No existing ACL found, creating new entry: filename='%s'", filename);
+    if (!acl || owner_id == NAME_NONE || reserve_user(acl) != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "ACL allocation failed: filename='%s', stripe_records=%d", 
+                   filename, stripe->record_count);
+        pthread_rwlock_unlock(&stripe->lock);
+        return ERR_OUT_OF_MEMORY;
+    }
     
-    // Add new ACL
-    FileAccessControl *acl = &acl_mgr->acl_list[acl_mgr->acl_count];
-    strncpy(acl->filename, filename, MAX_FILENAME_LENGTH - 1);
-    acl->filename[MAX_FILENAME_LENGTH - 1] = '\0';
-    strncpy(acl->owner, owner, MAX_USERNAME_LENGTH - 1);
-    acl->owner[MAX_USERNAME_LENGTH - 1] = '\0';
+    acl->owner = owner_id;
     
     // Owner gets full access
-    strncpy(acl->users[0], owner, MAX_USERNAME_LENGTH - 1);
-    acl->users[0][MAX_USERNAME_LENGTH - 1] = '\0';
+    acl->users[0] = owner_id;
     acl->access_levels[0] = ACCESS_OWNER;
     acl->user_count = 1;
     
-    acl_mgr->acl_count++;
-    
-    pthread_mutex_unlock(&acl_mgr->acl_lock);
+    pthread_rwlock_unlock(&stripe->lock);
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "ACL created: filename='%s', owner='%s', total_acls=%d", 
-               filename, owner, acl_mgr->acl_count);
+               "ACL created: filename='%s', owner='%s'", filename, owner);
     
     printf("  ✓ ACL created for '%s' (owner: %s)\n", filename, owner);
     return ERR_SUCCESS;
 }
 
-int grant_access(AccessControlManager *acl_mgr, const char *filename, 
-                const char *username, int access_level) {
+// ============================================================================
+// LOCK-HELD VARIANTS
+// ============================================================================
+// The *_locked functions expect the filename's catalog stripe to be locked
+// (for writing, to grant or revoke), so a BATCH can check and change access
+// for all its commands in one pass. The plain versions lock the stripe
+// around a single call: shared for checks, which run concurrently,
+// exclusive for changes.
+
+// The file's record, if it has an ACL
+static FileRecord* find_acl_locked(FileCatalog *catalog, const char *filename) {
+    FileRecord *acl = catalog_find_locked(catalog, filename);
+    return acl && acl->owner != NAME_NONE ? acl : NULL;
+}
+
+int grant_access_locked(FileCatalog *catalog, const char *filename, 
+                        const char *username, int access_level) {
     const char *level_str = (access_level == ACCESS_READ) ? "READ" : 
                            (access_level == ACCESS_WRITE) ? "WRITE" : 
                            (access_level == ACCESS_READ_WRITE) ? "READ_WRITE" : "UNKNOWN";
@@ -86,152 +161,131 @@ int grant_access(AccessControlManager *acl_mgr, const char *filename,
                "Granting access: filename='%s', username='%s', level=%s(%d)", 
                filename, username, level_str, access_level);
     
-    pthread_mutex_lock(&acl_mgr->acl_lock);
-    
-    FileAccessControl *acl = NULL;
-    int acl_index = -1;
-    
-    for (int i = 0; i < acl_mgr->acl_count; i++) {
-        if (strcmp(acl_mgr->acl_list[i].filename, filename) == 0) {
-            acl = &acl_mgr->acl_list[i];
-            acl_index = i;
-            break;
-        }
-    }
+    FileRecord *acl = find_acl_locked(catalog, filename);
     
     if (!acl) {
         log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                    "Grant access failed: ACL not found for filename='%s'", filename);
-        pthread_mutex_unlock(&acl_mgr->acl_lock);
         return ERR_FILE_NOT_FOUND;
     }
     
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "ACL found: filename='%s', index=%d, owner='%s', user_count=%d", 
-               filename, acl_index, acl->owner, acl->user_count);
+               "ACL found: filename='%s', owner='%s', user_count=%d", 
+               filename, name_of(acl->owner), acl->user_count);
+    
+    uint32_t user = name_intern(username);
+    if (user == NAME_NONE) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "Grant access failed: Out of memory for username='%s'", username);
+        return ERR_OUT_OF_MEMORY;
+    }
     
     // Check if user already has access - update level
-    for (int i = 0; i < acl->user_count; i++) {
-        if (strcmp(acl->users[i], username) == 0) {
-            int old_level = acl->access_levels[i];
-            const char *old_level_str = (old_level == ACCESS_READ) ? "READ" : 
-                                       (old_level == ACCESS_WRITE) ? "WRITE" : 
-                                       (old_level == ACCESS_READ_WRITE) ? "READ_WRITE" : 
-                                       (old_level == ACCESS_OWNER) ? "OWNER" : "UNKNOWN";
-            
-            acl->access_levels[i] = access_level;
-            
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Access level updated: filename='%s', username='%s', old=%s(%d), new=%s(%d)", 
-                       filename, username, old_level_str, old_level, level_str, access_level);
-            
-            pthread_mutex_unlock(&acl_mgr->acl_lock);
-            return ERR_SUCCESS;
-        }
+    int existing = find_user(acl, user);
+    if (existing >= 0) {
+        int old_level = acl->access_levels[existing];
+        const char *old_level_str = (old_level == ACCESS_READ) ? "READ" : 
+                                   (old_level == ACCESS_WRITE) ? "WRITE" : 
+                                   (old_level == ACCESS_READ_WRITE) ? "READ_WRITE" : 
+                                   (old_level == ACCESS_OWNER) ? "OWNER" : "UNKNOWN";
+        
+        acl->access_levels[existing] = access_level;
+        
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+                   "Access level updated: filename='%s', username='%s', old=%s(%d), new=%s(%d)", 
+                   filename, username, old_level_str, old_level, level_str, access_level);
+        
+        return ERR_SUCCESS;
     }
     
     // Add new user
-    if (acl->user_count >= MAX_USERS) {
+    if (reserve_user(acl) != ERR_SUCCESS) {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Grant access failed: Max users reached for filename='%s' (max=%d)", 
-                   filename, MAX_USERS);
-        pthread_mutex_unlock(&acl_mgr->acl_lock);
-        return ERR_MAX_CLIENTS_REACHED;
+                   "Grant access failed: Out of memory for filename='%s' (user_count=%d)", 
+                   filename, acl->user_count);
+        return ERR_OUT_OF_MEMORY;
     }
     
     int user_index = acl->user_count;
-    strncpy(acl->users[user_index], username, MAX_USERNAME_LENGTH - 1);
-    acl->users[user_index][MAX_USERNAME_LENGTH - 1] = '\0';
+    acl->users[user_index] = user;
     acl->access_levels[user_index] = access_level;
     acl->user_count++;
     
+    if (acl->user_index && acl->user_count * 2 <= acl->user_index_size) {
+        user_index_insert(acl, user_index, user_hash(user));
+    } else if (acl->user_count > ACL_USER_SCAN_LIMIT) {
+        user_index_rebuild(acl);
+    }
+    
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Access granted: filename='%s', username='%s', level=%s(%d), user_count=%d", 
                filename, username, level_str, access_level, acl->user_count);
     
-    pthread_mutex_unlock(&acl_mgr->acl_lock);
     return ERR_SUCCESS;
 }
 
-int revoke_access(AccessControlManager *acl_mgr, const char *filename, 
-                 const char *username) {
+int revoke_access_locked(FileCatalog *catalog, const char *filename, 
+                         const char *username) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Revoking access: filename='%s', username='%s'", filename, username);
     
-    pthread_mutex_lock(&acl_mgr->acl_lock);
-    
-    FileAccessControl *acl = NULL;
-    int acl_index = -1;
-    
-    for (int i = 0; i < acl_mgr->acl_count; i++) {
-        if (strcmp(acl_mgr->acl_list[i].filename, filename) == 0) {
-            acl = &acl_mgr->acl_list[i];
-            acl_index = i;
-            break;
-        }
-    }
+    FileRecord *acl = find_acl_locked(catalog, filename);
     
     if (!acl) {
         log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                    "Revoke access failed: ACL not found for filename='%s'", filename);
-        pthread_mutex_unlock(&acl_mgr->acl_lock);
         return ERR_FILE_NOT_FOUND;
     }
     
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "ACL found: filename='%s', index=%d, user_count=%d", 
-               filename, acl_index, acl->user_count);
+               "ACL found: filename='%s', user_count=%d", 
+               filename, acl->user_count);
     
-    // Find and remove user (shift array)
-    for (int i = 0; i < acl->user_count; i++) {
-        if (strcmp(acl->users[i], username) == 0) {
-            int user_level = acl->access_levels[i];
-            
-            // Don't remove owner
-            if (user_level == ACCESS_OWNER) {
-                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "Revoke access denied: Cannot revoke owner access - filename='%s', username='%s'", 
-                           filename, username);
-                pthread_mutex_unlock(&acl_mgr->acl_lock);
-                return ERR_PERMISSION_DENIED;
-            }
-            
-            const char *level_str = (user_level == ACCESS_READ) ? "READ" : 
-                                   (user_level == ACCESS_WRITE) ? "WRITE" : 
-                                   (user_level == ACCESS_READ_WRITE) ? "READ_WRITE" : "UNKNOWN";
-            
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "Removing user: filename='%s', username='%s', level=%s(%d), position=%d", 
-                       filename, username, level_str, user_level, i);
-            
-            // Shift remaining users
-            int shifted_count = 0;
-            for (int j = i; j < acl->user_count - 1; j++) {
-                strcpy(acl->users[j], acl->users[j + 1]);
-                acl->access_levels[j] = acl->access_levels[j + 1];
-                shifted_count++;
-            }
-            acl->user_count--;
-            
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Access revoked: filename='%s', username='%s', shifted=%d users, new_count=%d", 
-                       filename, username, shifted_count, acl->user_count);
-            
-            pthread_mutex_unlock(&acl_mgr->acl_lock);
-            return ERR_SUCCESS;
-        }
+    int i = find_user(acl, name_lookup(username));
+    if (i < 0) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Revoke access failed: User not found in ACL - filename='%s', username='%s'", 
+                   filename, username);
+        return ERR_USER_NOT_FOUND;
+    }
+    
+    int user_level = acl->access_levels[i];
+    
+    // Don't remove owner
+    if (user_level == ACCESS_OWNER) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Revoke access denied: Cannot revoke owner access - filename='%s', username='%s'", 
+                   filename, username);
+        return ERR_PERMISSION_DENIED;
     }
     
-    log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-               "Revoke access failed: User not found in ACL - filename='%s', username='%s'", 
-               filename, username);
+    const char *level_str = (user_level == ACCESS_READ) ? "READ" : 
+                           (user_level == ACCESS_WRITE) ? "WRITE" : 
+                           (user_level == ACCESS_READ_WRITE) ? "READ_WRITE" : "UNKNOWN";
     
-    pthread_mutex_unlock(&acl_mgr->acl_lock);
-    return ERR_USER_NOT_FOUND;
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+               "Removing user: filename='%s', username='%s', level=%s(%d), position=%d", 
+               filename, username, level_str, user_level, i);
+    
+    // Shift remaining users
+    int shifted_count = 0;
+    for (int j = i; j < acl->user_count - 1; j++) {
+        acl->users[j] = acl->users[j + 1];
+        acl->access_levels[j] = acl->access_levels[j + 1];
+        shifted_count++;
+    }
+    acl->user_count--;
+    if (acl->user_index) user_index_rebuild(acl);
+    
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "Access revoked: filename='%s', username='%s', shifted=%d users, new_count=%d", 
+               filename, username, shifted_count, acl->user_count);
+    
+    return ERR_SUCCESS;
 }
 
-int check_access(AccessControlManager *acl_mgr, const char *filename, 
-                const char *username, int required_level) {
+int check_access_locked(FileCatalog *catalog, const char *filename, 
+                        const char *username, int required_level) {
     const char *required_str = (required_level == ACCESS_READ) ? "READ" : 
                               (required_level == ACCESS_WRITE) ? "WRITE" : 
                               (required_level == ACCESS_READ_WRITE) ? "READ_WRITE" : "UNKNOWN";
@@ -240,90 +294,101 @@ int check_access(AccessControlManager *acl_mgr, const char *filename,
                "Checking access: filename='%s', username='%s', required_level=%s(%d)", 
                filename, username, required_str, required_level);
     
-    pthread_mutex_lock(&acl_mgr->acl_lock);
-    
-    FileAccessControl *acl = NULL;
-    int search_count = 0;
-    
-    for (int i = 0; i < acl_mgr->acl_count; i++) {
-        search_count++;
-        if (strcmp(acl_mgr->acl_list[i].filename, filename) == 0) {
-            acl = &acl_mgr->acl_list[i];
-            break;
-        }
-    }
+    FileRecord *acl = find_acl_locked(catalog, filename);
     
     if (!acl) {
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Access denied: No ACL found - filename='%s', searched=%d entries", 
-                   filename, search_count);
-        pthread_mutex_unlock(&acl_mgr->acl_lock);
+                   "Access denied: No ACL found - filename='%s'", filename);
         return 0;  // No ACL = no access
     }
     
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "ACL found: filename='%s', owner='%s', user_count=%d", 
-               filename, acl->owner, acl->user_count);
+               filename, name_of(acl->owner), acl->user_count);
     
     // Check user access
-    for (int i = 0; i < acl->user_count; i++) {
-        if (strcmp(acl->users[i], username) == 0) {
-            int user_level = acl->access_levels[i];
-            const char *user_level_str = (user_level == ACCESS_READ) ? "READ" : 
-                                        (user_level == ACCESS_WRITE) ? "WRITE" : 
-                                        (user_level == ACCESS_READ_WRITE) ? "READ_WRITE" : 
-                                        (user_level == ACCESS_OWNER) ? "OWNER" : "UNKNOWN";
-            
-            pthread_mutex_unlock(&acl_mgr->acl_lock);
-            
-            // ACCESS_OWNER (3) >= ACCESS_WRITE (2) >= ACCESS_READ (1)
-            int has_access = (user_level >= required_level);
-            
-            if (has_access) {
-                log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                           "Access granted: filename='%s', username='%s', has=%s(%d), required=%s(%d)", 
-                           filename, username, user_level_str, user_level, required_str, required_level);
-            } else {
-                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "Access denied: Insufficient permissions - filename='%s', username='%s', has=%s(%d), required=%s(%d)", 
-                           filename, username, user_level_str, user_level, required_str, required_level);
-            }
-            
-            return has_access;
-        }
+    int i = find_user(acl, name_lookup(username));
+    if (i < 0) {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                   "Access denied: User not in ACL - filename='%s', username='%s'", 
+                   filename, username);
+        return 0;  // User not in ACL
     }
     
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Access denied: User not in ACL - filename='%s', username='%s'", 
-               filename, username);
+    int user_level = acl->access_levels[i];
+    const char *user_level_str = (user_level == ACCESS_READ) ? "READ" : 
+                                (user_level == ACCESS_WRITE) ? "WRITE" : 
+                                (user_level == ACCESS_READ_WRITE) ? "READ_WRITE" : 
+                                (user_level == ACCESS_OWNER) ? "OWNER" : "UNKNOWN";
+    
+    // ACCESS_OWNER (3) >= ACCESS_WRITE (2) >= ACCESS_READ (1)
+    int has_access = (user_level >= required_level);
+    
+    if (has_access) {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                   "Access granted: filename='%s', username='%s', has=%s(%d), required=%s(%d)", 
+                   filename, username, user_level_str, user_level, required_str, required_level);
+    } else {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Access denied: Insufficient permissions - filename='%s', username='%s', has=%s(%d), required=%s(%d)", 
+                   filename, username, user_level_str, user_level, required_str, required_level);
+    }
     
-    pthread_mutex_unlock(&acl_mgr->acl_lock);
-    return 0;  // User not in ACL
+    return has_access;
 }
 
-FileAccessControl* get_file_acl(AccessControlManager *acl_mgr, const char *filename) {
+FileRecord* get_file_acl_locked(FileCatalog *catalog, const char *filename) {
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Getting file ACL: filename='%s'", filename);
     
-    pthread_mutex_lock(&acl_mgr->acl_lock);
+    FileRecord *acl = find_acl_locked(catalog, filename);
     
-    int search_count = 0;
-    
-    for (int i = 0; i < acl_mgr->acl_count; i++) {
-        search_count++;
-        if (strcmp(acl_mgr->acl_list[i].filename, filename) == 0) {
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "ACL found: filename='%s', owner='%s', user_count=%d, searched=%d", 
-                       filename, acl_mgr->acl_list[i].owner, 
-                       acl_mgr->acl_list[i].user_count, search_count);
-            pthread_mutex_unlock(&acl_mgr->acl_lock);
-            return &acl_mgr->acl_list[i];
-        }
+    if (acl) {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                   "ACL found: filename='%s', owner='%s', user_count=%d", 
+                   filename, name_of(acl->owner), acl->user_count);
+    } else {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                   "ACL not found: filename='%s'", filename);
     }
-    
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "ACL not found: filename='%s', searched=%d entries", filename, search_count);
-    
-    pthread_mutex_unlock(&acl_mgr->acl_lock);
-    return NULL;
+    return acl;
+}
+
+// ============================================================================
+// SINGLE CALLS
+// ============================================================================
+
+int grant_access(FileCatalog *catalog, const char *filename, 
+                const char *username, int access_level) {
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_wrlock(&stripe->lock);
+    int result = grant_access_locked(catalog, filename, username, access_level);
+    pthread_rwlock_unlock(&stripe->lock);
+    return result;
+}
+
+int revoke_access(FileCatalog *catalog, const char *filename, 
+                 const char *username) {
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_wrlock(&stripe->lock);
+    int result = revoke_access_locked(catalog, filename, username);
+    pthread_rwlock_unlock(&stripe->lock);
+    return result;
+}
+
+int check_access(FileCatalog *catalog, const char *filename, 
+                const char *username, int required_level) {
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_rdlock(&stripe->lock);
+    int has_access = check_access_locked(catalog, filename, username, required_level);
+    pthread_rwlock_unlock(&stripe->lock);
+    return has_access;
+}
+
+FileRecord* get_file_acl(FileCatalog *catalog, const char *filename) {
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_rdlock(&stripe->lock);
+    FileRecord *acl = get_file_acl_locked(catalog, filename);
+    pthread_rwlock_unlock(&stripe->lock);
+    return acl;
 }
@@ -3,36 +3,39 @@
 #define ACL_CACHE_FILE ".ns_acl_cache.dat"
 
 // Save ACL to disk
-int save_acl_cache(AccessControlManager *acl_mgr) {
+int save_acl_cache(FileCatalog *catalog) {
     FILE *fp = fopen(ACL_CACHE_FILE, "w");
     if (!fp) {
         perror("Failed to save ACL cache");
         return -1;
     }
 
-    pthread_mutex_lock(&acl_mgr->acl_lock);
-
     int saved_count = 0;
 
-    // Iterate through ACL list
-    for (int i = 0; i < acl_mgr->acl_count; i++) {
-        FileAccessControl *acl = &acl_mgr->acl_list[i];
-
-        // Format: filename|owner|user1:access1,user2:access2,...
-        fprintf(fp, "%s|%s|", acl->filename, acl->owner);
-
-        // Write access list for users
-        for (int j = 0; j < acl->user_count; j++) {
-            fprintf(fp, "%s:%d", acl->users[j], acl->access_levels[j]);
-            if (j < acl->user_count - 1) {
-                fprintf(fp, ",");
+    // Iterate through ACL list, a stripe at a time
+    for (int i = 0; i < CATALOG_STRIPES; i++) {
+        CatalogStripe *stripe = &catalog->stripes[i];
+        pthread_rwlock_rdlock(&stripe->lock);
+        for (int j = 0; j < stripe->record_count; j++) {
+            FileRecord *acl = stripe->records[j];
+            if (acl->owner == NAME_NONE) continue;   // No ACL
+
+            // Format: filename|owner|user1:access1,user2:access2,...
+            fprintf(fp, "%s|%s|", name_of(acl->name), name_of(acl->owner));
+
+            // Write access list for users
+            for (int k = 0; k < acl->user_count; k++) {
+                fprintf(fp, "%s:%d", name_of(acl->users[k]), acl->access_levels[k]);
+                if (k < acl->user_count - 1) {
+                    fprintf(fp, ",");
+                }
             }
+            fprintf(fp, "\n");
+            saved_count++;
         }
-        fprintf(fp, "\n");
-        saved_count++;
+        pthread_rwlock_unlock(&stripe->lock);
     }
 
-    pthread_mutex_unlock(&acl_mgr->acl_lock);
     fclose(fp);
 
     printf("  → Saved %d ACL entries to cache\n", saved_count);
@@ -40,17 +43,19 @@ int save_acl_cache(AccessControlManager *acl_mgr) {
 }
 
 // Load ACL from disk
-int load_acl_cache(AccessControlManager *acl_mgr) {
+int load_acl_cache(FileCatalog *catalog) {
     FILE *fp = fopen(ACL_CACHE_FILE, "r");
     if (!fp) {
         printf("  → No ACL cache found (first run or clean start)\n");
         return 0;  // Not an error - just no cache
     }
 
-    char line[BUFFER_SIZE];
+    // A file's grant list has no length limit, so neither do lines
+    char *line = NULL;
+    size_t line_size = 0;
     int restored = 0;
 
-    while (fgets(line, sizeof(line), fp)) {
+    while (getline(&line, &line_size, fp) != -1) {
         // Remove newline
         char *nl = strchr(line, '\n');
         if (nl) *nl = '\0';
@@ -67,15 +72,12 @@ int load_acl_cache(AccessControlManager *acl_mgr) {
         if (!filename || !owner) continue;
 
         // Add file with owner (this creates the ACL entry)
-        add_file_access(acl_mgr, filename, owner);
+        add_file_access(catalog, filename, owner);
 
         // Parse and add other users' access
         if (access_list && strlen(access_list) > 0) {
-            char access_copy[BUFFER_SIZE];
-            strncpy(access_copy, access_list, sizeof(access_copy) - 1);
-            access_copy[sizeof(access_copy) - 1] = '\0';
-
-            char *user_access = strtok(access_copy, ",");
+            char *list_saveptr;
+            char *user_access = strtok_r(access_list, ",", &list_saveptr);
             while (user_access) {
                 char *colon = strchr(user_access, ':');
                 if (colon) {
@@ -84,15 +86,16 @@ int load_acl_cache(AccessControlManager *acl_mgr) {
                     int access_level = atoi(colon + 1);
 
                     // Grant access to this user
-                    grant_access(acl_mgr, filename, username, access_level);
+                    grant_access(catalog, filename, username, access_level);
                 }
-                user_access = strtok(NULL, ",");
+                user_access = strtok_r(NULL, ",", &list_saveptr);
             }
         }
 
         restored++;
     }
 
+    free(line);
     fclose(fp);
     printf("  → Restored %d ACL entries from cache\n", restored);
     return restored;
@@ -0,0 +1,308 @@
+#include "../include/nameserver.h"
+
+// External log file handle
+extern FILE* log_file;
+
+// ============================================================================
+// FILE CATALOG
+// ============================================================================
+// One record per file: its ACL, where it lives and what is cached about it.
+// Filenames are interned in the name table, so finding a record is one
+// name table lookup and then an index by the filename's ID.
+//
+// Records are split into CATALOG_STRIPES stripes by the top bits of the
+// filename's hash, each with its own read-write lock, so a READ's access
+// check and redirect happen under one shared stripe lock and a CREATE
+// only excludes lookups of the files in its stripe. The stripe follows
+// from the string, so a lookup can pick it before it knows the name's ID.
+// Records are never removed.
+//
+// The ID -> record index is chunked like the name table's strings: a
+// chunk is allocated once and never moves, so growing it never holds up a
+// lookup. A record's slot is written and read under its stripe's lock.
+//
+// Lock order: stripes in increasing order, then the name table's or the
+// SS list's. Names are interned before a stripe is locked, so a CREATE
+// never grows a name stripe with a catalog stripe held.
+//
+// Memory follows what is stored: the record lists start small and double
+// as they fill, and index chunks are allocated as IDs reach them, so there
+// is no cap on files.
+
+static void free_record(FileRecord *record) {
+    free(record->users);
+    free(record->access_levels);
+    free(record->user_index);
+    free(record);
+}
+
+int init_catalog(FileCatalog *catalog) {
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Initializing file catalog");
+
+    for (int i = 0; i < CATALOG_STRIPES; i++) {
+        CatalogStripe *stripe = &catalog->stripes[i];
+        stripe->records = NULL;
+        stripe->record_count = 0;
+        stripe->record_capacity = 0;
+        pthread_rwlock_init(&stripe->lock, NULL);
+    }
+    memset(catalog->by_name, 0, sizeof(catalog->by_name));
+    pthread_mutex_init(&catalog->chunk_lock, NULL);
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "File catalog initialized: stripes=%d", CATALOG_STRIPES);
+
+    return ERR_SUCCESS;
+}
+
+// Frees every record, the lists and index, and the locks
+void cleanup_catalog(FileCatalog *catalog) {
+    for (int i = 0; i < CATALOG_STRIPES; i++) {
+        CatalogStripe *stripe = &catalog->stripes[i];
+        for (int j = 0; j < stripe->record_count; j++) {
+            free_record(stripe->records[j]);
+        }
+        free(stripe->records);
+        stripe->records = NULL;
+        stripe->record_count = 0;
+        stripe->record_capacity = 0;
+        pthread_rwlock_destroy(&stripe->lock);
+    }
+    for (int i = 0; i < NAME_MAX_CHUNKS; i++) {
+        free(catalog->by_name[i]);
+        catalog->by_name[i] = NULL;
+    }
+    pthread_mutex_destroy(&catalog->chunk_lock);
+}
+
+CatalogStripe* catalog_stripe(FileCatalog *catalog, const char *filename) {
+    return &catalog->stripes[name_hash(filename) >> (32 - CATALOG_STRIPE_BITS)];
+}
+
+// filename's stripe as a bit of the set catalog_lock_stripes() takes
+uint32_t catalog_stripe_bit(const char *filename) {
+    return 1u << (name_hash(filename) >> (32 - CATALOG_STRIPE_BITS));
+}
+
+// Lock every stripe in the set, in increasing order so two BATCHes can't
+// deadlock
+void catalog_lock_stripes(FileCatalog *catalog, uint32_t stripes, int exclusive) {
+    for (int i = 0; i < CATALOG_STRIPES; i++) {
+        if (!(stripes & (1u << i))) continue;
+        if (exclusive) {
+            pthread_rwlock_wrlock(&catalog->stripes[i].lock);
+        } else {
+            pthread_rwlock_rdlock(&catalog->stripes[i].lock);
+        }
+    }
+}
+
+void catalog_unlock_stripes(FileCatalog *catalog, uint32_t stripes) {
+    for (int i = CATALOG_STRIPES - 1; i >= 0; i--) {
+        if (stripes & (1u << i)) pthread_rwlock_unlock(&catalog->stripes[i].lock);
+    }
+}
+
+FileRecord* catalog_record_locked(FileCatalog *catalog, uint32_t name) {
+    if (name == NAME_NONE) return NULL;
+    FileRecord **chunk = __atomic_load_n(&catalog->by_name[name / NAME_CHUNK_SIZE],
+                                         __ATOMIC_ACQUIRE);
+    return chunk ? chunk[name % NAME_CHUNK_SIZE] : NULL;
+}
+
+FileRecord* catalog_find_locked(FileCatalog *catalog, const char *filename) {
+    return catalog_record_locked(catalog, name_lookup(filename));
+}
+
+// A new record for a filename not in the catalog: no owner, no location.
+// NULL without memory.
+FileRecord* catalog_insert_locked(FileCatalog *catalog, uint32_t name) {
+    if (name == NAME_NONE) return NULL;
+    CatalogStripe *stripe = catalog_stripe(catalog, name_of(name));
+
+    // Make room in the stripe's list, and the index chunk for this ID
+    if (stripe->record_count == stripe->record_capacity) {
+        int capacity = stripe->record_capacity > 0 ? stripe->record_capacity * 2 : 16;
+        FileRecord **records = realloc(stripe->records, (size_t)capacity * sizeof(*records));
+        if (!records) return NULL;
+        stripe->records = records;
+        stripe->record_capacity = capacity;
+    }
+    FileRecord ***by_name = &catalog->by_name[name / NAME_CHUNK_SIZE];
+    FileRecord **chunk = __atomic_load_n(by_name, __ATOMIC_ACQUIRE);
+    if (!chunk) {
+        // Other stripes share the chunk
+        pthread_mutex_lock(&catalog->chunk_lock);
+        chunk = *by_name;
+        if (!chunk) {
+            chunk = calloc(NAME_CHUNK_SIZE, sizeof(FileRecord*));
+            __atomic_store_n(by_name, chunk, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&catalog->chunk_lock);
+        if (!chunk) return NULL;
+    }
+
+    FileRecord *record = calloc(1, sizeof(FileRecord));
+    if (!record) return NULL;
+    record->name = name;
+    record->primary_ss_id = -1;
+    record->version = 1;
+
+    stripe->records[stripe->record_count++] = record;
+    chunk[name % NAME_CHUNK_SIZE] = record;
+    return record;
+}
+
+// ============================================================================
+// LOCATIONS
+// ============================================================================
+
+// Record that location's SS holds filename, adding the file if it is new.
+// The SS is checked under the stripe's write lock: handle_ss_failure drops
+// it from the SS list before it clears its files here, stripe by stripe,
+// so a location set for a failed SS either is refused or is cleared after.
+int catalog_set_location(NameServerConfig *config, const char *filename,
+                         const FileLocation *location) {
+    FileCatalog *catalog = &config->catalog;
+    uint32_t name = name_intern(filename);
+    if (name == NAME_NONE) return ERR_OUT_OF_MEMORY;
+
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_wrlock(&stripe->lock);
+
+    if (!ss_session_registered(config, location->ss_id)) {
+        pthread_rwlock_unlock(&stripe->lock);
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "File not located: filename='%s', SS#%d is gone",
+                   filename, location->ss_id);
+        return ERR_SS_NOT_REGISTERED;
+    }
+
+    FileRecord *record = catalog_record_locked(catalog, name);
+    if (!record) record = catalog_insert_locked(catalog, name);
+    if (!record) {
+        pthread_rwlock_unlock(&stripe->lock);
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Catalog insert failed: filename='%s', stripe_records=%d",
+                   filename, stripe->record_count);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    if (record->primary_ss_id != location->ss_id) {
+        record->primary_ss_id = location->ss_id;
+        record->version++;
+    }
+    strncpy(record->ss_ip, location->ip, INET_ADDRSTRLEN - 1);
+    record->ss_ip[INET_ADDRSTRLEN - 1] = '\0';
+    record->ss_client_port = location->client_port;
+
+    pthread_rwlock_unlock(&stripe->lock);
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "File located: filename='%s', ss_id=%d (%s:%d)",
+               filename, location->ss_id, location->ip, location->client_port);
+    return ERR_SUCCESS;
+}
+
+// The file is gone from its SS. Its ACL stays.
+int catalog_clear_location(FileCatalog *catalog, const char *filename) {
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_wrlock(&stripe->lock);
+    FileRecord *record = catalog_find_locked(catalog, filename);
+    int result = ERR_FILE_NOT_FOUND;
+    if (record && record->primary_ss_id >= 0) {
+        record->primary_ss_id = -1;
+        record->version++;
+        result = ERR_SUCCESS;
+    }
+    pthread_rwlock_unlock(&stripe->lock);
+    return result;
+}
+
+// An SS failed: every file it held is lost. Returns how many.
+int catalog_drop_ss(FileCatalog *catalog, int ss_id) {
+    int lost = 0;
+    for (int i = 0; i < CATALOG_STRIPES; i++) {
+        CatalogStripe *stripe = &catalog->stripes[i];
+        pthread_rwlock_wrlock(&stripe->lock);
+        for (int j = 0; j < stripe->record_count; j++) {
+            FileRecord *record = stripe->records[j];
+            if (record->primary_ss_id == ss_id) {
+                printf("    ✗ File '%s' lost\n", name_of(record->name));
+                record->primary_ss_id = -1;
+                record->version++;
+                lost++;
+            }
+        }
+        pthread_rwlock_unlock(&stripe->lock);
+    }
+    return lost;
+}
+
+// The SS reported a change, so cached metadata is stale
+void catalog_file_updated(FileCatalog *catalog, const char *filename) {
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_wrlock(&stripe->lock);
+    FileRecord *record = catalog_find_locked(catalog, filename);
+    if (record) record->version++;
+    pthread_rwlock_unlock(&stripe->lock);
+}
+
+// Keep what an INFO reported, unless the file changed since version was
+// resolved
+void catalog_cache_stats(FileCatalog *catalog, const char *filename, uint32_t version,
+                         size_t size, int words, int chars) {
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_wrlock(&stripe->lock);
+    FileRecord *record = catalog_find_locked(catalog, filename);
+    if (record && record->version == version) {
+        record->stats_version = version;
+        record->cached_size = size;
+        record->cached_words = words;
+        record->cached_chars = chars;
+    }
+    pthread_rwlock_unlock(&stripe->lock);
+}
+
+static int resolve_record(const FileRecord *record, const char *filename, uint32_t user,
+                          int required_level, FileLocation *location) {
+    // No ACL = no access, as check_access() has it
+    if (required_level != ACCESS_NONE &&
+        (!record || user_access_level(record, user) < required_level)) {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                   "Resolve denied: filename='%s', username='%s', required=%d",
+                   filename, name_of(user), required_level);
+        return ERR_PERMISSION_DENIED;
+    }
+    if (!record || record->primary_ss_id < 0) {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                   "Resolve failed: no location for filename='%s'", filename);
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    location->ss_id = record->primary_ss_id;
+    memcpy(location->ip, record->ss_ip, INET_ADDRSTRLEN);
+    location->client_port = record->ss_client_port;
+    location->version = record->version;
+    return ERR_SUCCESS;
+}
+
+int resolve_file_locked(FileCatalog *catalog, const char *filename, uint32_t user,
+                        int required_level, FileLocation *location) {
+    return resolve_record(catalog_find_locked(catalog, filename), filename, user,
+                          required_level, location);
+}
+
+// The name lookup runs before the stripe lock: an ID never changes, and a
+// file created meanwhile is one this request may miss either way
+int resolve_file(FileCatalog *catalog, const char *filename, uint32_t user,
+                 int required_level, FileLocation *location) {
+    uint32_t name = name_lookup(filename);
+    CatalogStripe *stripe = catalog_stripe(catalog, filename);
+    pthread_rwlock_rdlock(&stripe->lock);
+    int result = resolve_record(catalog_record_locked(catalog, name), filename, user,
+                                required_level, location);
+    pthread_rwlock_unlock(&stripe->lock);
+    return result;
+}
@@ -21,11 +21,22 @@ ClientSession* create_client_session(int socket_fd, const char *username,
     session->socket_fd = socket_fd;
     strncpy(session->username, username, MAX_USERNAME_LENGTH - 1);
     session->username[MAX_USERNAME_LENGTH - 1] = '\0';
+    session->user = name_intern(session->username);
+    if (session->user == NAME_NONE) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "Failed to intern username='%s' (out of memory)", username);
+        free(session);
+        return NULL;
+    }
     strncpy(session->ip, ip, INET_ADDRSTRLEN - 1);
     session->ip[INET_ADDRSTRLEN - 1] = '\0';
     session->port = port;
     session->is_active = 1;
     session->connected_time = time(NULL);
+    session->conn = NULL;
+    session->capture = NULL;
+    session->captured_frame = 0;
+    session->pending = NULL;
     session->next = NULL;
 
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
@@ -48,7 +59,7 @@ int add_client_session(NameServerConfig *config, ClientSession *session) {
     
     while (current) {
         duplicate_check_count++;
-        if (strcmp(current->username, session->username) == 0 && current->is_active) {
+        if (current->user == session->user && current->is_active) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "Duplicate login attempt: username='%s', ip=%s:%d, existing_ip=%s:%d", 
                        session->username, session->ip, session->port, 
@@ -82,20 +93,22 @@ int add_client_session(NameServerConfig *config, ClientSession *session) {
     return ERR_SUCCESS;
 }
 
-// Remove session from linked list
+// Remove session from linked list. The socket belongs to the client
+// reactor, which closes it once the connection's handler is done.
 int remove_client_session(NameServerConfig *config, const char *username) {
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Removing client session: username='%s'", username);
     
     pthread_mutex_lock(&config->client_session_lock);
 
+    uint32_t user = name_lookup(username);
     ClientSession *current = config->client_sessions;
     ClientSession *prev = NULL;
     int search_count = 0;
 
     while (current) {
         search_count++;
-        if (strcmp(current->username, username) == 0) {
+        if (current->user == user) {
             // Log session details before removal
             time_t session_duration = time(NULL) - current->connected_time;
             
@@ -111,11 +124,6 @@ int remove_client_session(NameServerConfig *config, const char *username) {
             }
 
             current->is_active = 0;
-            
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "Closing client socket: username='%s', fd=%d", username, current->socket_fd);
-            close(current->socket_fd);
-            
             config->client_session_count--;
             int remaining_count = config->client_session_count;
 
@@ -148,12 +156,13 @@ ClientSession* find_client_session(NameServerConfig *config, const char *usernam
     
     pthread_mutex_lock(&config->client_session_lock);
 
+    uint32_t user = name_lookup(username);
     ClientSession *current = config->client_sessions;
     int search_count = 0;
     
     while (current) {
         search_count++;
-        if (strcmp(current->username, username) == 0 && current->is_active) {
+        if (current->user == user && current->is_active) {
             log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                        "Client session found: username='%s', ip=%s:%d, searched=%d entries", 
                        username, current->ip, current->port, search_count);
@@ -213,100 +222,21 @@ void cleanup_all_sessions(NameServerConfig *config) {
                cleaned_count, avg_duration);
 }
 
-// ✅ FIX: Per-client session handler (runs in separate thread)
-void* handle_client_session(void *arg) {
-    // Extract from proper struct
-    ClientThreadArg *thread_arg = (ClientThreadArg*)arg;
-    ClientSession *session = thread_arg->session;
-    NameServerConfig *config = thread_arg->config;
-    free(thread_arg);  // Clean up immediately
-
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Client session thread started: username='%s', ip=%s:%d, thread_id=%lu", 
-               session->username, session->ip, session->port, pthread_self());
-
-    char buffer[BUFFER_SIZE];
-
-    printf("  → Session thread started for '%s'\n", session->username);
-
-    // Send welcome message
-    char welcome[256];
-    snprintf(welcome, sizeof(welcome), 
-             "SUCCESS|Welcome %s! Connected to LangOS Name Server.\n", 
-             session->username);
-    send(session->socket_fd, welcome, strlen(welcome), 0);
-    
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Welcome message sent: username='%s'", session->username);
-
-    int command_count = 0;
-    int empty_messages = 0;
-
-    // Command loop - THIS IS THE KEY DIFFERENCE
-    while (session->is_active) {
-        memset(buffer, 0, sizeof(buffer));
-        
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Waiting for command from '%s' (commands_processed=%d)", 
-                   session->username, command_count);
-        
-        ssize_t bytes = recv(session->socket_fd, buffer, sizeof(buffer) - 1, 0);
-
-        if (bytes <= 0) {
-            // Client disconnected
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Client disconnected: username='%s', bytes=%zd, commands_processed=%d", 
-                       session->username, bytes, command_count);
-            printf("  ✗ Client '%s' disconnected\n", session->username);
-            break;
-        }
-
-        buffer[bytes] = '\0';
-
-        // Remove newline
-        char *newline = strchr(buffer, '\n');
-        if (newline) *newline = '\0';
-        newline = strchr(buffer, '\r');
-        if (newline) *newline = '\0';
-
-        if (strlen(buffer) == 0) {
-            empty_messages++;
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "Empty message received from '%s' (empty_count=%d)", 
-                       session->username, empty_messages);
-            continue;
-        }
-
-        command_count++;
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "Command received: username='%s', command='%s', count=%d", 
-                   session->username, buffer, command_count);
-
-        printf("  [%s] Command: %s\n", session->username, buffer);
+// Queue a reply to the client; the reactor sends it when the command
+// returns. Only the worker running the session's connection may call this.
+// Inside a BATCH the reply is gathered for the command being run instead.
+int session_send(ClientSession *session, const char *data, size_t length) {
+    if (session->capture) return dynbuf_append(session->capture, data, length);
+    return reactor_send(session->conn, data, length);
+}
 
-        // Handle command
-        handle_session_command(session, config, buffer);
-        
-        // Check if session was terminated by command (e.g., QUIT)
-        if (!session->is_active) {
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Session marked inactive by command: username='%s'", 
-                       session->username);
-        }
+// Queue a frame built with frame_begin() as the reply, as is. On the
+// command pool it is gathered, and sent as the reply once the command is
+// done.
+int session_send_frame(ClientSession *session, DynamicBuffer *frame) {
+    if (session->capture) {
+        session->captured_frame = 1;
+        return dynbuf_append(session->capture, frame->data, frame->length);
     }
-
-    time_t session_duration = time(NULL) - session->connected_time;
-    
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Client session thread ending: username='%s', duration=%ld seconds, commands=%d, empty_messages=%d", 
-               session->username, session_duration, command_count, empty_messages);
-
-    // Cleanup
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Removing client session: username='%s'", session->username);
-    
-    remove_client_session(config, session->username);
-
-    return NULL;
+    return reactor_send_frame(session->conn, frame);
 }
@@ -0,0 +1,183 @@
+#include "../include/nameserver.h"
+
+
+// ============================================================================
+// COMMAND POOL
+// ============================================================================
+// A client's blocking command is copied off its connection and queued here.
+// A pool thread runs it with the session's replies captured, then wakes the
+// connection; its handler sends them and goes on to the next command. The
+// session belongs to whichever side holds the command, so the reactor never
+// runs the session while a pool thread does.
+
+static void free_pending_command(PendingCommand *pending) {
+    free(pending->storage);
+    dynbuf_free(&pending->output);
+    free(pending);
+}
+
+// The connection closed first: its session is still ours to drop
+static void drop_abandoned(NameServerConfig *config, PendingCommand *pending) {
+    ClientSession *session = pending->session;
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Client left during a command: username='%s', command='%s'",
+               session->username, pending->line);
+    remove_client_session(config, session->username);
+    free_pending_command(pending);
+}
+
+static void* command_worker(void *arg) {
+    NameServerConfig *config = (NameServerConfig*)arg;
+    CommandPool *pool = &config->command_pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->stopping) break;
+
+        PendingCommand *pending = pool->head;
+        pool->head = pending->next;
+        if (!pool->head) pool->tail = NULL;
+        pool->queued--;
+        int abandoned = pending->abandoned;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (abandoned) {
+            drop_abandoned(config, pending);
+            pthread_mutex_lock(&pool->lock);
+            continue;
+        }
+
+        ClientSession *session = pending->session;
+        session->capture = &pending->output;
+        session->captured_frame = 0;
+        handle_session_command(session, config, &pending->msg, pending->line);
+        session->capture = NULL;
+
+        // Woken under the pool lock, so the connection can't close between
+        // finding the command done and the wake
+        pthread_mutex_lock(&pool->lock);
+        pending->done = 1;
+        if (pending->abandoned) {
+            pthread_mutex_unlock(&pool->lock);
+            drop_abandoned(config, pending);
+            pthread_mutex_lock(&pool->lock);
+        } else {
+            reactor_wake(session->conn);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int command_pool_start(NameServerConfig *config) {
+    CommandPool *pool = &config->command_pool;
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+
+    for (int i = 0; i < COMMAND_POOL_WORKERS; i++) {
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, command_worker, config) != 0) {
+            break;
+        }
+        pool->thread_count++;
+    }
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Command pool started: workers=%d, queue=%d",
+               pool->thread_count, COMMAND_POOL_QUEUE);
+    return pool->thread_count > 0 ? ERR_SUCCESS : ERR_INITIALIZATION_FAILED;
+}
+
+// Let running commands finish and join the workers; queued ones never run
+void command_pool_stop(NameServerConfig *config) {
+    CommandPool *pool = &config->command_pool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool->thread_count = 0;
+}
+
+// Queue msg, taken from the session's connection but not yet parsed.
+// Returns ERR_SUCCESS, ERR_OUT_OF_MEMORY, or ERR_TIMEOUT if the queue is
+// full. Only the worker running the session's connection may call this.
+int command_pool_submit(NameServerConfig *config, ClientSession *session,
+                        const WireMessage *msg, const char *line) {
+    CommandPool *pool = &config->command_pool;
+
+    PendingCommand *pending = calloc(1, sizeof(PendingCommand));
+    if (!pending) return ERR_OUT_OF_MEMORY;
+    pending->storage = message_copy(&pending->msg, msg);
+    if (!pending->storage) {
+        free(pending);
+        return ERR_OUT_OF_MEMORY;
+    }
+    pending->session = session;
+    snprintf(pending->line, sizeof(pending->line), "%s", line);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->queued >= COMMAND_POOL_QUEUE || pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        free_pending_command(pending);
+        return ERR_TIMEOUT;
+    }
+    if (pool->tail) {
+        pool->tail->next = pending;
+    } else {
+        pool->head = pending;
+    }
+    pool->tail = pending;
+    pool->queued++;
+    session->pending = pending;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return ERR_SUCCESS;
+}
+
+// Send the pending command's replies once it is done. Returns 1 if the
+// session is free for its next command, 0 if the command still runs.
+int command_pool_finish(NameServerConfig *config, ClientSession *session) {
+    CommandPool *pool = &config->command_pool;
+    PendingCommand *pending = session->pending;
+    if (!pending) return 1;
+
+    pthread_mutex_lock(&pool->lock);
+    int done = pending->done;
+    pthread_mutex_unlock(&pool->lock);
+    if (!done) return 0;
+
+    session->pending = NULL;
+    if (session->captured_frame) {
+        session_send_frame(session, &pending->output);
+    } else {
+        reactor_send_buffer(session->conn, &pending->output);
+    }
+    free_pending_command(pending);
+    return 1;
+}
+
+// The session's connection is closing. Returns 1 if a command is still
+// pending: the pool then drops the session when it is done with it.
+int command_pool_abandon(NameServerConfig *config, ClientSession *session) {
+    CommandPool *pool = &config->command_pool;
+    PendingCommand *pending = session->pending;
+    if (!pending) return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    int running = !pending->done;
+    if (running) pending->abandoned = 1;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!running) {
+        session->pending = NULL;
+        free_pending_command(pending);
+    }
+    return running;
+}
@@ -31,24 +31,25 @@ int init_nameserver(NameServerConfig *config, int nm_port, int client_port) {
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Client session structures initialized");
     
-    // Initialize hash table
+    // Initialize the name table, then the file catalog (locations and
+    // ACLs) that refers to files and users by name ID
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Initializing file hash table");
-    init_hash_table(&config->file_table);
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "File hash table initialized");
-    
-    // Initialize ACL manager
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Initializing access control manager");
-    init_access_control(&config->acl_manager);
+               "Initializing file catalog");
+    if (init_names() != ERR_SUCCESS) {
+        perror("Name table initialization failed");
+        return ERR_OUT_OF_MEMORY;
+    }
+    if (init_catalog(&config->catalog) != ERR_SUCCESS) {
+        perror("File catalog initialization failed");
+        return ERR_OUT_OF_MEMORY;
+    }
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Access control manager initialized");
+               "File catalog initialized");
 
     printf("Loading ACL cache...\n");
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Loading ACL cache from persistent storage");
-    load_acl_cache(&config->acl_manager);
+    load_acl_cache(&config->catalog);
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "ACL cache loaded successfully");
     
@@ -98,7 +99,7 @@ int init_nameserver(NameServerConfig *config, int nm_port, int client_port) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Storage server socket bound to port %d", nm_port);
     
-    if (listen(config->nm_socket, 10) < 0) {
+    if (listen(config->nm_socket, SOMAXCONN) < 0) {
         log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL, 
                    "Storage server socket listen failed (errno=%d: %s)", 
                    errno, strerror(errno));
@@ -108,7 +109,7 @@ int init_nameserver(NameServerConfig *config, int nm_port, int client_port) {
     }
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Storage server socket listening (backlog=10)");
+               "Storage server socket listening (backlog=%d)", SOMAXCONN);
     
     // Create socket for clients
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
@@ -157,7 +158,7 @@ int init_nameserver(NameServerConfig *config, int nm_port, int client_port) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Client socket bound to port %d", client_port);
     
-    if (listen(config->client_socket, 10) < 0) {
+    if (listen(config->client_socket, SOMAXCONN) < 0) {
         log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL, 
                    "Client socket listen failed (errno=%d: %s)", 
                    errno, strerror(errno));
@@ -168,7 +169,7 @@ int init_nameserver(NameServerConfig *config, int nm_port, int client_port) {
     }
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Client socket listening (backlog=10)");
+               "Client socket listening (backlog=%d)", SOMAXCONN);
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Name server initialization completed successfully - SS port=%d, Client port=%d", 
@@ -188,7 +189,7 @@ void cleanup_nameserver(NameServerConfig *config) {
     printf("Saving ACL cache...\n");
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Saving ACL cache to persistent storage");
-    save_acl_cache(&config->acl_manager);
+    save_acl_cache(&config->catalog);
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "ACL cache saved successfully");
     
@@ -241,13 +242,6 @@ void cleanup_nameserver(NameServerConfig *config) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Client sessions cleaned up: %d sessions closed", client_sessions_before);
     
-    // Cleanup hash table
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Cleaning up file hash table");
-    cleanup_hash_table(&config->file_table);
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "File hash table cleaned up");
-    
     // Destroy mutexes
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Destroying mutex locks");
@@ -260,9 +254,10 @@ void cleanup_nameserver(NameServerConfig *config) {
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Client session lock destroyed");
     
-    pthread_mutex_destroy(&config->acl_manager.acl_lock);
+    cleanup_catalog(&config->catalog);
+    cleanup_names();
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "ACL manager lock destroyed");
+               "File catalog and name table freed");
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Name server cleanup completed successfully (SS sessions=%d, Client sessions=%d)", 
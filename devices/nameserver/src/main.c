@@ -153,24 +153,6 @@ int main(int argc, char *argv[]) {
                "Client accept thread created: thread_id=%lu", 
                global_config.client_accept_thread);
     
-    // Create heartbeat monitor thread
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Creating heartbeat monitor thread");
-    
-    if (pthread_create(&global_config.heartbeat_thread, NULL, 
-                      monitor_ss_heartbeats, &global_config) != 0) {
-        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL, 
-                   "Failed to create heartbeat monitor thread (errno=%d)", errno);
-        fprintf(stderr, "Failed to create heartbeat thread\n");
-        cleanup_nameserver(&global_config);
-        if (log_file) fclose(log_file);
-        return 1;
-    }
-    
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Heartbeat monitor thread created: thread_id=%lu", 
-               global_config.heartbeat_thread);
-    
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "All threads started successfully - name server operational");
     
@@ -180,7 +162,6 @@ int main(int argc, char *argv[]) {
     
     void *ss_thread_result = NULL;
     void *client_thread_result = NULL;
-    void *heartbeat_thread_result = NULL;
     
     int ss_join = pthread_join(global_config.nm_accept_thread, &ss_thread_result);
     if (ss_join != 0) {
@@ -200,15 +181,6 @@ int main(int argc, char *argv[]) {
                    "Client accept thread joined successfully");
     }
     
-    int heartbeat_join = pthread_join(global_config.heartbeat_thread, &heartbeat_thread_result);
-    if (heartbeat_join != 0) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Heartbeat monitor thread join failed: error=%d", heartbeat_join);
-    } else {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Heartbeat monitor thread joined successfully");
-    }
-    
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "All worker threads terminated, performing cleanup");
     
@@ -0,0 +1,209 @@
+#include "../include/nameserver.h"
+
+// External log file handle
+extern FILE* log_file;
+
+// ============================================================================
+// NAME TABLE
+// ============================================================================
+// Every filename and username the name server holds is stored once here
+// and referred to everywhere else by a dense 32-bit ID. Names are never
+// removed, so an ID stays valid for the life of the process. The string
+// for an ID sits in a chunk that never moves once allocated, so name_of()
+// takes no lock: whoever holds an ID got it after its chunk was published.
+//
+// Finding a name's ID goes through an open-addressing index split into
+// NAME_STRIPES stripes by the top bits of the name's hash. Each stripe has
+// its own read-write lock and grows on its own. Every lookup still takes
+// its stripe's lock, shared, so lookups in one stripe contend on that
+// lock's cache line, and an intern excludes them while it adds its name.
+// A resize rehashes the whole stripe under its write lock, stalling that
+// stripe's lookups for as long (names_bench reports the worst), while the
+// other stripes keep serving. Slots keep the full hash, so a resize never
+// rereads a string.
+//
+// Lock order: a stripe's lock, then id_lock.
+
+NameTable name_table;
+
+// FNV-1a, then the MurmurHash3 finalizer so the top bits (stripe) and low
+// bits (slot) both depend on every byte
+uint32_t name_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static inline NameStripe* name_stripe(uint32_t hash) {
+    return &name_table.stripes[hash >> (32 - NAME_STRIPE_BITS)];
+}
+
+// The name's slot in its stripe: the one holding it, or the empty one
+// where it would go
+static NameSlot* name_slot(NameStripe *stripe, const char *name, uint32_t hash) {
+    int mask = stripe->index_size - 1;
+    int slot = (int)(hash & (uint32_t)mask);
+    while (stripe->index[slot].position != 0) {
+        NameSlot *entry = &stripe->index[slot];
+        if (entry->hash == hash && strcmp(name_of((uint32_t)entry->position), name) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return &stripe->index[slot];
+}
+
+// Double a stripe's index and move its names over by their stored hashes
+static int name_grow_stripe(NameStripe *stripe) {
+    int size = stripe->index_size * 2;
+    NameSlot *slots = calloc((size_t)size, sizeof(NameSlot));
+    if (!slots) return ERR_OUT_OF_MEMORY;
+
+    int mask = size - 1;
+    for (int i = 0; i < stripe->index_size; i++) {
+        if (stripe->index[i].position == 0) continue;
+        int slot = (int)(stripe->index[i].hash & (uint32_t)mask);
+        while (slots[slot].position != 0) slot = (slot + 1) & mask;
+        slots[slot] = stripe->index[i];
+    }
+
+    free(stripe->index);
+    stripe->index = slots;
+    stripe->index_size = size;
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "Name stripe grown: stripe=%d, slots=%d, names=%d",
+               (int)(stripe - name_table.stripes), size, stripe->used);
+    return ERR_SUCCESS;
+}
+
+// Store a copy of name under the next ID. NAME_NONE when full or without
+// memory.
+static uint32_t name_assign(const char *name) {
+    pthread_mutex_lock(&name_table.id_lock);
+
+    uint32_t id = name_table.count + 1;
+    uint32_t chunk = id / NAME_CHUNK_SIZE;
+    if (chunk >= NAME_MAX_CHUNKS) {
+        pthread_mutex_unlock(&name_table.id_lock);
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Name table full: names=%u", name_table.count);
+        return NAME_NONE;
+    }
+    if (!name_table.chunks[chunk]) {
+        name_table.chunks[chunk] = calloc(NAME_CHUNK_SIZE, sizeof(char*));
+    }
+    char *copy = name_table.chunks[chunk] ? strdup(name) : NULL;
+    if (!copy) {
+        pthread_mutex_unlock(&name_table.id_lock);
+        return NAME_NONE;
+    }
+    name_table.chunks[chunk][id % NAME_CHUNK_SIZE] = copy;
+    name_table.count = id;
+
+    pthread_mutex_unlock(&name_table.id_lock);
+    return id;
+}
+
+int init_names(void) {
+    memset(name_table.chunks, 0, sizeof(name_table.chunks));
+    name_table.count = 0;
+    pthread_mutex_init(&name_table.id_lock, NULL);
+
+    for (int i = 0; i < NAME_STRIPES; i++) {
+        NameStripe *stripe = &name_table.stripes[i];
+        stripe->index = calloc(NAME_STRIPE_INITIAL_SIZE, sizeof(NameSlot));
+        stripe->index_size = stripe->index ? NAME_STRIPE_INITIAL_SIZE : 0;
+        stripe->used = 0;
+        pthread_rwlock_init(&stripe->lock, NULL);
+
+        if (!stripe->index) {
+            log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL,
+                       "Failed to allocate name index");
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+    return ERR_SUCCESS;
+}
+
+void cleanup_names(void) {
+    for (uint32_t id = 1; id <= name_table.count; id++) {
+        free(name_table.chunks[id / NAME_CHUNK_SIZE][id % NAME_CHUNK_SIZE]);
+    }
+    for (int i = 0; i < NAME_MAX_CHUNKS; i++) {
+        free(name_table.chunks[i]);
+        name_table.chunks[i] = NULL;
+    }
+    name_table.count = 0;
+    pthread_mutex_destroy(&name_table.id_lock);
+
+    for (int i = 0; i < NAME_STRIPES; i++) {
+        NameStripe *stripe = &name_table.stripes[i];
+        free(stripe->index);
+        stripe->index = NULL;
+        stripe->index_size = 0;
+        stripe->used = 0;
+        pthread_rwlock_destroy(&stripe->lock);
+    }
+}
+
+uint32_t name_lookup(const char *name) {
+    uint32_t hash = name_hash(name);
+    NameStripe *stripe = name_stripe(hash);
+    pthread_rwlock_rdlock(&stripe->lock);
+    uint32_t id = (uint32_t)name_slot(stripe, name, hash)->position;
+    pthread_rwlock_unlock(&stripe->lock);
+    return id;
+}
+
+uint32_t name_intern(const char *name) {
+    uint32_t hash = name_hash(name);
+    NameStripe *stripe = name_stripe(hash);
+
+    pthread_rwlock_rdlock(&stripe->lock);
+    uint32_t id = (uint32_t)name_slot(stripe, name, hash)->position;
+    pthread_rwlock_unlock(&stripe->lock);
+    if (id != NAME_NONE) return id;
+
+    pthread_rwlock_wrlock(&stripe->lock);
+
+    // Someone may have added it since
+    NameSlot *slot = name_slot(stripe, name, hash);
+    if (slot->position != 0) {
+        id = (uint32_t)slot->position;
+        pthread_rwlock_unlock(&stripe->lock);
+        return id;
+    }
+
+    // Keep the stripe under half full
+    if ((stripe->used + 1) * 2 > stripe->index_size) {
+        if (name_grow_stripe(stripe) != ERR_SUCCESS) {
+            pthread_rwlock_unlock(&stripe->lock);
+            return NAME_NONE;
+        }
+        slot = name_slot(stripe, name, hash);
+    }
+
+    id = name_assign(name);
+    if (id != NAME_NONE) {
+        slot->hash = hash;
+        slot->position = (int)id;
+        stripe->used++;
+    }
+
+    pthread_rwlock_unlock(&stripe->lock);
+    return id;
+}
+
+const char* name_of(uint32_t id) {
+    if (id == NAME_NONE) return "";
+    return name_table.chunks[id / NAME_CHUNK_SIZE][id % NAME_CHUNK_SIZE];
+}
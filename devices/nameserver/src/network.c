@@ -2,191 +2,206 @@
 
 
 // ============================================================================
-// CLIENT ACCEPT THREAD (Persistent Sessions)
+// CLIENT CONNECTIONS (Persistent Sessions)
 // ============================================================================
+// Clients are served by an epoll reactor (common/reactor.h). A connection
+// that has not sent INIT yet holds no thread, so a silent client cannot
+// hold up other logins, and commands run on the reactor's worker pool
+// instead of a thread per session. Commands that block go to the command
+// pool (command_pool.c), which wakes the connection when they are done.
+
+// Split the reactor's "ip:port" peer name
+static void split_peer(const char *peer, char *ip, int *port) {
+    strncpy(ip, peer, INET_ADDRSTRLEN - 1);
+    ip[INET_ADDRSTRLEN - 1] = '\0';
+    char *colon = strrchr(ip, ':');
+    *port = 0;
+    if (colon) {
+        *colon = '\0';
+        *port = atoi(colon + 1);
+    }
+}
 
-void* accept_client_connections(void *arg) {
-    NameServerConfig *config = (NameServerConfig*)arg;
+// First message on a connection: INIT|username. Returns the new session,
+// or NULL once an error reply is queued.
+static ClientSession* start_client_session(NameServerConfig *config, ReactorConn *conn,
+                                           WireMessage *msg, const char *line) {
+    char client_ip[INET_ADDRSTRLEN];
+    int client_port;
+    split_peer(conn->peer, client_ip, &client_port);
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "New client connection: fd=%d, ip=%s:%d", conn->fd, client_ip, client_port);
+
+    printf("\n[NEW CLIENT] Connection from %s:%d\n", client_ip, client_port);
+    printf("  Received: %s\n", line);
+
+    // Parse INIT|username
+    message_parse(msg);
+    const char *cmd = msg->verb;
+
+    if (!message_is(msg, "INIT")) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Invalid INIT command from %s:%d: '%s'",
+                   client_ip, client_port, cmd ? cmd : "(null)");
+        reactor_send(conn, "ERROR|First message must be INIT|username\n", 42);
+        return NULL;
+    }
 
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Client connection acceptor thread started: port=%d, thread_id=%lu", 
-               config->client_port, pthread_self());
-    
-    printf("✓ Client connection acceptor started on port %d\n", config->client_port);
-
-    int connection_count = 0;
-    int failed_accepts = 0;
-    int failed_inits = 0;
-
-    while (config->is_running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Waiting for client connection (total accepted=%d)", connection_count);
-
-        int client_fd = accept(config->client_socket, (struct sockaddr*)&client_addr, &client_len);
-
-        if (client_fd < 0) {
-            if (config->is_running) {
-                failed_accepts++;
-                log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                           "Client accept failed (errno=%d: %s, total_failures=%d)", 
-                           errno, strerror(errno), failed_accepts);
-                perror("Client accept failed");
-            } else {
-                log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                           "Accept interrupted - server shutting down");
-            }
-            continue;
-        }
+    char *username = message_next_arg(msg);
+    if (!username) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Missing username in INIT from %s:%d", client_ip, client_port);
+        reactor_send(conn, "ERROR|Missing username\n", 23);
+        return NULL;
+    }
 
-        connection_count++;
-
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-        int client_port = ntohs(client_addr.sin_port);
-
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "New client connection accepted: fd=%d, ip=%s:%d, connection_number=%d", 
-                   client_fd, client_ip, client_port, connection_count);
-        
-        printf("\n[NEW CLIENT] Connection from %s:%d\n", client_ip, client_port);
-
-        // Read INIT message to get username
-        char buffer[BUFFER_SIZE];
-        
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Waiting for INIT message from %s:%d", client_ip, client_port);
-        
-        ssize_t bytes = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-
-        if (bytes <= 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Client disconnected before sending INIT: %s:%d (bytes=%zd)", 
-                       client_ip, client_port, bytes);
-            close(client_fd);
-            failed_inits++;
-            continue;
-        }
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Client initialization: username='%s', ip=%s:%d",
+               username, client_ip, client_port);
 
-        buffer[bytes] = '\0';
-
-        // Remove newline
-        char *newline = strchr(buffer, '\n');
-        if (newline) *newline = '\0';
-
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Received from %s:%d: '%s' (%zd bytes)", 
-                   client_ip, client_port, buffer, bytes);
-        
-        printf("  Received: %s\n", buffer);
-
-        // Parse INIT|username
-        char *saveptr;
-        char *cmd = strtok_r(buffer, "|", &saveptr);
-
-        if (!cmd || strcmp(cmd, "INIT") != 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Invalid INIT command from %s:%d: '%s'", 
-                       client_ip, client_port, cmd ? cmd : "(null)");
-            send(client_fd, "ERROR|First message must be INIT|username\n", 43, 0);
-            close(client_fd);
-            failed_inits++;
-            continue;
-        }
+    ClientSession *session = create_client_session(conn->fd, username, client_ip, client_port);
+    if (!session) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Failed to create session for user '%s' from %s:%d",
+                   username, client_ip, client_port);
+        reactor_send(conn, "ERROR|Failed to create session\n", 31);
+        return NULL;
+    }
+    session->conn = conn;
+
+    int result = add_client_session(config, session);
+    if (result != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Failed to add session - user '%s' already connected (error=%d)",
+                   username, result);
+        reactor_send(conn, "ERROR|User already connected\n", 29);
+        free(session);
+        return NULL;
+    }
 
-        char *username = strtok_r(NULL, "|", &saveptr);
-        if (!username) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Missing username in INIT from %s:%d", client_ip, client_port);
-            send(client_fd, "ERROR|Missing username\n", 23, 0);
-            close(client_fd);
-            failed_inits++;
-            continue;
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Client session established: user='%s', ip=%s:%d, session_id=%d",
+               username, client_ip, client_port, session->socket_fd);
+
+    char welcome[256];
+    snprintf(welcome, sizeof(welcome),
+             "SUCCESS|Welcome %s! Connected to LangOS Name Server.\n",
+             session->username);
+    session_send(session, welcome, strlen(welcome));
+
+    return session;
+}
+
+static void client_event(ReactorConn *conn, unsigned events) {
+    NameServerConfig *config = conn->reactor->server;
+    ClientSession *session = conn->state;
+
+    if (events & REACTOR_EVENT_CLOSED) {
+        if (session) {
+            time_t session_duration = time(NULL) - session->connected_time;
+            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                       "Client disconnected: username='%s', duration=%ld seconds",
+                       session->username, session_duration);
+            printf("  ✗ Client '%s' disconnected\n", session->username);
+            // A command still on the pool drops the session when it's done
+            if (!command_pool_abandon(config, session)) {
+                remove_client_session(config, session->username);
+            }
         }
+        return;
+    }
 
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "Client initialization: username='%s', ip=%s:%d", 
-                   username, client_ip, client_port);
+    // Later commands wait for the reply of one on the command pool
+    if (session && !command_pool_finish(config, session)) {
+        return;
+    }
 
-        // Create session
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Creating client session for user '%s'", username);
-        
-        ClientSession *session = create_client_session(client_fd, username, client_ip, client_port);
+    // A command's reply may be large; leave later commands queued until
+    // the client has taken it
+    WireMessage msg;
+    char line[BUFFER_SIZE];
+    while (!conn->closing && reactor_output_pending(conn) < REACTOR_OUTPUT_HIGH_WATER &&
+           reactor_next_message(conn, &msg)) {
+        message_describe(&msg, line, sizeof(line));
         if (!session) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "Failed to create session for user '%s' from %s:%d", 
-                       username, client_ip, client_port);
-            send(client_fd, "ERROR|Failed to create session\n", 32, 0);
-            close(client_fd);
+            session = start_client_session(config, conn, &msg, line);
+            conn->state = session;
+            if (!session) reactor_close(conn);
             continue;
         }
 
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Session created for '%s': session_id=%d", 
-                   username, session->socket_fd);
-
-        // Add to session list
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Adding session to session list: user='%s'", username);
-        
-        int result = add_client_session(config, session);
-        if (result != ERR_SUCCESS) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Failed to add session - user '%s' already connected (error=%d)", 
-                       username, result);
-            send(client_fd, "ERROR|User already connected\n", 29, 0);
-            close(client_fd);
-            free(session);
+        if (line[0] == '\0') {
+            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                       "Empty message received from '%s'", session->username);
             continue;
         }
 
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "Session added to list: user='%s', total_sessions=%d", 
-                   username, config->client_session_count);
-
-        // ✅ FIX: Use proper thread argument instead of hijacking ->next
-        ClientThreadArg *thread_arg = malloc(sizeof(ClientThreadArg));
-        if (!thread_arg) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "Failed to allocate thread argument for user '%s'", username);
-            perror("malloc thread_arg failed");
-            remove_client_session(config, username);
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                   "Command received: username='%s', command='%s'",
+                   session->username, line);
+
+        printf("  [%s] Command: %s\n", session->username, line);
+
+        if (command_blocks(&msg)) {
+            int queued = command_pool_submit(config, session, &msg, line);
+            if (queued == ERR_SUCCESS) break;
+            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                       "Command pool refused '%s' from '%s' (error=%d)",
+                       line, session->username, queued);
+            session_send(session, "ERROR|Name server busy, try again\n", 34);
             continue;
         }
 
-        thread_arg->session = session;
-        thread_arg->config = config;
-
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Creating handler thread for user '%s'", username);
+        handle_session_command(session, config, &msg, line);
 
-        // Create thread for this session
-        if (pthread_create(&session->thread, NULL, handle_client_session, thread_arg) != 0) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "Failed to create handler thread for user '%s' (errno=%d: %s)", 
-                       username, errno, strerror(errno));
-            perror("Failed to create client thread");
-            remove_client_session(config, username);
-            free(thread_arg);
-            continue;
+        // Check if session was terminated by command (e.g., QUIT)
+        if (!session->is_active) {
+            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                       "Session marked inactive by command: username='%s'",
+                       session->username);
+            reactor_close(conn);
         }
+    }
+}
 
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "Client session established: user='%s', ip=%s:%d, thread_id=%lu, session_id=%d", 
-                   username, client_ip, client_port, session->thread, session->socket_fd);
+void* accept_client_connections(void *arg) {
+    NameServerConfig *config = (NameServerConfig*)arg;
 
-        pthread_detach(session->thread);
-        
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Handler thread detached for user '%s'", username);
+    long fd_limit = reactor_raise_fd_limit();
+    int workers = reactor_default_workers();
+
+    if (command_pool_start(config) != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL,
+                   "Failed to start command pool (errno=%d: %s)", errno, strerror(errno));
+        perror("Command pool failed");
+        return NULL;
     }
 
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Client connection acceptor stopping: total_connections=%d, failed_accepts=%d, failed_inits=%d", 
-               connection_count, failed_accepts, failed_inits);
+    if (reactor_init(&config->client_reactor, config->client_socket, client_event,
+                     config, workers, log_file) != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL,
+                   "Failed to start client reactor (errno=%d: %s)", errno, strerror(errno));
+        perror("Client reactor failed");
+        return NULL;
+    }
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Client reactor started: port=%d, workers=%d, fd_limit=%ld",
+               config->client_port, config->client_reactor.worker_count, fd_limit);
+
+    printf("✓ Client connection acceptor started on port %d (%d workers)\n",
+           config->client_port, config->client_reactor.worker_count);
+
+    reactor_run(&config->client_reactor, &config->is_running);
+    reactor_stop(&config->client_reactor);
+    command_pool_stop(config);
+
+    ReactorStats stats;
+    reactor_get_stats(&config->client_reactor, &stats);
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Client reactor stopping: total_connections=%lu, open=%d",
+               stats.accepted, stats.connections);
 
     return NULL;
 }
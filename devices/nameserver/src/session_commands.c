@@ -1,24 +1,423 @@
 #include "../include/nameserver.h"
+#include <poll.h>
 
 
+// Connect, giving up after SS_CALL_CONNECT_TIMEOUT_MS (errno ETIMEDOUT)
+static int connect_with_timeout(int fd, const struct sockaddr_in *addr) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return -1;
+
+    int result = connect(fd, (const struct sockaddr*)addr, sizeof(*addr));
+    if (result < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int ready;
+        do {
+            ready = poll(&pfd, 1, SS_CALL_CONNECT_TIMEOUT_MS);
+        } while (ready < 0 && errno == EINTR);
+
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (ready == 0) {
+            error = ETIMEDOUT;
+        } else if (ready < 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+            error = errno;
+        }
+        result = error ? -1 : 0;
+        errno = error;
+    }
+    if (result < 0) return -1;
+    return fcntl(fd, F_SETFL, flags);
+}
+
+// One request to a storage server over a fresh connection. It goes out as
+// a frame, so the whole reply comes back however many reads it takes,
+// rendered as text into reply. Runs on the command pool; every step is
+// bounded, so a hung SS costs one worker SS_CALL_TIMEOUT_SEC at most per
+// send or receive. Returns ERR_SUCCESS, ERR_CONNECT_FAILED or
+// ERR_RECV_FAILED.
+static int call_storage_server(const char *ip, int port, const char *request,
+                               DynamicBuffer *reply) {
+    int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (ss_socket < 0) return ERR_CONNECT_FAILED;
+
+    struct sockaddr_in ss_addr;
+    memset(&ss_addr, 0, sizeof(ss_addr));
+    ss_addr.sin_family = AF_INET;
+    ss_addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &ss_addr.sin_addr);
+
+    if (connect_with_timeout(ss_socket, &ss_addr) < 0) {
+        int saved_errno = errno;
+        close(ss_socket);
+        errno = saved_errno;
+        return ERR_CONNECT_FAILED;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = SS_CALL_TIMEOUT_SEC;
+    timeout.tv_usec = 0;
+    setsockopt(ss_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(ss_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    FrameConn conn;
+    frame_conn_init(&conn, ss_socket);
+    int result = frame_conn_call(&conn, request, reply);
+    frame_conn_free(&conn);
+    close(ss_socket);
+    return result == ERR_SUCCESS ? ERR_SUCCESS : ERR_RECV_FAILED;
+}
+
+// ============================================================================
+// ACCESS CHANGES
+// ============================================================================
+// ADDACCESS and REMACCESS once their arguments are read, with the file's
+// catalog stripe locked for writing so a BATCH can run many in one pass
+
+static void add_access_locked(ClientSession *session, NameServerConfig *config,
+                              const char *access_type, const char *filename,
+                              const char *target_user) {
+    // Check if owner
+    FileRecord *acl = get_file_acl_locked(&config->catalog, filename);
+    if (!acl || acl->owner != session->user) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "ADDACCESS denied: user='%s' is not owner of '%s'", 
+                   session->username, filename);
+        session_send(session, "ERROR|Only owner can grant access\n", 34);
+        return;
+    }
+    
+    int access_level = ACCESS_NONE;
+    if (strcmp(access_type, "-R") == 0) {
+        access_level = ACCESS_READ;
+    } else if (strcmp(access_type, "-W") == 0) {
+        access_level = ACCESS_WRITE;
+    } else {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "ADDACCESS: Invalid access type '%s'", access_type);
+        session_send(session, "ERROR|Invalid access type (use -R or -W)\n", 41);
+        return;
+    }
+    
+    int result = grant_access_locked(&config->catalog, filename, target_user, access_level);
+    
+    if (result == ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+                   "Access granted: file='%s', target='%s', level=%d, by='%s'", 
+                   filename, target_user, access_level, session->username);
+        session_send(session, "SUCCESS|Access granted successfully!\n", 37);
+    } else {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "ADDACCESS failed: file='%s', target='%s', error=%d", 
+                   filename, target_user, result);
+        char error[256];
+        snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(result));
+        session_send(session, error, strlen(error));
+    }
+}
+
+static void remove_access_locked(ClientSession *session, NameServerConfig *config,
+                                 const char *filename, const char *target_user) {
+    // Check if owner
+    FileRecord *acl = get_file_acl_locked(&config->catalog, filename);
+    if (!acl || acl->owner != session->user) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "REMACCESS denied: user='%s' is not owner of '%s'", 
+                   session->username, filename);
+        session_send(session, "ERROR|Only owner can revoke access\n", 35);
+        return;
+    }
+    
+    int result = revoke_access_locked(&config->catalog, filename, target_user);
+    
+    if (result == ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+                   "Access revoked: file='%s', target='%s', by='%s'", 
+                   filename, target_user, session->username);
+        session_send(session, "SUCCESS|Access removed successfully!\n", 37);
+    } else {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "REMACCESS failed: file='%s', target='%s', error=%d", 
+                   filename, target_user, result);
+        char error[256];
+        snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(result));
+        session_send(session, error, strlen(error));
+    }
+}
+
+// ============================================================================
+// REDIRECTS
+// ============================================================================
+// READ, WRITE, STREAM and UNDO send the client to the file's SS. The access
+// check and the location come from one catalog lookup.
+
+// Access a redirect or batched command needs, ACCESS_NONE for INFO, or -1
+// if it is neither
+static int command_required_access(const char *verb) {
+    if (strcmp(verb, "READ") == 0 || strcmp(verb, "STREAM") == 0) return ACCESS_READ;
+    if (strcmp(verb, "WRITE") == 0 || strcmp(verb, "UNDO") == 0) return ACCESS_WRITE;
+    if (strcmp(verb, "INFO") == 0) return ACCESS_NONE;
+    return -1;
+}
+
+// Reply to a redirect command from what resolve_file() returned
+static void send_redirect(ClientSession *session, const char *verb, const char *filename,
+                          int result, const FileLocation *location) {
+    if (result == ERR_PERMISSION_DENIED) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "%s denied: user='%s' lacks access to file='%s'", 
+                   verb, session->username, filename);
+        session_send(session, "ERROR|Access denied\n", 20);
+        return;
+    }
+    if (result != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "%s: File not found '%s'", verb, filename);
+        session_send(session, "ERROR|File not found\n", 21);
+        return;
+    }
+
+    // Return SS connection info for DIRECT connection
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response), "REDIRECT|%s|%d\n", location->ip, location->client_port);
+    session_send(session, response, strlen(response));
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "%s redirect: user='%s', file='%s' -> SS#%d (%s:%d)", 
+               verb, session->username, filename, location->ss_id,
+               location->ip, location->client_port);
+
+    printf("    → Redirecting %s to SS#%d (%s:%d)\n", verb, location->ss_id,
+           location->ip, location->client_port);
+}
+
+// ============================================================================
+// BATCH
+// ============================================================================
+// Metadata commands sent as one framed request. The ACL changes of
+// ADDACCESS/REMACCESS and the lookups for READ/WRITE/STREAM/UNDO run in
+// one pass under the locks of their files' catalog stripes; INFO lookups
+// follow without them, so an INFO shows the ACL as the whole batch left
+// it. Each command's reply goes back, in order, inside one BATCH reply.
+
+typedef struct {
+    const char *verb;
+    char *args[3];
+    int argc;
+    int allowed;                // INFO still to run
+    int resolved;               // Redirect looked up: result and location
+    int result;
+    FileLocation location;
+    DynamicBuffer reply;
+} BatchCommand;
+
+// The file a batched command names, NULL if it is missing
+static const char* batch_filename(const BatchCommand *command) {
+    if (strcmp(command->verb, "ADDACCESS") == 0) {
+        return command->argc >= 3 ? command->args[1] : NULL;
+    }
+    return command->argc >= 1 ? command->args[0] : NULL;
+}
+
+// Whether a BATCH holds an INFO, which asks the SS. Reads the frame headers
+// (and an OP_VERB command's verb) without decoding anything in place.
+static int batch_has_info(const WireMessage *msg) {
+    if (!msg->framed || msg->argc != 1 || msg->types[0] != FIELD_STR) return 0;
+
+    const unsigned char *data = (const unsigned char*)msg->argv[0];
+    size_t length = msg->lengths[0];
+    size_t offset = 0;
+    while (length - offset >= FRAME_HEADER_SIZE) {
+        const unsigned char *header = data + offset;
+        uint16_t opcode = (uint16_t)((header[2] << 8) | header[3]);
+        uint32_t payload = protocol_get32(header + 8);
+        if (payload > length - offset - FRAME_HEADER_SIZE) return 0;
+
+        if (opcode == OP_INFO) return 1;
+        const unsigned char *field = header + FRAME_HEADER_SIZE;
+        if (opcode == OP_VERB && payload >= 5 + 4 && field[0] == FIELD_STR &&
+            protocol_get32(field + 1) == 4 && memcmp(field + 5, "INFO", 4) == 0) {
+            return 1;
+        }
+        offset += FRAME_HEADER_SIZE + payload;
+    }
+    return 0;
+}
+
+static void handle_batch(ClientSession *session, NameServerConfig *config, WireMessage *msg) {
+    DynamicBuffer *outer = session->capture;
+    if (!msg->framed) {
+        session_send(session, "ERROR|BATCH needs a framed request\n", 35);
+        return;
+    }
+
+    BatchCommand *commands = calloc(BATCH_MAX_COMMANDS, sizeof(BatchCommand));
+    if (!commands) {
+        session_send(session, "ERROR|Out of memory\n", 20);
+        return;
+    }
+
+    // Commands are decoded in place, so only once
+    WireMessage item;
+    size_t offset = 0;
+    int count = 0, changes = 0, status;
+    uint32_t stripes = 0;       // Catalog stripes of the files named
+    while ((status = message_next_batched(msg, &offset, &item)) > 0) {
+        if (count == BATCH_MAX_COMMANDS) {
+            count++;        // Too many
+            break;
+        }
+        BatchCommand *command = &commands[count++];
+        command->verb = item.verb ? item.verb : "";
+        if (strcmp(command->verb, "ADDACCESS") == 0 || strcmp(command->verb, "REMACCESS") == 0) {
+            changes++;
+        }
+        char *arg;
+        while (command->argc < 3 && (arg = message_next_arg(&item)) != NULL) {
+            command->args[command->argc++] = arg;
+        }
+        const char *filename = batch_filename(command);
+        if (filename) stripes |= catalog_stripe_bit(filename);
+    }
+    if (status < 0 || count == 0 || count > BATCH_MAX_COMMANDS) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "BATCH rejected: user='%s', commands=%d, malformed=%d", 
+                   session->username, count, status < 0);
+        char error[128];
+        snprintf(error, sizeof(error), "ERROR|A BATCH holds 1 to %d well-formed commands\n",
+                 BATCH_MAX_COMMANDS);
+        session_send(session, error, strlen(error));
+        free(commands);
+        return;
+    }
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "BATCH request: user='%s', commands=%d", session->username, count);
+    printf("    → BATCH of %d commands\n", count);
+
+    // Access pass: one hold of the files' stripes for every lookup and ACL
+    // change, shared if there are only lookups
+    catalog_lock_stripes(&config->catalog, stripes, changes > 0);
+    for (int i = 0; i < count; i++) {
+        BatchCommand *command = &commands[i];
+        session->capture = &command->reply;
+
+        if (strcmp(command->verb, "ADDACCESS") == 0) {
+            if (command->argc < 3) {
+                session_send(session, "ERROR|Missing parameters\n", 25);
+            } else {
+                add_access_locked(session, config, command->args[0],
+                                  command->args[1], command->args[2]);
+            }
+            continue;
+        }
+        if (strcmp(command->verb, "REMACCESS") == 0) {
+            if (command->argc < 2) {
+                session_send(session, "ERROR|Missing parameters\n", 25);
+            } else {
+                remove_access_locked(session, config, command->args[0], command->args[1]);
+            }
+            continue;
+        }
+
+        int required = command_required_access(command->verb);
+        if (required < 0) {
+            char error[256];
+            snprintf(error, sizeof(error), "ERROR|Can't batch command: %.64s\n", command->verb);
+            session_send(session, error, strlen(error));
+        } else if (command->argc < 1) {
+            session_send(session, "ERROR|Missing filename\n", 23);
+        } else if (required == ACCESS_NONE) {
+            command->allowed = 1;
+        } else {
+            command->result = resolve_file_locked(&config->catalog, command->args[0],
+                                                  session->user, required,
+                                                  &command->location);
+            command->resolved = 1;
+        }
+    }
+    catalog_unlock_stripes(&config->catalog, stripes);
+
+    // Replies for the redirects, and the INFO lookups
+    for (int i = 0; i < count; i++) {
+        BatchCommand *command = &commands[i];
+        session->capture = &command->reply;
+
+        if (command->resolved) {
+            send_redirect(session, command->verb, command->args[0],
+                          command->result, &command->location);
+        } else if (command->allowed) {
+            WireMessage info;
+            memset(&info, 0, sizeof(info));
+            info.framed = 1;
+            info.opcode = OP_INFO;
+            info.verb = command->verb;
+            info.argc = command->argc;
+            for (int a = 0; a < command->argc; a++) {
+                info.argv[a] = command->args[a];
+                info.lengths[a] = strlen(command->args[a]);
+                info.types[a] = FIELD_STR;
+            }
+            handle_session_command(session, config, &info, "INFO (batched)");
+        }
+    }
+    session->capture = outer;
+
+    // One reply frame carrying each command's reply
+    DynamicBuffer frame = {0};
+    long start = frame_batch_begin(&frame, OP_REPLY_BATCH, 0);
+    int result = start < 0 ? ERR_OUT_OF_MEMORY : ERR_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        if (result == ERR_SUCCESS) {
+            result = frame_encode_reply(&frame, (uint32_t)i, commands[i].reply.data ?
+                                        commands[i].reply.data : "", commands[i].reply.length);
+        }
+        dynbuf_free(&commands[i].reply);
+    }
+    free(commands);
+
+    if (result == ERR_SUCCESS) {
+        frame_batch_end(&frame, start);
+        session_send_frame(session, &frame);
+    } else {
+        session_send(session, "ERROR|Out of memory\n", 20);
+    }
+    dynbuf_free(&frame);
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "BATCH completed: user='%s', commands=%d", session->username, count);
+}
+
+// Whether a command, taken but not yet parsed, may block on a storage
+// server or a program it runs; those go to the command pool
+int command_blocks(const WireMessage *msg) {
+    static const char *blocking[] = { "CREATE", "DELETE", "INFO", "EXEC" };
+
+    const char *verb = msg->framed ? msg->verb : msg->line;
+    if (!verb) return 0;
+    size_t length = msg->framed ? strlen(verb) : strcspn(verb, "|");
+    if (length == 5 && memcmp(verb, "BATCH", 5) == 0) {
+        return batch_has_info(msg);
+    }
+    for (size_t i = 0; i < sizeof(blocking) / sizeof(blocking[0]); i++) {
+        if (strlen(blocking[i]) == length && memcmp(verb, blocking[i], length) == 0) return 1;
+    }
+    return 0;
+}
+
 void handle_session_command(ClientSession *session, NameServerConfig *config, 
-                           const char *command) {
+                           WireMessage *msg, const char *command) {
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Processing command: user='%s', session_id=%d, command='%s'", 
                session->username, session->socket_fd, command);
     
-    char cmd_copy[BUFFER_SIZE];
-    strncpy(cmd_copy, command, sizeof(cmd_copy) - 1);
-    cmd_copy[sizeof(cmd_copy) - 1] = '\0';
-    
-    char *saveptr;
-    char *cmd = strtok_r(cmd_copy, "|", &saveptr);
+    message_parse(msg);
+    const char *cmd = msg->verb;
     
     if (!cmd) {
         log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                    "Invalid command format: user='%s', command='%s'", 
                    session->username, command);
-        send(session->socket_fd, "ERROR|Invalid command\n", 22, 0);
+        session_send(session, "ERROR|Invalid command\n", 22);
         return;
     }
     
@@ -29,7 +428,7 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                    "User disconnecting: user='%s', session_id=%d", 
                    session->username, session->socket_fd);
-        send(session->socket_fd, "SUCCESS|Goodbye!\n", 17, 0);
+        session_send(session, "SUCCESS|Goodbye!\n", 17);
         session->is_active = 0;
         return;
     }
@@ -38,12 +437,12 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
     // CREATE - Create new file
     // ========================================================================
     else if (strcmp(cmd, "CREATE") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
+        char *filename = message_next_arg(msg);
         
         if (!filename) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "CREATE: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
+            session_send(session, "ERROR|Missing filename\n", 23);
             return;
         }
         
@@ -56,251 +455,157 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
         if (ss_id < 0) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "CREATE failed: No storage server available for file '%s'", filename);
-            send(session->socket_fd, "ERROR|No storage server available\n", 35, 0);
+            session_send(session, "ERROR|No storage server available\n", 34);
             return;
         }
         
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Selected SS#%d for file '%s'", ss_id, filename);
         
-        // Get SS session
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
+        // Copy where the SS is: it may fail, and its session be freed,
+        // while the CREATE is out
+        FileLocation ss;
+        if (ss_session_location(config, ss_id, &ss) != ERR_SUCCESS) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "CREATE failed: SS#%d session not found", ss_id);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
+            session_send(session, "ERROR|SS not available\n", 23);
             return;
         }
         
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Connecting to SS#%d: %s:%d", ss_id, ss->ip, ss->client_port);
+                   "Connecting to SS#%d: %s:%d", ss_id, ss.ip, ss.client_port);
         printf("    → Forwarding CREATE to SS#%d\n", ss_id);
         
-        // Connect to SS
-        int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-        struct sockaddr_in ss_addr;
-        memset(&ss_addr, 0, sizeof(ss_addr));
-        ss_addr.sin_family = AF_INET;
-        ss_addr.sin_port = htons(ss->client_port);
-        inet_pton(AF_INET, ss->ip, &ss_addr.sin_addr);
+        // Forward CREATE
+        char ss_cmd[BUFFER_SIZE];
+        snprintf(ss_cmd, sizeof(ss_cmd), "CREATE|%s|%s", filename, session->username);
+        DynamicBuffer reply = {0};
+        int call_result = call_storage_server(ss.ip, ss.client_port, ss_cmd, &reply);
         
-        if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) < 0) {
+        if (call_result == ERR_CONNECT_FAILED) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "CREATE: Failed to connect to SS#%d at %s:%d (errno=%d: %s)", 
-                       ss_id, ss->ip, ss->client_port, errno, strerror(errno));
-            send(session->socket_fd, "ERROR|Failed to connect to SS\n", 31, 0);
-            close(ss_socket);
+                       ss_id, ss.ip, ss.client_port, errno, strerror(errno));
+            session_send(session, "ERROR|Failed to connect to SS\n", 30);
             return;
         }
         
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Connected to SS#%d, sending CREATE command", ss_id);
-        
-        // Forward CREATE
-        char ss_cmd[BUFFER_SIZE];
-        snprintf(ss_cmd, sizeof(ss_cmd), "CREATE|%s|%s\n", filename, session->username);
-        send(ss_socket, ss_cmd, strlen(ss_cmd), 0);
-        
-        // Get response
-        char ss_response[BUFFER_SIZE];
-        ssize_t bytes = recv(ss_socket, ss_response, sizeof(ss_response) - 1, 0);
-        close(ss_socket);
-        
-        if (bytes > 0) {
-            ss_response[bytes] = '\0';
+        if (call_result == ERR_SUCCESS && reply.length > 0) {
+            const char *ss_response = reply.data;
             
             log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                        "SS#%d response: %s", ss_id, ss_response);
             
             if (strncmp(ss_response, "SUCCESS", 7) == 0) {
-                // Add to hash table and ACL (no backup)
-                add_file_mapping(&config->file_table, filename, ss_id);
-                add_file_access(&config->acl_manager, filename, session->username);
+                // Add to the catalog (no backup), unless the SS failed
+                // while it was creating the file
+                if (catalog_set_location(config, filename, &ss) != ERR_SUCCESS) {
+                    dynbuf_free(&reply);
+                    session_send(session, "ERROR|SS not available\n", 23);
+                    return;
+                }
+                add_file_access(&config->catalog, filename, session->username);
                 
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "File created successfully: filename='%s', owner='%s', ss_id=%d", 
                            filename, session->username, ss_id);
                 
-                send(session->socket_fd, "SUCCESS|File created successfully!\n", 36, 0);
+                session_send(session, "SUCCESS|File created successfully!\n", 35);
                 printf("    ✓ File '%s' created on SS#%d\n", filename, ss_id);
             } else {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                            "CREATE failed on SS#%d: %s", ss_id, ss_response);
-                send(session->socket_fd, ss_response, bytes, 0);
+                session_send(session, ss_response, reply.length);
             }
         } else {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "CREATE: No response from SS#%d (bytes=%zd)", ss_id, bytes);
-            send(session->socket_fd, "ERROR|No response from SS\n", 27, 0);
+                       "CREATE: No response from SS#%d", ss_id);
+            session_send(session, "ERROR|No response from SS\n", 26);
         }
+        dynbuf_free(&reply);
     }
     
     // ========================================================================
     // VIEW - List files
     // ========================================================================
     else if (strcmp(cmd, "VIEW") == 0) {
-        char *flags = strtok_r(NULL, "|", &saveptr);
+        char *flags = message_next_arg(msg);
         
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                    "VIEW request: user='%s', flags='%s'", 
                    session->username, flags ? flags : "(none)");
         
-        char response[LARGE_BUFFER_SIZE] = "SUCCESS|\n";
+        DynamicBuffer response = {0};
+        dynbuf_append_str(&response, "SUCCESS|\n");
         int file_count = 0;
         int accessible_count = 0;
         
-        pthread_mutex_lock(&config->file_table.lock);
-        for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-            FileMapping *current = config->file_table.buckets[i];
-            while (current) {
+        // Files an SS holds, each checked against its own record, a
+        // stripe at a time
+        for (int s = 0; s < CATALOG_STRIPES; s++) {
+            CatalogStripe *stripe = &config->catalog.stripes[s];
+            pthread_rwlock_rdlock(&stripe->lock);
+            for (int i = 0; i < stripe->record_count; i++) {
+                FileRecord *record = stripe->records[i];
+                if (record->primary_ss_id < 0) continue;
                 file_count++;
                 
-                // Check access (if not -a flag)
-                if (!flags || !strstr(flags, "a")) {
-                    // Only show files user has access to
-                    if (!check_access(&config->acl_manager, current->filename, 
-                                     session->username, ACCESS_READ)) {
-                        current = current->next;
-                        continue;
-                    }
+                // Only show files user has access to (unless -a flag)
+                if ((!flags || !strstr(flags, "a")) &&
+                    user_access_level(record, session->user) < ACCESS_READ) {
+                    continue;
                 }
                 
                 accessible_count++;
-                strcat(response, "--> ");
-                strcat(response, current->filename);
-                strcat(response, "\n");
-                current = current->next;
+                dynbuf_append_str(&response, "--> ");
+                dynbuf_append_str(&response, name_of(record->name));
+                dynbuf_append_str(&response, "\n");
             }
+            pthread_rwlock_unlock(&stripe->lock);
         }
-        pthread_mutex_unlock(&config->file_table.lock);
         
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                    "VIEW completed: user='%s', total_files=%d, accessible=%d", 
                    session->username, file_count, accessible_count);
         
-        send(session->socket_fd, response, strlen(response), 0);
+        session_send(session, response.data, response.length);
+        dynbuf_free(&response);
     }
     
     // ========================================================================
-    // READ - Redirect to SS
+    // READ / WRITE / STREAM / UNDO - Redirect to SS
     // ========================================================================
-    else if (strcmp(cmd, "READ") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
+    else if (strcmp(cmd, "READ") == 0 || strcmp(cmd, "WRITE") == 0 ||
+             strcmp(cmd, "STREAM") == 0 || strcmp(cmd, "UNDO") == 0) {
+        char *filename = message_next_arg(msg);
         
         if (!filename) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "READ: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
-            return;
-        }
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "READ request: user='%s', filename='%s'", 
-                   session->username, filename);
-        
-        // Check access
-        if (!check_access(&config->acl_manager, filename, session->username, ACCESS_READ)) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "READ denied: user='%s' lacks access to file='%s'", 
-                       session->username, filename);
-            send(session->socket_fd, "ERROR|Access denied\n", 20, 0);
-            return;
-        }
-        
-        // Get SS info
-        int ss_id = get_file_primary_ss(&config->file_table, filename);
-        if (ss_id < 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "READ: File not found '%s'", filename);
-            send(session->socket_fd, "ERROR|File not found\n", 21, 0);
-            return;
-        }
-        
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "READ: SS#%d not available for file '%s'", ss_id, filename);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
+                       "%s: Missing filename - user='%s'", cmd, session->username);
+            session_send(session, "ERROR|Missing filename\n", 23);
             return;
         }
         
-        // Return SS connection info for DIRECT connection
-        char response[BUFFER_SIZE];
-        snprintf(response, sizeof(response), "REDIRECT|%s|%d\n", ss->ip, ss->client_port);
-        send(session->socket_fd, response, strlen(response), 0);
-        
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "READ redirect: user='%s', file='%s' -> SS#%d (%s:%d)", 
-                   session->username, filename, ss_id, ss->ip, ss->client_port);
+                   "%s request: user='%s', filename='%s'", 
+                   cmd, session->username, filename);
         
-        printf("    → Redirecting READ to SS#%d (%s:%d)\n", ss_id, ss->ip, ss->client_port);
-    }
-    
-    // ========================================================================
-    // WRITE - Redirect to SS
-    // ========================================================================
-    else if (strcmp(cmd, "WRITE") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
-        
-        if (!filename) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "WRITE: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
-            return;
-        }
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "WRITE request: user='%s', filename='%s'", 
-                   session->username, filename);
-        
-        // Check write access
-        if (!check_access(&config->acl_manager, filename, session->username, ACCESS_WRITE)) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "WRITE denied: user='%s' lacks write access to file='%s'", 
-                       session->username, filename);
-            send(session->socket_fd, "ERROR|Access denied\n", 20, 0);
-            return;
-        }
-        
-        // Get SS info
-        int ss_id = get_file_primary_ss(&config->file_table, filename);
-        if (ss_id < 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "WRITE: File not found '%s'", filename);
-            send(session->socket_fd, "ERROR|File not found\n", 21, 0);
-            return;
-        }
-        
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "WRITE: SS#%d not available for file '%s'", ss_id, filename);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
-            return;
-        }
-        
-        // Return SS connection info
-        char response[BUFFER_SIZE];
-        snprintf(response, sizeof(response), "REDIRECT|%s|%d\n", ss->ip, ss->client_port);
-        send(session->socket_fd, response, strlen(response), 0);
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "WRITE redirect: user='%s', file='%s' -> SS#%d (%s:%d)", 
-                   session->username, filename, ss_id, ss->ip, ss->client_port);
-        
-        printf("    → Redirecting WRITE to SS#%d\n", ss_id);
+        FileLocation location;
+        int result = resolve_file(&config->catalog, filename, session->user,
+                                  command_required_access(cmd), &location);
+        send_redirect(session, cmd, filename, result, &location);
     }
     
     // ========================================================================
     // DELETE - Forward to SS
     // ========================================================================
     else if (strcmp(cmd, "DELETE") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
+        char *filename = message_next_arg(msg);
         
         if (!filename) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "DELETE: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
+            session_send(session, "ERROR|Missing filename\n", 23);
             return;
         }
         
@@ -308,96 +613,79 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
                    "DELETE request: user='%s', filename='%s'", 
                    session->username, filename);
         
-        // Check if owner
-        FileAccessControl *acl = get_file_acl(&config->acl_manager, filename);
-        if (!acl || strcmp(acl->owner, session->username) != 0) {
+        // Only the owner holds ACCESS_OWNER
+        FileLocation location;
+        int result = resolve_file(&config->catalog, filename, session->user,
+                                  ACCESS_OWNER, &location);
+        if (result == ERR_PERMISSION_DENIED) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "DELETE denied: user='%s' is not owner of file='%s' (owner='%s')", 
-                       session->username, filename, acl ? acl->owner : "(no ACL)");
-            send(session->socket_fd, "ERROR|Only owner can delete\n", 29, 0);
+                       "DELETE denied: user='%s' is not owner of file='%s'", 
+                       session->username, filename);
+            session_send(session, "ERROR|Only owner can delete\n", 28);
             return;
         }
-        
-        // Get SS
-        int ss_id = get_file_primary_ss(&config->file_table, filename);
-        if (ss_id < 0) {
+        if (result != ERR_SUCCESS) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "DELETE: File not found '%s'", filename);
-            send(session->socket_fd, "ERROR|File not found\n", 21, 0);
-            return;
-        }
-        
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "DELETE: SS#%d not available", ss_id);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
+            session_send(session, "ERROR|File not found\n", 21);
             return;
         }
+        int ss_id = location.ss_id;
         
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Forwarding DELETE to SS#%d: file='%s'", ss_id, filename);
         printf("    → Forwarding DELETE to SS#%d\n", ss_id);
         
         // Connect and delete
-        int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-        struct sockaddr_in ss_addr;
-        memset(&ss_addr, 0, sizeof(ss_addr));
-        ss_addr.sin_family = AF_INET;
-        ss_addr.sin_port = htons(ss->client_port);
-        inet_pton(AF_INET, ss->ip, &ss_addr.sin_addr);
-        
-        if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) < 0) {
+        char ss_cmd[BUFFER_SIZE];
+        snprintf(ss_cmd, sizeof(ss_cmd), "DELETE|%s", filename);
+        DynamicBuffer reply = {0};
+        int call_result = call_storage_server(location.ip, location.client_port, ss_cmd, &reply);
+        
+        if (call_result == ERR_CONNECT_FAILED) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "DELETE: Failed to connect to SS#%d (errno=%d: %s)", 
                        ss_id, errno, strerror(errno));
-            send(session->socket_fd, "ERROR|Failed to connect to SS\n", 31, 0);
+            session_send(session, "ERROR|Failed to connect to SS\n", 30);
             return;
         }
         
-        char ss_cmd[BUFFER_SIZE];
-        snprintf(ss_cmd, sizeof(ss_cmd), "DELETE|%s\n", filename);
-        send(ss_socket, ss_cmd, strlen(ss_cmd), 0);
-        
-        char ss_response[BUFFER_SIZE];
-        ssize_t bytes = recv(ss_socket, ss_response, sizeof(ss_response) - 1, 0);
-        close(ss_socket);
-        
-        if (bytes > 0) {
-            ss_response[bytes] = '\0';
+        if (call_result == ERR_SUCCESS && reply.length > 0) {
+            const char *ss_response = reply.data;
             
             if (strncmp(ss_response, "SUCCESS", 7) == 0) {
-                // Remove from hash table
-                remove_file_mapping(&config->file_table, filename);
+                // The ACL stays; the file just has no location
+                catalog_clear_location(&config->catalog, filename);
                 
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "File deleted successfully: filename='%s', owner='%s', ss_id=%d", 
                            filename, session->username, ss_id);
                 
-                send(session->socket_fd, "SUCCESS|File deleted successfully!\n", 36, 0);
+                session_send(session, "SUCCESS|File deleted successfully!\n", 35);
                 printf("    ✓ File '%s' deleted from SS#%d\n", filename, ss_id);
             } else {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                            "DELETE failed on SS#%d: %s", ss_id, ss_response);
-                send(session->socket_fd, ss_response, bytes, 0);
+                session_send(session, ss_response, reply.length);
             }
         } else {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "DELETE: No response from SS#%d", ss_id);
-            send(session->socket_fd, "ERROR|No response from SS\n", 27, 0);
+            session_send(session, "ERROR|No response from SS\n", 26);
         }
+        dynbuf_free(&reply);
     }
     
     // ========================================================================
     // INFO - Fetch and augment with ACL
     // ========================================================================
     else if (strcmp(cmd, "INFO") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
+        char *filename = message_next_arg(msg);
 
         if (!filename) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "INFO: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
+            session_send(session, "ERROR|Missing filename\n", 23);
             return;
         }
 
@@ -406,240 +694,133 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
                    session->username, filename);
 
         // Get SS info
-        int ss_id = get_file_primary_ss(&config->file_table, filename);
-        if (ss_id < 0) {
+        FileLocation location;
+        if (resolve_file(&config->catalog, filename, NAME_NONE, ACCESS_NONE, &location) != ERR_SUCCESS) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "INFO: File not found '%s'", filename);
-            send(session->socket_fd, "ERROR|File not found\n", 21, 0);
-            return;
-        }
-
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "INFO: SS#%d not available", ss_id);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
+            session_send(session, "ERROR|File not found\n", 21);
             return;
         }
+        int ss_id = location.ss_id;
 
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Fetching INFO from SS#%d for file '%s'", ss_id, filename);
 
-        // Connect to SS, send INFO request
-        int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-        struct sockaddr_in ss_addr;
-        memset(&ss_addr, 0, sizeof(ss_addr));
-        ss_addr.sin_family = AF_INET;
-        ss_addr.sin_port = htons(ss->client_port);
-        inet_pton(AF_INET, ss->ip, &ss_addr.sin_addr);
+        // Ask the SS for its INFO
+        char ss_cmd[BUFFER_SIZE];
+        snprintf(ss_cmd, sizeof(ss_cmd), "INFO|%s", filename);
+        DynamicBuffer reply = {0};
+        int call_result = call_storage_server(location.ip, location.client_port, ss_cmd, &reply);
 
-        if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) < 0) {
+        if (call_result == ERR_CONNECT_FAILED) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "INFO: Failed to connect to SS#%d (errno=%d: %s)", 
                        ss_id, errno, strerror(errno));
-            send(session->socket_fd, "ERROR|Failed to connect to SS\n", 31, 0);
-            close(ss_socket);
+            session_send(session, "ERROR|Failed to connect to SS\n", 30);
             return;
         }
 
-        char ss_cmd[BUFFER_SIZE];
-        snprintf(ss_cmd, sizeof(ss_cmd), "INFO|%s\n", filename);
-        send(ss_socket, ss_cmd, strlen(ss_cmd), 0);
-
-        char ss_response[LARGE_BUFFER_SIZE];
-        ssize_t bytes = recv(ss_socket, ss_response, sizeof(ss_response) - 1, 0);
-        close(ss_socket);
-
-        if (bytes <= 0) {
+        if (call_result != ERR_SUCCESS || reply.length == 0) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "INFO: No response from SS#%d (bytes=%zd)", ss_id, bytes);
-            send(session->socket_fd, "ERROR|Failed to get info\n", 25, 0);
+                       "INFO: No response from SS#%d", ss_id);
+            dynbuf_free(&reply);
+            session_send(session, "ERROR|Failed to get info\n", 25);
             return;
         }
-        ss_response[bytes] = '\0';
 
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Received INFO from SS#%d, augmenting with ACL", ss_id);
 
-        // Compose final response
-        char response[LARGE_BUFFER_SIZE];
-        snprintf(response, sizeof(response), "%s\n", ss_response);
+        // Keep the SS's counts in the catalog
+        const char *size_line = strstr(reply.data, "Size:");
+        const char *words_line = strstr(reply.data, "Words:");
+        const char *chars_line = strstr(reply.data, "Characters:");
+        size_t size;
+        int words, chars;
+        if (size_line && words_line && chars_line &&
+            sscanf(size_line, "Size: %zu", &size) == 1 &&
+            sscanf(words_line, "Words: %d", &words) == 1 &&
+            sscanf(chars_line, "Characters: %d", &chars) == 1) {
+            catalog_cache_stats(&config->catalog, filename, location.version, size, words, chars);
+        }
+
+        // Compose final response on the SS reply; it grows with the ACL
+        DynamicBuffer *response = &reply;
+        dynbuf_append_char(response, '\n');
 
-        // Attach access rights
-        FileAccessControl *acl = get_file_acl(&config->acl_manager, filename);
+        // Attach access rights. A grant may move acl->users, so hold
+        // the file's stripe while reading it.
+        CatalogStripe *stripe = catalog_stripe(&config->catalog, filename);
+        pthread_rwlock_rdlock(&stripe->lock);
+        FileRecord *acl = get_file_acl_locked(&config->catalog, filename);
         if (!acl) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "No ACL found for file '%s'", filename);
-            strcat(response, "ACCESS|No ACL entry for this file\n");
+            dynbuf_append_str(response, "ACCESS|No ACL entry for this file\n");
         } else {
             int reader_count = 0, writer_count = 0;
             
-            strcat(response, "ACCESS|\n");
-            strcat(response, "  Owner(RW): ");
-            strcat(response, acl->owner);
-            strcat(response, "\n");
+            dynbuf_append_str(response, "ACCESS|\n");
+            dynbuf_append_str(response, "  Owner(RW): ");
+            dynbuf_append_str(response, name_of(acl->owner));
+            dynbuf_append_str(response, "\n");
 
             // Readers
-            strcat(response, "  Readers(R): ");
+            dynbuf_append_str(response, "  Readers(R): ");
             int has_reader = 0;
             for (int i = 0; i < acl->user_count; i++) {
                 if (acl->access_levels[i] == ACCESS_READ || 
                     acl->access_levels[i] == ACCESS_READ_WRITE || 
                     acl->access_levels[i] == ACCESS_WRITE) {
-                    if (has_reader) strcat(response, ",");
-                    strcat(response, acl->users[i]);
+                    if (has_reader) dynbuf_append_str(response, ",");
+                    dynbuf_append_str(response, name_of(acl->users[i]));
                     has_reader = 1;
                     reader_count++;
                 }
             }
-            if (!has_reader) strcat(response, "(none)");
-            strcat(response, "\n");
+            if (!has_reader) dynbuf_append_str(response, "(none)");
+            dynbuf_append_str(response, "\n");
 
             // Writers
-            strcat(response, "  Writers(W): ");
+            dynbuf_append_str(response, "  Writers(W): ");
             int has_writer = 0;
             for (int i = 0; i < acl->user_count; i++) {
                 if (acl->access_levels[i] == ACCESS_WRITE || 
                     acl->access_levels[i] == ACCESS_READ_WRITE) {
-                    if (has_writer) strcat(response, ",");
-                    strcat(response, acl->users[i]);
+                    if (has_writer) dynbuf_append_str(response, ",");
+                    dynbuf_append_str(response, name_of(acl->users[i]));
                     has_writer = 1;
                     writer_count++;
                 }
             }
-            if (!has_writer) strcat(response, "(none)");
-            strcat(response, "\n");
+            if (!has_writer) dynbuf_append_str(response, "(none)");
+            dynbuf_append_str(response, "\n");
             
             log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                        "ACL info: file='%s', owner='%s', readers=%d, writers=%d", 
-                       filename, acl->owner, reader_count, writer_count);
+                       filename, name_of(acl->owner), reader_count, writer_count);
         }
 
-        send(session->socket_fd, response, strlen(response), 0);
+        pthread_rwlock_unlock(&stripe->lock);
+
+        session_send(session, response->data, response->length);
+        dynbuf_free(&reply);
         
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                    "INFO completed: user='%s', file='%s', ss_id=%d", 
                    session->username, filename, ss_id);
     }
 
-    // ========================================================================
-    // STREAM - Redirect to SS
-    // ========================================================================
-    else if (strcmp(cmd, "STREAM") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
-        
-        if (!filename) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "STREAM: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
-            return;
-        }
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "STREAM request: user='%s', filename='%s'", 
-                   session->username, filename);
-        
-        // Check access
-        if (!check_access(&config->acl_manager, filename, session->username, ACCESS_READ)) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "STREAM denied: user='%s' lacks access to file='%s'", 
-                       session->username, filename);
-            send(session->socket_fd, "ERROR|Access denied\n", 20, 0);
-            return;
-        }
-        
-        // Get SS info
-        int ss_id = get_file_primary_ss(&config->file_table, filename);
-        if (ss_id < 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "STREAM: File not found '%s'", filename);
-            send(session->socket_fd, "ERROR|File not found\n", 21, 0);
-            return;
-        }
-        
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "STREAM: SS#%d not available", ss_id);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
-            return;
-        }
-        
-        // Return SS connection info
-        char response[BUFFER_SIZE];
-        snprintf(response, sizeof(response), "REDIRECT|%s|%d\n", ss->ip, ss->client_port);
-        send(session->socket_fd, response, strlen(response), 0);
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "STREAM redirect: user='%s', file='%s' -> SS#%d", 
-                   session->username, filename, ss_id);
-    }
-    
-    // ========================================================================
-    // UNDO - Redirect to SS
-    // ========================================================================
-    else if (strcmp(cmd, "UNDO") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
-        
-        if (!filename) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "UNDO: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
-            return;
-        }
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "UNDO request: user='%s', filename='%s'", 
-                   session->username, filename);
-        
-        // Check write access
-        if (!check_access(&config->acl_manager, filename, session->username, ACCESS_WRITE)) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "UNDO denied: user='%s' lacks write access to file='%s'", 
-                       session->username, filename);
-            send(session->socket_fd, "ERROR|Access denied\n", 20, 0);
-            return;
-        }
-        
-        // Get SS info
-        int ss_id = get_file_primary_ss(&config->file_table, filename);
-        if (ss_id < 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "UNDO: File not found '%s'", filename);
-            send(session->socket_fd, "ERROR|File not found\n", 21, 0);
-            return;
-        }
-        
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "UNDO: SS#%d not available", ss_id);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
-            return;
-        }
-        
-        // Return SS connection info
-        char response[BUFFER_SIZE];
-        snprintf(response, sizeof(response), "REDIRECT|%s|%d\n", ss->ip, ss->client_port);
-        send(session->socket_fd, response, strlen(response), 0);
-        
-        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "UNDO redirect: user='%s', file='%s' -> SS#%d", 
-                   session->username, filename, ss_id);
-        
-        printf("    → Redirecting UNDO to SS#%d\n", ss_id);
-    }
-    
     // ========================================================================
     // EXEC - Fetch from SS, execute on NM
     // ========================================================================
     else if (strcmp(cmd, "EXEC") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
+        char *filename = message_next_arg(msg);
         
         if (!filename) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "EXEC: Missing filename - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing filename\n", 23, 0);
+            session_send(session, "ERROR|Missing filename\n", 23);
             return;
         }
         
@@ -647,72 +828,54 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
                    "EXEC request: user='%s', filename='%s'", 
                    session->username, filename);
         
-        // Check read access
-        if (!check_access(&config->acl_manager, filename, session->username, ACCESS_READ)) {
+        // Check read access and get SS info
+        FileLocation location;
+        int resolved = resolve_file(&config->catalog, filename, session->user,
+                                    ACCESS_READ, &location);
+        if (resolved == ERR_PERMISSION_DENIED) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "EXEC denied: user='%s' lacks access to file='%s'", 
                        session->username, filename);
-            send(session->socket_fd, "ERROR|Access denied\n", 20, 0);
+            session_send(session, "ERROR|Access denied\n", 20);
             return;
         }
-        
-        // Get SS info
-        int ss_id = get_file_primary_ss(&config->file_table, filename);
-        if (ss_id < 0) {
+        if (resolved != ERR_SUCCESS) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "EXEC: File not found '%s'", filename);
-            send(session->socket_fd, "ERROR|File not found\n", 21, 0);
-            return;
-        }
-        
-        SSSession *ss = find_ss_session(config, ss_id);
-        if (!ss) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "EXEC: SS#%d not available", ss_id);
-            send(session->socket_fd, "ERROR|SS not available\n", 23, 0);
+            session_send(session, "ERROR|File not found\n", 21);
             return;
         }
+        int ss_id = location.ss_id;
         
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Fetching content from SS#%d for EXEC", ss_id);
         printf("    → Fetching content from SS#%d for EXEC\n", ss_id);
         
-        // Connect to SS to get file content
-        int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-        struct sockaddr_in ss_addr;
-        memset(&ss_addr, 0, sizeof(ss_addr));
-        ss_addr.sin_family = AF_INET;
-        ss_addr.sin_port = htons(ss->client_port);
-        inet_pton(AF_INET, ss->ip, &ss_addr.sin_addr);
+        // Get file content (any size)
+        char ss_cmd[BUFFER_SIZE];
+        snprintf(ss_cmd, sizeof(ss_cmd), "CLEANREAD|%s", filename);
+        DynamicBuffer ss_response = {0};
+        int call_result = call_storage_server(location.ip, location.client_port, ss_cmd, &ss_response);
         
-        if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) < 0) {
+        if (call_result == ERR_CONNECT_FAILED) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "EXEC: Failed to connect to SS#%d (errno=%d: %s)", 
                        ss_id, errno, strerror(errno));
-            send(session->socket_fd, "ERROR|Failed to connect to SS\n", 31, 0);
-            close(ss_socket);
+            session_send(session, "ERROR|Failed to connect to SS\n", 30);
             return;
         }
         
-        // Request file content
-        char ss_cmd[BUFFER_SIZE];
-        snprintf(ss_cmd, sizeof(ss_cmd), "CLEANREAD|%s\n", filename);
-        send(ss_socket, ss_cmd, strlen(ss_cmd), 0);
-        
-        // Get response
-        char ss_response[LARGE_BUFFER_SIZE];
-        ssize_t bytes = recv(ss_socket, ss_response, sizeof(ss_response) - 1, 0);
-        close(ss_socket);
-        
-        if (bytes <= 0 || strncmp(ss_response, "SUCCESS|", 8) != 0) {
+        if (call_result != ERR_SUCCESS || ss_response.length < 8 ||
+            strncmp(ss_response.data, "SUCCESS|", 8) != 0) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "EXEC: Failed to read file from SS#%d (bytes=%zd)", ss_id, bytes);
-            send(session->socket_fd, "ERROR|Failed to read file\n", 27, 0);
+                       "EXEC: Failed to read file from SS#%d (bytes=%zu)", ss_id, ss_response.length);
+            dynbuf_free(&ss_response);
+            session_send(session, "ERROR|Failed to read file\n", 26);
             return;
         }
         
         // Extract content (skip "SUCCESS|")
-        char *content = ss_response + 8;
+        char *content = ss_response.data + 8;
         
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                    "Executing command: user='%s', file='%s', command='%s'", 
@@ -720,15 +883,16 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
         printf("    → Executing commands from '%s' command: %s\n", filename, content);
         
         // Execute on NM
-        char result[LARGE_BUFFER_SIZE] = "SUCCESS|\n";
         FILE *fp = popen(content, "r");
+        dynbuf_free(&ss_response);
         if (!fp) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                        "EXEC: popen failed (errno=%d: %s)", errno, strerror(errno));
-            send(session->socket_fd, "ERROR|Execution failed\n", 24, 0);
+            session_send(session, "ERROR|Execution failed\n", 23);
             return;
         }
         
+        char result[LARGE_BUFFER_SIZE] = "SUCCESS|\n";
         char line[BUFFER_SIZE];
         int output_lines = 0;
         while (fgets(line, sizeof(line), fp)) {
@@ -743,14 +907,14 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
                    session->username, filename, exit_code, output_lines);
         
         if (exit_code == 0) {
-            send(session->socket_fd, result, strlen(result), 0);
+            session_send(session, result, strlen(result));
         } else {
             char error[BUFFER_SIZE];
             snprintf(error, sizeof(error), "ERROR|Command failed with exit code %d\n%s", 
                     exit_code, result + 8);
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "EXEC failed: exit_code=%d", exit_code);
-            send(session->socket_fd, error, strlen(error), 0);
+            session_send(session, error, strlen(error));
         }
     }
     
@@ -761,7 +925,8 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                    "LIST request: user='%s'", session->username);
         
-        char response[LARGE_BUFFER_SIZE] = "SUCCESS|Users:\n";
+        DynamicBuffer response = {0};
+        dynbuf_append_str(&response, "SUCCESS|Users:\n");
         
         pthread_mutex_lock(&config->client_session_lock);
         
@@ -770,9 +935,9 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
         
         while (current) {
             if (current->is_active) {
-                strcat(response, "--> ");
-                strcat(response, current->username);
-                strcat(response, "\n");
+                dynbuf_append_str(&response, "--> ");
+                dynbuf_append_str(&response, current->username);
+                dynbuf_append_str(&response, "\n");
                 user_count++;
             }
             current = current->next;
@@ -781,27 +946,28 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
         pthread_mutex_unlock(&config->client_session_lock);
         
         if (user_count == 0) {
-            strcat(response, "(No users connected)\n");
+            dynbuf_append_str(&response, "(No users connected)\n");
         }
         
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                    "LIST completed: active_users=%d", user_count);
         
-        send(session->socket_fd, response, strlen(response), 0);
+        session_send(session, response.data, response.length);
+        dynbuf_free(&response);
     }    
     
     // ========================================================================
     // ADDACCESS - Grant access
     // ========================================================================
     else if (strcmp(cmd, "ADDACCESS") == 0) {
-        char *access_type = strtok_r(NULL, "|", &saveptr);
-        char *filename = strtok_r(NULL, "|", &saveptr);
-        char *target_user = strtok_r(NULL, "|", &saveptr);
+        char *access_type = message_next_arg(msg);
+        char *filename = message_next_arg(msg);
+        char *target_user = message_next_arg(msg);
         
         if (!access_type || !filename || !target_user) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "ADDACCESS: Missing parameters - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing parameters\n", 25, 0);
+            session_send(session, "ERROR|Missing parameters\n", 25);
             return;
         }
         
@@ -809,56 +975,23 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
                    "ADDACCESS request: user='%s', file='%s', target='%s', type='%s'", 
                    session->username, filename, target_user, access_type);
         
-        // Check if owner
-        FileAccessControl *acl = get_file_acl(&config->acl_manager, filename);
-        if (!acl || strcmp(acl->owner, session->username) != 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "ADDACCESS denied: user='%s' is not owner of '%s'", 
-                       session->username, filename);
-            send(session->socket_fd, "ERROR|Only owner can grant access\n", 35, 0);
-            return;
-        }
-        
-        int access_level = ACCESS_NONE;
-        if (strcmp(access_type, "-R") == 0) {
-            access_level = ACCESS_READ;
-        } else if (strcmp(access_type, "-W") == 0) {
-            access_level = ACCESS_WRITE;
-        } else {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "ADDACCESS: Invalid access type '%s'", access_type);
-            send(session->socket_fd, "ERROR|Invalid access type (use -R or -W)\n", 42, 0);
-            return;
-        }
-        
-        int result = grant_access(&config->acl_manager, filename, target_user, access_level);
-        
-        if (result == ERR_SUCCESS) {
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Access granted: file='%s', target='%s', level=%d, by='%s'", 
-                       filename, target_user, access_level, session->username);
-            send(session->socket_fd, "SUCCESS|Access granted successfully!\n", 38, 0);
-        } else {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "ADDACCESS failed: file='%s', target='%s', error=%d", 
-                       filename, target_user, result);
-            char error[256];
-            snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(result));
-            send(session->socket_fd, error, strlen(error), 0);
-        }
+        CatalogStripe *stripe = catalog_stripe(&config->catalog, filename);
+        pthread_rwlock_wrlock(&stripe->lock);
+        add_access_locked(session, config, access_type, filename, target_user);
+        pthread_rwlock_unlock(&stripe->lock);
     }
     
     // ========================================================================
     // REMACCESS - Revoke access
     // ========================================================================
     else if (strcmp(cmd, "REMACCESS") == 0) {
-        char *filename = strtok_r(NULL, "|", &saveptr);
-        char *target_user = strtok_r(NULL, "|", &saveptr);
+        char *filename = message_next_arg(msg);
+        char *target_user = message_next_arg(msg);
         
         if (!filename || !target_user) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                        "REMACCESS: Missing parameters - user='%s'", session->username);
-            send(session->socket_fd, "ERROR|Missing parameters\n", 25, 0);
+            session_send(session, "ERROR|Missing parameters\n", 25);
             return;
         }
         
@@ -866,31 +999,17 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
                    "REMACCESS request: user='%s', file='%s', target='%s'", 
                    session->username, filename, target_user);
         
-        // Check if owner
-        FileAccessControl *acl = get_file_acl(&config->acl_manager, filename);
-        if (!acl || strcmp(acl->owner, session->username) != 0) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "REMACCESS denied: user='%s' is not owner of '%s'", 
-                       session->username, filename);
-            send(session->socket_fd, "ERROR|Only owner can revoke access\n", 36, 0);
-            return;
-        }
-        
-        int result = revoke_access(&config->acl_manager, filename, target_user);
-        
-        if (result == ERR_SUCCESS) {
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Access revoked: file='%s', target='%s', by='%s'", 
-                       filename, target_user, session->username);
-            send(session->socket_fd, "SUCCESS|Access removed successfully!\n", 38, 0);
-        } else {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "REMACCESS failed: file='%s', target='%s', error=%d", 
-                       filename, target_user, result);
-            char error[256];
-            snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(result));
-            send(session->socket_fd, error, strlen(error), 0);
-        }
+        CatalogStripe *stripe = catalog_stripe(&config->catalog, filename);
+        pthread_rwlock_wrlock(&stripe->lock);
+        remove_access_locked(session, config, filename, target_user);
+        pthread_rwlock_unlock(&stripe->lock);
+    }
+    
+    // ========================================================================
+    // BATCH - Many metadata commands in one request
+    // ========================================================================
+    else if (strcmp(cmd, "BATCH") == 0) {
+        handle_batch(session, config, msg);
     }
     
     // ========================================================================
@@ -902,6 +1021,6 @@ void handle_session_command(ClientSession *session, NameServerConfig *config,
                    session->username, cmd);
         char error[256];
         snprintf(error, sizeof(error), "ERROR|Unknown command: %s\n", cmd);
-        send(session->socket_fd, error, strlen(error), 0);
+        session_send(session, error, strlen(error));
     }
 }
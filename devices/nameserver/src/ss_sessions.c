@@ -14,6 +14,7 @@ SSSession* create_ss_session(int socket_fd, int ss_id, const char *ip,
     session->client_port = client_port;
     session->is_active = 1;
     session->last_heartbeat = time(NULL);
+    session->conn = NULL;
     session->next = NULL;
     
     return session;
@@ -37,7 +38,7 @@ int add_ss_session(NameServerConfig *config, SSSession *session) {
     return ERR_SUCCESS;
 }
 
-// Remove SS session
+// Remove SS session. Its socket belongs to the SS reactor, which closes it.
 int remove_ss_session(NameServerConfig *config, int ss_id) {
     pthread_mutex_lock(&config->ss_session_lock);
     
@@ -54,7 +55,6 @@ int remove_ss_session(NameServerConfig *config, int ss_id) {
             }
             
             current->is_active = 0;
-            close(current->socket_fd);
             config->ss_session_count--;
             
             printf("✗ SS#%d session removed (Total: %d)\n", 
@@ -72,21 +72,41 @@ int remove_ss_session(NameServerConfig *config, int ss_id) {
     return ERR_SS_NOT_REGISTERED;
 }
 
-// Find SS session by ID
-SSSession* find_ss_session(NameServerConfig *config, int ss_id) {
+// Copy where ss_id serves clients. The session itself may be freed as soon
+// as the lock drops, so callers keep this copy rather than the session.
+int ss_session_location(NameServerConfig *config, int ss_id, FileLocation *location) {
     pthread_mutex_lock(&config->ss_session_lock);
     
     SSSession *current = config->ss_sessions;
     while (current) {
         if (current->ss_id == ss_id && current->is_active) {
+            memset(location, 0, sizeof(*location));
+            location->ss_id = current->ss_id;
+            memcpy(location->ip, current->ip, INET_ADDRSTRLEN);
+            location->client_port = current->client_port;
             pthread_mutex_unlock(&config->ss_session_lock);
-            return current;
+            return ERR_SUCCESS;
         }
         current = current->next;
     }
     
     pthread_mutex_unlock(&config->ss_session_lock);
-    return NULL;
+    return ERR_SS_NOT_REGISTERED;
+}
+
+int ss_session_registered(NameServerConfig *config, int ss_id) {
+    pthread_mutex_lock(&config->ss_session_lock);
+    
+    int registered = 0;
+    for (SSSession *current = config->ss_sessions; current; current = current->next) {
+        if (current->ss_id == ss_id && current->is_active) {
+            registered = 1;
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&config->ss_session_lock);
+    return registered;
 }
 
 // Handle SS failure
@@ -96,72 +116,9 @@ void handle_ss_failure(NameServerConfig *config, int failed_ss_id) {
     // Remove from session list
     remove_ss_session(config, failed_ss_id);
     
-    // Remove all file mappings for this SS
-    printf("  → Removing file mappings for SS#%d\n", failed_ss_id);
-    
-    pthread_mutex_lock(&config->file_table.lock);
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        FileMapping *current = config->file_table.buckets[i];
-        FileMapping *prev = NULL;
-        
-        while (current) {
-            if (current->primary_ss_id == failed_ss_id) {
-                printf("    ✗ File '%s' lost\n", current->filename);
-                FileMapping *to_delete = current;
-                
-                if (prev) {
-                    prev->next = current->next;
-                } else {
-                    config->file_table.buckets[i] = current->next;
-                }
-                
-                current = current->next;
-                free(to_delete);
-            } else {
-                prev = current;
-                current = current->next;
-            }
-        }
-    }
-    pthread_mutex_unlock(&config->file_table.lock);
+    // Every file it held loses its location
+    printf("  → Removing file locations for SS#%d\n", failed_ss_id);
+    int lost = catalog_drop_ss(&config->catalog, failed_ss_id);
     
-    printf("  ✓ Cleanup complete for SS#%d\n", failed_ss_id);
+    printf("  ✓ Cleanup complete for SS#%d (%d files lost)\n", failed_ss_id, lost);
 }
-
-// Monitor SS heartbeats
-void* monitor_ss_heartbeats(void *arg) {
-    NameServerConfig *config = (NameServerConfig*)arg;
-    
-    printf("✓ Heartbeat monitor started\n");
-    
-    while (config->is_running) {
-        sleep(5); // Check every 5 seconds
-        
-        pthread_mutex_lock(&config->ss_session_lock);
-        
-        SSSession *current = config->ss_sessions;
-        while (current) {
-            time_t now = time(NULL);
-            time_t elapsed = now - current->last_heartbeat;
-            
-            // If no heartbeat for 15 seconds, consider failed
-            if (elapsed > 15 && current->is_active) {
-                int failed_id = current->ss_id;
-                pthread_mutex_unlock(&config->ss_session_lock);
-                
-                handle_ss_failure(config, failed_id);
-                
-                pthread_mutex_lock(&config->ss_session_lock);
-                // Restart iteration after modification
-                current = config->ss_sessions;
-                continue;
-            }
-            
-            current = current->next;
-        }
-        
-        pthread_mutex_unlock(&config->ss_session_lock);
-    }
-    
-    return NULL;
-}
\ No newline at end of file
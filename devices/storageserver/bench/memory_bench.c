@@ -0,0 +1,120 @@
+#include "../include/storageserver.h"
+#include <time.h>
+#include <sys/resource.h>
+
+// ============================================================================
+// DOCUMENT MEMORY BENCHMARK
+// ============================================================================
+// Loads and frees a generated file several times and reports the best load
+// and free times (mostly allocator work: every sentence and word of the
+// document is allocated on load and released on free), then the process's
+// peak RSS with one copy loaded and what stays resident once loading is done.
+// Only load_file_content() and free_file_content() are called, so it builds
+// against older trees too: `make bench-baseline BASELINE=<commit>` builds it
+// against the tree at that commit, e.g. the last one before the document arena.
+//
+// The peak is several times the file because it holds the whole file as read
+// plus the parsed copy. Each generated sentence parses into a 112-byte node,
+// about 52 bytes of text and 12 four-byte word offsets, ~212 bytes for ~55
+// bytes of file; the ID table adds 8 bytes per sentence.
+//
+// Usage: memory_bench [sentences] [repeats]   (default 1000000 3)
+
+FILE* log_file;
+
+#define BENCH_FILE "bench.txt"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Resident set now, 0 if /proc isn't there
+static long current_rss_kb(void) {
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%*s %ld", &pages) != 1) pages = 0;
+        fclose(statm);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[]) {
+    int sentences = argc > 1 ? atoi(argv[1]) : 1000000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 3;
+    if (sentences <= 0 || repeats <= 0) {
+        fprintf(stderr, "Usage: %s [sentences] [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    char dir[] = "/tmp/ss_bench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", dir, BENCH_FILE);
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        rmdir(dir);
+        return 1;
+    }
+    for (int i = 0; i < sentences; i++) {
+        fprintf(file, "Sentence %d has a few more words in it and then some. ", i);
+    }
+    long file_bytes = ftell(file);
+    fclose(file);
+
+    long baseline_kb = peak_rss_kb();
+    long baseline_resident_kb = current_rss_kb();
+    double best_load = 1e9;
+    double best_free = 1e9;
+    int result = 0;
+
+    for (int i = 0; i < repeats && result == 0; i++) {
+        double start = now_seconds();
+        FileContent *doc = load_file_content(dir, BENCH_FILE);
+        double loaded = now_seconds();
+        if (!doc) {
+            fprintf(stderr, "Failed to load %s\n", path);
+            result = 1;
+            break;
+        }
+        free_file_content(doc);
+        double freed = now_seconds();
+
+        if (loaded - start < best_load) best_load = loaded - start;
+        if (freed - loaded < best_free) best_free = freed - loaded;
+    }
+
+    if (result == 0) {
+        FileContent *doc = load_file_content(dir, BENCH_FILE);
+        long peak_kb = peak_rss_kb();
+        long resident_kb = current_rss_kb() - baseline_resident_kb;
+
+        printf("Document memory, %d sentences (%.1f MB file), best of %d\n",
+               doc->sentence_count, file_bytes / 1048576.0, repeats);
+        printf("  load        %9.1f ms\n", best_load * 1e3);
+        printf("  free        %9.1f ms\n", best_free * 1e3);
+        printf("  peak RSS    %9.1f MB   (%.1f MB before loading)\n",
+               peak_kb / 1024.0, baseline_kb / 1024.0);
+        printf("  resident    %9.1f MB   (%.0f bytes per sentence once loaded)\n",
+               resident_kb / 1024.0, resident_kb * 1024.0 / doc->sentence_count);
+
+        free_file_content(doc);
+    }
+
+    unlink(path);
+    rmdir(dir);
+    return result;
+}
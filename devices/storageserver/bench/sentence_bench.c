@@ -0,0 +1,148 @@
+#include "../include/storageserver.h"
+#include <time.h>
+
+// ============================================================================
+// SENTENCE INDEX BENCHMARK
+// ============================================================================
+// Times reaching a random sentence and a full edit session (stage, insert,
+// split, merge) on generated files of growing size. The list walk the
+// index replaced is timed alongside for comparison: with the treap the
+// per-operation cost should grow with log n, the walk's with n.
+//
+// Usage: sentence_bench [sentences...] [-o ops]   (default 1000 10000 100000)
+
+FILE* log_file;
+static FILE *report;    // The real stdout; the editing code prints progress to stdout
+
+#define BENCH_FILE "bench.txt"
+#define DEFAULT_OPS 20000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int write_document(const char *dir, int sentences) {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", dir, BENCH_FILE);
+    FILE *file = fopen(path, "w");
+    if (!file) return ERR_FILE_OPEN_FAILED;
+    for (int i = 0; i < sentences; i++) {
+        fprintf(file, "Sentence %d has a few more words in it. ", i);
+    }
+    fclose(file);
+    return ERR_SUCCESS;
+}
+
+// Sentence N by following next pointers, as before the index
+static SentenceNode* walk_to_sentence(const FileContent *file, int sentence_num) {
+    SentenceNode *node = file->head;
+    while (node && sentence_num-- > 0) node = node->next;
+    return node;
+}
+
+static int run(const char *dir, int sentences, int ops) {
+    if (write_document(dir, sentences) != ERR_SUCCESS) return 1;
+
+    double start = now_seconds();
+    FileContent *doc = load_file_content(dir, BENCH_FILE);
+    double load_time = now_seconds() - start;
+    if (!doc) {
+        fprintf(stderr, "Failed to load %d-sentence document\n", sentences);
+        return 1;
+    }
+
+    long checksum = 0;
+    srand(1);
+    start = now_seconds();
+    for (int i = 0; i < ops; i++) {
+        checksum += get_sentence_node(doc, rand() % doc->sentence_count)->word_count;
+    }
+    double index_time = now_seconds() - start;
+
+    // The walk is far slower on big files; fewer ops keep the run short
+    int walk_ops = ops / 20 > 0 ? ops / 20 : 1;
+    srand(1);
+    start = now_seconds();
+    for (int i = 0; i < walk_ops; i++) {
+        checksum += walk_to_sentence(doc, rand() % doc->sentence_count)->word_count;
+    }
+    double walk_time = now_seconds() - start;
+
+    srand(2);
+    start = now_seconds();
+    for (int i = 0; i < ops; i++) {
+        SentenceNode *target = get_sentence_node(doc, rand() % doc->sentence_count);
+        FileContent *staging = create_staging_content(BENCH_FILE, target);
+        int staged = 0;
+        SentenceDelta delta;
+        FileSplice splice;
+        sentence_delta_init(&delta);
+        file_splice_init(&splice);
+
+        modify_sentence_multiword(staging, 0, 3, "extra", "bench", &staged);
+        modify_sentence_multiword(staging, 0, 2, "split. here", "bench", &staged);
+        if (merge_sentence_edits(doc, target, staging, &delta, &splice) != ERR_SUCCESS) {
+            fprintf(stderr, "Merge failed at op %d\n", i);
+            return 1;
+        }
+        sentence_delta_free(&delta);
+        file_splice_free(&splice);
+    }
+    double edit_time = now_seconds() - start;
+
+    fprintf(report, "%10d %10.3f %14.2f %14.2f %14.2f   (%d sentences after, checksum %ld)\n",
+           sentences, load_time, index_time / ops * 1e6, walk_time / walk_ops * 1e6,
+           edit_time / ops * 1e6, doc->sentence_count, checksum);
+
+    free_file_content(doc);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[16];
+    int size_count = 0;
+    int ops = DEFAULT_OPS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            ops = atoi(argv[++i]);
+        } else if (size_count < 16) {
+            sizes[size_count++] = atoi(argv[i]);
+        }
+    }
+    if (size_count == 0) {
+        sizes[size_count++] = 1000;
+        sizes[size_count++] = 10000;
+        sizes[size_count++] = 100000;
+    }
+
+    char dir[] = "/tmp/ss_bench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        perror("stdout");
+        return 1;
+    }
+
+    fprintf(report, "Sentence index, %d ops per size (walk: %d)\n", ops, ops / 20 > 0 ? ops / 20 : 1);
+    fprintf(report, "%10s %10s %14s %14s %14s\n", "sentences", "load s", "index us/op", "walk us/op", "edit us/op");
+
+    int result = 0;
+    for (int i = 0; i < size_count && result == 0; i++) {
+        if (sizes[i] <= 0) continue;
+        result = run(dir, sizes[i], ops);
+    }
+
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", dir, BENCH_FILE);
+    unlink(path);
+    rmdir(dir);
+    fclose(report);
+    return result;
+}
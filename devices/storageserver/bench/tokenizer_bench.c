@@ -0,0 +1,129 @@
+#include "../include/storageserver.h"
+#include <time.h>
+
+// ============================================================================
+// TOKENIZER BENCHMARK
+// ============================================================================
+// Throughput of each block scanner the CPU supports, of text_stats() and
+// of the tokenizer, over generated text held in memory. A plain byte loop
+// counting words the same way is timed as the baseline.
+//
+// Usage: tokenizer_bench [sentences] [repeats]   (default 1000000 5)
+
+FILE* log_file;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t byte_loop_words(const char *text, size_t length) {
+    size_t words = 0;
+    int in_word = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        int boundary = c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t' ||
+                       c == '.' || c == '!' || c == '?';
+        words += !boundary && !in_word;
+        in_word = !boundary;
+    }
+    return words;
+}
+
+static size_t scan_all(TextScanFn scan, const char *text, size_t length) {
+    size_t bits = 0;
+    for (size_t offset = 0; offset < length; offset += TEXT_SCAN_BLOCK) {
+        uint64_t ws, delim;
+        text_scan_at(scan, text, length, offset, &ws, &delim);
+        bits += (size_t)__builtin_popcountll(ws | delim);
+    }
+    return bits;
+}
+
+static size_t tokenize_all(const char *text, size_t length) {
+    TextTokenizer tok;
+    TextToken token;
+    size_t tokens = 0;
+    text_tokenizer_init(&tok, text, length, 1);
+    while (text_tokenizer_next(&tok, &token)) tokens++;
+    return tokens;
+}
+
+static void report(const char *name, double seconds, size_t length, size_t result) {
+    printf("  %-12s %6.2f GB/s   (%zu)\n", name, length / seconds / 1e9, result);
+}
+
+int main(int argc, char *argv[]) {
+    int sentences = argc > 1 ? atoi(argv[1]) : 1000000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    if (sentences <= 0 || repeats <= 0) {
+        fprintf(stderr, "Usage: %s [sentences] [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    DynamicBuffer text;
+    dynbuf_init(&text, (size_t)sentences * 64);
+    for (int i = 0; i < sentences; i++) {
+        char sentence[96];
+        int n = snprintf(sentence, sizeof(sentence),
+                         "Sentence %d has a few more words in it and then some%c ", i, ".!?"[i % 3]);
+        dynbuf_append(&text, sentence, (size_t)n);
+    }
+
+    printf("Tokenizer, %.1f MB of text, best of %d\n", text.length / 1048576.0, repeats);
+
+    typedef struct {
+        const char *name;
+        TextScanFn scan;
+    } ScanPath;
+    ScanPath paths[3];
+    int path_count = 0;
+    paths[path_count++] = (ScanPath){"scan scalar", text_scan_block_scalar};
+#ifdef TEXT_SCAN_X86
+    if (__builtin_cpu_supports("sse2")) paths[path_count++] = (ScanPath){"scan sse2", text_scan_block_sse2};
+    if (__builtin_cpu_supports("avx2")) paths[path_count++] = (ScanPath){"scan avx2", text_scan_block_avx2};
+#endif
+
+    double best = 1e9;
+    size_t result = 0;
+    for (int r = 0; r < repeats; r++) {
+        double start = now_seconds();
+        result = byte_loop_words(text.data, text.length);
+        double elapsed = now_seconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    report("byte loop", best, text.length, result);
+
+    for (int p = 0; p < path_count; p++) {
+        best = 1e9;
+        for (int r = 0; r < repeats; r++) {
+            double start = now_seconds();
+            result = scan_all(paths[p].scan, text.data, text.length);
+            double elapsed = now_seconds() - start;
+            if (elapsed < best) best = elapsed;
+        }
+        report(paths[p].name, best, text.length, result);
+    }
+
+    best = 1e9;
+    for (int r = 0; r < repeats; r++) {
+        double start = now_seconds();
+        result = text_stats(text.data, text.length).words;
+        double elapsed = now_seconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    report("text_stats", best, text.length, result);
+
+    best = 1e9;
+    for (int r = 0; r < repeats; r++) {
+        double start = now_seconds();
+        result = tokenize_all(text.data, text.length);
+        double elapsed = now_seconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    report("tokenizer", best, text.length, result);
+
+    dynbuf_free(&text);
+    return 0;
+}
@@ -2,59 +2,505 @@
 #define STORAGESERVER_H
 
 #include "../../common/common.h"
+#include <stdint.h>
 
 #define LOG_FILE ".sslogs"
 extern FILE* log_file;
 
+// Room for <storage_dir>/<file> plus the longest suffix of its sidecars
+#define STORAGE_PATH_LENGTH (MAX_PATH_LENGTH + MAX_FILENAME_LENGTH + 32)
+
 // ============================================================================
 // SENTENCE AND WORD STRUCTURES
 // ============================================================================
 
-// Word node in doubly-linked list
-typedef struct WordNode {
-    char *content;
-    struct WordNode *prev;
-    struct WordNode *next;
-} WordNode;
-
-// Sentence node in linked list (contains word list)
+// Sentence node. The words are stored back to back in one text buffer,
+// separated by single spaces, with the start of each word in word_offsets:
+// word_index is a direct subscript and rendering is one copy. Sentences are
+// kept both in document order (next) and in an order-statistic treap so
+// sentence N is found in O(log n). Each one also has an ID that stays the
+// same while sentences before it come and go, hashed for lookup.
 typedef struct SentenceNode {
-    WordNode *word_head;
-    WordNode *word_tail;
+    char *text;                 // Not NUL-terminated, no delimiter
+    uint32_t *word_offsets;
+    uint32_t text_length;
+    uint32_t text_capacity;
     int word_count;
+    int word_capacity;
     char delimiter;  // . ! ? or \0
+    uint32_t id;     // Unique in the document, never reused
 
-    // Per-sentence lock (for thread safety within modifications)
-    int is_locked;
-    char locked_by[MAX_USERNAME_LENGTH];
-    pthread_mutex_t sentence_lock;
+    // User whose write session is editing this sentence of the live
+    // document, NULL when free. Guarded by the document's file_lock.
+    char *editor;
+
+    // Sentence index (implicit treap keyed by position)
+    struct SentenceNode *tree_left;
+    struct SentenceNode *tree_right;
+    struct SentenceNode *tree_parent;
+    unsigned int tree_priority;
+    int subtree_size;
+    uint32_t saved_bytes;       // This sentence's share of the saved text
+    size_t subtree_saved_bytes;
+
+    struct SentenceNode *id_next;   // ID hash chain
 
     struct SentenceNode *next;
 } SentenceNode;
 
+// ============================================================================
+// PER-DOCUMENT ARENA
+// ============================================================================
+
+#define ARENA_MIN_CHUNK_BYTES 4096
+#define ARENA_MAX_CHUNK_BYTES (1024 * 1024)
+#define SENTENCE_SLAB_MIN_NODES 8
+#define SENTENCE_SLAB_MAX_NODES 1024
+#define ARENA_COMPACT_MIN_DEAD_BYTES (64 * 1024)
+
+// Bump-allocated block holding sentence text and word offsets
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaChunk;
+
+// Block of sentence nodes; free nodes are chained through ->next
+typedef struct SentenceSlab {
+    struct SentenceSlab *next;
+    int capacity;
+    SentenceNode nodes[];
+} SentenceSlab;
+
+// Everything a parsed document owns lives here, so loading and freeing a
+// document costs a handful of allocations instead of several per word
+typedef struct {
+    ArenaChunk *chunks;         // Current chunk first
+    size_t chunk_bytes;         // Capacity of all chunks
+    size_t live_bytes;          // Bytes still referenced by the document
+    size_t dead_bytes;          // Bytes orphaned by edits, reclaimed by compaction
+    SentenceSlab *slabs;        // Newest (largest) slab first
+    size_t slab_bytes;
+    SentenceNode *free_sentences;
+} DocumentArena;
+
+// Counts for the text save_file_content() writes, kept up to date by every
+// edit so committing a write never has to rescan the document
+typedef struct {
+    long words;
+    long text_bytes;            // Words, separating spaces and delimiters
+    int filled_sentences;       // Sentences with words; empty ones aren't saved
+    int ended_sentences;        // Filled sentences that end in a delimiter
+} DocumentStats;
+
 // File content structure
 typedef struct {
     char filename[MAX_FILENAME_LENGTH];
+    DocumentArena arena;
     SentenceNode *head;
+    SentenceNode *tail;
+    SentenceNode *root;         // Sentence index root
+    unsigned int index_seed;    // Treap priority generator state
     int sentence_count;
+    SentenceNode **id_buckets;  // Sentences by ID; NULL if never allocated
+    uint32_t id_bucket_count;   // Power of two
+    uint32_t next_sentence_id;
+    DocumentStats stats;
     pthread_mutex_t file_lock;
+    int ref_count;  // Owners while shared through the content cache
+    int is_stale;   // Dropped from the cache by UNDO/DELETE; don't commit into it
+    int wal_dirty;  // Has logged commits the file on disk lacks; never evicted
+    int wal_base_raw;   // The file on disk is exactly this document's saved text
+
+    // Undo history in the <file>.versions format, read on the first commit
+    // or UNDO and changed together with the document under the commit gate
+    DynamicBuffer history;
+    int history_loaded;
 } FileContent;
 
+// How READ and CLEANREAD show a document, one sentence per line
+typedef enum {
+    RENDER_PLAIN,           // sentence
+    RENDER_NUMBERED,        // [n] sentence
+    RENDER_NUMBERED_IDS     // [n @id] sentence
+} RenderStyle;
+
+// ============================================================================
+// SENTENCE IDS
+// ============================================================================
+
+// The IDs of a file's saved sentences are kept next to it in <file>.sids,
+// in file order (one per line of the saved text), written by checkpoints
+// together with the file. The checksum of the text they were saved with
+// tells whether they still describe the file; a file changed some other
+// way gets fresh IDs, numbered from next_id so none is handed out twice.
+#define SENTENCE_ID_SUFFIX ".sids"
+#define SENTENCE_ID_MAGIC 0x44495353u       // "SSID"
+#define SENTENCE_ID_FORMAT 1
+#define SENTENCE_ID_MIN_BUCKETS 16
+
+// Lock key for appending a new sentence after the last one. Real IDs start at 1.
+#define SENTENCE_APPEND_ID 0
+
+// On-disk header, followed by count u32 IDs (0 = unknown). The checksum
+// covers the header (checksum = 0) and the IDs.
+typedef struct {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t reserved;
+    uint32_t next_id;
+    uint32_t count;
+    uint64_t text_length;
+    uint32_t text_checksum;
+    uint32_t checksum;
+} SentenceIdHeader;
+
+// ============================================================================
+// PARSED DOCUMENT CACHE
+// ============================================================================
+
+#define CONTENT_CACHE_BUCKETS 257
+#define CONTENT_CACHE_BUDGET_BYTES (64 * 1024 * 1024)
+
+typedef struct CacheEntry {
+    char filename[MAX_FILENAME_LENGTH];
+    FileContent *content;
+    size_t memory_bytes;
+    struct CacheEntry *hash_next;
+    struct CacheEntry *lru_prev;   // Towards most recently used
+    struct CacheEntry *lru_next;   // Towards least recently used
+} CacheEntry;
+
+typedef struct {
+    CacheEntry *buckets[CONTENT_CACHE_BUCKETS];
+    CacheEntry *lru_head;
+    CacheEntry *lru_tail;
+    int entry_count;
+    size_t memory_used;
+    size_t memory_budget;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long invalidations;
+    pthread_mutex_t lock;
+} ContentCache;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long invalidations;
+    int entry_count;
+    size_t memory_used;
+    size_t memory_budget;
+} ContentCacheStats;
+
 // ============================================================================
 // GLOBAL SENTENCE LOCK STRUCTURES (for cross-client locking)
 // ============================================================================
 
-// Global sentence lock entry (shared across all clients)
+// Hashed on (file, sentence ID) with a mutex per bucket, so editors of
+// different sentences rarely meet. An entry exists only while held.
+#define SENTENCE_LOCK_BUCKETS 1024
+
+// A WRITE session that sends nothing for this long gives up its sentence,
+// and another user may take over a lock not renewed for this long
+#define SENTENCE_LOCK_LEASE_SEC 300
+
+// Longest a blocking WRITE may queue for a sentence
+#define SENTENCE_LOCK_MAX_WAIT_MS (SENTENCE_LOCK_LEASE_SEC * 1000)
+
+// A waiting WRITE, queued on the entry it wants. Unlock hands the lock
+// straight to the oldest waiter, so newcomers can't cut in, and calls its
+// notify (with the bucket locked, so it must not block or take locks held
+// around lock calls). The waiter belongs to the connection that waits.
+typedef struct SentenceLockWaiter {
+    char username[MAX_USERNAME_LENGTH];
+    void (*notify)(void *arg);
+    void *arg;
+    int granted;
+    long long started_ms;
+    struct SentenceLockWaiter *next;
+} SentenceLockWaiter;
+
+// Global sentence lock entry (shared across all clients), keyed by
+// sentence ID so it keeps meaning the same sentence when others are
+// inserted before it
 typedef struct SentenceLockEntry {
     char filename[MAX_FILENAME_LENGTH];
-    int sentence_num;
-    int is_locked;
+    unsigned int file_hash;     // Compared before the name
+    uint32_t sentence_id;
     char locked_by[MAX_USERNAME_LENGTH];
-    pthread_mutex_t mutex;
-    time_t lock_time;
+    time_t lock_time;           // Granted or last renewed
+    SentenceLockWaiter *wait_head;
+    SentenceLockWaiter *wait_tail;
+    int wait_count;
     struct SentenceLockEntry *next;
 } SentenceLockEntry;
 
+typedef struct {
+    SentenceLockEntry *head;
+    pthread_mutex_t mutex;
+} SentenceLockBucket;
+
+typedef struct {
+    unsigned long waits;            // Blocking WRITEs that had to queue
+    unsigned long granted;          // ...and got the sentence
+    unsigned long timeouts;         // ...and gave up
+    unsigned long total_wait_ms;
+    unsigned long max_wait_ms;
+    int waiting;                    // Queued right now, all sentences
+    int max_queue_depth;            // Longest single queue seen
+} SentenceLockStats;
+
+// ============================================================================
+// PER-FILE READER/WRITER LOCKS
+// ============================================================================
+
+#define FILE_LOCK_BUCKETS 257
+
+typedef enum {
+    FILE_LOCK_SHARED,      // Concurrent readers (READ, CLEANREAD, INFO, STREAM)
+    FILE_LOCK_EXCLUSIVE    // Single writer (ETIRW save, UNDO, DELETE)
+} FileLockMode;
+
+// Registry entry, refcounted and freed when no thread holds or waits on it
+typedef struct FileLockEntry {
+    char filename[MAX_FILENAME_LENGTH];
+    pthread_rwlock_t rwlock;
+    int ref_count;
+    struct FileLockEntry *next;
+} FileLockEntry;
+
+// ============================================================================
+// VERSION LOG (MULTI-LEVEL UNDO)
+// ============================================================================
+
+// Every committed write adds one record to the file's undo history
+// describing which sentences it replaced, with their text before and after,
+// so UNDO can step back one commit at a time. Records cost the size of the
+// edit, not of the file. Like the file's text, the history changes in
+// memory and in the write-ahead log record of the commit or undo that
+// changes it, and <file>.versions is only rewritten by checkpoints and
+// recovery, so it never runs ahead of the text. Once a history grows
+// VERSION_LOG_COMPACT_SLACK past VERSION_LOG_RETAIN records it is trimmed
+// back to the newest VERSION_LOG_RETAIN.
+#define VERSION_LOG_SUFFIX ".versions"
+#define VERSION_LOG_MAGIC 0x4C565353u       // "SSVL"
+#define VERSION_LOG_FORMAT 1
+#define VERSION_LOG_RETAIN 32
+#define VERSION_LOG_COMPACT_SLACK 32
+
+// What one commit did: sentences [position, position + old_count) became
+// new_count sentences. Each side holds its sentences as "u32 length,
+// rendered text"; the new side lets an undo check it removes exactly what
+// the commit put there.
+typedef struct {
+    int position;
+    int old_count;
+    int new_count;
+    DynamicBuffer old_text;
+    DynamicBuffer new_text;
+} SentenceDelta;
+
+// On-disk record, followed by old_bytes and new_bytes of sentence texts
+// and then the record's total length as a u32 so the log can be walked
+// backwards from its end. The checksum covers the header (checksum = 0)
+// and both payloads.
+typedef struct {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t reserved;
+    uint64_t sequence;
+    int64_t commit_time;
+    uint32_t position;
+    uint32_t old_count;
+    uint32_t new_count;
+    uint32_t old_bytes;
+    uint32_t new_bytes;
+    uint32_t checksum;
+} VersionRecord;
+
+// ============================================================================
+// WRITE-AHEAD LOG
+// ============================================================================
+
+// Commits are not written into the files themselves. Each one appends a
+// record to the storage server's log saying which bytes of the file's
+// saved text it replaced, and the document stays in memory (pinned in the
+// content cache) until a checkpoint writes it out. A checkpoint switches
+// to a new log segment, writes every file changed in the old one as
+// <file>.ckpt, lists them in .checkpoint, renames them into place and then
+// deletes the old segment. Startup finishes an interrupted checkpoint and
+// replays what is left of the log.
+#define WAL_SEGMENT_PREFIX ".wal."
+#define WAL_CHECKPOINT_FILE ".checkpoint"
+#define CHECKPOINT_SUFFIX ".ckpt"
+#define WAL_RECORD_MAGIC 0x4C575353u        // "SSWL"
+#define WAL_CHECKPOINT_INTERVAL_SEC 30
+#define WAL_CHECKPOINT_BYTES (16 * 1024 * 1024)
+
+typedef enum {
+    WAL_MODE_NONE,      // Written by a background thread, never synced
+    WAL_MODE_GROUP,     // Commits wait for a sync shared with whoever committed meanwhile
+    WAL_MODE_SYNC       // Every commit writes and syncs the log itself
+} WalMode;
+
+typedef enum {
+    WAL_RECORD_SPLICE = 1,      // Replace old_length bytes at offset
+    WAL_RECORD_RESET = 2        // File replaced or deleted; earlier records are void
+} WalRecordType;
+
+// The record's offsets count the text of the file as loaded from disk
+// and saved again, not the raw bytes on disk
+#define WAL_FLAG_REPARSED_BASE 0x01
+// The file's undo history is emptied before the record's change to it
+#define WAL_FLAG_HISTORY_RESET 0x02
+
+// A commit as seen in the saved text: old_text at byte offset became
+// new_text. Offsets count the saved text with a newline after every
+// sentence, the last one included. new_ids holds the u32 ID of each line
+// of new_text. The undo history changes with it: emptied if
+// history_reset, then its newest history_undo records dropped, then
+// history_record (a whole VersionRecord with its texts) added if not empty.
+typedef struct {
+    size_t offset;
+    DynamicBuffer old_text;
+    DynamicBuffer new_text;
+    DynamicBuffer new_ids;
+    DynamicBuffer history_record;
+    int history_undo;
+    int history_reset;
+} FileSplice;
+
+// On-disk record, followed by the filename, old_length bytes the splice
+// replaces, new_length bytes that replace them, id_count u32 sentence
+// IDs of the new lines and history_length bytes of undo history record.
+// The checksum covers the record (with checksum = 0) and all five.
+typedef struct {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t name_length;
+    uint32_t old_length;
+    uint32_t new_length;
+    uint64_t lsn;
+    uint64_t offset;
+    uint32_t checksum;
+    uint32_t id_count;          // 0 in records from older servers
+    uint32_t history_length;
+    uint32_t history_undo;      // Newest history records the change drops
+} WalRecord;
+
+// A commit whose acknowledgment waits for its record to be synced. notify
+// runs (with the log locked, so it must not block) once the record is
+// durable or the log has failed. The waiter belongs to the connection.
+typedef struct WalWaiter {
+    uint64_t lsn;
+    void (*notify)(void *arg);
+    void *arg;
+    int queued;                 // Guarded by the log lock
+    struct WalWaiter *next;
+} WalWaiter;
+
+typedef struct {
+    WalMode mode;
+    int fd;                     // Current segment
+    uint64_t generation;        // Current segment number
+    size_t segment_bytes;
+    uint64_t last_lsn;          // Last record handed out
+    uint64_t written_lsn;       // Last record in the segment file
+    uint64_t durable_lsn;       // Last record synced
+    DynamicBuffer pending;      // Records not yet written
+    int flushing;               // The flusher is writing a batch
+    int failed;                 // A write or sync failed; no more commits
+    int stopping;               // wal_close(): threads finish up and exit
+    int closed;                 // wal_close(): no more records; flusher drains and exits
+    int has_flusher;            // Not in sync mode
+    pthread_t flusher;
+    pthread_t checkpointer;
+    unsigned long commits;
+    unsigned long syncs;
+    unsigned long checkpoints;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // Records pending
+    pthread_cond_t flushed;     // written_lsn/durable_lsn moved
+    WalWaiter *waiters;         // Commits waiting for durable_lsn to pass them
+    pthread_cond_t checkpoint_due;  // Segment reached WAL_CHECKPOINT_BYTES
+    // Commits hold it shared from changing a document to logging the
+    // change; a checkpoint holds it exclusively to snapshot documents
+    pthread_rwlock_t commit_gate;
+} WriteAheadLog;
+
+typedef struct {
+    unsigned long commits;
+    unsigned long syncs;
+    unsigned long checkpoints;
+    uint64_t generation;
+    size_t segment_bytes;
+    WalMode mode;
+} WalStats;
+
+// ============================================================================
+// METADATA STORE
+// ============================================================================
+
+// All metadata of a storage server lives in one append-only log of small
+// records in the storage directory, replayed into a hash index at startup.
+// Access times only change the index and reach the log in batches from a
+// background flusher, which also compacts the log once it is mostly stale.
+#define METADATA_STORE_FILE ".metadata"
+#define METADATA_STORE_TMP_FILE ".metadata.tmp"
+#define METADATA_STORE_BUCKETS 1021
+#define METADATA_RECORD_MAGIC 0x444D5353u     // "SSMD"
+#define METADATA_RECORD_VERSION 1
+#define METADATA_FLUSH_INTERVAL_SEC 5
+#define METADATA_COMPACT_MIN_BYTES (256 * 1024)
+
+typedef enum {
+    METADATA_RECORD_PUT = 1,
+    METADATA_RECORD_DELETE = 2
+} MetadataRecordType;
+
+// On-disk record, followed by name_length filename bytes and owner_length
+// owner bytes. The checksum covers the record (with checksum = 0) and both.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t type;
+    uint8_t is_folder;
+    uint16_t name_length;
+    uint16_t owner_length;
+    uint32_t checksum;
+    uint64_t size;
+    int64_t created_time;
+    int64_t modified_time;
+    int64_t accessed_time;
+    uint32_t word_count;
+    uint32_t char_count;
+    uint32_t sentence_count;
+    uint32_t reserved;
+} MetadataRecord;
+
+typedef struct MetadataEntry {
+    FileMetadata metadata;
+    int atime_dirty;        // accessed_time newer than the log
+    struct MetadataEntry *next;
+} MetadataEntry;
+
+typedef struct {
+    char storage_dir[MAX_PATH_LENGTH];
+    int is_open;
+    int log_fd;
+    size_t log_bytes;       // Current size of the log
+    size_t live_bytes;      // Size of the log right after compaction
+    MetadataEntry *buckets[METADATA_STORE_BUCKETS];
+    int entry_count;
+    int dirty_count;
+    pthread_mutex_t lock;
+} MetadataStore;
+
 // ============================================================================
 // STORAGE SERVER CONFIGURATION
 // ============================================================================
@@ -65,11 +511,24 @@ typedef struct {
     int client_port;
     int client_socket;
     int is_running;
+
+    // Serializes namespace changes only (CREATE/DELETE)
     pthread_mutex_t storage_lock;
 
+    // Per-file reader/writer locks keyed by filename
+    FileLockEntry *file_locks[FILE_LOCK_BUCKETS];
+    pthread_mutex_t file_locks_mutex;
+
+    // Parsed documents; the cached copy is the live document WRITE sessions edit
+    ContentCache content_cache;
+
+    // Committed edits not yet checkpointed into the files
+    WriteAheadLog wal;
+
     // Global lock table for sentence-level locking
-    SentenceLockEntry *global_locks;
-    pthread_mutex_t lock_table_mutex;
+    SentenceLockBucket sentence_locks[SENTENCE_LOCK_BUCKETS];
+    SentenceLockStats sentence_lock_stats;
+    pthread_mutex_t sentence_lock_stats_mutex;
 
 } StorageServerConfig;
 
@@ -81,8 +540,21 @@ FileContent* load_file_content(const char *storage_dir, const char *filename);
 int save_file_content(const char *storage_dir, FileContent *file_content);
 void free_file_content(FileContent *file_content);
 
-int lock_sentence(FileContent *file, int sentence_num, const char *username);
-int unlock_sentence(FileContent *file, int sentence_num, const char *username);
+SentenceNode* get_sentence_node(FileContent *file, int sentence_num);
+int parse_sentence_ref(const char *ref, int *sentence_num, uint32_t *sentence_id);
+int lock_sentence(FileContent *file, SentenceNode *sentence, const char *username);
+void unlock_sentence(FileContent *file, SentenceNode *sentence, const char *username);
+
+// Write sessions edit a private staging copy and merge it into the live document
+FileContent* create_staging_content(const char *filename, const SentenceNode *source);
+int merge_sentence_edits(FileContent *live, SentenceNode *target, FileContent *staging,
+                         SentenceDelta *delta, FileSplice *splice);
+int revert_sentence_delta(FileContent *file, const SentenceDelta *delta, FileSplice *splice);
+int reapply_sentence_delta(FileContent *file, const SentenceDelta *delta);
+void sentence_delta_init(SentenceDelta *delta);
+void sentence_delta_free(SentenceDelta *delta);
+void file_splice_init(FileSplice *splice);
+void file_splice_free(FileSplice *splice);
 int modify_sentence(FileContent *file, int sentence_num, int word_index, 
                     const char *new_content, const char *username);
 
@@ -91,29 +563,146 @@ int modify_sentence_multiword(FileContent *file, int sentence_num, int word_inde
                               const char *new_content, const char *username, int *new_sentence_num);
 
 char* get_sentence_string(SentenceNode *sentence);
+int append_sentence_text(DynamicBuffer *out, const SentenceNode *sentence);
+int render_file_content(const FileContent *file, RenderStyle style, DynamicBuffer *out);
+int render_sentence(const SentenceNode *sentence, int sentence_num, DynamicBuffer *out);
+int render_saved_text(const FileContent *file, DynamicBuffer *out);
+TextStats document_text_stats(const FileContent *file, size_t *saved_length);
 
-// Helper functions
-char* word_list_to_string(WordNode *word_head, char delimiter);
-WordNode* create_word_node(const char *word_content);
+// ============================================================================
+// DOCUMENT ARENA
+// ============================================================================
+
+void arena_init(DocumentArena *arena);
+void arena_destroy(DocumentArena *arena);
+void* arena_alloc(DocumentArena *arena, size_t size);
+char* arena_alloc_bytes(DocumentArena *arena, size_t size);
+void arena_release(DocumentArena *arena, size_t size);
+SentenceNode* arena_alloc_sentence(DocumentArena *arena);
+void arena_free_sentence(DocumentArena *arena, SentenceNode *node);
+size_t arena_memory_usage(const DocumentArena *arena);
+void compact_file_content(FileContent *file);
+
+// ============================================================================
+// SENTENCE INDEX
+// ============================================================================
+
+void sentence_index_init(FileContent *file);
+void sentence_index_destroy(FileContent *file);
+SentenceNode* sentence_index_find_id(const FileContent *file, uint32_t id);
+SentenceNode* sentence_index_at(const FileContent *file, int sentence_num);
+void sentence_index_insert_after(FileContent *file, SentenceNode *after, SentenceNode *node);
+void sentence_index_remove(FileContent *file, SentenceNode *prev, SentenceNode *node);
+int sentence_index_rank(const SentenceNode *node);
+void sentence_index_set_saved_bytes(SentenceNode *node, uint32_t saved_bytes);
+size_t sentence_index_saved_offset(const FileContent *file, const SentenceNode *node);
+
+// ============================================================================
+// SENTENCE ID FILES
+// ============================================================================
+
+void get_sentence_id_path(char *path, size_t size, const char *storage_dir, const char *filename);
+int collect_saved_sentence_ids(const FileContent *file, DynamicBuffer *ids);
+int encode_sentence_ids(uint32_t next_id, const uint32_t *ids, uint32_t count,
+                        const char *text, size_t length, DynamicBuffer *out);
+int read_sentence_ids(const char *storage_dir, const char *filename, const char *text, size_t length,
+                      uint32_t **ids, uint32_t *count, uint32_t *next_id);
+
+// ============================================================================
+// VERSION LOG
+// ============================================================================
+
+int version_log_read(const char *storage_dir, const char *filename, DynamicBuffer *history);
+int version_log_load(const char *storage_dir, FileContent *file);
+int version_log_record(const char *storage_dir, const FileContent *file, const SentenceDelta *delta,
+                       FileSplice *splice);
+int version_log_apply(DynamicBuffer *history, const char *record, size_t length, int undo, int reset);
+int undo_file_versions(StorageServerConfig *ctx, FileContent *live, int levels, uint64_t *lsn);
+int version_log_delete(const char *storage_dir, const char *filename);
+
+// ============================================================================
+// WRITE-AHEAD LOG
+// ============================================================================
+
+int parse_wal_mode(const char *name, WalMode *mode);
+const char* wal_mode_name(WalMode mode);
+int wal_open(StorageServerConfig *ctx, WalMode mode);
+void wal_begin_commit(StorageServerConfig *ctx);
+void wal_end_commit(StorageServerConfig *ctx);
+int wal_log_splice(StorageServerConfig *ctx, FileContent *file, const FileSplice *splice, uint64_t *lsn);
+int wal_discard_file(StorageServerConfig *ctx, const char *filename);
+void wal_mark_failed(StorageServerConfig *ctx, const char *filename);
+int wal_wait_durable(StorageServerConfig *ctx, uint64_t lsn);
+int wal_poll_durable(StorageServerConfig *ctx, uint64_t lsn, WalWaiter *waiter, int *result);
+void wal_cancel_durable(StorageServerConfig *ctx, WalWaiter *waiter);
+void wal_close(StorageServerConfig *ctx);
+void wal_get_stats(StorageServerConfig *ctx, WalStats *stats);
+
+// ============================================================================
+// FILE LOCK REGISTRY
+// ============================================================================
 
-// Global sentence locking functions
+void init_file_locks(StorageServerConfig *ctx);
+FileLockEntry* acquire_file_lock(StorageServerConfig *ctx, const char *filename, FileLockMode mode);
+void release_file_lock(StorageServerConfig *ctx, FileLockEntry *entry);
+void destroy_file_locks(StorageServerConfig *ctx);
+
+// ============================================================================
+// GLOBAL SENTENCE LOCK TABLE
+// ============================================================================
+
+void init_sentence_locks(StorageServerConfig *ctx);
 int global_try_lock_sentence(StorageServerConfig *ctx, const char *filename, 
-                             int sentence_num, const char *username);
+                             uint32_t sentence_id, const char *username);
+int global_queue_lock_sentence(StorageServerConfig *ctx, const char *filename,
+                               uint32_t sentence_id, SentenceLockWaiter *waiter);
+int global_check_lock_wait(StorageServerConfig *ctx, const char *filename,
+                           uint32_t sentence_id, SentenceLockWaiter *waiter, long long *retry_ms);
+int global_cancel_lock_wait(StorageServerConfig *ctx, const char *filename,
+                            uint32_t sentence_id, SentenceLockWaiter *waiter);
+int global_renew_sentence_lock(StorageServerConfig *ctx, const char *filename,
+                               uint32_t sentence_id, const char *username);
 int global_unlock_sentence(StorageServerConfig *ctx, const char *filename, 
-                          int sentence_num, const char *username);
+                          uint32_t sentence_id, const char *username);
+void sentence_lock_get_stats(StorageServerConfig *ctx, SentenceLockStats *stats);
+void destroy_sentence_locks(StorageServerConfig *ctx);
+
+// ============================================================================
+// CONTENT CACHE
+// ============================================================================
+
+void init_content_cache(ContentCache *cache, size_t memory_budget);
+FileContent* content_cache_acquire(StorageServerConfig *ctx, const char *filename);
+void content_cache_release(StorageServerConfig *ctx, FileContent *file);
+void content_cache_update_usage(StorageServerConfig *ctx, FileContent *file);
+void content_cache_invalidate(StorageServerConfig *ctx, const char *filename);
+FileContent** content_cache_dirty_files(StorageServerConfig *ctx, int *count);
+void content_cache_get_stats(StorageServerConfig *ctx, ContentCacheStats *stats);
+void destroy_content_cache(StorageServerConfig *ctx);
+size_t file_content_memory_usage(const FileContent *file);
 
 // ============================================================================
 // FILE OPERATIONS
 // ============================================================================
 
+// New versions are written to a .partial file and renamed over the old
+// one. UNDO history lives in the version log; a .backup left by older
+// servers is only restored for files that have no history.
+#define BACKUP_SUFFIX ".backup"
+#define PARTIAL_SUFFIX ".partial"
+
 int create_storage_directory(const char *storage_dir);
 char* get_file_path(const char *storage_dir, const char *filename);
+int is_reserved_storage_name(const char *filename);
 
 int ss_create_file(const char *storage_dir, const char *filename, const char *owner);
 int ss_delete_file(const char *storage_dir, const char *filename);
-int ss_read_file(const char *storage_dir, const char *filename, char *buffer, size_t buffer_size);
-int ss_write_file(const char *storage_dir, const char *filename, const char *content);
-int ss_backup_file(const char *storage_dir, const char *filename);
+int ss_read_file(const char *storage_dir, const char *filename, char **content, size_t *length);
+int ss_write_file(const char *storage_dir, const char *filename, const char *content, size_t content_length,
+                  const TextStats *stats);
+int ss_restore_backup(const char *storage_dir, const char *filename);
+void ss_update_file_metadata(const char *storage_dir, const char *filename, size_t length,
+                             const TextStats *stats);
 
 int list_files(const char *storage_dir, char files[][MAX_FILENAME_LENGTH], int max_files);
 
@@ -121,8 +710,12 @@ int list_files(const char *storage_dir, char files[][MAX_FILENAME_LENGTH], int m
 // METADATA OPERATIONS
 // ============================================================================
 
+int metadata_store_open(const char *storage_dir);
+void metadata_store_flush(void);
 int save_metadata(const char *storage_dir, const FileMetadata *metadata);
 int load_metadata(const char *storage_dir, const char *filename, FileMetadata *metadata);
-int update_file_stats(const char *storage_dir, FileMetadata *metadata);
+int delete_metadata(const char *storage_dir, const char *filename);
+void touch_metadata(const char *storage_dir, const char *filename, time_t accessed_time);
+void update_file_stats(FileMetadata *metadata, size_t char_count, const TextStats *stats);
 
 #endif // STORAGESERVER_H
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "../include/storageserver.h"
+
+// ============================================================================
+// PARSED DOCUMENT CACHE (LRU, MEMORY-BUDGETED)
+// ============================================================================
+// The cache holds one reference on every FileContent it indexes; each
+// content_cache_acquire() hands out another. Cached documents are shared:
+// readers hold the file lock shared, and write sessions only modify them at
+// commit time with the file lock held exclusively. Entries still referenced
+// outside the cache are never evicted, only documents nobody is using, and
+// neither are documents whose commits are only in the write-ahead log.
+
+static unsigned int hash_cache_filename(const char *filename) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash % CONTENT_CACHE_BUCKETS;
+}
+
+// Heap footprint of a parsed document: its arena, ID table and undo history
+size_t file_content_memory_usage(const FileContent *file) {
+    return sizeof(FileContent) + arena_memory_usage(&file->arena) +
+           (size_t)file->id_bucket_count * sizeof(SentenceNode*) + file->history.capacity;
+}
+
+void init_content_cache(ContentCache *cache, size_t memory_budget) {
+    memset(cache, 0, sizeof(ContentCache));
+    cache->memory_budget = memory_budget;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Content cache initialized (budget=%zu bytes)", memory_budget);
+}
+
+// Drop one reference; the document is freed once nobody holds it.
+// Caller must hold cache->lock.
+static void put_content_locked(FileContent *file) {
+    file->ref_count--;
+    if (file->ref_count == 0) {
+        free_file_content(file);
+    }
+}
+
+static void lru_unlink(ContentCache *cache, CacheEntry *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else cache->lru_head = entry->lru_next;
+
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else cache->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(ContentCache *cache, CacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) cache->lru_head->lru_prev = entry;
+    cache->lru_head = entry;
+    if (!cache->lru_tail) cache->lru_tail = entry;
+}
+
+static CacheEntry* find_entry_locked(ContentCache *cache, const char *filename) {
+    CacheEntry *entry = cache->buckets[hash_cache_filename(filename)];
+    while (entry && strcmp(entry->filename, filename) != 0) {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+// Unlink an entry from the index and LRU list and drop the cache's reference
+static void remove_entry_locked(ContentCache *cache, CacheEntry *entry) {
+    CacheEntry **link = &cache->buckets[hash_cache_filename(entry->filename)];
+    while (*link && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = entry->hash_next;
+
+    lru_unlink(cache, entry);
+    cache->memory_used -= entry->memory_bytes;
+    cache->entry_count--;
+
+    // Write sessions still holding this document must not commit into it
+    entry->content->is_stale = 1;
+    put_content_locked(entry->content);
+    free(entry);
+}
+
+// Evict least recently used documents nobody else is holding until the
+// cache fits its budget again
+static void evict_locked(ContentCache *cache) {
+    CacheEntry *entry = cache->lru_tail;
+
+    while (entry && cache->memory_used > cache->memory_budget) {
+        CacheEntry *prev = entry->lru_prev;
+
+        if (entry->content->ref_count == 1 && !entry->content->wal_dirty) {
+            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                       "Content cache evicting '%s' (%zu bytes)",
+                       entry->filename, entry->memory_bytes);
+            cache->evictions++;
+            remove_entry_locked(cache, entry);
+        }
+        entry = prev;
+    }
+}
+
+// Insert (or replace) the cached document for file->filename. One of the
+// references already counted in file->ref_count becomes the cache's own.
+static void insert_locked(ContentCache *cache, FileContent *file) {
+    CacheEntry *existing = find_entry_locked(cache, file->filename);
+    if (existing) {
+        remove_entry_locked(cache, existing);
+    }
+
+    CacheEntry *entry = malloc(sizeof(CacheEntry));
+    if (!entry) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Content cache entry allocation failed for '%s'", file->filename);
+        put_content_locked(file);
+        return;
+    }
+
+    strncpy(entry->filename, file->filename, MAX_FILENAME_LENGTH - 1);
+    entry->filename[MAX_FILENAME_LENGTH - 1] = '\0';
+    entry->content = file;
+    entry->memory_bytes = file_content_memory_usage(file);
+
+    unsigned int index = hash_cache_filename(entry->filename);
+    entry->hash_next = cache->buckets[index];
+    cache->buckets[index] = entry;
+    lru_push_front(cache, entry);
+
+    cache->memory_used += entry->memory_bytes;
+    cache->entry_count++;
+
+    evict_locked(cache);
+}
+
+// Get the parsed document for a file, loading it from disk on a miss.
+// Caller must hold the file's lock (shared is enough) and must hand the
+// result back with content_cache_release().
+FileContent* content_cache_acquire(StorageServerConfig *ctx, const char *filename) {
+    ContentCache *cache = &ctx->content_cache;
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = find_entry_locked(cache, filename);
+    if (entry) {
+        cache->hits++;
+        entry->content->ref_count++;
+        lru_unlink(cache, entry);
+        lru_push_front(cache, entry);
+        FileContent *file = entry->content;
+        pthread_mutex_unlock(&cache->lock);
+
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                   "Content cache hit: '%s'", filename);
+        return file;
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "Content cache miss: '%s'", filename);
+
+    // Parse outside the cache lock so other files stay servable
+    FileContent *file = load_file_content(ctx->storage_dir, filename);
+    if (!file) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    entry = find_entry_locked(cache, filename);
+    if (entry) {
+        // Another reader of the same file won the race; use its copy
+        free_file_content(file);
+        file = entry->content;
+        file->ref_count++;
+    } else {
+        file->ref_count = 2;  // cache + caller
+        insert_locked(cache, file);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return file;
+}
+
+void content_cache_release(StorageServerConfig *ctx, FileContent *file) {
+    if (!file) return;
+
+    pthread_mutex_lock(&ctx->content_cache.lock);
+    put_content_locked(file);
+    // Documents pinned while over budget become evictable once released
+    if (ctx->content_cache.memory_used > ctx->content_cache.memory_budget) {
+        evict_locked(&ctx->content_cache);
+    }
+    pthread_mutex_unlock(&ctx->content_cache.lock);
+}
+
+// Re-account a cached document's memory after a write session merged into it
+void content_cache_update_usage(StorageServerConfig *ctx, FileContent *file) {
+    ContentCache *cache = &ctx->content_cache;
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = find_entry_locked(cache, file->filename);
+    if (entry && entry->content == file) {
+        size_t memory_bytes = file_content_memory_usage(file);
+        cache->memory_used = cache->memory_used - entry->memory_bytes + memory_bytes;
+        entry->memory_bytes = memory_bytes;
+        evict_locked(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Forget the cached document of a file whose on-disk content changed behind
+// the cache (UNDO) or which no longer exists (DELETE)
+void content_cache_invalidate(StorageServerConfig *ctx, const char *filename) {
+    ContentCache *cache = &ctx->content_cache;
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = find_entry_locked(cache, filename);
+    if (entry) {
+        cache->invalidations++;
+        remove_entry_locked(cache, entry);
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                   "Content cache invalidated: '%s'", filename);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Documents with commits not yet checkpointed, each with a reference the
+// caller hands back with content_cache_release(). Caller holds the WAL
+// commit gate exclusively so the set can't change underneath.
+FileContent** content_cache_dirty_files(StorageServerConfig *ctx, int *count) {
+    ContentCache *cache = &ctx->content_cache;
+    *count = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    FileContent **files = malloc(((size_t)cache->entry_count + 1) * sizeof(FileContent*));
+    if (files) {
+        for (CacheEntry *entry = cache->lru_head; entry; entry = entry->lru_next) {
+            if (entry->content->wal_dirty) {
+                entry->content->ref_count++;
+                files[(*count)++] = entry->content;
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return files;
+}
+
+void content_cache_get_stats(StorageServerConfig *ctx, ContentCacheStats *stats) {
+    ContentCache *cache = &ctx->content_cache;
+
+    pthread_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->invalidations = cache->invalidations;
+    stats->entry_count = cache->entry_count;
+    stats->memory_used = cache->memory_used;
+    stats->memory_budget = cache->memory_budget;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void destroy_content_cache(StorageServerConfig *ctx) {
+    ContentCache *cache = &ctx->content_cache;
+
+    pthread_mutex_lock(&cache->lock);
+    while (cache->lru_head) {
+        remove_entry_locked(cache, cache->lru_head);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    pthread_mutex_destroy(&cache->lock);
+}
@@ -0,0 +1,182 @@
+#include "../include/storageserver.h"
+
+// ============================================================================
+// PER-DOCUMENT ARENA
+// ============================================================================
+// Sentence text and word offsets are bump-allocated from chunks that grow
+// geometrically; sentence nodes come from slabs. Nothing is freed
+// individually: storage dropped by an edit is only counted as dead, and
+// compact_file_content() copies the live words into fresh chunks once
+// enough of it piles up in a long-lived cached document.
+
+void arena_init(DocumentArena *arena) {
+    memset(arena, 0, sizeof(DocumentArena));
+}
+
+void arena_destroy(DocumentArena *arena) {
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    SentenceSlab *slab = arena->slabs;
+    while (slab) {
+        SentenceSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    arena_init(arena);
+}
+
+static void* arena_bump(DocumentArena *arena, size_t size, size_t align) {
+    ArenaChunk *chunk = arena->chunks;
+
+    if (chunk) {
+        size_t offset = (chunk->used + align - 1) & ~(align - 1);
+        if (offset + size <= chunk->capacity) {
+            chunk->used = offset + size;
+            arena->live_bytes += size;
+            return chunk->data + offset;
+        }
+    }
+
+    // Each chunk doubles the previous one up to the cap, so a document
+    // needs O(log size) chunks until it is large
+    size_t capacity = chunk ? chunk->capacity * 2 : ARENA_MIN_CHUNK_BYTES;
+    if (capacity > ARENA_MAX_CHUNK_BYTES) capacity = ARENA_MAX_CHUNK_BYTES;
+    if (capacity < size) capacity = size;
+
+    ArenaChunk *new_chunk = malloc(sizeof(ArenaChunk) + capacity);
+    if (!new_chunk) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                    "Arena chunk allocation failed (%zu bytes)", capacity);
+        return NULL;
+    }
+
+    // The remainder of the old chunk is lost to this document
+    if (chunk) {
+        arena->dead_bytes += chunk->capacity - chunk->used;
+    }
+
+    new_chunk->capacity = capacity;
+    new_chunk->used = size;
+    new_chunk->next = chunk;
+    arena->chunks = new_chunk;
+    arena->chunk_bytes += capacity;
+    arena->live_bytes += size;
+    return new_chunk->data;
+}
+
+void* arena_alloc(DocumentArena *arena, size_t size) {
+    return arena_bump(arena, size, sizeof(void *));
+}
+
+// Unaligned storage for sentence text
+char* arena_alloc_bytes(DocumentArena *arena, size_t size) {
+    return arena_bump(arena, size, 1);
+}
+
+// Account for arena storage the document no longer references
+void arena_release(DocumentArena *arena, size_t size) {
+    arena->live_bytes -= size;
+    arena->dead_bytes += size;
+}
+
+SentenceNode* arena_alloc_sentence(DocumentArena *arena) {
+    if (!arena->free_sentences) {
+        // Slabs double like chunks, so one-sentence staging documents stay small
+        int capacity = arena->slabs ? arena->slabs->capacity * 2 : SENTENCE_SLAB_MIN_NODES;
+        if (capacity > SENTENCE_SLAB_MAX_NODES) capacity = SENTENCE_SLAB_MAX_NODES;
+
+        size_t bytes = sizeof(SentenceSlab) + (size_t)capacity * sizeof(SentenceNode);
+        SentenceSlab *slab = malloc(bytes);
+        if (!slab) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                        "Sentence slab allocation failed");
+            return NULL;
+        }
+
+        slab->capacity = capacity;
+        slab->next = arena->slabs;
+        arena->slabs = slab;
+        arena->slab_bytes += bytes;
+
+        for (int i = capacity - 1; i >= 0; i--) {
+            slab->nodes[i].next = arena->free_sentences;
+            arena->free_sentences = &slab->nodes[i];
+        }
+    }
+
+    SentenceNode *node = arena->free_sentences;
+    arena->free_sentences = node->next;
+    return node;
+}
+
+void arena_free_sentence(DocumentArena *arena, SentenceNode *node) {
+    node->next = arena->free_sentences;
+    arena->free_sentences = node;
+}
+
+size_t arena_memory_usage(const DocumentArena *arena) {
+    return arena->chunk_bytes + arena->slab_bytes;
+}
+
+// Copy every sentence's text and offsets into fresh chunks and drop the
+// old ones.
+// Sentence nodes stay where they are, so pointers held by write sessions
+// remain valid. Caller must hold the file lock exclusively.
+void compact_file_content(FileContent *file) {
+    DocumentArena *arena = &file->arena;
+    ArenaChunk *old_chunks = arena->chunks;
+    size_t old_bytes = arena->chunk_bytes;
+
+    arena->chunks = NULL;
+    arena->chunk_bytes = 0;
+    arena->live_bytes = 0;
+    arena->dead_bytes = 0;
+
+    for (SentenceNode *sent = file->head; sent; sent = sent->next) {
+        if (sent->word_count == 0) {
+            sent->text = NULL;
+            sent->word_offsets = NULL;
+            sent->text_length = sent->text_capacity = 0;
+            sent->word_capacity = 0;
+            continue;
+        }
+
+        uint32_t *offsets = arena_alloc(arena, (size_t)sent->word_count * sizeof(uint32_t));
+        char *text = arena_alloc_bytes(arena, sent->text_length);
+
+        if (!offsets || !text) {
+            // Out of memory: keep the old chunks alive, they are still in use
+            ArenaChunk *tail = old_chunks;
+            while (tail->next) tail = tail->next;
+            tail->next = arena->chunks;
+            arena->chunks = old_chunks;
+            arena->chunk_bytes += old_bytes;
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                        "Compaction of '%s' aborted: out of memory", file->filename);
+            return;
+        }
+
+        memcpy(offsets, sent->word_offsets, (size_t)sent->word_count * sizeof(uint32_t));
+        memcpy(text, sent->text, sent->text_length);
+        sent->word_offsets = offsets;
+        sent->word_capacity = sent->word_count;
+        sent->text = text;
+        sent->text_capacity = sent->text_length;
+    }
+
+    while (old_chunks) {
+        ArenaChunk *next = old_chunks->next;
+        free(old_chunks);
+        old_chunks = next;
+    }
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                "Compacted '%s': %zu -> %zu arena bytes",
+                file->filename, old_bytes, arena->chunk_bytes);
+}
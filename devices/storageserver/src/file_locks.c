@@ -0,0 +1,113 @@
+#include "../include/storageserver.h"
+
+// ============================================================================
+// PER-FILE READER/WRITER LOCK REGISTRY
+// ============================================================================
+// Entries are created on first use and removed once the last holder or
+// waiter releases them, so the registry only grows with files in use.
+
+static unsigned int hash_lock_filename(const char *filename) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash % FILE_LOCK_BUCKETS;
+}
+
+void init_file_locks(StorageServerConfig *ctx) {
+    for (int i = 0; i < FILE_LOCK_BUCKETS; i++) {
+        ctx->file_locks[i] = NULL;
+    }
+    pthread_mutex_init(&ctx->file_locks_mutex, NULL);
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "File lock registry initialized (%d buckets)", FILE_LOCK_BUCKETS);
+}
+
+// Acquire the lock for a file in shared (readers) or exclusive (writer) mode.
+// Blocks until the lock is available. Returns the entry to pass to
+// release_file_lock(), or NULL on allocation failure.
+FileLockEntry* acquire_file_lock(StorageServerConfig *ctx, const char *filename, FileLockMode mode) {
+    unsigned int index = hash_lock_filename(filename);
+
+    pthread_mutex_lock(&ctx->file_locks_mutex);
+
+    FileLockEntry *entry = ctx->file_locks[index];
+    while (entry && strcmp(entry->filename, filename) != 0) {
+        entry = entry->next;
+    }
+
+    if (!entry) {
+        entry = malloc(sizeof(FileLockEntry));
+        if (!entry) {
+            pthread_mutex_unlock(&ctx->file_locks_mutex);
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Failed to allocate file lock entry for '%s'", filename);
+            return NULL;
+        }
+        strncpy(entry->filename, filename, MAX_FILENAME_LENGTH - 1);
+        entry->filename[MAX_FILENAME_LENGTH - 1] = '\0';
+        pthread_rwlock_init(&entry->rwlock, NULL);
+        entry->ref_count = 0;
+        entry->next = ctx->file_locks[index];
+        ctx->file_locks[index] = entry;
+    }
+
+    // Reference taken under the registry mutex keeps the entry alive while we block
+    entry->ref_count++;
+    pthread_mutex_unlock(&ctx->file_locks_mutex);
+
+    if (mode == FILE_LOCK_EXCLUSIVE) {
+        pthread_rwlock_wrlock(&entry->rwlock);
+    } else {
+        pthread_rwlock_rdlock(&entry->rwlock);
+    }
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "File lock acquired: file='%s', mode=%s",
+               filename, mode == FILE_LOCK_EXCLUSIVE ? "exclusive" : "shared");
+
+    return entry;
+}
+
+void release_file_lock(StorageServerConfig *ctx, FileLockEntry *entry) {
+    if (!entry) return;
+
+    pthread_rwlock_unlock(&entry->rwlock);
+
+    pthread_mutex_lock(&ctx->file_locks_mutex);
+    entry->ref_count--;
+
+    if (entry->ref_count == 0) {
+        unsigned int index = hash_lock_filename(entry->filename);
+        FileLockEntry **link = &ctx->file_locks[index];
+        while (*link && *link != entry) {
+            link = &(*link)->next;
+        }
+        if (*link) {
+            *link = entry->next;
+        }
+        pthread_rwlock_destroy(&entry->rwlock);
+        free(entry);
+    }
+    pthread_mutex_unlock(&ctx->file_locks_mutex);
+}
+
+void destroy_file_locks(StorageServerConfig *ctx) {
+    pthread_mutex_lock(&ctx->file_locks_mutex);
+    for (int i = 0; i < FILE_LOCK_BUCKETS; i++) {
+        FileLockEntry *entry = ctx->file_locks[i];
+        while (entry) {
+            FileLockEntry *next = entry->next;
+            pthread_rwlock_destroy(&entry->rwlock);
+            free(entry);
+            entry = next;
+        }
+        ctx->file_locks[i] = NULL;
+    }
+    pthread_mutex_unlock(&ctx->file_locks_mutex);
+    pthread_mutex_destroy(&ctx->file_locks_mutex);
+}
@@ -1,4 +1,5 @@
 #include "../include/storageserver.h"
+#include "../../common/reactor.h"
 #include <signal.h>
 
 StorageServerConfig global_ctx;
@@ -6,136 +7,678 @@ FILE* log_file;
 
 // Add to global context
 int nm_socket = -1;
+static FrameConn nm_conn;      // Reads whole lines from nm_socket
 pthread_t nm_session_thread;
 
+static Reactor client_reactor;
+static volatile sig_atomic_t received_signal;
+
+// Only stops the reactor: flushing the log and metadata takes locks and
+// does I/O, so main() does it once reactor_run() returns
 void signal_handler(int signum) {
-    printf("\nReceived signal %d, shutting down...\n", signum);
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, "Received signal %d, initiating shutdown", signum);
+    received_signal = signum;
     global_ctx.is_running = 0;
-    if (global_ctx.client_socket > 0) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, "Closing client socket: %d", global_ctx.client_socket);
-        close(global_ctx.client_socket);
-    }
-    if (nm_socket > 0) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, "Closing name server socket: %d", nm_socket);
-        close(nm_socket);
-    }
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, "Shutdown complete");
-    exit(0);
+    reactor_interrupt(&client_reactor);
 }
 
 void* maintain_nm_session(void *arg) {
     StorageServerConfig *ctx = (StorageServerConfig*)arg;
     char buffer[BUFFER_SIZE];
-    
+    WireMessage msg;
+
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, "Name server session maintenance thread started");
 
     while (ctx->is_running) {
-        memset(buffer, 0, sizeof(buffer));
-        ssize_t bytes = recv(nm_socket, buffer, sizeof(buffer) - 1, 0);
-
-        if (bytes <= 0) {
+        // One whole line at a time, however the reads split them
+        if (frame_conn_next(&nm_conn, &msg) != ERR_SUCCESS) {
             log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "Lost connection to name server (bytes=%zd, errno=%d)", bytes, errno);
+                       "Lost connection to name server (errno=%d)", errno);
             printf("Lost connection to Name Server\n");
 
             sleep(5);
             continue;
         }
 
-        buffer[bytes] = '\0';
-        char *nl = strchr(buffer, '\n');
-        if (nl) *nl = '\0';
-
+        message_describe(&msg, buffer, sizeof(buffer));
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Received from name server: %s", buffer);
 
-        char *saveptr;
-        char *cmd = strtok_r(buffer, "|", &saveptr);
-
-        if (strcmp(cmd, "HEARTBEAT") == 0) {
+        message_parse(&msg);
+        if (message_is(&msg, "HEARTBEAT")) {
             send(nm_socket, "HEARTBEAT_ACK\n", 14, 0);
             log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, "Sent heartbeat acknowledgment");
         } else {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Unknown command from name server: %s", cmd);
+                       "Unknown command from name server: %s", buffer);
         }
     }
 
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, "Name server session maintenance thread stopping");
     return NULL;
 }
-
 // ============================================================================
-// CLIENT THREAD ARGUMENT STRUCTURE
+// CLIENT CONNECTIONS
 // ============================================================================
+// Clients are served by an epoll reactor and a small pool of workers (see
+// common/reactor.h). Most requests are answered within one handler call.
+// A WRITE session, a wait for a sentence lock or for the log, and a STREAM
+// span many calls: their state lives in a ClientState, and requests that
+// arrive meanwhile wait in the input buffer. Idle connections have none.
+
+typedef enum {
+    CLIENT_LOCK_WAIT,       // WRITE queued for a held sentence
+    CLIENT_WRITING,         // WRITE session taking word updates until ETIRW
+    CLIENT_DURABLE_WAIT,    // Reply held until the change's log record is synced
+    CLIENT_STREAMING        // STREAM sending a word per tick
+} ClientPhase;
+
 typedef struct {
-    int client_fd;
-    StorageServerConfig *ctx;
-} ClientThreadArg;
+    ClientPhase phase;
+    long long deadline_ms;      // Lock wait timeout, lease expiry or next word
+
+    // WRITE session
+    char filename[MAX_FILENAME_LENGTH];
+    char username[MAX_USERNAME_LENGTH];
+    char sentence_ref[32];      // As the client named it
+    int sentence_num;
+    uint32_t sentence_id;       // 0 if named by index
+    uint32_t lock_id;           // ID the sentence lock is keyed by
+    FileContent *live;
+    FileContent *staging;
+    SentenceNode *target;
+    int current_sentence;
+    int word_update_count;
+    SentenceLockWaiter lock_waiter;
+
+    // Durable wait
+    WalWaiter wal_waiter;
+    uint64_t lsn;
+    char reply[64];
+    char nm_notice[MAX_FILENAME_LENGTH + 32];
+
+    // STREAM
+    DynamicBuffer text;
+    TextTokenizer tokenizer;
+    int word_count;
+} ClientState;
+
+// Lock and log waiters call this from other threads
+static void wake_client(void *arg) {
+    reactor_wake((ReactorConn*)arg);
+}
+
+static ClientState* begin_client_state(ReactorConn *conn, ClientPhase phase) {
+    ClientState *state = calloc(1, sizeof(ClientState));
+    if (!state) return NULL;
+
+    state->phase = phase;
+    state->lock_waiter.notify = wake_client;
+    state->lock_waiter.arg = conn;
+    state->wal_waiter.notify = wake_client;
+    state->wal_waiter.arg = conn;
+    conn->state = state;
+    return state;
+}
+
+// Back to serving requests
+static void end_client_state(ReactorConn *conn) {
+    ClientState *state = conn->state;
+    if (!state) return;
+
+    dynbuf_free(&state->text);
+    free(state);
+    conn->state = NULL;
+    reactor_cancel_timer(conn);
+}
+
+// Give up a WRITE session's claims without committing
+static void release_write_session(StorageServerConfig *ctx, ClientState *state) {
+    if (state->target) unlock_sentence(state->live, state->target, state->username);
+    content_cache_release(ctx, state->live);
+    free_file_content(state->staging);
+    global_unlock_sentence(ctx, state->filename, state->lock_id, state->username);
+}
+
+// A session that goes quiet for a whole lease gives the sentence up, so a
+// client that hung or vanished can't hold it forever
+static void renew_write_lease(ReactorConn *conn) {
+    ClientState *state = conn->state;
+    state->deadline_ms = reactor_now_ms() + SENTENCE_LOCK_LEASE_SEC * 1000LL;
+    reactor_set_timer(conn, SENTENCE_LOCK_LEASE_SEC * 1000LL);
+}
+
+static void expire_write_session(ReactorConn *conn) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state;
+
+    long long left = state->deadline_ms - reactor_now_ms();
+    if (left > 0) {
+        reactor_set_timer(conn, left);
+        return;
+    }
+
+    log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+               "WRITE session idle for %d seconds, releasing '%s' sentence %d (fd=%d)", 
+               SENTENCE_LOCK_LEASE_SEC, state->filename, state->sentence_num, conn->fd);
+    release_write_session(ctx, state);
+    reactor_send(conn, "ERROR|Write session expired, sentence released\n", 47);
+    end_client_state(conn);
+}
 
 // ============================================================================
-// CLIENT HANDLER (with persistent connection for multiple commands)
+// REPLIES HELD FOR THE LOG
 // ============================================================================
-void handle_client(int client_fd, StorageServerConfig *ctx) {
-    char buffer[BUFFER_SIZE];
+
+static void send_acknowledgment(ReactorConn *conn, int result, const char *reply, const char *nm_notice) {
+    if (result != ERR_SUCCESS) {
+        char error[256];
+        snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(result));
+        reactor_send_str(conn, error);
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "Change not made durable: %s", get_error_message(result));
+        return;
+    }
+
+    reactor_send_str(conn, reply);
+    if (nm_notice[0] && nm_socket > 0) {
+        send(nm_socket, nm_notice, strlen(nm_notice), 0);
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                   "Notified name server: %.*s", (int)strlen(nm_notice) - 1, nm_notice);
+    }
+}
+
+// Reply once the log record lsn is durable
+static void continue_durable_wait(ReactorConn *conn) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state;
+
+    int result;
+    if (!wal_poll_durable(ctx, state->lsn, &state->wal_waiter, &result)) {
+        return;
+    }
+    send_acknowledgment(conn, result, state->reply, state->nm_notice);
+    end_client_state(conn);
+}
+
+// Send reply (and tell the name server nm_notice) once the log record lsn
+// is synced. The worker moves on meanwhile, so other commits can join the
+// same sync.
+static void reply_when_durable(ReactorConn *conn, uint64_t lsn, const char *reply, const char *nm_notice) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state ? conn->state : begin_client_state(conn, CLIENT_DURABLE_WAIT);
+
+    if (!state) {
+        send_acknowledgment(conn, wal_wait_durable(ctx, lsn), reply, nm_notice);
+        return;
+    }
+
+    state->phase = CLIENT_DURABLE_WAIT;
+    reactor_cancel_timer(conn);
+    state->lsn = lsn;
+    snprintf(state->reply, sizeof(state->reply), "%s", reply);
+    snprintf(state->nm_notice, sizeof(state->nm_notice), "%s", nm_notice);
+    continue_durable_wait(conn);
+}
+
+// ============================================================================
+// WRITE SESSIONS
+// ============================================================================
+
+// The sentence lock is ours: claim the sentence in the live document and
+// set up the session's staging copy
+static void start_write_session(ReactorConn *conn) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state;
+    const char *filename = state->filename;
+    const char *username = state->username;
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+               "Lock acquired: file='%s', sentence=%s@%u, user='%s'", 
+               filename, state->sentence_ref, state->lock_id, username);
+
+    // All write sessions on a file share the cached live document;
+    // the reference pins it in the cache until the session ends
+    FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_SHARED);
+    FileContent *live = content_cache_acquire(ctx, filename);
+
+    if (!live) {
+        release_file_lock(ctx, file_lock);
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "WRITE: File load failed '%s'", filename);
+        global_unlock_sentence(ctx, filename, state->lock_id, username);
+        reactor_send(conn, "ERROR|File not found\n", 21);
+        end_client_state(conn);
+        return;
+    }
+
+    // Commits while we waited may have moved the sentence, or
+    // removed it
+    int sentence_num = state->sentence_num;
+    if (state->lock_id != SENTENCE_APPEND_ID) {
+        SentenceNode *named = sentence_index_find_id(live, state->lock_id);
+        if (!named) {
+            release_file_lock(ctx, file_lock);
+            content_cache_release(ctx, live);
+            global_unlock_sentence(ctx, filename, state->lock_id, username);
+            reactor_send(conn, "ERROR|Sentence does not exist\n", 30);
+            end_client_state(conn);
+            return;
+        }
+        sentence_num = sentence_index_rank(named);
+    } else if (state->sentence_id == 0 && sentence_num < live->sentence_count) {
+        // An append that another commit beat us to
+        sentence_num = live->sentence_count;
+    }
+
+    // Validate sentence number
+    // Allow: sentence_num == 0 for empty file
+    // Allow: sentence_num < sentence_count for existing sentences
+    // Allow: sentence_num == sentence_count ONLY if last sentence has delimiter
+    int sentence_count = live->sentence_count;
+    int allow_append = 0;
+    if (sentence_count > 0 && sentence_num == sentence_count) {
+        // Check if last sentence ends with delimiter
+        SentenceNode *last = get_sentence_node(live, sentence_count - 1);
+        if (last && is_sentence_delimiter(last->delimiter)) {
+            allow_append = 1;
+            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                        "Allowing append to new sentence %d (last sentence has delimiter '%c')",
+                        sentence_num, last->delimiter);
+        }
+    }
+
+    // Error conditions:
+    // 1. Empty file and asking for sentence > 0
+    // 2. Non-empty file and sentence_num > sentence_count
+    // 3. sentence_num == sentence_count but last sentence has no delimiter
+    if ((sentence_count == 0 && sentence_num > 0) ||
+        (sentence_count > 0 && sentence_num > sentence_count) ||
+        (sentence_count > 0 && sentence_num == sentence_count && !allow_append)) {
+
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Sentence validation failed: requested=%d, count=%d, allow_append=%d",
+                    sentence_num, sentence_count, allow_append);
+
+        release_file_lock(ctx, file_lock);
+        content_cache_release(ctx, live);
+        global_unlock_sentence(ctx, filename, state->lock_id, username);
+
+        char error_msg[192];
+        snprintf(error_msg, sizeof(error_msg),
+                "ERROR|Sentence %d does not exist. File has %d sentence(s). %s\n",
+                sentence_num, sentence_count,
+                (sentence_count > 0 && sentence_num == sentence_count) ?
+                "Last sentence must end with delimiter (. ! ?) to create new sentence." : "");
+        reactor_send_str(conn, error_msg);
+        end_client_state(conn);
+        return;
+    }
     
+    // Editing an existing sentence claims its node in the live document;
+    // a new sentence (empty file or append) is only created at commit
+    SentenceNode *target = NULL;
+    if (sentence_num < sentence_count) {
+        target = get_sentence_node(live, sentence_num);
+        if (lock_sentence(live, target, username) != ERR_SUCCESS) {
+            release_file_lock(ctx, file_lock);
+            content_cache_release(ctx, live);
+            global_unlock_sentence(ctx, filename, state->lock_id, username);
+            reactor_send(conn, "ERROR|Sentence locked by another user\n", 38);
+            end_client_state(conn);
+            return;
+        }
+    }
+
+    FileContent *staging = create_staging_content(filename, target);
+    release_file_lock(ctx, file_lock);
+
+    if (!staging) {
+        if (target) unlock_sentence(live, target, username);
+        content_cache_release(ctx, live);
+        global_unlock_sentence(ctx, filename, state->lock_id, username);
+        reactor_send(conn, "ERROR|Out of memory\n", 20);
+        end_client_state(conn);
+        return;
+    }
+
+    char response[192];
+    if (target) {
+        snprintf(response, sizeof(response), 
+                "SUCCESS|Sentence %d (id %u) locked for '%s'. Send word updates (word_index|content), then ETIRW\n", 
+                sentence_num, target->id, username);
+    } else {
+        snprintf(response, sizeof(response), 
+                "SUCCESS|Sentence %d locked for '%s'. Send word updates (word_index|content), then ETIRW\n", 
+                sentence_num, username);
+    }
+    reactor_send_str(conn, response);
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Client handler started for fd=%d, thread_id=%lu", client_fd, pthread_self());
+               "Write session started: sentence %d locked for user '%s'", 
+               sentence_num, username);
+    printf("  Locked sentence %d for user '%s'\n", sentence_num, username);
+
+    state->phase = CLIENT_WRITING;
+    state->live = live;
+    state->staging = staging;
+    state->target = target;
+    state->sentence_num = sentence_num;
+    state->current_sentence = sentence_num;
+    state->word_update_count = 0;
+    renew_write_lease(conn);
+}
 
-    // Keep connection open for multiple commands
-    while (ctx->is_running) {
-        memset(buffer, 0, sizeof(buffer));
-        ssize_t bytes = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+// A WRITE queued for its sentence: start once the lock is handed over, or
+// give up at the deadline
+static void continue_lock_wait(ReactorConn *conn) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state;
 
-        if (bytes <= 0) {
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Client disconnected (fd=%d, bytes=%zd)", client_fd, bytes);
-            printf("Client disconnected\n");
-            close(client_fd);
+    long long retry_ms;
+    if (global_check_lock_wait(ctx, state->filename, state->lock_id, &state->lock_waiter, &retry_ms)) {
+        start_write_session(conn);
+        return;
+    }
+
+    long long left = state->deadline_ms - reactor_now_ms();
+    if (left <= 0) {
+        if (global_cancel_lock_wait(ctx, state->filename, state->lock_id, &state->lock_waiter)) {
+            start_write_session(conn);
             return;
         }
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "WRITE: Sentence already locked - file='%s', sentence=%s", 
+                   state->filename, state->sentence_ref);
+        reactor_send(conn, "ERROR|Timed out waiting for sentence lock\n", 42);
+        end_client_state(conn);
+        return;
+    }
+
+    // The head of the queue also takes over when the holder's lease runs
+    // out, which nobody wakes us for
+    reactor_set_timer(conn, retry_ms >= 0 && retry_ms < left ? retry_ms : left);
+}
+
+// Commit the session's staged sentences
+static void commit_write_session(ReactorConn *conn) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state;
+    const char *filename = state->filename;
+    FileContent *live = state->live;
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "WRITE session completing: file='%s', updates=%d", 
+               filename, state->word_update_count);
+    
+    // Merge the staged sentences into the live document and log
+    // the change; the checkpointer writes the file later. Other
+    // sessions' edits are already merged into the same document,
+    // so nothing they committed is overwritten.
+    FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_EXCLUSIVE);
+    int save_result;
+    uint64_t lsn = 0;
+    SentenceDelta delta;
+    FileSplice splice;
+    sentence_delta_init(&delta);
+    file_splice_init(&splice);
+
+    if (live->is_stale) {
+        save_result = ERR_WRITE_CONFLICT;
+        free_file_content(state->staging);
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Write session discarded, '%s' was replaced or deleted meanwhile", 
+                   filename);
+    } else if ((save_result = version_log_load(ctx->storage_dir, live)) != ERR_SUCCESS) {
+        free_file_content(state->staging);
+    } else {
+        // The reverse delta for UNDO goes in the same log record as the
+        // change, so the history is exactly as durable as the text
+        wal_begin_commit(ctx);
+        save_result = merge_sentence_edits(live, state->target, state->staging, &delta, &splice);
+        if (save_result == ERR_SUCCESS) {
+            save_result = version_log_record(ctx->storage_dir, live, &delta, &splice);
+        }
+        if (save_result == ERR_SUCCESS) {
+            save_result = wal_log_splice(ctx, live, &splice, &lsn);
+        }
+        // Not logged, so take out whatever made it into the
+        // document. A delta with no new sentences means the
+        // merge failed before changing anything.
+        if (save_result != ERR_SUCCESS && (delta.position < 0 || delta.new_count > 0) &&
+            (delta.position < 0 || revert_sentence_delta(live, &delta, NULL) != ERR_SUCCESS)) {
+            wal_mark_failed(ctx, filename);
+        }
+        wal_end_commit(ctx);
+
+        if (save_result == ERR_SUCCESS) {
+            size_t saved_length;
+            TextStats stats = document_text_stats(live, &saved_length);
+            ss_update_file_metadata(ctx->storage_dir, filename, saved_length, &stats);
+        }
+    }
+    sentence_delta_free(&delta);
+    file_splice_free(&splice);
+    state->staging = NULL;
+
+    if (save_result == ERR_SUCCESS) {
+        content_cache_update_usage(ctx, live);
+    } else if (save_result != ERR_WRITE_CONFLICT) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "Commit failed: %s (error=%d)", filename, save_result);
+    }
+    if (state->target) unlock_sentence(live, state->target, state->username);
+    release_file_lock(ctx, file_lock);
+
+    content_cache_release(ctx, live);
+    global_unlock_sentence(ctx, filename, state->lock_id, state->username);
+
+    if (save_result != ERR_SUCCESS) {
+        char error[256];
+        snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(save_result));
+        reactor_send_str(conn, error);
+        end_client_state(conn);
+        return;
+    }
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "WRITE session completed successfully");
+    printf("  Write session completed\n");
+
+    // Locks are released first so other commits can join the
+    // same log sync
+    char notify[MAX_FILENAME_LENGTH + 32];
+    snprintf(notify, sizeof(notify), "FILE_UPDATED|%s\n", filename);
+    reply_when_durable(conn, lsn, "SUCCESS|Write complete\n", notify);
+}
+
+// One message of a WRITE session: a word update, or ETIRW
+static void write_session_line(ReactorConn *conn, WireMessage *msg) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state;
+    char buffer[BUFFER_SIZE];
+
+    message_describe(msg, buffer, sizeof(buffer));
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+               "WRITE session received: '%s'", buffer);
+    printf("  Received: '%s'\n", buffer);
+
+    message_parse(msg);
+    if (message_is(msg, "ETIRW")) {
+        commit_write_session(conn);
+        return;
+    }
+
+    // Parse word update: a WORD_UPDATE frame, or the text "idx|content"
+    // where the content is the rest of the line
+    const char *word_index_str = msg->verb;
+    if (msg->framed) {
+        word_index_str = msg->opcode == OP_WORD_UPDATE ? message_next_arg(msg) : NULL;
+    }
+    char *content = message_rest(msg);
+
+    if (!word_index_str || !content) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "WRITE: Invalid word update format");
+        reactor_send(conn, "ERROR|Invalid format. Use: word_index|content\n", 46);
+        return;
+    }
+
+    int word_index = atoi(word_index_str);
+
+    // Each update renews the lease; if it ran out, another
+    // user may have the sentence now
+    if (!global_renew_sentence_lock(ctx, state->filename, state->lock_id, state->username)) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "WRITE: Lease on '%s' sentence %d lost by '%s'", 
+                   state->filename, state->sentence_num, state->username);
+        if (state->target) unlock_sentence(state->live, state->target, state->username);
+        content_cache_release(ctx, state->live);
+        free_file_content(state->staging);
+        reactor_send(conn, "ERROR|Write lease expired, sentence released\n", 45);
+        end_client_state(conn);
+        return;
+    }
+    renew_write_lease(conn);
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+               "Word update: sentence=%d, word_index=%d, content='%s'", 
+               state->current_sentence, word_index, content);
+    printf("  Inserting at word %d: '%s' (sentence %d)\n", 
+           word_index, content, state->current_sentence);
+
+    // The staging document numbers its sentences from the locked one
+    int staged_sentence = state->current_sentence - state->sentence_num;
+    int new_staged_sentence = staged_sentence;
+    int mod_result = modify_sentence_multiword(state->staging, staged_sentence, 
+                                              word_index, content, state->username, &new_staged_sentence);
+    int new_sentence_num = state->sentence_num + new_staged_sentence;
+
+    if (mod_result == ERR_SUCCESS) {
+        state->word_update_count++;
+        reactor_send(conn, "SUCCESS|Word updated\n", 21);
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                   "Word updated successfully (now in sentence %d)", new_sentence_num);
+        printf("  ✓ Updated (now in sentence %d)\n", new_sentence_num);
+
+        // Check if sentence changed (delimiter detected)
+        if (new_sentence_num > state->current_sentence) {
+            state->current_sentence = new_sentence_num;
+            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+                       "Auto-switched to sentence %d", state->current_sentence);
+            printf("  → Auto-switched to sentence %d\n", state->current_sentence);
 
-        buffer[bytes] = '\0';
+            char info_msg[128];
+            snprintf(info_msg, sizeof(info_msg), 
+                    "INFO|Sentence ended. Now editing sentence %d\n", state->current_sentence);
+            reactor_send_str(conn, info_msg);
+        }
+    } else {
+        char error[256];
+        snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(mod_result));
+        reactor_send_str(conn, error);
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "Word update failed: %s", get_error_message(mod_result));
+        printf("  ✗ Failed: %s\n", get_error_message(mod_result));
+    }
+}
+
+// ============================================================================
+// STREAM
+// ============================================================================
+
+// Send the next word, or STOP after the last. A client that isn't reading
+// is not sent more until it catches up.
+static void continue_stream(ReactorConn *conn) {
+    ClientState *state = conn->state;
+    long long now = reactor_now_ms();
+
+    if (now < state->deadline_ms) {
+        reactor_set_timer(conn, state->deadline_ms - now);
+        return;
+    }
+    if (reactor_output_pending(conn) >= REACTOR_OUTPUT_HIGH_WATER) {
+        state->deadline_ms = now + STREAM_DELAY_MS;
+        reactor_set_timer(conn, STREAM_DELAY_MS);
+        return;
+    }
+
+    // Whitespace-separated words, punctuation included
+    TextToken token;
+    if (text_tokenizer_next(&state->tokenizer, &token)) {
+        char word_msg[BUFFER_SIZE];
+        snprintf(word_msg, sizeof(word_msg), "WORD|%.*s\n",
+                 (int)token.length, state->text.data + token.start);
+        reactor_send_str(conn, word_msg);
+        state->word_count++;
+
+        state->deadline_ms = now + STREAM_DELAY_MS;
+        reactor_set_timer(conn, STREAM_DELAY_MS);
+        return;
+    }
+
+    reactor_send(conn, "STOP\n", 5);
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "STREAM completed: %s (%d words)", state->filename, state->word_count);
+    printf("Streamed file: %s\n", state->filename);
+    end_client_state(conn);
+}
+
+// ============================================================================
+// CLIENT REQUESTS
+// ============================================================================
+
+// Answer the requests that have arrived, in order. They stay in the input
+// buffer while a lock wait, durable wait or STREAM is in progress, and
+// while the client isn't reading its replies.
+static void serve_requests(ReactorConn *conn) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    WireMessage msg;
+    char buffer[BUFFER_SIZE];
 
-        // Remove newline
-        char *newline = strchr(buffer, '\n');
-        if (newline) *newline = '\0';
+    while (!conn->closing && reactor_output_pending(conn) < REACTOR_OUTPUT_HIGH_WATER) {
+        ClientState *state = conn->state;
+        if (state && state->phase != CLIENT_WRITING) break;
+        if (!reactor_next_message(conn, &msg)) break;
+
+        if (state) {
+            write_session_line(conn, &msg);
+            continue;
+        }
 
+        message_describe(&msg, buffer, sizeof(buffer));
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Received command from fd=%d: %s", client_fd, buffer);
+                   "Received command from fd=%d: %s", conn->fd, buffer);
 
         // Check for QUIT command
-        if (strcmp(buffer, "QUIT") == 0 || strcmp(buffer, "EXIT") == 0) {
+        message_parse(&msg);
+        if (message_is(&msg, "QUIT") || message_is(&msg, "EXIT")) {
             log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Client requested disconnect (fd=%d)", client_fd);
-            send(client_fd, "SUCCESS|Goodbye\n", 16, 0);
-            close(client_fd);
-            return;
+                       "Client requested disconnect (fd=%d)", conn->fd);
+            reactor_send(conn, "SUCCESS|Goodbye\n", 16);
+            reactor_close(conn);
+            continue;
         }
 
         printf("Received: %s\n", buffer);
 
-        // Parse command: CMD|arg1|arg2|...
-        char *saveptr;
-        char *cmd = strtok_r(buffer, "|", &saveptr);
+        // Command: CMD|arg1|arg2|...
+        const char *cmd = msg.verb;
 
         if (!cmd) {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Invalid command format (fd=%d)", client_fd);
-            send(client_fd, "ERROR|Invalid command\n", 22, 0);
+                       "Invalid command format (fd=%d)", conn->fd);
+            reactor_send(conn, "ERROR|Invalid command\n", 22);
             continue;
         }
 
         // CREATE|filename|owner
         if (strcmp(cmd, "CREATE") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
-            char *owner = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
+            char *owner = message_next_arg(&msg);
 
             if (!filename || !owner) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "CREATE: Missing parameters (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing parameters\n", 25, 0);
+                           "CREATE: Missing parameters (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing parameters\n", 25);
             } else {
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "CREATE request: filename='%s', owner='%s'", filename, owner);
@@ -147,7 +690,7 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
                 if (result == ERR_SUCCESS) {
                     char response[256];
                     snprintf(response, sizeof(response), "SUCCESS|File '%s' created\n", filename);
-                    send(client_fd, response, strlen(response), 0);
+                    reactor_send_str(conn, response);
                     
                     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                                "File created successfully: %s (owner: %s)", filename, owner);
@@ -164,456 +707,306 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
                 } else {
                     char response[256];
                     snprintf(response, sizeof(response), "ERROR|%s\n", get_error_message(result));
-                    send(client_fd, response, strlen(response), 0);
+                    reactor_send_str(conn, response);
                     log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                                "CREATE failed: %s (error=%d)", filename, result);
                 }
             }
         }
 
-        // READ|filename
+        // READ|filename[|ids|n|@id]
+        // "ids" shows each sentence's ID; n or @id reads just that sentence
         else if (strcmp(cmd, "READ") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
+            char *view = message_next_arg(&msg);
+            RenderStyle style = RENDER_NUMBERED;
+            int only_num = -1;
+            uint32_t only_id = 0;
+            int single = 0;
+            if (view && strcmp(view, "ids") == 0) {
+                style = RENDER_NUMBERED_IDS;
+            } else if (view) {
+                single = 1;
+            }
         
             if (!filename) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "READ: Missing filename (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing filename\n", 23, 0);
+                           "READ: Missing filename (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing filename\n", 23);
+            } else if (single && !parse_sentence_ref(view, &only_num, &only_id)) {
+                reactor_send(conn, "ERROR|Invalid sentence reference\n", 33);
             } else {
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "READ request: filename='%s'", filename);
                 
-                pthread_mutex_lock(&ctx->storage_lock);
+                FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_SHARED);
         
-                // Load as FileContent to access sentences
-                FileContent *file = load_file_content(ctx->storage_dir, filename);
+                // Parsed document from the content cache (loaded on a miss)
+                FileContent *file = content_cache_acquire(ctx, filename);
         
-                if (file) {
-                    char response[LARGE_BUFFER_SIZE] = "SUCCESS|\n";
-        
-                    SentenceNode *current = file->head;
-                    int sent_num = 0;
-                    while (current) {
-                        // Get sentence as string
-                        char *sent_str = word_list_to_string(current->word_head, current->delimiter);
-                        if (sent_str) {
-                            char line[MAX_SENTENCE_LENGTH + 20];
-                            // Format: [0] Hello world.
-                            snprintf(line, sizeof(line), "[%d] %s\n", sent_num, sent_str);
-                            strncat(response, line, LARGE_BUFFER_SIZE - strlen(response) - 1);
-                            free(sent_str);
-                        }
-                        sent_num++;
-                        current = current->next;
+                SentenceNode *only = NULL;
+                if (file && single) {
+                    only = only_id ? sentence_index_find_id(file, only_id) :
+                           only_num < file->sentence_count ? get_sentence_node(file, only_num) : NULL;
+                    if (only && only_id) only_num = sentence_index_rank(only);
+                }
+
+                DynamicBuffer response;
+                if (file && single && !only) {
+                    content_cache_release(ctx, file);
+                    reactor_send(conn, "ERROR|Sentence does not exist\n", 30);
+                } else if (file && dynbuf_init(&response, 4096) == ERR_SUCCESS) {
+                    // Format: [0] Hello world.   (with IDs: [0 @17] Hello world.)
+                    int sent_num = file->sentence_count;
+                    dynbuf_append_str(&response, "SUCCESS|\n");
+                    int rendered = only ? render_sentence(only, only_num, &response) :
+                                          render_file_content(file, style, &response);
+                    if (rendered == ERR_SUCCESS &&
+                        dynbuf_append_str(&response, "STOP\n") == ERR_SUCCESS) {
+                        reactor_send_buffer(conn, &response);
+                        // A cache hit never reads the file, so record the access here
+                        touch_metadata(ctx->storage_dir, filename, time(NULL));
+                    } else {
+                        reactor_send(conn, "ERROR|Out of memory\n", 20);
                     }
-        
-                    send(client_fd, response, strlen(response), 0);
-                    send(client_fd, "STOP\n", 5, 0);
+                    dynbuf_free(&response);
         
                     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                                "READ completed: %s (%d sentences)", filename, sent_num);
-                    free_file_content(file);
+                    content_cache_release(ctx, file);
                     printf("Read file: %s (%d sentences)\n", filename, sent_num);
                 } else {
+                    content_cache_release(ctx, file);
                     log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                                "READ failed: File not found '%s'", filename);
-                    send(client_fd, "ERROR|File not found\n", 21, 0);
+                    reactor_send(conn, "ERROR|File not found\n", 21);
                 }
         
-                pthread_mutex_unlock(&ctx->storage_lock);
+                release_file_lock(ctx, file_lock);
             }
         }
 
         else if (strcmp(cmd, "CLEANREAD") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
         
             if (!filename) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "CLEANREAD: Missing filename (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing filename\n", 23, 0);
+                           "CLEANREAD: Missing filename (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing filename\n", 23);
             } else {
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "CLEANREAD request: filename='%s'", filename);
                 
-                pthread_mutex_lock(&ctx->storage_lock);
+                FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_SHARED);
         
-                FileContent *file = load_file_content(ctx->storage_dir, filename);
+                FileContent *file = content_cache_acquire(ctx, filename);
         
-                if (file) {
-                    char response[LARGE_BUFFER_SIZE] = "SUCCESS|\n";
-        
-                    SentenceNode *current = file->head;
-                    int sent_num = 0;
-                    while (current) {
-                        char *sent_str = word_list_to_string(current->word_head, current->delimiter);
-                        if (sent_str) {
-                            char line[MAX_SENTENCE_LENGTH + 20];
-                            snprintf(line, sizeof(line), "%s\n", sent_str);
-                            strncat(response, line, LARGE_BUFFER_SIZE - strlen(response) - 1);
-                            free(sent_str);
-                        }
-                        sent_num++;
-                        current = current->next;
+                DynamicBuffer response;
+                if (file && dynbuf_init(&response, 4096) == ERR_SUCCESS) {
+                    int sent_num = file->sentence_count;
+                    dynbuf_append_str(&response, "SUCCESS|\n");
+                    if (render_file_content(file, RENDER_PLAIN, &response) == ERR_SUCCESS) {
+                        reactor_send_buffer(conn, &response);
+                        touch_metadata(ctx->storage_dir, filename, time(NULL));
+                    } else {
+                        reactor_send(conn, "ERROR|Out of memory\n", 20);
                     }
-        
-                    send(client_fd, response, strlen(response), 0);
+                    dynbuf_free(&response);
         
                     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                                "CLEANREAD completed: %s (%d sentences)", filename, sent_num);
-                    free_file_content(file);
+                    content_cache_release(ctx, file);
                     printf("Read file: %s (%d sentences)\n", filename, sent_num);
                 } else {
+                    content_cache_release(ctx, file);
                     log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                                "CLEANREAD failed: File not found '%s'", filename);
-                    send(client_fd, "ERROR|File not found\n", 21, 0);
+                    reactor_send(conn, "ERROR|File not found\n", 21);
                 }
         
-                pthread_mutex_unlock(&ctx->storage_lock);
+                release_file_lock(ctx, file_lock);
             }
         }
 
-        // WRITE|filename|sentence_num|username
+        // WRITE|filename|sentence|username[|wait_ms]
+        // The sentence is an index or @id. Locks are keyed by the sentence's
+        // ID, so a session keeps its sentence when other commits split or
+        // merge the ones before it. With wait_ms, a held sentence is waited
+        // for (in arrival order) instead of refused straight away.
         else if (strcmp(cmd, "WRITE") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
-            char *sentence_num_str = strtok_r(NULL, "|", &saveptr);
-            char *username_ptr = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
+            char *sentence_num_str = message_next_arg(&msg);
+            char *username_ptr = message_next_arg(&msg);
+            char *wait_ms_str = message_next_arg(&msg);
         
             if (!filename || !sentence_num_str || !username_ptr) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "WRITE: Missing parameters (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing parameters\n", 25, 0);
+                           "WRITE: Missing parameters (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing parameters\n", 25);
                 continue;
             }
         
-            char username[MAX_USERNAME_LENGTH];
-            strncpy(username, username_ptr, MAX_USERNAME_LENGTH - 1);
-            username[MAX_USERNAME_LENGTH - 1] = '\0';
-        
-            char filename_copy[MAX_FILENAME_LENGTH];
-            strncpy(filename_copy, filename, MAX_FILENAME_LENGTH - 1);
-            filename_copy[MAX_FILENAME_LENGTH - 1] = '\0';
+            int sentence_num;
+            uint32_t sentence_id;
+            int wait_ms = wait_ms_str ? atoi(wait_ms_str) : 0;
+            if (wait_ms > SENTENCE_LOCK_MAX_WAIT_MS) wait_ms = SENTENCE_LOCK_MAX_WAIT_MS;
         
-            int sentence_num = atoi(sentence_num_str);
-        
-            if (sentence_num < 0) {
+            if (!parse_sentence_ref(sentence_num_str, &sentence_num, &sentence_id)) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "WRITE: Invalid sentence number %d", sentence_num);
-                send(client_fd, "ERROR|Sentence number must be >= 0\n", 36, 0);
+                           "WRITE: Invalid sentence '%s'", sentence_num_str);
+                reactor_send(conn, "ERROR|Sentence must be an index >= 0 or @id\n", 44);
                 continue;
             }
-        
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "WRITE request: file='%s', sentence=%d, user='%s'", 
-                       filename_copy, sentence_num, username);
-            printf("WRITE request: file='%s', sentence=%d, user='%s'\n", 
-                   filename_copy, sentence_num, username);
-        
-            // Try global lock
-            if (!global_try_lock_sentence(ctx, filename_copy, sentence_num, username)) {
-                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "WRITE: Sentence already locked - file='%s', sentence=%d", 
-                           filename_copy, sentence_num);
-                send(client_fd, "ERROR|Sentence locked by another user\n", 39, 0);
+
+            ClientState *state = begin_client_state(conn, CLIENT_LOCK_WAIT);
+            if (!state) {
+                reactor_send(conn, "ERROR|Out of memory\n", 20);
                 continue;
             }
+            strncpy(state->username, username_ptr, MAX_USERNAME_LENGTH - 1);
+            strncpy(state->filename, filename, MAX_FILENAME_LENGTH - 1);
+            strncpy(state->sentence_ref, sentence_num_str, sizeof(state->sentence_ref) - 1);
+            strcpy(state->lock_waiter.username, state->username);
+            state->sentence_num = sentence_num;
+            state->sentence_id = sentence_id;
         
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "Lock acquired: file='%s', sentence=%d, user='%s'", 
-                       filename_copy, sentence_num, username);
-        
-            // Load file into buffer
-            pthread_mutex_lock(&ctx->storage_lock);
-            FileContent *file_buffer = load_file_content(ctx->storage_dir, filename_copy);
-            pthread_mutex_unlock(&ctx->storage_lock);
-        
-            if (!file_buffer) {
-                log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                           "WRITE: File load failed '%s'", filename_copy);
-                global_unlock_sentence(ctx, filename_copy, sentence_num, username);
-                send(client_fd, "ERROR|File not found\n", 21, 0);
-                continue;
-            }
-
-            // Validate sentence number
-            // Allow: sentence_num == 0 for empty file
-            // Allow: sentence_num < sentence_count for existing sentences
-            // Allow: sentence_num == sentence_count ONLY if last sentence has delimiter
-            int allow_append = 0;
-            if (file_buffer->sentence_count > 0 && sentence_num == file_buffer->sentence_count) {
-                // Check if last sentence ends with delimiter
-                SentenceNode *last = file_buffer->head;
-                while (last && last->next) last = last->next;
-                if (last && is_sentence_delimiter(last->delimiter)) {
-                    allow_append = 1;
-                    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                                "Allowing append to new sentence %d (last sentence has delimiter '%c')",
-                                sentence_num, last->delimiter);
-                }
+            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+                       "WRITE request: file='%s', sentence=%s, user='%s'", 
+                       state->filename, sentence_num_str, state->username);
+            printf("WRITE request: file='%s', sentence=%s, user='%s'\n", 
+                   state->filename, sentence_num_str, state->username);
+
+            // The ID the lock is keyed by: that of the sentence named now, or
+            // SENTENCE_APPEND_ID for a new sentence at the end
+            FileLockEntry *file_lock = acquire_file_lock(ctx, state->filename, FILE_LOCK_SHARED);
+            FileContent *live = content_cache_acquire(ctx, state->filename);
+            state->lock_id = SENTENCE_APPEND_ID;
+            int resolved = live != NULL;
+            if (live && sentence_id) {
+                SentenceNode *named = sentence_index_find_id(live, sentence_id);
+                resolved = named != NULL;
+                state->lock_id = sentence_id;
+            } else if (live && sentence_num < live->sentence_count) {
+                state->lock_id = get_sentence_node(live, sentence_num)->id;
             }
+            content_cache_release(ctx, live);
+            release_file_lock(ctx, file_lock);
 
-            // Error conditions:
-            // 1. Empty file and asking for sentence > 0
-            // 2. Non-empty file and sentence_num > sentence_count
-            // 3. sentence_num == sentence_count but last sentence has no delimiter
-            if ((file_buffer->sentence_count == 0 && sentence_num > 0) ||
-                (file_buffer->sentence_count > 0 && sentence_num > file_buffer->sentence_count) ||
-                (file_buffer->sentence_count > 0 && sentence_num == file_buffer->sentence_count && !allow_append)) {
-
-                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-                            "Sentence validation failed: requested=%d, count=%d, allow_append=%d",
-                            sentence_num, file_buffer->sentence_count, allow_append);
-
-                global_unlock_sentence(ctx, filename_copy, sentence_num, username);
-                free_file_content(file_buffer);
-
-                char error_msg[128];
-                snprintf(error_msg, sizeof(error_msg),
-                        "ERROR|Sentence %d does not exist. File has %d sentence(s). %s\n",
-                        sentence_num, file_buffer->sentence_count,
-                        (file_buffer->sentence_count > 0 && sentence_num == file_buffer->sentence_count) ?
-                        "Last sentence must end with delimiter (. ! ?) to create new sentence." : "");
-                send(client_fd, error_msg, strlen(error_msg), 0);
+            if (!resolved) {
+                reactor_send(conn, live ? "ERROR|Sentence does not exist\n" : "ERROR|File not found\n",
+                             live ? 30 : 21);
+                end_client_state(conn);
                 continue;
             }
-            
-            // Create first sentence node if file is empty and user requests sentence_num==0
-            if (file_buffer->sentence_count == 0 && sentence_num == 0) {
-                SentenceNode *node = malloc(sizeof(SentenceNode));
-                node->word_head = NULL;
-                node->word_tail = NULL;
-                node->word_count = 0;
-                node->delimiter = '\0';
-                node->next = NULL;
-                node->is_locked = 0;
-                node->locked_by[0] = '\0';
-                pthread_mutex_init(&node->sentence_lock, NULL);
-                file_buffer->head = node;
-                file_buffer->sentence_count = 1;
-            }
-            // Allow creation of new blank sentence at the end if previous ends with delimiter
-            else if (allow_append && sentence_num == file_buffer->sentence_count) {
-                SentenceNode *node = malloc(sizeof(SentenceNode));
-                node->word_head = NULL;
-                node->word_tail = NULL;
-                node->word_count = 0;
-                node->delimiter = '\0';
-                node->next = NULL;
-                node->is_locked = 0;
-                node->locked_by[0] = '\0';
-                pthread_mutex_init(&node->sentence_lock, NULL);
-                // Append to list
-                SentenceNode *last = file_buffer->head;
-                while (last && last->next) last = last->next;
-                if (last) last->next = node;
-                file_buffer->sentence_count++;
-            }
         
-            // Ensure sentence exists
-            lock_sentence(file_buffer, sentence_num, username);
-        
-            char response[128];
-            snprintf(response, sizeof(response), 
-                    "SUCCESS|Sentence %d locked for '%s'. Send word updates (word_index|content), then ETIRW\n", 
-                    sentence_num, username);
-            send(client_fd, response, strlen(response), 0);
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                       "Write session started: sentence %d locked for user '%s'", 
-                       sentence_num, username);
-            printf("  Locked sentence %d for user '%s'\n", sentence_num, username);
-        
-            int current_sentence = sentence_num;
-            int write_active = 1;
-            int word_update_count = 0;
-        
-            while (write_active) {
-                memset(buffer, 0, sizeof(buffer));
-                bytes = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        
-                if (bytes <= 0) {
-                    log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                               "Client disconnected during WRITE session (fd=%d)", client_fd);
-                    printf("  Client disconnected during WRITE\n");
-                    global_unlock_sentence(ctx, filename_copy, sentence_num, username);
-                    free_file_content(file_buffer);
-                    close(client_fd);
-                    return;
-                }
-        
-                buffer[bytes] = '\0';
-                newline = strchr(buffer, '\n');
-                if (newline) *newline = '\0';
-                newline = strchr(buffer, '\r');
-                if (newline) *newline = '\0';
-        
-                log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                           "WRITE session received: '%s'", buffer);
-                printf("  Received: '%s'\n", buffer);
-        
-                if (strcmp(buffer, "ETIRW") == 0) {
-                    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                               "WRITE session completing: file='%s', updates=%d", 
-                               filename_copy, word_update_count);
-                    
-                    // Save buffer to disk
-                    pthread_mutex_lock(&ctx->storage_lock);
-                    int save_result = save_file_content(ctx->storage_dir, file_buffer);
-        
-                    if (save_result == ERR_SUCCESS) {
-                        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                                   "File saved successfully: %s", filename_copy);
-                        
-                        FileMetadata metadata;
-                        if (load_metadata(ctx->storage_dir, filename_copy, &metadata) == ERR_SUCCESS) {
-                            metadata.modified_time = time(NULL);
-                            update_file_stats(ctx->storage_dir, &metadata);
-                            save_metadata(ctx->storage_dir, &metadata);
-                            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                                       "Metadata updated for: %s", filename_copy);
-                        }
-                    } else {
-                        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                                   "File save failed: %s (error=%d)", filename_copy, save_result);
-                    }
-                    pthread_mutex_unlock(&ctx->storage_lock);
-        
-                    free_file_content(file_buffer);
-                    global_unlock_sentence(ctx, filename_copy, sentence_num, username);
-        
-                    send(client_fd, "SUCCESS|Write complete\n", 23, 0);
-                    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                               "WRITE session completed successfully");
-                    printf("  Write session completed\n");
-        
-                    if (nm_socket > 0) {
-                        char notify[256];
-                        snprintf(notify, sizeof(notify), "FILE_UPDATED|%s\n", filename_copy);
-                        send(nm_socket, notify, strlen(notify), 0);
-                        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                                   "Notified name server of file update: %s", filename_copy);
-                    }
-        
-                    write_active = 0;
-                }
-                else {
-                    // Parse word update
-                    char buffer_copy[BUFFER_SIZE];
-                    strncpy(buffer_copy, buffer, sizeof(buffer_copy) - 1);
-                    buffer_copy[sizeof(buffer_copy) - 1] = '\0';
-        
-                    char *saveptr2;
-                    char *word_index_str = strtok_r(buffer_copy, "|", &saveptr2);
-                    char *content = strtok_r(NULL, "", &saveptr2);
-        
-                    if (!word_index_str || !content) {
-                        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                                   "WRITE: Invalid word update format");
-                        send(client_fd, "ERROR|Invalid format. Use: word_index|content\n", 47, 0);
-                        continue;
-                    }
-        
-                    int word_index = atoi(word_index_str);
-        
-                    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                               "Word update: sentence=%d, word_index=%d, content='%s'", 
-                               current_sentence, word_index, content);
-                    printf("  Inserting at word %d: '%s' (sentence %d)\n", 
-                           word_index, content, current_sentence);
-        
-                    int new_sentence_num = current_sentence;
-                    int mod_result = modify_sentence_multiword(file_buffer, current_sentence, 
-                                                              word_index, content, username, &new_sentence_num);
-        
-                    if (mod_result == ERR_SUCCESS) {
-                        word_update_count++;
-                        send(client_fd, "SUCCESS|Word updated\n", 21, 0);
-                        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                                   "Word updated successfully (now in sentence %d)", new_sentence_num);
-                        printf("  ✓ Updated (now in sentence %d)\n", new_sentence_num);
-        
-                        // Check if sentence changed (delimiter detected)
-                        if (new_sentence_num > current_sentence) {
-                            current_sentence = new_sentence_num;
-                            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                                       "Auto-switched to sentence %d", current_sentence);
-                            printf("  → Auto-switched to sentence %d\n", current_sentence);
-        
-                            char info_msg[128];
-                            snprintf(info_msg, sizeof(info_msg), 
-                                    "INFO|Sentence ended. Now editing sentence %d\n", current_sentence);
-                            send(client_fd, info_msg, strlen(info_msg), 0);
-                        }
-                    } else {
-                        char error[256];
-                        snprintf(error, sizeof(error), "ERROR|%s\n", get_error_message(mod_result));
-                        send(client_fd, error, strlen(error), 0);
-                        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                                   "Word update failed: %s", get_error_message(mod_result));
-                        printf("  ✗ Failed: %s\n", get_error_message(mod_result));
-                    }
+            // Try global lock; with wait_ms, queue for it and take up the
+            // session when it is handed over
+            int locked;
+            if (wait_ms > 0) {
+                locked = global_queue_lock_sentence(ctx, state->filename, state->lock_id, &state->lock_waiter);
+                if (locked == 0) {
+                    state->deadline_ms = reactor_now_ms() + wait_ms;
+                    continue_lock_wait(conn);
+                    continue;
                 }
+                locked = locked > 0;
+            } else {
+                locked = global_try_lock_sentence(ctx, state->filename, state->lock_id, state->username);
+            }
+            if (!locked) {
+                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                           "WRITE: Sentence already locked - file='%s', sentence=%s", 
+                           state->filename, sentence_num_str);
+                reactor_send(conn, "ERROR|Sentence locked by another user\n", 38);
+                end_client_state(conn);
+                continue;
             }
+            start_write_session(conn);
         }
 
-        // UNDO|filename
+        // UNDO|filename[|levels]
         else if (strcmp(cmd, "UNDO") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
+            char *levels_str = message_next_arg(&msg);
+            int levels = levels_str ? atoi(levels_str) : 1;
 
             if (!filename) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "UNDO: Missing filename (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing filename\n", 23, 0);
+                           "UNDO: Missing filename (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing filename\n", 23);
+            } else if (levels < 1) {
+                reactor_send(conn, "ERROR|Invalid undo level count\n", 31);
             } else {
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                           "UNDO request: filename='%s'", filename);
+                           "UNDO request: filename='%s', levels=%d", filename, levels);
                 
-                pthread_mutex_lock(&ctx->storage_lock);
-
-                char *file_path = get_file_path(ctx->storage_dir, filename);
-                char backup_path[MAX_PATH_LENGTH];
-                snprintf(backup_path, sizeof(backup_path), "%s.backup", file_path);
+                FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_EXCLUSIVE);
+                FileContent *live = content_cache_acquire(ctx, filename);
+                uint64_t lsn = 0;
+                int result = live ? undo_file_versions(ctx, live, levels, &lsn) : ERR_FILE_NOT_FOUND;
+                if (live) content_cache_release(ctx, live);
+
+                // Files last written by an older server may still have a
+                // single .backup instead of a history
+                if (result == ERR_NOTHING_TO_UNDO && levels == 1) {
+                    result = ss_restore_backup(ctx->storage_dir, filename);
+                    if (result == ERR_SUCCESS) {
+                        result = wal_discard_file(ctx, filename);
+                    } else if (result == ERR_FILE_NOT_FOUND) {
+                        result = ERR_NOTHING_TO_UNDO;
+                    }
+                }
+                release_file_lock(ctx, file_lock);
 
-                if (access(backup_path, F_OK) != 0) {
+                if (result != ERR_SUCCESS) {
                     log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                               "UNDO: No backup available for '%s'", filename);
-                    free(file_path);
-                    pthread_mutex_unlock(&ctx->storage_lock);
-                    send(client_fd, "ERROR|No backup available\n", 27, 0);
+                               "UNDO failed for '%s': %s", filename, get_error_message(result));
+                    char response[256];
+                    snprintf(response, sizeof(response), "ERROR|%s\n", get_error_message(result));
+                    reactor_send_str(conn, response);
                 } else {
-                    char cmd_buf[BUFFER_SIZE];
-                    snprintf(cmd_buf, sizeof(cmd_buf), "cp %s %s", backup_path, file_path);
-                    int sys_result = system(cmd_buf);
-
                     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                               "UNDO executed: file='%s', result=%d", filename, sys_result);
-                    free(file_path);
-                    pthread_mutex_unlock(&ctx->storage_lock);
-
-                    send(client_fd, "SUCCESS|Undo successful\n", 24, 0);
-                    printf("Undone changes for: %s\n", filename);
+                               "UNDO executed: file='%s', levels=%d", filename, levels);
+                    printf("Undone %d change(s) for: %s\n", levels, filename);
+                    reply_when_durable(conn, lsn, "SUCCESS|Undo successful\n", "");
                 }
             }
         }
 
         // DELETE|filename
         else if (strcmp(cmd, "DELETE") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
 
             if (!filename) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "DELETE: Missing filename (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing filename\n", 23, 0);
+                           "DELETE: Missing filename (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing filename\n", 23);
             } else {
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "DELETE request: filename='%s'", filename);
                 
+                // Namespace change: hold the server-wide lock, and wait out any
+                // readers/writers of this file before unlinking it
                 pthread_mutex_lock(&ctx->storage_lock);
+                FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_EXCLUSIVE);
                 int result = ss_delete_file(ctx->storage_dir, filename);
+                if (result == ERR_SUCCESS) {
+                    // Commits still in the log must not be replayed into a
+                    // file created later under the same name, so the delete
+                    // only counts once that is durable
+                    result = wal_discard_file(ctx, filename);
+                    if (result != ERR_SUCCESS) {
+                        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL,
+                                   "DELETE: '%s' unlinked but its log reset was not written", filename);
+                    }
+                }
+                release_file_lock(ctx, file_lock);
                 pthread_mutex_unlock(&ctx->storage_lock);
 
                 if (result == ERR_SUCCESS) {
                     char response[256];
                     snprintf(response, sizeof(response), "SUCCESS|File '%s' deleted\n", filename);
-                    send(client_fd, response, strlen(response), 0);
+                    reactor_send_str(conn, response);
                     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                                "File deleted successfully: %s", filename);
                     printf("Deleted file: %s\n", filename);
@@ -628,7 +1021,7 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
                 } else {
                     char response[256];
                     snprintf(response, sizeof(response), "ERROR|%s\n", get_error_message(result));
-                    send(client_fd, response, strlen(response), 0);
+                    reactor_send_str(conn, response);
                     log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                                "DELETE failed: %s (error=%d)", filename, result);
                 }
@@ -639,17 +1032,21 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
         else if (strcmp(cmd, "LIST") == 0) {
             log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, "LIST request received");
             
-            pthread_mutex_lock(&ctx->storage_lock);
             char files[MAX_FILES_PER_SS][MAX_FILENAME_LENGTH];
             int count = list_files(ctx->storage_dir, files, MAX_FILES_PER_SS);
-            pthread_mutex_unlock(&ctx->storage_lock);
 
-            char response[LARGE_BUFFER_SIZE] = "SUCCESS|Files:\n";
-            for (int i = 0; i < count; i++) {
-                strcat(response, files[i]);
-                strcat(response, "\n");
+            DynamicBuffer response;
+            if (dynbuf_init(&response, 4096) == ERR_SUCCESS) {
+                dynbuf_append_str(&response, "SUCCESS|Files:\n");
+                for (int i = 0; i < count; i++) {
+                    dynbuf_append_str(&response, files[i]);
+                    dynbuf_append_char(&response, '\n');
+                }
+                reactor_send_buffer(conn, &response);
+                dynbuf_free(&response);
+            } else {
+                reactor_send(conn, "ERROR|Out of memory\n", 20);
             }
-            send(client_fd, response, strlen(response), 0);
             log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                        "LIST completed: %d files", count);
             printf("Listed %d files\n", count);
@@ -657,20 +1054,20 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
 
         // INFO|filename
         else if (strcmp(cmd, "INFO") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
 
             if (!filename) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "INFO: Missing filename (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing filename\n", 23, 0);
+                           "INFO: Missing filename (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing filename\n", 23);
             } else {
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "INFO request: filename='%s'", filename);
                 
-                pthread_mutex_lock(&ctx->storage_lock);
+                FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_SHARED);
                 FileMetadata metadata;
                 int result = load_metadata(ctx->storage_dir, filename, &metadata);
-                pthread_mutex_unlock(&ctx->storage_lock);
+                release_file_lock(ctx, file_lock);
 
                 if (result == ERR_SUCCESS) {
                     char response[BUFFER_SIZE];
@@ -695,7 +1092,7 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
                             metadata.word_count, metadata.char_count, metadata.sentence_count,
                             created, modified, accessed);
 
-                    send(client_fd, response, strlen(response), 0);
+                    reactor_send_str(conn, response);
                     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                                "INFO completed: %s (size=%zu, words=%d)", 
                                filename, metadata.size, metadata.word_count);
@@ -703,7 +1100,7 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
                 } else {
                     char response[256];
                     snprintf(response, sizeof(response), "ERROR|%s\n", get_error_message(result));
-                    send(client_fd, response, strlen(response), 0);
+                    reactor_send_str(conn, response);
                     log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                                "INFO failed: %s (error=%d)", filename, result);
                 }
@@ -712,79 +1109,168 @@ void handle_client(int client_fd, StorageServerConfig *ctx) {
 
         // STREAM|filename
         else if (strcmp(cmd, "STREAM") == 0) {
-            char *filename = strtok_r(NULL, "|", &saveptr);
+            char *filename = message_next_arg(&msg);
 
             if (!filename) {
                 log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                           "STREAM: Missing filename (fd=%d)", client_fd);
-                send(client_fd, "ERROR|Missing filename\n", 23, 0);
+                           "STREAM: Missing filename (fd=%d)", conn->fd);
+                reactor_send(conn, "ERROR|Missing filename\n", 23);
             } else {
                 log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                            "STREAM request: filename='%s'", filename);
                 
-                pthread_mutex_lock(&ctx->storage_lock);
-                char content[LARGE_BUFFER_SIZE];
-                int result = ss_read_file(ctx->storage_dir, filename, content, sizeof(content));
-                pthread_mutex_unlock(&ctx->storage_lock);
+                // The live document, since the file itself may not have the
+                // latest commits until the next checkpoint
+                FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_SHARED);
+                FileContent *file = content_cache_acquire(ctx, filename);
+                DynamicBuffer text = { NULL, 0, 0 };
+                int result = file ? dynbuf_init(&text, 4096) : ERR_FILE_NOT_FOUND;
+                if (result == ERR_SUCCESS) {
+                    result = render_saved_text(file, &text);
+                }
+                content_cache_release(ctx, file);
+                release_file_lock(ctx, file_lock);
+                if (result == ERR_SUCCESS) {
+                    touch_metadata(ctx->storage_dir, filename, time(NULL));
+                }
+
+                ClientState *state = NULL;
+                if (result == ERR_SUCCESS) {
+                    state = begin_client_state(conn, CLIENT_STREAMING);
+                    if (!state) result = ERR_OUT_OF_MEMORY;
+                }
 
                 if (result != ERR_SUCCESS) {
+                    dynbuf_free(&text);
                     char response[256];
                     snprintf(response, sizeof(response), "ERROR|%s\n", get_error_message(result));
-                    send(client_fd, response, strlen(response), 0);
+                    reactor_send_str(conn, response);
                     log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                                "STREAM failed: %s (error=%d)", filename, result);
                 } else {
-                    send(client_fd, "SUCCESS|Starting stream\n", 24, 0);
-                    usleep(50000);
-
-                    int word_count = 0;
-                    char *token = strtok(content, " \t\n\r");
-                    while (token) {
-                        char word_msg[BUFFER_SIZE];
-                        snprintf(word_msg, sizeof(word_msg), "WORD|%s\n", token);
-                        send(client_fd, word_msg, strlen(word_msg), 0);
-                        word_count++;
-
-                        usleep(STREAM_DELAY_MS * 1000);
-
-                        token = strtok(NULL, " \t\n\r");
-                    }
-
-                    send(client_fd, "STOP\n", 5, 0);
-                    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                               "STREAM completed: %s (%d words)", filename, word_count);
-                    printf("Streamed file: %s\n", filename);
+                    reactor_send(conn, "SUCCESS|Starting stream\n", 24);
+
+                    // A word every STREAM_DELAY_MS from a timer, the first
+                    // shortly after the header
+                    strncpy(state->filename, filename, MAX_FILENAME_LENGTH - 1);
+                    state->text = text;
+                    text_tokenizer_init(&state->tokenizer, state->text.data, state->text.length, 0);
+                    state->deadline_ms = reactor_now_ms() + 50;
+                    reactor_set_timer(conn, 50);
                 }
             }
         }
 
+        // STATS
+        else if (strcmp(cmd, "STATS") == 0) {
+            ContentCacheStats stats;
+            content_cache_get_stats(ctx, &stats);
+            WalStats wal_stats;
+            wal_get_stats(ctx, &wal_stats);
+            SentenceLockStats lock_stats;
+            sentence_lock_get_stats(ctx, &lock_stats);
+            ReactorStats conn_stats;
+            reactor_get_stats(conn->reactor, &conn_stats);
+
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response),
+                    "SUCCESS|\n"
+                    "Cache entries: %d\n"
+                    "Cache memory: %zu / %zu bytes\n"
+                    "Cache hits: %lu\n"
+                    "Cache misses: %lu\n"
+                    "Cache evictions: %lu\n"
+                    "Cache invalidations: %lu\n"
+                    "WAL mode: %s\n"
+                    "WAL commits: %lu\n"
+                    "WAL syncs: %lu\n"
+                    "WAL checkpoints: %lu\n"
+                    "WAL segment: %llu (%zu bytes)\n"
+                    "Lock waits: %lu (granted %lu, timed out %lu)\n"
+                    "Lock wait time: %lu ms total, %lu ms max\n"
+                    "Lock waiters: %d now, %d deepest queue\n"
+                    "Connections: %d open, %lu accepted, %d workers\n",
+                    stats.entry_count, stats.memory_used, stats.memory_budget,
+                    stats.hits, stats.misses, stats.evictions, stats.invalidations,
+                    wal_mode_name(wal_stats.mode), wal_stats.commits, wal_stats.syncs,
+                    wal_stats.checkpoints, (unsigned long long)wal_stats.generation,
+                    wal_stats.segment_bytes,
+                    lock_stats.waits, lock_stats.granted, lock_stats.timeouts,
+                    lock_stats.total_wait_ms, lock_stats.max_wait_ms,
+                    lock_stats.waiting, lock_stats.max_queue_depth,
+                    conn_stats.connections, conn_stats.accepted, conn_stats.workers);
+            reactor_send_str(conn, response);
+            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+                       "STATS completed: hits=%lu, misses=%lu, evictions=%lu", 
+                       stats.hits, stats.misses, stats.evictions);
+        }
+
         else {
             log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Unknown command: %s (fd=%d)", cmd, client_fd);
-            send(client_fd, "ERROR|Unknown command\n", 22, 0);
+                       "Unknown command: %s (fd=%d)", cmd, conn->fd);
+            reactor_send(conn, "ERROR|Unknown command\n", 22);
         }
     }
+}
+
+// Last call for a connection: give back whatever its session held
+static void drop_client(ReactorConn *conn) {
+    StorageServerConfig *ctx = conn->reactor->server;
+    ClientState *state = conn->state;
 
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Client handler ending (fd=%d)", client_fd);
-    close(client_fd);
+               "Client disconnected (fd=%d)", conn->fd);
+    printf("Client disconnected\n");
+    if (!state) return;
+
+    switch (state->phase) {
+    case CLIENT_LOCK_WAIT:
+        if (global_cancel_lock_wait(ctx, state->filename, state->lock_id, &state->lock_waiter)) {
+            global_unlock_sentence(ctx, state->filename, state->lock_id, state->username);
+        }
+        break;
+    case CLIENT_WRITING:
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Client disconnected during WRITE session (fd=%d)", conn->fd);
+        printf("  Client disconnected during WRITE\n");
+        release_write_session(ctx, state);
+        break;
+    case CLIENT_DURABLE_WAIT:
+        wal_cancel_durable(ctx, &state->wal_waiter);
+        break;
+    case CLIENT_STREAMING:
+        break;
+    }
+    end_client_state(conn);
 }
 
-// ============================================================================
-// CLIENT THREAD WRAPPER
-// ============================================================================
-void* client_thread_handler(void *arg) {
-    ClientThreadArg *client_arg = (ClientThreadArg*)arg;
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Client thread spawned: fd=%d, thread_id=%lu", 
-               client_arg->client_fd, pthread_self());
-    
-    handle_client(client_arg->client_fd, client_arg->ctx);
-    
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Client thread terminating: thread_id=%lu", pthread_self());
-    free(client_arg);
-    return NULL;
+// Reactor handler for client connections
+static void client_event(ReactorConn *conn, unsigned events) {
+    if (events & REACTOR_EVENT_CLOSED) {
+        drop_client(conn);
+        return;
+    }
+
+    // Timers and wakeups left over from an earlier phase are ignored
+    ClientState *state = conn->state;
+    if (state && (events & (REACTOR_EVENT_TIMER | REACTOR_EVENT_WAKE))) {
+        switch (state->phase) {
+        case CLIENT_LOCK_WAIT:
+            continue_lock_wait(conn);
+            break;
+        case CLIENT_WRITING:
+            if (events & REACTOR_EVENT_TIMER) expire_write_session(conn);
+            break;
+        case CLIENT_DURABLE_WAIT:
+            if (events & REACTOR_EVENT_WAKE) continue_durable_wait(conn);
+            break;
+        case CLIENT_STREAMING:
+            if (events & REACTOR_EVENT_TIMER) continue_stream(conn);
+            break;
+        }
+    }
+
+    serve_requests(conn);
 }
 
 // ============================================================================
@@ -801,8 +1287,8 @@ int main(int argc, char *argv[]) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, "Storage Server initializing");
 
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s <storage_dir> <client_port> [nm_ip] [nm_port]\n", argv[0]);
-        fprintf(stderr, "Example: %s ./storage_data 8001 127.0.0.1 9000\n", argv[0]);
+        fprintf(stderr, "Usage: %s <storage_dir> <client_port> [nm_ip] [nm_port] [none|group|sync]\n", argv[0]);
+        fprintf(stderr, "Example: %s ./storage_data 8001 127.0.0.1 9000 group\n", argv[0]);
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                    "Insufficient arguments (argc=%d)", argc);
         return 1;
@@ -811,8 +1297,17 @@ int main(int argc, char *argv[]) {
     const char *storage_dir = argv[1];
     int client_port = atoi(argv[2]);
 
+    // How commits reach the disk: group (default) shares one log sync among
+    // concurrent commits, sync syncs every commit, none never waits
+    WalMode wal_mode = WAL_MODE_GROUP;
+    if (argc >= 6 && parse_wal_mode(argv[5], &wal_mode) != ERR_SUCCESS) {
+        fprintf(stderr, "Unknown WAL mode '%s' (use none, group or sync)\n", argv[5]);
+        return 1;
+    }
+
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Configuration: storage_dir='%s', client_port=%d", storage_dir, client_port);
+               "Configuration: storage_dir='%s', client_port=%d, wal_mode=%s",
+               storage_dir, client_port, wal_mode_name(wal_mode));
 
     // Initialize context
     memset(&global_ctx, 0, sizeof(StorageServerConfig));
@@ -821,9 +1316,10 @@ int main(int argc, char *argv[]) {
     global_ctx.client_port = client_port;
     global_ctx.is_running = 1;
     pthread_mutex_init(&global_ctx.storage_lock, NULL);
+    init_file_locks(&global_ctx);
+    init_content_cache(&global_ctx.content_cache, CONTENT_CACHE_BUDGET_BYTES);
 
-    global_ctx.global_locks = NULL;
-    pthread_mutex_init(&global_ctx.lock_table_mutex, NULL);
+    init_sentence_locks(&global_ctx);
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -839,6 +1335,21 @@ int main(int argc, char *argv[]) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Storage directory verified: %s", storage_dir);
 
+    if (metadata_store_open(storage_dir) != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to open metadata store\n");
+        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL, 
+                   "Failed to open metadata store in: %s", storage_dir);
+        return 1;
+    }
+
+    // Replays commits a crash kept from reaching the files
+    if (wal_open(&global_ctx, wal_mode) != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to open write-ahead log\n");
+        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL, 
+                   "Failed to open write-ahead log in: %s", storage_dir);
+        return 1;
+    }
+
     printf("Storage Server Starting...\n");
     printf("Storage Directory: %s\n", storage_dir);
     printf("Client Port: %d\n", client_port);
@@ -892,13 +1403,14 @@ int main(int argc, char *argv[]) {
             }
 
             // Read response
-            char response[BUFFER_SIZE];
-            ssize_t bytes = recv(nm_socket, response, sizeof(response) - 1, 0);
-            if (bytes > 0) {
-                response[bytes] = '\0';
+            WireMessage response;
+            frame_conn_init(&nm_conn, nm_socket);
+            if (frame_conn_next(&nm_conn, &response) == ERR_SUCCESS) {
+                char response_text[BUFFER_SIZE];
+                message_describe(&response, response_text, sizeof(response_text));
                 log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                           "Name server response: %s", response);
-                printf("NM Response: %s", response);
+                           "Name server response: %s", response_text);
+                printf("NM Response: %s\n", response_text);
             }
 
             pthread_create(&nm_session_thread, NULL, maintain_nm_session, &global_ctx);
@@ -916,6 +1428,9 @@ int main(int argc, char *argv[]) {
                    "No name server specified, running standalone");
     }
 
+    // Idle connections each hold a descriptor
+    long fd_limit = reactor_raise_fd_limit();
+
     // Create server socket
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
@@ -954,7 +1469,7 @@ int main(int argc, char *argv[]) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Socket bound successfully to port %d", client_port);
 
-    if (listen(server_fd, 10) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen");
         log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL, 
                    "listen() failed (errno=%d)", errno);
@@ -969,67 +1484,43 @@ int main(int argc, char *argv[]) {
     printf("Server listening on port %d\n", client_port);
     printf("Ready for connections (use Ctrl+C to stop)\n\n");
 
-    // ACCEPT LOOP - CREATE THREAD FOR EACH CLIENT
-    int client_count = 0;
-    while (global_ctx.is_running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+    // One epoll loop watches every client connection; a fixed pool of
+    // workers runs the requests, so idle clients cost no thread
+    int workers = reactor_default_workers();
+    if (reactor_init(&client_reactor, server_fd, client_event, &global_ctx, workers, log_file) != ERR_SUCCESS) {
+        perror("reactor_init");
+        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL, 
+                   "Failed to start client reactor (errno=%d)", errno);
+        close(server_fd);
+        return 1;
+    }
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
+               "Serving clients with %d workers (fd limit %ld)", client_reactor.worker_count, fd_limit);
 
-        if (client_fd < 0) {
-            if (global_ctx.is_running) {
-                log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                           "accept() failed (errno=%d)", errno);
-                perror("accept");
-            }
-            continue;
-        }
+    reactor_run(&client_reactor, &global_ctx.is_running);
 
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-        
-        client_count++;
+    if (received_signal) {
+        printf("\nReceived signal %d, shutting down...\n", (int)received_signal);
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "Client connection #%d accepted from %s:%d (fd=%d)", 
-                   client_count, client_ip, ntohs(client_addr.sin_port), client_fd);
-        printf("Client connected from %s:%d\n", client_ip, ntohs(client_addr.sin_port));
-
-        // Create thread for this client
-        ClientThreadArg *client_arg = malloc(sizeof(ClientThreadArg));
-        if (!client_arg) {
-            perror("malloc");
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "Failed to allocate client thread argument");
-            close(client_fd);
-            continue;
-        }
-
-        client_arg->client_fd = client_fd;
-        client_arg->ctx = &global_ctx;
-
-        pthread_t client_thread;
-        if (pthread_create(&client_thread, NULL, client_thread_handler, client_arg) != 0) {
-            perror("pthread_create");
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                       "Failed to create client thread (errno=%d)", errno);
-            close(client_fd);
-            free(client_arg);
-            continue;
-        }
-
-        pthread_detach(client_thread);
+                   "Received signal %d, initiating shutdown", (int)received_signal);
     }
-
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Server shutting down, cleaning up resources");
-    pthread_mutex_destroy(&global_ctx.storage_lock);
-    pthread_mutex_destroy(&global_ctx.lock_table_mutex);
+
+    // Requests already running finish before the log is closed under
+    // them; the caches and lock tables are left to process exit, and only
+    // the log and the buffered access times need writing out
+    reactor_stop(&client_reactor);
+    wal_close(&global_ctx);
+    metadata_store_flush();
+    if (nm_socket > 0) {
+        close(nm_socket);
+    }
     close(server_fd);
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Storage Server stopped cleanly");
-    fclose(log_file);
+    fflush(log_file);
     printf("Server stopped\n");
 
     return 0;
@@ -1,161 +1,643 @@
 #include "../include/storageserver.h"
+#include <dirent.h>
 
+static MetadataStore metadata_store = { .log_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
 
-static char* get_metadata_path(const char *storage_dir, const char *filename) {
-    char *meta_path = malloc(MAX_PATH_LENGTH);
-    if (!meta_path) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Memory allocation failed for metadata path: storage_dir='%s', filename='%s'", 
-                   storage_dir, filename);
+// Layout of the per-file .meta blobs older servers wrote, read once to
+// migrate them into the store. The array sizes are frozen on purpose.
+typedef struct {
+    char filename[MAX_FILENAME_LENGTH];
+    char owner[MAX_USERNAME_LENGTH];
+    char path[MAX_PATH_LENGTH];
+    size_t size;
+    int word_count;
+    int char_count;
+    int sentence_count;
+    time_t created_time;
+    time_t modified_time;
+    time_t accessed_time;
+    int access_rights[500];
+    int locked_sentences[1000];
+    int is_folder;
+} LegacyFileMetadata;
+
+// ============================================================================
+// RECORDS
+// ============================================================================
+
+static unsigned int hash_metadata_filename(const char *filename) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash % METADATA_STORE_BUCKETS;
+}
+
+// FNV-1a
+static uint32_t checksum_bytes(uint32_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t record_checksum(const MetadataRecord *record, const char *name, const char *owner) {
+    MetadataRecord copy = *record;
+    copy.checksum = 0;
+
+    uint32_t hash = checksum_bytes(2166136261u, &copy, sizeof(copy));
+    hash = checksum_bytes(hash, name, record->name_length);
+    return checksum_bytes(hash, owner, record->owner_length);
+}
+
+// Serialize a record into buf (sizeof(MetadataRecord) + both name lengths);
+// returns the encoded length
+static size_t encode_record(char *buf, MetadataRecordType type, const FileMetadata *metadata) {
+    MetadataRecord record;
+    memset(&record, 0, sizeof(record));
+
+    record.magic = METADATA_RECORD_MAGIC;
+    record.version = METADATA_RECORD_VERSION;
+    record.type = (uint8_t)type;
+    record.name_length = (uint16_t)strlen(metadata->filename);
+
+    if (type == METADATA_RECORD_PUT) {
+        record.is_folder = (uint8_t)metadata->is_folder;
+        record.owner_length = (uint16_t)strlen(metadata->owner);
+        record.size = metadata->size;
+        record.created_time = metadata->created_time;
+        record.modified_time = metadata->modified_time;
+        record.accessed_time = metadata->accessed_time;
+        record.word_count = (uint32_t)metadata->word_count;
+        record.char_count = (uint32_t)metadata->char_count;
+        record.sentence_count = (uint32_t)metadata->sentence_count;
+    }
+
+    const char *owner = type == METADATA_RECORD_PUT ? metadata->owner : "";
+    record.checksum = record_checksum(&record, metadata->filename, owner);
+
+    memcpy(buf, &record, sizeof(record));
+    memcpy(buf + sizeof(record), metadata->filename, record.name_length);
+    memcpy(buf + sizeof(record) + record.name_length, owner, record.owner_length);
+    return sizeof(record) + record.name_length + record.owner_length;
+}
+
+static size_t put_record_length(const FileMetadata *metadata) {
+    return sizeof(MetadataRecord) + strlen(metadata->filename) + strlen(metadata->owner);
+}
+
+// ============================================================================
+// INDEX
+// ============================================================================
+
+static MetadataEntry* find_entry(MetadataStore *store, const char *filename) {
+    MetadataEntry *entry = store->buckets[hash_metadata_filename(filename)];
+    while (entry && strcmp(entry->metadata.filename, filename) != 0) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+// Insert or overwrite an entry. Returns NULL when out of memory.
+static MetadataEntry* put_entry(MetadataStore *store, const FileMetadata *metadata) {
+    MetadataEntry *entry = find_entry(store, metadata->filename);
+
+    if (entry) {
+        store->live_bytes -= put_record_length(&entry->metadata);
+    } else {
+        entry = calloc(1, sizeof(MetadataEntry));
+        if (!entry) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Metadata entry allocation failed for '%s'", metadata->filename);
+            return NULL;
+        }
+        unsigned int index = hash_metadata_filename(metadata->filename);
+        entry->next = store->buckets[index];
+        store->buckets[index] = entry;
+        store->entry_count++;
+    }
+
+    entry->metadata = *metadata;
+    store->live_bytes += put_record_length(&entry->metadata);
+    return entry;
+}
+
+static void remove_entry(MetadataStore *store, const char *filename) {
+    MetadataEntry **link = &store->buckets[hash_metadata_filename(filename)];
+
+    while (*link) {
+        MetadataEntry *entry = *link;
+        if (strcmp(entry->metadata.filename, filename) == 0) {
+            *link = entry->next;
+            store->live_bytes -= put_record_length(&entry->metadata);
+            if (entry->atime_dirty) store->dirty_count--;
+            store->entry_count--;
+            free(entry);
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+// ============================================================================
+// LOG
+// ============================================================================
+
+// Append one record; the store lock must be held
+static int append_record(MetadataStore *store, MetadataRecordType type, const FileMetadata *metadata) {
+    char buf[sizeof(MetadataRecord) + MAX_FILENAME_LENGTH + MAX_USERNAME_LENGTH];
+    size_t length = encode_record(buf, type, metadata);
+
+    if (write_all(store->log_fd, buf, length) != 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Metadata log append failed for '%s' (errno=%d)", metadata->filename, errno);
+        return ERR_FILE_WRITE_FAILED;
+    }
+
+    store->log_bytes += length;
+    return ERR_SUCCESS;
+}
+
+// Apply the records of a log image to the index. Returns the length of the
+// valid prefix; anything after it is a torn or corrupt tail.
+static size_t replay_log(MetadataStore *store, const char *data, size_t length) {
+    size_t offset = 0;
+
+    while (offset + sizeof(MetadataRecord) <= length) {
+        MetadataRecord record;
+        memcpy(&record, data + offset, sizeof(record));
+
+        if (record.magic != METADATA_RECORD_MAGIC || record.version == 0 ||
+            record.version > METADATA_RECORD_VERSION ||
+            record.name_length == 0 || record.name_length >= MAX_FILENAME_LENGTH ||
+            record.owner_length >= MAX_USERNAME_LENGTH) {
+            break;
+        }
+
+        size_t record_length = sizeof(record) + record.name_length + record.owner_length;
+        if (offset + record_length > length) {
+            break;
+        }
+
+        const char *name = data + offset + sizeof(record);
+        const char *owner = name + record.name_length;
+        if (record_checksum(&record, name, owner) != record.checksum) {
+            break;
+        }
+
+        FileMetadata metadata;
+        memset(&metadata, 0, sizeof(metadata));
+        memcpy(metadata.filename, name, record.name_length);
+
+        if (record.type == METADATA_RECORD_PUT) {
+            memcpy(metadata.owner, owner, record.owner_length);
+            metadata.size = (size_t)record.size;
+            metadata.word_count = (int)record.word_count;
+            metadata.char_count = (int)record.char_count;
+            metadata.sentence_count = (int)record.sentence_count;
+            metadata.created_time = (time_t)record.created_time;
+            metadata.modified_time = (time_t)record.modified_time;
+            metadata.accessed_time = (time_t)record.accessed_time;
+            metadata.is_folder = record.is_folder;
+            if (!put_entry(store, &metadata)) break;
+        } else if (record.type == METADATA_RECORD_DELETE) {
+            remove_entry(store, metadata.filename);
+        }
+
+        offset += record_length;
+    }
+
+    return offset;
+}
+
+// Rewrite the log with one record per live file. Also writes out pending
+// access times. The store lock must be held.
+static int compact_log(MetadataStore *store) {
+    char tmp_path[MAX_PATH_LENGTH + 32];
+    char log_path[MAX_PATH_LENGTH + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s", store->storage_dir, METADATA_STORE_TMP_FILE);
+    snprintf(log_path, sizeof(log_path), "%s/%s", store->storage_dir, METADATA_STORE_FILE);
+
+    DynamicBuffer image;
+    if (dynbuf_init(&image, store->live_bytes + 1) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    for (int i = 0; i < METADATA_STORE_BUCKETS; i++) {
+        for (MetadataEntry *entry = store->buckets[i]; entry; entry = entry->next) {
+            char buf[sizeof(MetadataRecord) + MAX_FILENAME_LENGTH + MAX_USERNAME_LENGTH];
+            size_t length = encode_record(buf, METADATA_RECORD_PUT, &entry->metadata);
+            if (dynbuf_append(&image, buf, length) != ERR_SUCCESS) {
+                dynbuf_free(&image);
+                return ERR_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    // The new log is opened for appending before it is renamed into place,
+    // so the store never keeps a descriptor to the replaced file
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0 || write_all(fd, image.data, image.length) != 0 || fsync(fd) != 0 ||
+        rename(tmp_path, log_path) != 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Metadata compaction failed writing %s (errno=%d)", tmp_path, errno);
+        if (fd >= 0) close(fd);
+        unlink(tmp_path);
+        dynbuf_free(&image);
+        return ERR_FILE_WRITE_FAILED;
+    }
+    close(store->log_fd);
+    store->log_fd = fd;
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Metadata log compacted: %zu -> %zu bytes (%d files)",
+               store->log_bytes, image.length, store->entry_count);
+
+    store->log_bytes = image.length;
+    for (int i = 0; i < METADATA_STORE_BUCKETS; i++) {
+        for (MetadataEntry *entry = store->buckets[i]; entry; entry = entry->next) {
+            entry->atime_dirty = 0;
+        }
+    }
+    store->dirty_count = 0;
+
+    dynbuf_free(&image);
+    return ERR_SUCCESS;
+}
+
+static int log_needs_compaction(const MetadataStore *store) {
+    return store->log_bytes >= METADATA_COMPACT_MIN_BYTES && store->log_bytes > 2 * store->live_bytes;
+}
+
+// Append the coalesced access times; the store lock must be held
+static void flush_access_times(MetadataStore *store) {
+    if (store->dirty_count == 0) {
+        return;
+    }
+
+    DynamicBuffer batch;
+    if (dynbuf_init(&batch, 4096) != ERR_SUCCESS) {
+        return;
+    }
+
+    int flushed = 0;
+    for (int i = 0; i < METADATA_STORE_BUCKETS; i++) {
+        for (MetadataEntry *entry = store->buckets[i]; entry; entry = entry->next) {
+            if (!entry->atime_dirty) continue;
+
+            char buf[sizeof(MetadataRecord) + MAX_FILENAME_LENGTH + MAX_USERNAME_LENGTH];
+            size_t length = encode_record(buf, METADATA_RECORD_PUT, &entry->metadata);
+            if (dynbuf_append(&batch, buf, length) != ERR_SUCCESS) {
+                dynbuf_free(&batch);
+                return;
+            }
+            flushed++;
+        }
+    }
+
+    // One write for the whole batch
+    if (write_all(store->log_fd, batch.data, batch.length) != 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Access time flush failed (errno=%d)", errno);
+        dynbuf_free(&batch);
+        return;
+    }
+    store->log_bytes += batch.length;
+
+    for (int i = 0; i < METADATA_STORE_BUCKETS; i++) {
+        for (MetadataEntry *entry = store->buckets[i]; entry; entry = entry->next) {
+            entry->atime_dirty = 0;
+        }
+    }
+    store->dirty_count = 0;
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "Flushed access times of %d file(s)", flushed);
+    dynbuf_free(&batch);
+}
+
+static void* metadata_flusher(void *arg) {
+    MetadataStore *store = (MetadataStore*)arg;
+
+    while (1) {
+        sleep(METADATA_FLUSH_INTERVAL_SEC);
+
+        pthread_mutex_lock(&store->lock);
+        if (log_needs_compaction(store)) {
+            compact_log(store);
+        } else {
+            flush_access_times(store);
+        }
+        pthread_mutex_unlock(&store->lock);
+    }
+    return NULL;
+}
+
+// ============================================================================
+// OPENING AND MIGRATION
+// ============================================================================
+
+// Import the .meta blobs of older servers and delete them; files already in
+// the store keep the store's version
+static void migrate_legacy_metadata(MetadataStore *store) {
+    DIR *dir = opendir(store->storage_dir);
+    if (!dir) {
+        return;
+    }
+
+    int migrated = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[MAX_PATH_LENGTH + MAX_FILENAME_LENGTH];
+        size_t len = strlen(entry->d_name);
+        snprintf(path, sizeof(path), "%s/%s", store->storage_dir, entry->d_name);
+
+        // Temp files of an interrupted legacy save
+        if (strstr(entry->d_name, ".meta.tmp.") != NULL) {
+            unlink(path);
+            continue;
+        }
+        if (len <= 5 || strcmp(entry->d_name + len - 5, ".meta") != 0) {
+            continue;
+        }
+
+        LegacyFileMetadata legacy;
+        FILE *fp = fopen(path, "rb");
+        size_t read = fp ? fread(&legacy, sizeof(legacy), 1, fp) : 0;
+        if (fp) fclose(fp);
+
+        if (read != 1) {
+            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                       "Skipping unreadable legacy metadata: %s", path);
+            continue;
+        }
+        legacy.filename[MAX_FILENAME_LENGTH - 1] = '\0';
+        legacy.owner[MAX_USERNAME_LENGTH - 1] = '\0';
+
+        if (!find_entry(store, legacy.filename)) {
+            FileMetadata metadata;
+            memset(&metadata, 0, sizeof(metadata));
+            strcpy(metadata.filename, legacy.filename);
+            strcpy(metadata.owner, legacy.owner);
+            metadata.size = legacy.size;
+            metadata.word_count = legacy.word_count;
+            metadata.char_count = legacy.char_count;
+            metadata.sentence_count = legacy.sentence_count;
+            metadata.created_time = legacy.created_time;
+            metadata.modified_time = legacy.modified_time;
+            metadata.accessed_time = legacy.accessed_time;
+            metadata.is_folder = legacy.is_folder;
+
+            if (!put_entry(store, &metadata) ||
+                append_record(store, METADATA_RECORD_PUT, &metadata) != ERR_SUCCESS) {
+                continue;
+            }
+            migrated++;
+        }
+        unlink(path);
+    }
+    closedir(dir);
+
+    if (migrated > 0) {
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                   "Migrated %d legacy .meta file(s) into the metadata store", migrated);
+    }
+}
+
+static int open_store_locked(MetadataStore *store, const char *storage_dir) {
+    if (store->is_open) {
+        if (strcmp(store->storage_dir, storage_dir) != 0) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Metadata store already open for '%s', not '%s'",
+                       store->storage_dir, storage_dir);
+            return ERR_INVALID_PARAMETER;
+        }
+        return ERR_SUCCESS;
+    }
+
+    strncpy(store->storage_dir, storage_dir, MAX_PATH_LENGTH - 1);
+    store->storage_dir[MAX_PATH_LENGTH - 1] = '\0';
+
+    char log_path[MAX_PATH_LENGTH + 32];
+    snprintf(log_path, sizeof(log_path), "%s/%s", storage_dir, METADATA_STORE_FILE);
+
+    int fd = open(log_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Failed to open metadata log %s (errno=%d: %s)",
+                   log_path, errno, strerror(errno));
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    // Replay the log into the index
+    char *image = NULL;
+    size_t image_length = 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        image = malloc((size_t)st.st_size);
+        if (!image) {
+            close(fd);
+            return ERR_OUT_OF_MEMORY;
+        }
+        while (image_length < (size_t)st.st_size) {
+            ssize_t n = pread(fd, image + image_length, (size_t)st.st_size - image_length, (off_t)image_length);
+            if (n <= 0) break;
+            image_length += (size_t)n;
+        }
+    }
+
+    store->log_fd = fd;
+    size_t valid = replay_log(store, image, image_length);
+    free(image);
+
+    if (valid < image_length) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Metadata log %s: dropping %zu bytes of torn or corrupt records",
+                   log_path, image_length - valid);
+        if (ftruncate(fd, (off_t)valid) != 0) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Failed to truncate metadata log (errno=%d)", errno);
+        }
+    }
+    store->log_bytes = valid;
+    store->is_open = 1;
+
+    migrate_legacy_metadata(store);
+    if (log_needs_compaction(store)) {
+        compact_log(store);
+    }
+
+    pthread_t flusher;
+    if (pthread_create(&flusher, NULL, metadata_flusher, store) == 0) {
+        pthread_detach(flusher);
+    } else {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Metadata flusher thread failed to start; access times flush on compaction only");
+    }
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Metadata store opened: %s (%d files, %zu log bytes)",
+               log_path, store->entry_count, store->log_bytes);
+    return ERR_SUCCESS;
+}
+
+// Open (once) the metadata store of a storage directory. Every metadata
+// call opens it on first use too; calling this at startup surfaces errors
+// and migrates legacy .meta files before any client is served.
+int metadata_store_open(const char *storage_dir) {
+    pthread_mutex_lock(&metadata_store.lock);
+    int result = open_store_locked(&metadata_store, storage_dir);
+    pthread_mutex_unlock(&metadata_store.lock);
+    return result;
+}
+
+// Write out pending access times now (shutdown, from main() once the
+// reactor has stopped; waits for a worker holding the store)
+void metadata_store_flush(void) {
+    pthread_mutex_lock(&metadata_store.lock);
+    if (metadata_store.is_open) {
+        flush_access_times(&metadata_store);
+    }
+    pthread_mutex_unlock(&metadata_store.lock);
+}
+
+// ============================================================================
+// METADATA OPERATIONS
+// ============================================================================
+
+// Lock the store, opening it first if needed. Returns NULL (unlocked) when
+// it cannot be opened.
+static MetadataStore* lock_store(const char *storage_dir) {
+    pthread_mutex_lock(&metadata_store.lock);
+    if (open_store_locked(&metadata_store, storage_dir) != ERR_SUCCESS) {
+        pthread_mutex_unlock(&metadata_store.lock);
         return NULL;
     }
-    
-    snprintf(meta_path, MAX_PATH_LENGTH, "%s/%s.meta", storage_dir, filename);
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Generated metadata path: %s", meta_path);
-    return meta_path;
+    return &metadata_store;
 }
 
-// Save metadata to .meta file
+// Save a file's metadata: one small record appended to the store's log
 int save_metadata(const char *storage_dir, const FileMetadata *metadata) {
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Saving metadata: filename='%s', storage_dir='%s'", 
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "Saving metadata: filename='%s', storage_dir='%s'",
                metadata->filename, storage_dir);
-    
-    char *meta_path = get_metadata_path(storage_dir, metadata->filename);
-    if (!meta_path) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to get metadata path for '%s'", metadata->filename);
+
+    MetadataStore *store = lock_store(storage_dir);
+    if (!store) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    MetadataEntry *entry = put_entry(store, metadata);
+    if (!entry) {
+        pthread_mutex_unlock(&store->lock);
         return ERR_OUT_OF_MEMORY;
     }
-    
-    FILE *fp = fopen(meta_path, "wb");
-    if (!fp) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to open metadata file for writing: %s (errno=%d)", 
-                   meta_path, errno);
-        free(meta_path);
-        return ERR_FILE_WRITE_FAILED;
+
+    int result = append_record(store, METADATA_RECORD_PUT, metadata);
+
+    // The record carries the access time too; on failure let the flusher retry
+    int dirty = result != ERR_SUCCESS;
+    if (entry->atime_dirty != dirty) {
+        store->dirty_count += dirty ? 1 : -1;
+        entry->atime_dirty = dirty;
     }
-    
-    // Write metadata structure
-    size_t written = fwrite(metadata, sizeof(FileMetadata), 1, fp);
-    fclose(fp);
-    
-    if (written != 1) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to write metadata: %s (written=%zu, expected=1)", 
-                   meta_path, written);
-        free(meta_path);
-        return ERR_FILE_WRITE_FAILED;
+    pthread_mutex_unlock(&store->lock);
+
+    if (result == ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                   "Metadata saved successfully: filename='%s', size=%zu, words=%d, sentences=%d, chars=%d",
+                   metadata->filename, metadata->size, metadata->word_count,
+                   metadata->sentence_count, metadata->char_count);
     }
-    
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Metadata saved successfully: filename='%s', size=%zu, words=%d, sentences=%d, chars=%d", 
-               metadata->filename, metadata->size, metadata->word_count, 
-               metadata->sentence_count, metadata->char_count);
-    
-    free(meta_path);
-    return ERR_SUCCESS;
+    return result;
 }
 
-// Load metadata from .meta file
+// Load a file's metadata from the in-memory index
 int load_metadata(const char *storage_dir, const char *filename, FileMetadata *metadata) {
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Loading metadata: filename='%s', storage_dir='%s'", 
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "Loading metadata: filename='%s', storage_dir='%s'",
                filename, storage_dir);
-    
-    char *meta_path = get_metadata_path(storage_dir, filename);
-    if (!meta_path) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to get metadata path for '%s'", filename);
-        return ERR_OUT_OF_MEMORY;
+
+    MetadataStore *store = lock_store(storage_dir);
+    if (!store) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    MetadataEntry *entry = find_entry(store, filename);
+    if (entry) {
+        *metadata = entry->metadata;
     }
-    
-    FILE *fp = fopen(meta_path, "rb");
-    if (!fp) {
-        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                   "Metadata file not found: %s (errno=%d)", meta_path, errno);
-        free(meta_path);
+    pthread_mutex_unlock(&store->lock);
+
+    if (!entry) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Metadata not found: '%s'", filename);
         return ERR_FILE_NOT_FOUND;
     }
-    
-    // Read metadata structure
-    size_t read = fread(metadata, sizeof(FileMetadata), 1, fp);
-    fclose(fp);
-    
-    if (read != 1) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to read metadata from %s (read=%zu, expected=1)", 
-                   meta_path, read);
-        free(meta_path);
-        return ERR_FILE_READ_FAILED;
-    }
-    
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Metadata loaded successfully: filename='%s', owner='%s', size=%zu, words=%d, sentences=%d", 
-               metadata->filename, metadata->owner, metadata->size, 
-               metadata->word_count, metadata->sentence_count);
-    
-    free(meta_path);
     return ERR_SUCCESS;
 }
 
-// Update file statistics (word count, sentence count, etc.)
-int update_file_stats(const char *storage_dir, FileMetadata *metadata) {
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Updating file statistics: filename='%s'", metadata->filename);
-    
-    char content[LARGE_BUFFER_SIZE];
-    int read_result = ss_read_file(storage_dir, metadata->filename, content, sizeof(content));
-    
-    if (read_result != ERR_SUCCESS) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to read file for stats update: filename='%s', error=%d", 
-                   metadata->filename, read_result);
-        return ERR_FILE_READ_FAILED;
-    }
-    
+int delete_metadata(const char *storage_dir, const char *filename) {
+    MetadataStore *store = lock_store(storage_dir);
+    if (!store) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    int result = ERR_FILE_NOT_FOUND;
+    if (find_entry(store, filename)) {
+        FileMetadata metadata;
+        memset(&metadata, 0, sizeof(metadata));
+        strncpy(metadata.filename, filename, MAX_FILENAME_LENGTH - 1);
+
+        remove_entry(store, filename);
+        result = append_record(store, METADATA_RECORD_DELETE, &metadata);
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "Metadata delete: '%s' (result=%d)", filename, result);
+    return result;
+}
+
+// Record a read. Only the index changes here; the flusher writes the
+// latest access time of every touched file in one batch.
+void touch_metadata(const char *storage_dir, const char *filename, time_t accessed_time) {
+    MetadataStore *store = lock_store(storage_dir);
+    if (!store) {
+        return;
+    }
+
+    MetadataEntry *entry = find_entry(store, filename);
+    if (entry) {
+        entry->metadata.accessed_time = accessed_time;
+        if (!entry->atime_dirty) {
+            entry->atime_dirty = 1;
+            store->dirty_count++;
+        }
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Update file statistics (word count, sentence count, etc.) from counts
+// the caller already has, so no write path re-reads the file
+void update_file_stats(FileMetadata *metadata, size_t char_count, const TextStats *stats) {
     // Store old values for logging comparison
     int old_word_count = metadata->word_count;
     int old_sentence_count = metadata->sentence_count;
     int old_char_count = metadata->char_count;
-    
-    // Count characters
-    metadata->char_count = strlen(content);
-    
-    // Count words
-    metadata->word_count = 0;
-    int in_word = 0;
-    for (char *p = content; *p; p++) {
-        if (*p == ' ' || *p == '\t' || *p == '\n') {
-            in_word = 0;
-        } else if (!in_word) {
-            in_word = 1;
-            metadata->word_count++;
-        }
-    }
-    
-    // Count sentences
-    metadata->sentence_count = 0;
-    for (char *p = content; *p; p++) {
-        if (is_sentence_delimiter(*p)) {
-            metadata->sentence_count++;
-        }
-    }
-    
-    if (metadata->sentence_count == 0 && metadata->word_count > 0) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "No sentence delimiters found, defaulting to 1 sentence");
-        metadata->sentence_count = 1;  // Content without delimiter is one sentence
-    }
-    
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "File statistics updated: filename='%s', chars=%d (%+d), words=%d (%+d), sentences=%d (%+d)", 
-               metadata->filename, 
+
+    metadata->char_count = (int)char_count;
+    metadata->word_count = (int)stats->words;
+    metadata->sentence_count = (int)stats->sentences;
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "File statistics updated: filename='%s', chars=%d (%+d), words=%d (%+d), sentences=%d (%+d)",
+               metadata->filename,
                metadata->char_count, metadata->char_count - old_char_count,
                metadata->word_count, metadata->word_count - old_word_count,
                metadata->sentence_count, metadata->sentence_count - old_sentence_count);
-    
-    return ERR_SUCCESS;
 }
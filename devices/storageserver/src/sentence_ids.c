@@ -0,0 +1,111 @@
+#include "../include/storageserver.h"
+
+// ============================================================================
+// SENTENCE ID FILES
+// ============================================================================
+// <file>.sids lists the IDs of the file's saved sentences in file order.
+// It is only trusted for the exact text it was written with; loading maps
+// each ID to the sentence that starts on its line.
+
+// FNV-1a
+static uint32_t checksum_bytes(uint32_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t header_checksum(const SentenceIdHeader *header, const uint32_t *ids) {
+    SentenceIdHeader copy = *header;
+    copy.checksum = 0;
+
+    uint32_t hash = checksum_bytes(2166136261u, &copy, sizeof(copy));
+    return checksum_bytes(hash, ids, (size_t)header->count * sizeof(uint32_t));
+}
+
+void get_sentence_id_path(char *path, size_t size, const char *storage_dir, const char *filename) {
+    snprintf(path, size, "%s/%s%s", storage_dir, filename, SENTENCE_ID_SUFFIX);
+}
+
+// Append the u32 ID of every sentence render_saved_text() writes, in order
+int collect_saved_sentence_ids(const FileContent *file, DynamicBuffer *ids) {
+    for (const SentenceNode *node = file->head; node; node = node->next) {
+        if (node->word_count == 0) continue;
+        if (dynbuf_append(ids, (const char*)&node->id, sizeof(node->id)) != ERR_SUCCESS) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+    return ERR_SUCCESS;
+}
+
+// The contents of a .sids file for the given saved text and its line IDs
+int encode_sentence_ids(uint32_t next_id, const uint32_t *ids, uint32_t count,
+                        const char *text, size_t length, DynamicBuffer *out) {
+    SentenceIdHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SENTENCE_ID_MAGIC;
+    header.format = SENTENCE_ID_FORMAT;
+    header.next_id = next_id;
+    header.count = count;
+    header.text_length = length;
+    header.text_checksum = checksum_bytes(2166136261u, text, length);
+    header.checksum = header_checksum(&header, ids);
+
+    if (dynbuf_append(out, (const char*)&header, sizeof(header)) != ERR_SUCCESS ||
+        dynbuf_append(out, (const char*)ids, (size_t)count * sizeof(uint32_t)) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    return ERR_SUCCESS;
+}
+
+// Read the IDs saved for a file whose text is `text`. On success *ids (to
+// be freed) holds one ID per line. *next_id is the first ID never handed
+// out as far as the file knows, 1 if it knows nothing; it is set even when
+// the IDs don't match the text.
+int read_sentence_ids(const char *storage_dir, const char *filename, const char *text, size_t length,
+                      uint32_t **ids, uint32_t *count, uint32_t *next_id) {
+    *ids = NULL;
+    *count = 0;
+    *next_id = 1;
+
+    char path[STORAGE_PATH_LENGTH];
+    get_sentence_id_path(path, sizeof(path), storage_dir, filename);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    SentenceIdHeader header;
+    uint32_t *list = NULL;
+    int result = ERR_FILE_READ_FAILED;
+
+    if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        header.magic == SENTENCE_ID_MAGIC && header.format == SENTENCE_ID_FORMAT &&
+        header.count <= (uint32_t)(length / 2 + 1)) {
+        size_t bytes = (size_t)header.count * sizeof(uint32_t);
+        list = malloc(bytes + 1);
+        if (!list) {
+            result = ERR_OUT_OF_MEMORY;
+        } else if (pread(fd, list, bytes, sizeof(header)) == (ssize_t)bytes &&
+                   header_checksum(&header, list) == header.checksum) {
+            *next_id = header.next_id;
+            if (header.text_length == length &&
+                header.text_checksum == checksum_bytes(2166136261u, text, length)) {
+                result = ERR_SUCCESS;
+            }
+        }
+    }
+    close(fd);
+
+    if (result != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                    "Sentence IDs of '%s' don't match its text; numbering afresh", filename);
+        free(list);
+        return result;
+    }
+
+    *ids = list;
+    *count = header.count;
+    return ERR_SUCCESS;
+}
@@ -0,0 +1,283 @@
+#include "../include/storageserver.h"
+
+// ============================================================================
+// SENTENCE INDEX (ORDER-STATISTIC TREAP)
+// ============================================================================
+// Sentences are the in-order sequence of a treap whose nodes carry their
+// subtree size, so the node at a given position is found in O(log n) and a
+// sentence split inserts in O(log n). Nodes also sum the bytes their
+// sentences take in the saved file, which gives a sentence's byte offset
+// there in O(log n) for the write-ahead log. The next pointers mirror the
+// in-order sequence for cheap front-to-back walks (render, save, free).
+//
+// Sentences are also chained in a hash on their ID. IDs are handed out in
+// sequence, so the low bits spread them evenly over the buckets.
+
+static int subtree_size(const SentenceNode *node) {
+    return node ? node->subtree_size : 0;
+}
+
+static size_t subtree_saved_bytes(const SentenceNode *node) {
+    return node ? node->subtree_saved_bytes : 0;
+}
+
+static void update_subtree_size(SentenceNode *node) {
+    node->subtree_size = 1 + subtree_size(node->tree_left) + subtree_size(node->tree_right);
+    node->subtree_saved_bytes = node->saved_bytes + subtree_saved_bytes(node->tree_left) +
+                                subtree_saved_bytes(node->tree_right);
+}
+
+void sentence_index_init(FileContent *file) {
+    file->head = NULL;
+    file->tail = NULL;
+    file->root = NULL;
+    file->sentence_count = 0;
+    file->index_seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)file;
+    file->id_buckets = NULL;
+    file->id_bucket_count = 0;
+    file->next_sentence_id = 1;
+}
+
+void sentence_index_destroy(FileContent *file) {
+    free(file->id_buckets);
+    file->id_buckets = NULL;
+    file->id_bucket_count = 0;
+}
+
+// Rehash every sentence (the new one included) into a table sized for the
+// document. Returns 0 if memory ran out: the old table stays, just with
+// longer chains, and without any table lookups walk the document.
+static int resize_id_buckets(FileContent *file) {
+    uint32_t count = file->id_bucket_count ? file->id_bucket_count * 2 : SENTENCE_ID_MIN_BUCKETS;
+    while (count < (uint32_t)file->sentence_count) count *= 2;
+
+    SentenceNode **buckets = calloc(count, sizeof(SentenceNode*));
+    if (!buckets) return 0;
+
+    for (SentenceNode *node = file->head; node; node = node->next) {
+        SentenceNode **bucket = &buckets[node->id & (count - 1)];
+        node->id_next = *bucket;
+        *bucket = node;
+    }
+    free(file->id_buckets);
+    file->id_buckets = buckets;
+    file->id_bucket_count = count;
+    return 1;
+}
+
+SentenceNode* sentence_index_find_id(const FileContent *file, uint32_t id) {
+    if (!file->id_buckets) {
+        for (SentenceNode *node = file->head; node; node = node->next) {
+            if (node->id == id) return node;
+        }
+        return NULL;
+    }
+
+    SentenceNode *node = file->id_buckets[id & (file->id_bucket_count - 1)];
+    while (node && node->id != id) {
+        node = node->id_next;
+    }
+    return node;
+}
+
+// Rotate a node above its parent, keeping the in-order sequence intact
+static void rotate_up(FileContent *file, SentenceNode *node) {
+    SentenceNode *parent = node->tree_parent;
+    SentenceNode *grandparent = parent->tree_parent;
+
+    if (parent->tree_left == node) {
+        parent->tree_left = node->tree_right;
+        if (node->tree_right) node->tree_right->tree_parent = parent;
+        node->tree_right = parent;
+    } else {
+        parent->tree_right = node->tree_left;
+        if (node->tree_left) node->tree_left->tree_parent = parent;
+        node->tree_left = parent;
+    }
+    parent->tree_parent = node;
+    node->tree_parent = grandparent;
+
+    if (!grandparent) {
+        file->root = node;
+    } else if (grandparent->tree_left == parent) {
+        grandparent->tree_left = node;
+    } else {
+        grandparent->tree_right = node;
+    }
+
+    update_subtree_size(parent);
+    update_subtree_size(node);
+}
+
+SentenceNode* sentence_index_at(const FileContent *file, int sentence_num) {
+    if (sentence_num < 0 || sentence_num >= file->sentence_count) {
+        return NULL;
+    }
+
+    SentenceNode *node = file->root;
+    while (node) {
+        int left_size = subtree_size(node->tree_left);
+        if (sentence_num < left_size) {
+            node = node->tree_left;
+        } else if (sentence_num == left_size) {
+            return node;
+        } else {
+            sentence_num -= left_size + 1;
+            node = node->tree_right;
+        }
+    }
+    return NULL;
+}
+
+// Insert node right after `after` in document order, or at the front when
+// after == NULL. The new node becomes the in-order successor of `after`,
+// so it is attached below `after` or below its old successor and then
+// rotated up to restore heap order on the random priorities. A node with
+// id 0 gets the document's next ID; a given ID must not be in use.
+void sentence_index_insert_after(FileContent *file, SentenceNode *after, SentenceNode *node) {
+    SentenceNode *successor = after ? after->next : file->head;
+
+    if (node->id == 0) {
+        node->id = file->next_sentence_id++;
+    } else if (node->id >= file->next_sentence_id) {
+        file->next_sentence_id = node->id + 1;
+    }
+
+    node->tree_left = NULL;
+    node->tree_right = NULL;
+    node->tree_parent = NULL;
+    node->subtree_size = 1;
+    node->subtree_saved_bytes = node->saved_bytes;
+    node->tree_priority = (unsigned int)rand_r(&file->index_seed);
+
+    node->next = successor;
+    if (after) {
+        after->next = node;
+    } else {
+        file->head = node;
+    }
+    if (!successor) {
+        file->tail = node;
+    }
+    file->sentence_count++;
+
+    if (((uint32_t)file->sentence_count <= file->id_bucket_count || !resize_id_buckets(file)) &&
+        file->id_buckets) {
+        SentenceNode **bucket = &file->id_buckets[node->id & (file->id_bucket_count - 1)];
+        node->id_next = *bucket;
+        *bucket = node;
+    }
+
+    if (!file->root) {
+        file->root = node;
+        return;
+    }
+
+    // Either `after` has no right subtree (attach there), or the old
+    // successor is the leftmost node of that subtree (attach to its left)
+    if (after && !after->tree_right) {
+        after->tree_right = node;
+        node->tree_parent = after;
+    } else {
+        successor->tree_left = node;
+        node->tree_parent = successor;
+    }
+
+    for (SentenceNode *ancestor = node->tree_parent; ancestor; ancestor = ancestor->tree_parent) {
+        ancestor->subtree_size++;
+        ancestor->subtree_saved_bytes += node->saved_bytes;
+    }
+
+    while (node->tree_parent && node->tree_priority > node->tree_parent->tree_priority) {
+        rotate_up(file, node);
+    }
+}
+
+// Position of a node in document order, from the subtree sizes on its path
+// to the root
+int sentence_index_rank(const SentenceNode *node) {
+    int rank = subtree_size(node->tree_left);
+
+    for (; node->tree_parent; node = node->tree_parent) {
+        if (node->tree_parent->tree_right == node) {
+            rank += subtree_size(node->tree_parent->tree_left) + 1;
+        }
+    }
+    return rank;
+}
+
+// Unlink node from the document; prev is its predecessor (NULL for the
+// head). The node is rotated down below its higher-priority child until it
+// has at most one child, then spliced out.
+void sentence_index_remove(FileContent *file, SentenceNode *prev, SentenceNode *node) {
+    while (node->tree_left && node->tree_right) {
+        SentenceNode *child = node->tree_left->tree_priority > node->tree_right->tree_priority
+                              ? node->tree_left : node->tree_right;
+        rotate_up(file, child);
+    }
+
+    SentenceNode *child = node->tree_left ? node->tree_left : node->tree_right;
+    SentenceNode *parent = node->tree_parent;
+
+    if (child) child->tree_parent = parent;
+    if (!parent) {
+        file->root = child;
+    } else if (parent->tree_left == node) {
+        parent->tree_left = child;
+    } else {
+        parent->tree_right = child;
+    }
+
+    for (SentenceNode *ancestor = parent; ancestor; ancestor = ancestor->tree_parent) {
+        ancestor->subtree_size--;
+        ancestor->subtree_saved_bytes -= node->saved_bytes;
+    }
+
+    if (prev) {
+        prev->next = node->next;
+    } else {
+        file->head = node->next;
+    }
+    if (file->tail == node) {
+        file->tail = prev;
+    }
+    file->sentence_count--;
+
+    if (file->id_buckets) {
+        SentenceNode **link = &file->id_buckets[node->id & (file->id_bucket_count - 1)];
+        while (*link && *link != node) {
+            link = &(*link)->id_next;
+        }
+        if (*link) *link = node->id_next;
+    }
+    node->id_next = NULL;
+
+    node->tree_left = node->tree_right = node->tree_parent = NULL;
+    node->subtree_saved_bytes = node->saved_bytes;
+    node->next = NULL;
+}
+
+// Change a sentence's share of the saved text, here and in its ancestors
+void sentence_index_set_saved_bytes(SentenceNode *node, uint32_t saved_bytes) {
+    size_t old_bytes = node->saved_bytes;
+    node->saved_bytes = saved_bytes;
+    for (; node; node = node->tree_parent) {
+        node->subtree_saved_bytes = node->subtree_saved_bytes - old_bytes + saved_bytes;
+    }
+}
+
+// Byte offset of a sentence in the saved text (node == NULL: its end),
+// summed like sentence_index_rank()
+size_t sentence_index_saved_offset(const FileContent *file, const SentenceNode *node) {
+    if (!node) {
+        return subtree_saved_bytes(file->root);
+    }
+
+    size_t offset = subtree_saved_bytes(node->tree_left);
+    for (; node->tree_parent; node = node->tree_parent) {
+        if (node->tree_parent->tree_right == node) {
+            offset += subtree_saved_bytes(node->tree_parent->tree_left) + node->tree_parent->saved_bytes;
+        }
+    }
+    return offset;
+}
@@ -0,0 +1,399 @@
+#include "../include/storageserver.h"
+
+// ============================================================================
+// GLOBAL SENTENCE LOCK TABLE
+// ============================================================================
+// One entry per sentence being edited, found by hashing (file, sentence ID)
+// and freed on unlock. Each bucket has its own mutex. A holder renews its
+// lease with every update; a lock left alone for SENTENCE_LOCK_LEASE_SEC
+// goes to the next user who asks for it. Waiting WRITEs queue FIFO on the
+// entry and are handed the lock in turn; nothing here blocks, the waiting
+// connection is notified instead.
+
+static unsigned int hash_sentence_filename(const char *filename) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash;
+}
+
+static SentenceLockBucket* lock_bucket(StorageServerConfig *ctx, unsigned int file_hash, uint32_t sentence_id) {
+    unsigned int mixed = file_hash ^ (sentence_id * 2654435761u);
+    SentenceLockBucket *bucket = &ctx->sentence_locks[mixed % SENTENCE_LOCK_BUCKETS];
+    pthread_mutex_lock(&bucket->mutex);
+    return bucket;
+}
+
+// Find an entry in a locked bucket; *link_out gets the pointer to it
+static SentenceLockEntry* find_lock_entry(SentenceLockBucket *bucket, unsigned int file_hash,
+                                          const char *filename, uint32_t sentence_id,
+                                          SentenceLockEntry ***link_out) {
+    SentenceLockEntry **link = &bucket->head;
+    while (*link) {
+        SentenceLockEntry *entry = *link;
+        if (entry->file_hash == file_hash && entry->sentence_id == sentence_id &&
+            strcmp(entry->filename, filename) == 0) {
+            if (link_out) *link_out = link;
+            return entry;
+        }
+        link = &entry->next;
+    }
+    return NULL;
+}
+
+static void set_lock_holder(SentenceLockEntry *entry, const char *username, time_t now) {
+    strncpy(entry->locked_by, username, MAX_USERNAME_LENGTH - 1);
+    entry->locked_by[MAX_USERNAME_LENGTH - 1] = '\0';
+    entry->lock_time = now;
+}
+
+void init_sentence_locks(StorageServerConfig *ctx) {
+    for (int i = 0; i < SENTENCE_LOCK_BUCKETS; i++) {
+        ctx->sentence_locks[i].head = NULL;
+        pthread_mutex_init(&ctx->sentence_locks[i].mutex, NULL);
+    }
+    memset(&ctx->sentence_lock_stats, 0, sizeof(ctx->sentence_lock_stats));
+    pthread_mutex_init(&ctx->sentence_lock_stats_mutex, NULL);
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+               "Sentence lock table initialized (%d buckets, %d s lease)",
+               SENTENCE_LOCK_BUCKETS, SENTENCE_LOCK_LEASE_SEC);
+}
+
+static long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Give a locked entry to the oldest waiter. Returns 0 if none is queued.
+static int hand_to_next_waiter(SentenceLockEntry *entry, time_t now) {
+    SentenceLockWaiter *waiter = entry->wait_head;
+    if (!waiter) return 0;
+
+    entry->wait_head = waiter->next;
+    if (!entry->wait_head) entry->wait_tail = NULL;
+    entry->wait_count--;
+
+    set_lock_holder(entry, waiter->username, now);
+    waiter->granted = 1;
+    if (waiter->notify) waiter->notify(waiter->arg);
+    return 1;
+}
+
+// Bucket must be locked. Returns 1 if username now holds the sentence,
+// 0 if someone else does (*entry_out is their entry), -1 if out of memory.
+static int acquire_in_bucket(SentenceLockBucket *bucket, unsigned int file_hash,
+                             const char *filename, uint32_t sentence_id,
+                             const char *username, SentenceLockEntry **entry_out) {
+    time_t now = time(NULL);
+    SentenceLockEntry *entry = find_lock_entry(bucket, file_hash, filename, sentence_id, NULL);
+    *entry_out = entry;
+
+    if (entry) {
+        if (strcmp(entry->locked_by, username) == 0) {
+            entry->lock_time = now;
+            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                        "Lock reacquired: %s@%u by same user '%s'", filename, sentence_id, username);
+            printf("  [LOCK OK] Already locked by same user\n");
+            return 1;
+        }
+
+        time_t held = now - entry->lock_time;
+        if (held < SENTENCE_LOCK_LEASE_SEC) {
+            return 0;
+        }
+
+        // An expired lease goes to whoever has waited longest, if anyone
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Lock lease expired: %s@%u taken from '%s' (idle %ld seconds)",
+                    filename, sentence_id, entry->locked_by, (long)held);
+        if (hand_to_next_waiter(entry, now)) {
+            return 0;
+        }
+        set_lock_holder(entry, username, now);
+        printf("  [LOCK GRANTED] %s@%u by '%s' (lease expired)\n", filename, sentence_id, username);
+        return 1;
+    }
+
+    entry = malloc(sizeof(SentenceLockEntry));
+    if (!entry) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                    "Lock allocation failed: %s@%u (out of memory)", filename, sentence_id);
+        return -1;
+    }
+
+    strncpy(entry->filename, filename, MAX_FILENAME_LENGTH - 1);
+    entry->filename[MAX_FILENAME_LENGTH - 1] = '\0';
+    entry->file_hash = file_hash;
+    entry->sentence_id = sentence_id;
+    set_lock_holder(entry, username, now);
+    entry->wait_head = NULL;
+    entry->wait_tail = NULL;
+    entry->wait_count = 0;
+    entry->next = bucket->head;
+    bucket->head = entry;
+    *entry_out = entry;
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                "Lock granted: %s@%u by '%s'", filename, sentence_id, username);
+    printf("  [LOCK GRANTED] %s@%u by '%s'\n", filename, sentence_id, username);
+    return 1;
+}
+
+// Returns 1 if username now holds the sentence (or already did), 0 if
+// someone else holds a live lease on it or memory ran out
+int global_try_lock_sentence(StorageServerConfig *ctx, const char *filename,
+                            uint32_t sentence_id, const char *username) {
+    unsigned int file_hash = hash_sentence_filename(filename);
+    SentenceLockBucket *bucket = lock_bucket(ctx, file_hash, sentence_id);
+    SentenceLockEntry *entry;
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                "Lock attempt: %s@%u, user='%s', thread_id=%lu",
+                filename, sentence_id, username, pthread_self());
+    printf("  [LOCK CHECK] %s@%u by '%s'\n", filename, sentence_id, username);
+
+    int result = acquire_in_bucket(bucket, file_hash, filename, sentence_id, username, &entry);
+    if (result == 0) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Lock denied: %s@%u locked by '%s', denied for '%s'",
+                    filename, sentence_id, entry->locked_by, username);
+        printf("  [LOCK DENIED] Locked by '%s', denied for '%s'\n",
+               entry->locked_by, username);
+    }
+
+    pthread_mutex_unlock(&bucket->mutex);
+    return result == 1;
+}
+
+// Like global_try_lock_sentence, but if the sentence is held, queue the
+// waiter behind earlier ones. Returns 1 if waiter->username holds the
+// sentence now, 0 if queued (notify runs once it is handed over), -1 if
+// out of memory.
+int global_queue_lock_sentence(StorageServerConfig *ctx, const char *filename,
+                               uint32_t sentence_id, SentenceLockWaiter *waiter) {
+    unsigned int file_hash = hash_sentence_filename(filename);
+    SentenceLockBucket *bucket = lock_bucket(ctx, file_hash, sentence_id);
+    SentenceLockEntry *entry;
+
+    waiter->granted = 0;
+    waiter->next = NULL;
+    int result = acquire_in_bucket(bucket, file_hash, filename, sentence_id, waiter->username, &entry);
+    if (result != 0) {
+        pthread_mutex_unlock(&bucket->mutex);
+        return result;
+    }
+
+    // The entry stays in the table while anyone is queued on it
+    waiter->started_ms = monotonic_ms();
+    if (entry->wait_tail) {
+        entry->wait_tail->next = waiter;
+    } else {
+        entry->wait_head = waiter;
+    }
+    entry->wait_tail = waiter;
+    entry->wait_count++;
+    int position = entry->wait_count;
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                "Lock wait: %s@%u held by '%s', '%s' queued at position %d",
+                filename, sentence_id, entry->locked_by, waiter->username, position);
+    pthread_mutex_unlock(&bucket->mutex);
+    printf("  [LOCK WAIT] %s@%u by '%s' (position %d)\n",
+           filename, sentence_id, waiter->username, position);
+
+    pthread_mutex_lock(&ctx->sentence_lock_stats_mutex);
+    ctx->sentence_lock_stats.waits++;
+    ctx->sentence_lock_stats.waiting++;
+    if (position > ctx->sentence_lock_stats.max_queue_depth) {
+        ctx->sentence_lock_stats.max_queue_depth = position;
+    }
+    pthread_mutex_unlock(&ctx->sentence_lock_stats_mutex);
+    return 0;
+}
+
+// Take a waiter out of its entry's queue (bucket locked)
+static void unlink_waiter(SentenceLockEntry *entry, SentenceLockWaiter *waiter) {
+    SentenceLockWaiter **link = &entry->wait_head;
+    SentenceLockWaiter *prev = NULL;
+    while (*link && *link != waiter) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    if (!*link) return;
+
+    *link = waiter->next;
+    if (entry->wait_tail == waiter) entry->wait_tail = prev;
+    entry->wait_count--;
+}
+
+// Account for a wait that ended
+static void finish_wait(StorageServerConfig *ctx, const char *filename, uint32_t sentence_id,
+                        const SentenceLockWaiter *waiter) {
+    unsigned long waited = (unsigned long)(monotonic_ms() - waiter->started_ms);
+    pthread_mutex_lock(&ctx->sentence_lock_stats_mutex);
+    ctx->sentence_lock_stats.waiting--;
+    ctx->sentence_lock_stats.total_wait_ms += waited;
+    if (waited > ctx->sentence_lock_stats.max_wait_ms) {
+        ctx->sentence_lock_stats.max_wait_ms = waited;
+    }
+    if (waiter->granted) {
+        ctx->sentence_lock_stats.granted++;
+    } else {
+        ctx->sentence_lock_stats.timeouts++;
+    }
+    pthread_mutex_unlock(&ctx->sentence_lock_stats_mutex);
+
+    if (waiter->granted) {
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                    "Lock granted after wait: %s@%u by '%s' (%lu ms)",
+                    filename, sentence_id, waiter->username, waited);
+        printf("  [LOCK GRANTED] %s@%u by '%s' after %lu ms\n",
+               filename, sentence_id, waiter->username, waited);
+    } else {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Lock wait timed out: %s@%u for '%s' after %lu ms",
+                    filename, sentence_id, waiter->username, waited);
+    }
+}
+
+// See whether a queued waiter has the sentence yet. The first waiter also
+// takes over once the holder's lease runs out. Returns 1 once the waiter
+// holds it; otherwise 0, with *retry_ms set to when the holder's lease
+// runs out if this waiter is next in line, else -1.
+int global_check_lock_wait(StorageServerConfig *ctx, const char *filename,
+                           uint32_t sentence_id, SentenceLockWaiter *waiter, long long *retry_ms) {
+    unsigned int file_hash = hash_sentence_filename(filename);
+    SentenceLockBucket *bucket = lock_bucket(ctx, file_hash, sentence_id);
+
+    *retry_ms = -1;
+    if (!waiter->granted) {
+        SentenceLockEntry *entry = find_lock_entry(bucket, file_hash, filename, sentence_id, NULL);
+        if (entry && entry->wait_head == waiter) {
+            time_t now = time(NULL);
+            long long lease_left = (long long)(entry->lock_time + SENTENCE_LOCK_LEASE_SEC - now) * 1000;
+            if (lease_left <= 0) {
+                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                            "Lock lease expired: %s@%u taken from '%s'",
+                            filename, sentence_id, entry->locked_by);
+                hand_to_next_waiter(entry, now);
+            } else {
+                *retry_ms = lease_left;
+            }
+        }
+    }
+    int granted = waiter->granted;
+    pthread_mutex_unlock(&bucket->mutex);
+
+    if (granted) {
+        finish_wait(ctx, filename, sentence_id, waiter);
+    }
+    return granted;
+}
+
+// Give up waiting (timeout or disconnect). Returns 1 if the lock was
+// handed over first, in which case the caller holds it after all.
+int global_cancel_lock_wait(StorageServerConfig *ctx, const char *filename,
+                            uint32_t sentence_id, SentenceLockWaiter *waiter) {
+    unsigned int file_hash = hash_sentence_filename(filename);
+    SentenceLockBucket *bucket = lock_bucket(ctx, file_hash, sentence_id);
+
+    if (!waiter->granted) {
+        SentenceLockEntry *entry = find_lock_entry(bucket, file_hash, filename, sentence_id, NULL);
+        if (entry) unlink_waiter(entry, waiter);
+    }
+    int granted = waiter->granted;
+    pthread_mutex_unlock(&bucket->mutex);
+
+    finish_wait(ctx, filename, sentence_id, waiter);
+    return granted;
+}
+
+// Extend the holder's lease. Returns 0 if username no longer holds the
+// sentence (the lease ran out and someone else took it).
+int global_renew_sentence_lock(StorageServerConfig *ctx, const char *filename,
+                               uint32_t sentence_id, const char *username) {
+    unsigned int file_hash = hash_sentence_filename(filename);
+    SentenceLockBucket *bucket = lock_bucket(ctx, file_hash, sentence_id);
+
+    SentenceLockEntry *entry = find_lock_entry(bucket, file_hash, filename, sentence_id, NULL);
+    int held = entry && strcmp(entry->locked_by, username) == 0;
+    if (held) {
+        entry->lock_time = time(NULL);
+    }
+
+    pthread_mutex_unlock(&bucket->mutex);
+    return held;
+}
+
+int global_unlock_sentence(StorageServerConfig *ctx, const char *filename,
+                          uint32_t sentence_id, const char *username) {
+    unsigned int file_hash = hash_sentence_filename(filename);
+    SentenceLockBucket *bucket = lock_bucket(ctx, file_hash, sentence_id);
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                "Unlock attempt: file='%s', sentence=@%u, user='%s'",
+                filename, sentence_id, username);
+
+    SentenceLockEntry **link;
+    SentenceLockEntry *entry = find_lock_entry(bucket, file_hash, filename, sentence_id, &link);
+    if (!entry) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Unlock failed: lock entry not found for file='%s', sentence=@%u",
+                    filename, sentence_id);
+        pthread_mutex_unlock(&bucket->mutex);
+        return 0;
+    }
+    if (strcmp(entry->locked_by, username) != 0) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Unlock failed: file='%s', sentence=@%u, not locked by '%s' (locked_by='%s')",
+                    filename, sentence_id, username, entry->locked_by);
+        pthread_mutex_unlock(&bucket->mutex);
+        return 0;
+    }
+
+    time_t now = time(NULL);
+    long duration = (long)(now - entry->lock_time);
+    int handed_off = hand_to_next_waiter(entry, now);
+    if (!handed_off) {
+        *link = entry->next;
+    }
+    pthread_mutex_unlock(&bucket->mutex);
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                "Unlock successful: file='%s', sentence=@%u, user='%s', duration=%ld seconds%s",
+                filename, sentence_id, username, duration, handed_off ? " (handed to next waiter)" : "");
+    printf("  [UNLOCK] %s@%u by '%s'\n", filename, sentence_id, username);
+    if (!handed_off) {
+        free(entry);
+    }
+    return 1;
+}
+
+void sentence_lock_get_stats(StorageServerConfig *ctx, SentenceLockStats *stats) {
+    pthread_mutex_lock(&ctx->sentence_lock_stats_mutex);
+    *stats = ctx->sentence_lock_stats;
+    pthread_mutex_unlock(&ctx->sentence_lock_stats_mutex);
+}
+
+void destroy_sentence_locks(StorageServerConfig *ctx) {
+    for (int i = 0; i < SENTENCE_LOCK_BUCKETS; i++) {
+        SentenceLockBucket *bucket = &ctx->sentence_locks[i];
+        pthread_mutex_lock(&bucket->mutex);
+        SentenceLockEntry *entry = bucket->head;
+        while (entry) {
+            SentenceLockEntry *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+        bucket->head = NULL;
+        pthread_mutex_unlock(&bucket->mutex);
+        pthread_mutex_destroy(&bucket->mutex);
+    }
+    pthread_mutex_destroy(&ctx->sentence_lock_stats_mutex);
+}
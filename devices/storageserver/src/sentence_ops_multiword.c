@@ -1,412 +1,505 @@
 #include "../include/storageserver.h"
 
 // ============================================================================
-// GLOBAL SENTENCE LOCKING
+// WORD/SENTENCE OPERATIONS
 // ============================================================================
 
-static void get_lock_key(const char *filename, int sentence_num, char *key, size_t key_size) {
-    snprintf(key, key_size, "%s:%d", filename, sentence_num);
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Generated lock key: %s", key);
-}
-
-int global_try_lock_sentence(StorageServerConfig *ctx, const char *filename,
-                            int sentence_num, const char *username) {
-    char key[MAX_PATH_LENGTH];
-    get_lock_key(filename, sentence_num, key, sizeof(key));
+// Drop a sentence's words; their arena storage becomes dead
+static void release_sentence_words(DocumentArena *arena, SentenceNode *sentence) {
+    arena_release(arena, sentence->text_capacity +
+                         (size_t)sentence->word_capacity * sizeof(uint32_t));
+
+    sentence->text = NULL;
+    sentence->word_offsets = NULL;
+    sentence->text_length = 0;
+    sentence->text_capacity = 0;
+    sentence->word_count = 0;
+    sentence->word_capacity = 0;
+}
+
+// Make room for word_total words and text_total bytes of text. Growth
+// doubles and copies into fresh arena storage; the old blocks become dead.
+static int reserve_sentence_words(DocumentArena *arena, SentenceNode *sentence,
+                                  int word_total, size_t text_total) {
+    if (text_total > UINT32_MAX) {
+        return ERR_OUT_OF_MEMORY;
+    }
 
-    pthread_mutex_lock(&ctx->lock_table_mutex);
+    if (word_total > sentence->word_capacity) {
+        int new_capacity = sentence->word_capacity ? sentence->word_capacity * 2 : word_total;
+        while (new_capacity < word_total) {
+            new_capacity *= 2;
+        }
 
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Lock attempt: key=%s, user='%s', thread_id=%lu",
-                key, username, pthread_self());
-    printf("  [LOCK CHECK] %s by '%s'\n", key, username);
-
-    SentenceLockEntry *current = ctx->global_locks;
-    while (current) {
-        if (strcmp(current->filename, filename) == 0 && 
-            current->sentence_num == sentence_num) {
-            if (current->is_locked) {
-                if (strcmp(current->locked_by, username) == 0) {
-                    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                                "Lock reacquired: %s by same user '%s'", key, username);
-                    printf("  [LOCK OK] Already locked by same user\n");
-                    pthread_mutex_unlock(&ctx->lock_table_mutex);
-                    return 1;
-                }
+        uint32_t *offsets = arena_alloc(arena, (size_t)new_capacity * sizeof(uint32_t));
+        if (!offsets) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                        "Word offset allocation failed (capacity=%d)", new_capacity);
+            return ERR_OUT_OF_MEMORY;
+        }
+        if (sentence->word_count > 0) {
+            memcpy(offsets, sentence->word_offsets, (size_t)sentence->word_count * sizeof(uint32_t));
+        }
+        arena_release(arena, (size_t)sentence->word_capacity * sizeof(uint32_t));
 
-                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-                            "Lock denied: %s locked by '%s', denied for '%s'",
-                            key, current->locked_by, username);
-                printf("  [LOCK DENIED] Locked by '%s', denied for '%s'\n",
-                       current->locked_by, username);
-                pthread_mutex_unlock(&ctx->lock_table_mutex);
-                return 0;
-            }
+        sentence->word_offsets = offsets;
+        sentence->word_capacity = new_capacity;
+    }
 
-            current->is_locked = 1;
-            strncpy(current->locked_by, username, MAX_USERNAME_LENGTH - 1);
-            current->locked_by[MAX_USERNAME_LENGTH - 1] = '\0';
-            current->lock_time = time(NULL);
+    if (text_total > sentence->text_capacity) {
+        size_t new_capacity = sentence->text_capacity ? (size_t)sentence->text_capacity * 2 : text_total;
+        while (new_capacity < text_total) {
+            new_capacity *= 2;
+        }
+        if (new_capacity > UINT32_MAX) new_capacity = text_total;
 
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
-                        "Lock granted: %s by '%s' (existing entry)", key, username);
-            printf("  [LOCK GRANTED] %s by '%s'\n", key, username);
-            pthread_mutex_unlock(&ctx->lock_table_mutex);
-            return 1;
+        char *text = arena_alloc_bytes(arena, new_capacity);
+        if (!text) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                        "Sentence text allocation failed (capacity=%zu)", new_capacity);
+            return ERR_OUT_OF_MEMORY;
         }
-        current = current->next;
-    }
+        if (sentence->text_length > 0) {
+            memcpy(text, sentence->text, sentence->text_length);
+        }
+        arena_release(arena, sentence->text_capacity);
 
-    SentenceLockEntry *entry = malloc(sizeof(SentenceLockEntry));
-    if (!entry) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-                    "Lock allocation failed: %s (out of memory)", key);
-        pthread_mutex_unlock(&ctx->lock_table_mutex);
-        return 0;
+        sentence->text = text;
+        sentence->text_capacity = (uint32_t)new_capacity;
     }
 
-    strncpy(entry->filename, filename, MAX_FILENAME_LENGTH - 1);
-    entry->filename[MAX_FILENAME_LENGTH - 1] = '\0';
-    entry->sentence_num = sentence_num;
-    entry->is_locked = 1;
-    strncpy(entry->locked_by, username, MAX_USERNAME_LENGTH - 1);
-    entry->locked_by[MAX_USERNAME_LENGTH - 1] = '\0';
-    entry->lock_time = time(NULL);
-    pthread_mutex_init(&entry->mutex, NULL);
-
-    entry->next = ctx->global_locks;
-    ctx->global_locks = entry;
-
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
-                "Lock granted: %s by '%s' (new entry created)", key, username);
-    printf("  [LOCK GRANTED] %s by '%s' (new entry)\n", key, username);
-    pthread_mutex_unlock(&ctx->lock_table_mutex);
-    return 1;
+    return ERR_SUCCESS;
 }
 
-int global_unlock_sentence(StorageServerConfig *ctx, const char *filename,
-                          int sentence_num, const char *username) {
-    pthread_mutex_lock(&ctx->lock_table_mutex);
-
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Unlock attempt: file='%s', sentence=%d, user='%s'",
-                filename, sentence_num, username);
-
-    SentenceLockEntry *current = ctx->global_locks;
-    while (current) {
-        if (strcmp(current->filename, filename) == 0 && 
-            current->sentence_num == sentence_num) {
-            if (!current->is_locked || strcmp(current->locked_by, username) != 0) {
-                log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-                            "Unlock failed: file='%s', sentence=%d, not locked by '%s' (locked_by='%s', is_locked=%d)",
-                            filename, sentence_num, username, current->locked_by, current->is_locked);
-                pthread_mutex_unlock(&ctx->lock_table_mutex);
-                return 0;
-            }
+// Insert text[0..length) as a word at position pos of a sentence
+static int insert_sentence_word(DocumentArena *arena, SentenceNode *sentence, int pos,
+                                const char *text, size_t length) {
+    // The word brings its own separating space unless the sentence was empty
+    size_t added = sentence->word_count > 0 ? length + 1 : length;
+    if (reserve_sentence_words(arena, sentence, sentence->word_count + 1,
+                               sentence->text_length + added) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
 
-            time_t lock_duration = time(NULL) - current->lock_time;
-            current->is_locked = 0;
-            current->locked_by[0] = '\0';
+    uint32_t at;
+    uint32_t word_start;
+    if (pos < sentence->word_count) {
+        // "word " goes in front of the word currently at pos
+        at = sentence->word_offsets[pos];
+        word_start = at;
+    } else {
+        // " word" (or just "word") goes at the end
+        at = sentence->text_length;
+        word_start = sentence->word_count > 0 ? at + 1 : at;
+    }
 
-            log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
-                        "Unlock successful: file='%s', sentence=%d, user='%s', duration=%ld seconds",
-                        filename, sentence_num, username, lock_duration);
-            printf("  [UNLOCK] %s:%d by '%s'\n", filename, sentence_num, username);
-            pthread_mutex_unlock(&ctx->lock_table_mutex);
-            return 1;
-        }
-        current = current->next;
+    memmove(sentence->text + at + added, sentence->text + at, sentence->text_length - at);
+    if (pos < sentence->word_count) {
+        memcpy(sentence->text + at, text, length);
+        sentence->text[at + length] = ' ';
+    } else {
+        if (word_start > at) sentence->text[at] = ' ';
+        memcpy(sentence->text + word_start, text, length);
     }
+    sentence->text_length += (uint32_t)added;
 
-    log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-                "Unlock failed: lock entry not found for file='%s', sentence=%d",
-                filename, sentence_num);
-    pthread_mutex_unlock(&ctx->lock_table_mutex);
-    return 0;
+    for (int i = sentence->word_count; i > pos; i--) {
+        sentence->word_offsets[i] = sentence->word_offsets[i - 1] + (uint32_t)added;
+    }
+    sentence->word_offsets[pos] = word_start;
+    sentence->word_count++;
+    return ERR_SUCCESS;
 }
 
-// ============================================================================
-// WORD/SENTENCE OPERATIONS
-// ============================================================================
-
-WordNode* create_word_node(const char *word_content) {
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Creating word node: content='%s'", word_content);
+// Move words [start, word_count) of one sentence to the end of another
+// sentence of the same document
+static int move_sentence_words(DocumentArena *arena, SentenceNode *from, int start, SentenceNode *to) {
+    int moved = from->word_count - start;
+    uint32_t tail_start = from->word_offsets[start];
+    uint32_t tail_length = from->text_length - tail_start;
+    size_t separator = to->word_count > 0 ? 1 : 0;
 
-    WordNode *node = malloc(sizeof(WordNode));
-    if (!node) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-                    "Word node allocation failed for: '%s'", word_content);
-        return NULL;
+    if (reserve_sentence_words(arena, to, to->word_count + moved,
+                               to->text_length + separator + tail_length) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
     }
 
-    node->content = strdup(word_content);
-    if (!node->content) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-                    "Word content strdup failed for: '%s'", word_content);
-        free(node);
-        return NULL;
+    if (separator) to->text[to->text_length] = ' ';
+    uint32_t base = to->text_length + (uint32_t)separator;
+    memcpy(to->text + base, from->text + tail_start, tail_length);
+    for (int i = 0; i < moved; i++) {
+        to->word_offsets[to->word_count + i] = from->word_offsets[start + i] - tail_start + base;
     }
+    to->word_count += moved;
+    to->text_length = base + tail_length;
 
-    node->prev = NULL;
-    node->next = NULL;
-    return node;
+    // Drop the tail and the space in front of it
+    from->word_count = start;
+    from->text_length = start > 0 ? tail_start - 1 : 0;
+    return ERR_SUCCESS;
 }
 
-void free_word_list(WordNode *head) {
-    int word_count = 0;
-    WordNode *current = head;
-    while (current) {
-        WordNode *next = current->next;
-        free(current->content);
-        free(current);
-        word_count++;
-        current = next;
-    }
+// Replace dst's words with a copy of src's, allocated in dst's document
+static int copy_sentence_words(DocumentArena *arena, SentenceNode *dst, const SentenceNode *src) {
+    release_sentence_words(arena, dst);
+    dst->delimiter = src->delimiter;
 
-    if (word_count > 0) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                    "Freed word list: %d words", word_count);
+    if (src->word_count == 0) {
+        return ERR_SUCCESS;
+    }
+    if (reserve_sentence_words(arena, dst, src->word_count, src->text_length) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
     }
-}
-
-WordNode* parse_words_to_list(const char *sentence_str, int *word_count) {
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Parsing words from sentence: '%s'", sentence_str);
 
-    *word_count = 0;
-    char temp[MAX_SENTENCE_LENGTH];
-    strncpy(temp, sentence_str, MAX_SENTENCE_LENGTH - 1);
-    temp[MAX_SENTENCE_LENGTH - 1] = '\0';
+    memcpy(dst->text, src->text, src->text_length);
+    memcpy(dst->word_offsets, src->word_offsets, (size_t)src->word_count * sizeof(uint32_t));
+    dst->text_length = src->text_length;
+    dst->word_count = src->word_count;
+    return ERR_SUCCESS;
+}
 
-    size_t len = strlen(temp);
-    if (len > 0 && is_sentence_delimiter(temp[len - 1])) {
-        temp[len - 1] = '\0';
+// Store the words found by the tokenizer (offsets into base) as the
+// sentence's text, sized exactly so loading wastes no arena space
+static int fill_sentence_words(DocumentArena *arena, SentenceNode *sentence,
+                               const char *base, const TextToken *words, int word_total) {
+    if (word_total == 0) {
+        return ERR_SUCCESS;
     }
 
-    trim_whitespace(temp);
+    size_t text_total = (size_t)(word_total - 1);
+    for (int i = 0; i < word_total; i++) {
+        text_total += words[i].length;
+    }
+    if (reserve_sentence_words(arena, sentence, word_total, text_total) != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                    "Failed to store sentence (%d words)", word_total);
+        return ERR_OUT_OF_MEMORY;
+    }
 
-    if (strlen(temp) == 0) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                    "Empty sentence after trimming, returning NULL");
-        return NULL;
+    for (int i = 0; i < word_total; i++) {
+        if (i > 0) {
+            sentence->text[sentence->text_length++] = ' ';
+        }
+        sentence->word_offsets[i] = sentence->text_length;
+        memcpy(sentence->text + sentence->text_length, base + words[i].start, words[i].length);
+        sentence->text_length += (uint32_t)words[i].length;
     }
+    sentence->word_count = word_total;
+    return ERR_SUCCESS;
+}
 
-    WordNode *head = NULL;
-    WordNode *tail = NULL;
+static SentenceNode* create_empty_sentence(DocumentArena *arena) {
+    SentenceNode *node = arena_alloc_sentence(arena);
+    if (!node) return NULL;
+
+    node->text = NULL;
+    node->word_offsets = NULL;
+    node->text_length = 0;
+    node->text_capacity = 0;
+    node->word_count = 0;
+    node->word_capacity = 0;
+    node->delimiter = '\0';
+    node->id = 0;
+    node->id_next = NULL;
+    node->editor = NULL;
+    node->tree_left = node->tree_right = node->tree_parent = NULL;
+    node->subtree_size = 1;
+    node->saved_bytes = 0;
+    node->subtree_saved_bytes = 0;
+    node->tree_priority = 0;
+    node->next = NULL;
+    return node;
+}
 
-    char *token = strtok(temp, " \t\n\r");
-    while (token) {
-        WordNode *word_node = create_word_node(token);
-        if (!word_node) {
-            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-                        "Failed to create word node, freeing list (parsed=%d words)", *word_count);
-            free_word_list(head);
-            return NULL;
-        }
+// Add (sign 1) or remove (sign -1) one sentence's share of the document
+// stats and of the saved text (its words and delimiter, then a newline).
+// Callers take a sentence out before editing it and put it back after.
+static void account_sentence(FileContent *file, SentenceNode *sentence, int sign) {
+    if (sentence->word_count == 0) {
+        return;
+    }
 
-        if (tail) {
-            tail->next = word_node;
-            word_node->prev = tail;
-            tail = word_node;
-        } else {
-            head = tail = word_node;
-        }
+    sentence_index_set_saved_bytes(sentence, sign > 0
+        ? sentence->text_length + (sentence->delimiter ? 1 : 0) + 1 : 0);
 
-        (*word_count)++;
-        token = strtok(NULL, " \t\n\r");
+    DocumentStats *stats = &file->stats;
+    stats->words += sign * sentence->word_count;
+    stats->text_bytes += sign * ((long)sentence->text_length + (sentence->delimiter ? 1 : 0));
+    stats->filled_sentences += sign;
+    if (sentence->delimiter) {
+        stats->ended_sentences += sign;
     }
+}
 
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Parsed %d words from sentence", *word_count);
-    return head;
+static void free_sentence_node(DocumentArena *arena, SentenceNode *node) {
+    release_sentence_words(arena, node);
+    arena_free_sentence(arena, node);
 }
 
-char* word_list_to_string(WordNode *word_head, char delimiter) {
-    if (!word_head) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                    "Converting empty word list to string");
-        return strdup("");
+static FileContent* create_empty_content(const char *filename) {
+    FileContent *file = malloc(sizeof(FileContent));
+    if (!file) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                    "Failed to allocate FileContent for: %s", filename);
+        return NULL;
     }
 
-    size_t total_len = 0;
-    int word_count = 0;
-    WordNode *current = word_head;
-    while (current) {
-        total_len += strlen(current->content) + 1;
-        word_count++;
-        current = current->next;
-    }
+    strncpy(file->filename, filename, MAX_FILENAME_LENGTH - 1);
+    file->filename[MAX_FILENAME_LENGTH - 1] = '\0';
+    arena_init(&file->arena);
+    sentence_index_init(file);
+    memset(&file->stats, 0, sizeof(DocumentStats));
+    file->ref_count = 0;
+    file->is_stale = 0;
+    file->wal_dirty = 0;
+    file->wal_base_raw = 0;
+    memset(&file->history, 0, sizeof(DynamicBuffer));
+    file->history_loaded = 0;
+    pthread_mutex_init(&file->file_lock, NULL);
+    return file;
+}
 
-    total_len += 2;
-    char *result = malloc(total_len);
-    if (!result) {
+// ============================================================================
+// FILE CONTENT LOADING AND SAVING
+// ============================================================================
+
+// Insert a parsed sentence after `after` (NULL: at the front) with the
+// given ID, or a new one if id is 0
+static SentenceNode* insert_parsed_sentence(FileContent *file, SentenceNode *after, const char *base,
+                                            const TextToken *words, int word_total, char delimiter,
+                                            uint32_t id) {
+    SentenceNode *node = create_empty_sentence(&file->arena);
+    if (!node) {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-                    "Failed to allocate string buffer (size=%zu)", total_len);
+                    "Failed to allocate SentenceNode for '%s'", file->filename);
         return NULL;
     }
 
-    result[0] = '\0';
-    current = word_head;
-    while (current) {
-        strcat(result, current->content);
-        if (current->next) {
-            strcat(result, " ");
-        }
-        current = current->next;
+    node->delimiter = delimiter;
+    node->id = id;
+    if (fill_sentence_words(&file->arena, node, base, words, word_total) != ERR_SUCCESS) {
+        free_sentence_node(&file->arena, node);
+        return NULL;
     }
 
-    if (delimiter != '\0') {
-        size_t len = strlen(result);
-        result[len] = delimiter;
-        result[len + 1] = '\0';
-    }
+    sentence_index_insert_after(file, after, node);
+    account_sentence(file, node, 1);
+    return node;
+}
 
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Converted word list to string: %d words, delimiter='%c', length=%zu",
-                word_count, delimiter ? delimiter : '0', strlen(result));
-    return result;
+// Append a parsed sentence to the end of a document being built
+static int append_parsed_sentence(FileContent *file, const char *base,
+                                  const TextToken *words, int word_total, char delimiter,
+                                  uint32_t id) {
+    return insert_parsed_sentence(file, file->tail, base, words, word_total, delimiter, id)
+           ? ERR_SUCCESS : ERR_OUT_OF_MEMORY;
 }
 
-// ============================================================================
-// FILE CONTENT LOADING AND SAVING
-// ============================================================================
+// Newlines in data[from, to)
+static int count_lines(const char *data, size_t from, size_t to) {
+    int lines = 0;
+    const char *at = data + from;
+    const char *end = data + to;
+    while (at < end && (at = memchr(at, '\n', (size_t)(end - at))) != NULL) {
+        lines++;
+        at++;
+    }
+    return lines;
+}
 
 FileContent* load_file_content(const char *storage_dir, const char *filename) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
                 "Loading file content: storage_dir='%s', filename='%s'",
                 storage_dir, filename);
 
-    char content[LARGE_BUFFER_SIZE];
-    int read_result = ss_read_file(storage_dir, filename, content, sizeof(content));
+    char *content = NULL;
+    size_t content_length = 0;
+    int read_result = ss_read_file(storage_dir, filename, &content, &content_length);
     if (read_result != ERR_SUCCESS) {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
                     "Failed to read file: filename='%s', error=%d", filename, read_result);
         return NULL;
     }
 
-    FileContent *file = malloc(sizeof(FileContent));
+    FileContent *file = create_empty_content(filename);
     if (!file) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-                    "Failed to allocate FileContent for: %s", filename);
+        free(content);
         return NULL;
     }
 
-    strncpy(file->filename, filename, MAX_FILENAME_LENGTH - 1);
-    file->head = NULL;
-    file->sentence_count = 0;
-    pthread_mutex_init(&file->file_lock, NULL);
-
-    size_t content_length = strlen(content);
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
                 "File content loaded: %zu bytes", content_length);
 
-    if (content_length == 0) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                    "Empty file loaded: %s", filename);
-        return file;
-    }
-
-    char *start = content;
-    char *p = content;
-    SentenceNode *tail = NULL;
-
-    while (*p) {
-        if (is_sentence_delimiter(*p)) {
-            size_t len = p - start + 1;
-            char sentence_buffer[MAX_SENTENCE_LENGTH];
-            strncpy(sentence_buffer, start, len);
-            sentence_buffer[len] = '\0';
-
-            SentenceNode *node = malloc(sizeof(SentenceNode));
-            if (!node) {
-                log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-                            "Failed to allocate SentenceNode, freeing file content");
-                free_file_content(file);
-                return NULL;
+    // Saved sentence IDs, one per line of the text they were saved with. A
+    // line without a delimiter runs into the next one when parsed, and the
+    // sentence keeps the ID of the line it starts on.
+    uint32_t *line_ids = NULL;
+    uint32_t line_id_count = 0;
+    read_sentence_ids(storage_dir, filename, content, content_length,
+                      &line_ids, &line_id_count, &file->next_sentence_id);
+    size_t scanned = 0;
+    int line = 0;
+    int sentence_line = -1;
+    int last_id_line = -1;
+
+    // Words of the sentence being built, reused from sentence to sentence
+    int word_capacity = 64;
+    int word_total = 0;
+    TextToken *words = malloc((size_t)word_capacity * sizeof(TextToken));
+    int result = words ? ERR_SUCCESS : ERR_OUT_OF_MEMORY;
+
+    // Every delimiter ends a sentence; trailing words without one form a
+    // final sentence
+    TextTokenizer tokenizer;
+    TextToken token;
+    text_tokenizer_init(&tokenizer, content, content_length, 1);
+
+    while (result == ERR_SUCCESS && text_tokenizer_next(&tokenizer, &token)) {
+        if (token.type == TEXT_TOKEN_DELIMITER) {
+            uint32_t id = 0;
+            if (sentence_line >= 0 && sentence_line < (int)line_id_count && sentence_line != last_id_line) {
+                id = line_ids[sentence_line];
+                last_id_line = sentence_line;
             }
+            result = append_parsed_sentence(file, content, words, word_total, content[token.start], id);
+            word_total = 0;
+            sentence_line = -1;
+            continue;
+        }
 
-            node->delimiter = *p;
-            node->word_count = 0;
-            node->word_head = parse_words_to_list(sentence_buffer, &node->word_count);
-            node->word_tail = node->word_head;
-            if (node->word_tail) {
-                while (node->word_tail->next) {
-                    node->word_tail = node->word_tail->next;
-                }
+        if (word_total == 0 && line_ids) {
+            line += count_lines(content, scanned, token.start);
+            scanned = token.start;
+            sentence_line = line;
+        }
+
+        if (word_total == word_capacity) {
+            TextToken *grown = realloc(words, (size_t)word_capacity * 2 * sizeof(TextToken));
+            if (!grown) {
+                result = ERR_OUT_OF_MEMORY;
+                break;
             }
+            words = grown;
+            word_capacity *= 2;
+        }
+        words[word_total++] = token;
+    }
+
+    if (result == ERR_SUCCESS && word_total > 0) {
+        uint32_t id = 0;
+        if (sentence_line >= 0 && sentence_line < (int)line_id_count && sentence_line != last_id_line) {
+            id = line_ids[sentence_line];
+        }
+        result = append_parsed_sentence(file, content, words, word_total, '\0', id);
+    }
 
-            node->next = NULL;
-            node->is_locked = 0;
-            node->locked_by[0] = '\0';
-            pthread_mutex_init(&node->sentence_lock, NULL);
+    free(words);
+    free(line_ids);
+    free(content);
 
-            if (tail) {
-                tail->next = node;
-            } else {
-                file->head = node;
-            }
-            tail = node;
-            file->sentence_count++;
+    if (result != ERR_SUCCESS) {
+        free_file_content(file);
+        return NULL;
+    }
 
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                        "Parsed sentence #%d: %d words, delimiter='%c'",
-                        file->sentence_count - 1, node->word_count, node->delimiter);
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                "File content loaded successfully: filename='%s', sentences=%d",
+                filename, file->sentence_count);
+    return file;
+}
 
-            start = p + 1;
-            while (*start == ' ' || *start == '\n' || *start == '\r' || *start == '\t') {
-                start++;
+// Append "word word word<delimiter>" for one sentence
+int append_sentence_text(DynamicBuffer *out, const SentenceNode *sentence) {
+    if (dynbuf_append(out, sentence->text, sentence->text_length) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    if (sentence->delimiter != '\0') {
+        return dynbuf_append_char(out, sentence->delimiter);
+    }
+    return ERR_SUCCESS;
+}
+
+// Render a document one sentence per line, as "[n] sentence" (READ),
+// "[n @id] sentence" or as plain text (CLEANREAD)
+int render_file_content(const FileContent *file, RenderStyle style, DynamicBuffer *out) {
+    int sent_num = 0;
+    for (SentenceNode *current = file->head; current; current = current->next) {
+        if (style != RENDER_PLAIN) {
+            char prefix[48];
+            if (style == RENDER_NUMBERED_IDS) {
+                snprintf(prefix, sizeof(prefix), "[%d @%u] ", sent_num, current->id);
+            } else {
+                snprintf(prefix, sizeof(prefix), "[%d] ", sent_num);
             }
-            p = start;
-        } else {
-            p++;
+            if (dynbuf_append_str(out, prefix) != ERR_SUCCESS) return ERR_OUT_OF_MEMORY;
+        }
+        if (append_sentence_text(out, current) != ERR_SUCCESS ||
+            dynbuf_append_char(out, '\n') != ERR_SUCCESS) {
+            return ERR_OUT_OF_MEMORY;
         }
+        sent_num++;
     }
+    return ERR_SUCCESS;
+}
 
-    if (*start && start < p) {
-        char sentence_buffer[MAX_SENTENCE_LENGTH];
-        size_t len = p - start;
-        strncpy(sentence_buffer, start, len);
-        sentence_buffer[len] = '\0';
-        trim_whitespace(sentence_buffer);
-
-        if (strlen(sentence_buffer) > 0) {
-            SentenceNode *node = malloc(sizeof(SentenceNode));
-            if (node) {
-                node->delimiter = '\0';
-                node->word_count = 0;
-                node->word_head = parse_words_to_list(sentence_buffer, &node->word_count);
-                node->word_tail = node->word_head;
-                if (node->word_tail) {
-                    while (node->word_tail->next) {
-                        node->word_tail = node->word_tail->next;
-                    }
-                }
+// One sentence as READ|file|n lists it: "[n @id] text"
+int render_sentence(const SentenceNode *sentence, int sentence_num, DynamicBuffer *out) {
+    char prefix[48];
+    snprintf(prefix, sizeof(prefix), "[%d @%u] ", sentence_num, sentence->id);
+    if (dynbuf_append_str(out, prefix) != ERR_SUCCESS ||
+        append_sentence_text(out, sentence) != ERR_SUCCESS ||
+        dynbuf_append_char(out, '\n') != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    return ERR_SUCCESS;
+}
 
-                node->next = NULL;
-                node->is_locked = 0;
-                node->locked_by[0] = '\0';
-                pthread_mutex_init(&node->sentence_lock, NULL);
+// What text_stats() would count in the saved document, and its length,
+// without rendering it. Saved sentences are joined by newlines; delimiter-
+// less ones merge into the next sentence when read back, so only the last
+// one counts on its own.
+TextStats document_text_stats(const FileContent *file, size_t *saved_length) {
+    const DocumentStats *stats = &file->stats;
+    TextStats result;
 
-                if (tail) {
-                    tail->next = node;
-                } else {
-                    file->head = node;
-                }
-                file->sentence_count++;
+    result.words = (size_t)stats->words;
+    result.sentences = (size_t)stats->ended_sentences;
 
-                log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                            "Parsed trailing sentence #%d: %d words, no delimiter",
-                            file->sentence_count - 1, node->word_count);
+    if (stats->filled_sentences > 0) {
+        // Edits can leave empty sentences at the end; they are rare and cheap to skip
+        const SentenceNode *last = file->tail;
+        if (last->word_count == 0) {
+            for (const SentenceNode *node = file->head; node; node = node->next) {
+                if (node->word_count > 0) last = node;
             }
         }
+        if (last->delimiter == '\0') {
+            result.sentences++;
+        }
     }
 
-    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
-                "File content loaded successfully: filename='%s', sentences=%d",
-                filename, file->sentence_count);
-    return file;
+    if (saved_length) {
+        *saved_length = (size_t)stats->text_bytes +
+                        (stats->filled_sentences > 0 ? (size_t)stats->filled_sentences - 1 : 0);
+    }
+    return result;
+}
+
+// The text a document is saved as: sentences with words, one per line.
+// Its length is the root's subtree_saved_bytes less the final newline.
+int render_saved_text(const FileContent *file, DynamicBuffer *out) {
+    int first = 1;
+    for (const SentenceNode *current = file->head; current; current = current->next) {
+        if (current->word_count == 0) {
+            continue;
+        }
+        if ((!first && dynbuf_append_char(out, '\n') != ERR_SUCCESS) ||
+            append_sentence_text(out, current) != ERR_SUCCESS) {
+            return ERR_OUT_OF_MEMORY;
+        }
+        first = 0;
+    }
+    return ERR_SUCCESS;
 }
 
 int save_file_content(const char *storage_dir, FileContent *file_content) {
@@ -414,44 +507,32 @@ int save_file_content(const char *storage_dir, FileContent *file_content) {
                 "Saving file content: filename='%s', sentences=%d",
                 file_content->filename, file_content->sentence_count);
 
-    char buffer[LARGE_BUFFER_SIZE] = {0};
-    int sentences_saved = 0;
-    int total_words = 0;
-
-    SentenceNode *current = file_content->head;
-    while (current) {
-        if (current->word_count > 0) {
-            char *sentence_str = word_list_to_string(current->word_head, current->delimiter);
-            if (sentence_str) {
-                strncat(buffer, sentence_str, LARGE_BUFFER_SIZE - strlen(buffer) - 1);
-                total_words += current->word_count;
-                sentences_saved++;
-                free(sentence_str);
-
-                if (current->next && current->next->word_count > 0) {
-                    strncat(buffer, "\n", LARGE_BUFFER_SIZE - strlen(buffer) - 1);
-                }
-            }
-        }
-        current = current->next;
+    DynamicBuffer buffer;
+    if (dynbuf_init(&buffer, 4096) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    if (render_saved_text(file_content, &buffer) != ERR_SUCCESS) {
+        dynbuf_free(&buffer);
+        return ERR_OUT_OF_MEMORY;
     }
 
-    size_t buffer_length = strlen(buffer);
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "File buffer prepared: %zu bytes, %d sentences, %d words",
-                buffer_length, sentences_saved, total_words);
+                "File buffer prepared: %zu bytes, %d sentences, %ld words",
+                buffer.length, file_content->stats.filled_sentences, file_content->stats.words);
 
-    int result = ss_write_file(storage_dir, file_content->filename, buffer);
+    TextStats stats = document_text_stats(file_content, NULL);
+    int result = ss_write_file(storage_dir, file_content->filename, buffer.data, buffer.length, &stats);
     if (result == ERR_SUCCESS) {
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
                     "File saved successfully: filename='%s', size=%zu bytes",
-                    file_content->filename, buffer_length);
+                    file_content->filename, buffer.length);
     } else {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
                     "File save failed: filename='%s', error=%d",
                     file_content->filename, result);
     }
 
+    dynbuf_free(&buffer);
     return result;
 }
 
@@ -466,17 +547,12 @@ void free_file_content(FileContent *file_content) {
                 "Freeing file content: filename='%s', sentences=%d",
                 file_content->filename, file_content->sentence_count);
 
-    int sentence_count = 0;
-    SentenceNode *current = file_content->head;
-    while (current) {
-        SentenceNode *next = current->next;
-        free_word_list(current->word_head);
-        pthread_mutex_destroy(&current->sentence_lock);
-        free(current);
-        sentence_count++;
-        current = next;
-    }
+    int sentence_count = file_content->sentence_count;
 
+    // Words and sentence nodes all live in the document's arena
+    arena_destroy(&file_content->arena);
+    sentence_index_destroy(file_content);
+    dynbuf_free(&file_content->history);
     pthread_mutex_destroy(&file_content->file_lock);
     free(file_content);
 
@@ -484,539 +560,590 @@ void free_file_content(FileContent *file_content) {
                 "File content freed: %d sentences", sentence_count);
 }
 
-int lock_sentence(FileContent *file, int sentence_num, const char *username) {
-    (void)username;
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Lock sentence: file='%s', sentence=%d, current_count=%d",
-                file->filename, sentence_num, file->sentence_count);
+SentenceNode* get_sentence_node(FileContent *file, int sentence_num) {
+    return sentence_index_at(file, sentence_num);
+}
 
-    if (sentence_num < 0) {
-        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-                    "Invalid sentence number: %d (must be >= 0)", sentence_num);
-        return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
-    }
+// Parse how a request names a sentence: "n" for the sentence at position n
+// or "@id" for the sentence with that ID. Sets the one given and -1 / 0 in
+// the other; returns 0 if ref is neither.
+int parse_sentence_ref(const char *ref, int *sentence_num, uint32_t *sentence_id) {
+    char *end;
+    *sentence_num = -1;
+    *sentence_id = 0;
 
-    if (sentence_num >= file->sentence_count) {
-        return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
+    if (ref[0] == '@') {
+        unsigned long id = strtoul(ref + 1, &end, 10);
+        if (end == ref + 1 || *end != '\0' || id == 0 || id > UINT32_MAX) return 0;
+        *sentence_id = (uint32_t)id;
+        return 1;
     }
 
-    SentenceNode *current = file->head;
-    for (int i = 0; i < sentence_num && current; i++) {
-        current = current->next;
-    }
+    long num = strtol(ref, &end, 10);
+    if (end == ref || *end != '\0' || num < 0 || num > INT32_MAX) return 0;
+    *sentence_num = (int)num;
+    return 1;
+}
 
-    if (!current) return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
+// Mark a sentence of the live document as being edited by a write session.
+// Indices shift as other sessions commit splits, so this per-node marker is
+// what keeps two sessions from ever editing the same sentence. Guarded by
+// the document mutex, since sessions claim sentences under the shared lock.
+int lock_sentence(FileContent *file, SentenceNode *sentence, const char *username) {
+    int result = ERR_SUCCESS;
 
-    pthread_mutex_lock(&current->sentence_lock);
+    pthread_mutex_lock(&file->file_lock);
 
-    if (sentence_num < 0 || sentence_num >= file->sentence_count) {
-        pthread_mutex_unlock(&current->sentence_lock);
-        return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
+    if (sentence->editor && strcmp(sentence->editor, username) != 0) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Sentence already being edited by '%s', denied for '%s'",
+                    sentence->editor, username);
+        result = ERR_FILE_LOCKED;
+    } else if (!sentence->editor) {
+        sentence->editor = strdup(username);
+        if (!sentence->editor) result = ERR_OUT_OF_MEMORY;
     }
 
-    current->is_locked = 1;
-    strncpy(current->locked_by, username, MAX_USERNAME_LENGTH - 1);
-    current->locked_by[MAX_USERNAME_LENGTH - 1] = '\0';
-
-    pthread_mutex_unlock(&current->sentence_lock);
-    return ERR_SUCCESS;
+    pthread_mutex_unlock(&file->file_lock);
+    return result;
 }
 
-int unlock_sentence(FileContent *file, int sentence_num, const char *username) {
-    (void)username;
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                "Unlock sentence: file='%s', sentence=%d",
-                file->filename, sentence_num);
-
-    if (sentence_num < 0 || sentence_num >= file->sentence_count) {
-        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-                    "Unlock failed: sentence %d out of range (count=%d)",
-                    sentence_num, file->sentence_count);
-        return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
+void unlock_sentence(FileContent *file, SentenceNode *sentence, const char *username) {
+    pthread_mutex_lock(&file->file_lock);
+    if (sentence->editor && strcmp(sentence->editor, username) == 0) {
+        free(sentence->editor);
+        sentence->editor = NULL;
     }
-
-    return ERR_SUCCESS;
+    pthread_mutex_unlock(&file->file_lock);
 }
 
 // ============================================================================
-// MULTI-WORD SENTENCE MODIFICATION (FIXED VERSION)
+// WRITE SESSION STAGING AND MERGE
 // ============================================================================
 
-int modify_sentence_multiword(FileContent *file, int sentence_num, int word_index,
-    const char *new_content, const char *username, int *new_sentence_num) {
-(void)username;
+// Private one-sentence document a write session edits. It starts as a copy
+// of the target sentence, or empty when the session appends a new sentence
+// (source == NULL). Word updates split it into several sentences as
+// delimiters are typed.
+FileContent* create_staging_content(const char *filename, const SentenceNode *source) {
+    FileContent *staging = create_empty_content(filename);
+    if (!staging) {
+        return NULL;
+    }
 
-log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
-"Multiword modify: file='%s', sentence=%d, word_index=%d, content='%s', user='%s'",
-file->filename, sentence_num, word_index, new_content, username);
+    SentenceNode *node = create_empty_sentence(&staging->arena);
+    if (!node) {
+        free_file_content(staging);
+        return NULL;
+    }
+    sentence_index_insert_after(staging, NULL, node);
 
-*new_sentence_num = sentence_num;
+    if (source && copy_sentence_words(&staging->arena, node, source) != ERR_SUCCESS) {
+        free_file_content(staging);
+        return NULL;
+    }
+    account_sentence(staging, node, 1);
 
-// Validate sentence exists
-if (sentence_num < 0 || sentence_num >= file->sentence_count) {
-log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-"Sentence index %d out of range (count=%d)",
-sentence_num, file->sentence_count);
-return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
+    return staging;
 }
 
-// Navigate to target sentence
-SentenceNode *current = file->head;
-for (int i = 0; i < sentence_num && current; i++) {
-current = current->next;
-}
+// ============================================================================
+// SENTENCE DELTAS
+// ============================================================================
 
-if (!current) {
-log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
-"Sentence node is NULL after traversal (sentence=%d)", sentence_num);
-return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
+void sentence_delta_init(SentenceDelta *delta) {
+    memset(delta, 0, sizeof(SentenceDelta));
+    delta->position = -1;
 }
 
-pthread_mutex_lock(&current->sentence_lock);
-
-// Allow word_index == word_count for appending
-if (word_index < 0 || word_index > current->word_count) {
-log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
-"Word index %d out of range (word_count=%d, max allowed=%d)",
-word_index, current->word_count, current->word_count);
-pthread_mutex_unlock(&current->sentence_lock);
-return ERR_WORD_INDEX_OUT_OF_RANGE;
+void sentence_delta_free(SentenceDelta *delta) {
+    dynbuf_free(&delta->old_text);
+    dynbuf_free(&delta->new_text);
+    sentence_delta_init(delta);
 }
 
-// Save original delimiter before modifications
-char original_delimiter = current->delimiter;
-
-// Parse input content into words
-char temp[MAX_SENTENCE_LENGTH];
-strncpy(temp, new_content, MAX_SENTENCE_LENGTH - 1);
-temp[MAX_SENTENCE_LENGTH - 1] = '\0';
-
-char *words[100];
-int word_count = 0;
-char *token = strtok(temp, " \t\n\r");
-while (token && word_count < 100) {
-words[word_count++] = strdup(token);
-token = strtok(NULL, " \t\n\r");
+void file_splice_init(FileSplice *splice) {
+    memset(splice, 0, sizeof(FileSplice));
 }
 
-log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-"Parsed %d words from content: '%s'", word_count, new_content);
-
-// Navigate to insertion point
-WordNode *insert_after = NULL;
-if (word_index > 0) {
-insert_after = current->word_head;
-for (int i = 1; i < word_index && insert_after; i++) {
-insert_after = insert_after->next;
-}
+void file_splice_free(FileSplice *splice) {
+    dynbuf_free(&splice->old_text);
+    dynbuf_free(&splice->new_text);
+    dynbuf_free(&splice->new_ids);
+    dynbuf_free(&splice->history_record);
+    file_splice_init(splice);
 }
 
-// Process each word
-int current_sent = sentence_num;
-SentenceNode *active_sent = current;
-WordNode *last_inserted = insert_after;
-
-for (int i = 0; i < word_count; i++) {
-char *word = words[i];
-int len = strlen(word);
-char delimiter = '\0';
-int delimiter_pos = -1;
-
-// Find delimiter in word
-for (int j = 0; j < len; j++) {
-if (is_sentence_delimiter(word[j])) {
-delimiter = word[j];
-delimiter_pos = j;
-printf("  → Delimiter '%c' found at position %d in '%s'\n", delimiter, j, word);
-break;
-}
+// Append the saved form of count sentences starting at first, and their
+// IDs to ids if given
+static int splice_append_sentences(DynamicBuffer *side, DynamicBuffer *ids,
+                                   const SentenceNode *first, int count) {
+    if (!side->data && dynbuf_init(side, 256) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    if (ids && !ids->data && dynbuf_init(ids, 64) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    for (int i = 0; i < count && first; i++, first = first->next) {
+        if (first->word_count == 0) {
+            continue;
+        }
+        if (append_sentence_text(side, first) != ERR_SUCCESS ||
+            dynbuf_append_char(side, '\n') != ERR_SUCCESS ||
+            (ids && dynbuf_append(ids, (const char*)&first->id, sizeof(first->id)) != ERR_SUCCESS)) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+    return ERR_SUCCESS;
 }
 
-// Case 1: No delimiter in word - simple insertion
-if (delimiter == '\0') {
-WordNode *new_word = create_word_node(word);
-if (!new_word) {
-free(word);
-pthread_mutex_unlock(&current->sentence_lock);
-for (int j = i + 1; j < word_count; j++) free(words[j]);
-return ERR_OUT_OF_MEMORY;
-}
+// Append a sentence as "u32 length, rendered text" to one side of a delta
+static int delta_append_sentence(DynamicBuffer *side, const SentenceNode *sentence) {
+    if (!side->data && dynbuf_init(side, 256) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
 
-if (!last_inserted) {
-new_word->next = active_sent->word_head;
-if (active_sent->word_head) {
-active_sent->word_head->prev = new_word;
-}
-active_sent->word_head = new_word;
-if (!active_sent->word_tail) {
-active_sent->word_tail = new_word;
-}
-} else {
-new_word->next = last_inserted->next;
-new_word->prev = last_inserted;
-if (last_inserted->next) {
-last_inserted->next->prev = new_word;
-} else {
-active_sent->word_tail = new_word;
-}
-last_inserted->next = new_word;
+    uint32_t length = sentence->text_length + (sentence->delimiter ? 1 : 0);
+    if (dynbuf_append(side, (const char *)&length, sizeof(length)) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    return append_sentence_text(side, sentence);
 }
 
-active_sent->word_count++;
-last_inserted = new_word;
-free(word);
-}
-// Case 2: Delimiter at end of word
-else if (delimiter_pos == len - 1) {
-word[delimiter_pos] = '\0';
-
-// Insert word if not empty
-if (strlen(word) > 0) {
-WordNode *new_word = create_word_node(word);
-if (!new_word) {
-free(word);
-pthread_mutex_unlock(&current->sentence_lock);
-for (int j = i + 1; j < word_count; j++) free(words[j]);
-return ERR_OUT_OF_MEMORY;
+// Next sentence text of a delta side; 0 when the side is exhausted or malformed
+static int delta_next_sentence(const DynamicBuffer *side, size_t *offset,
+                               const char **text, uint32_t *length) {
+    if (!side->data || *offset + sizeof(uint32_t) > side->length) {
+        return 0;
+    }
+    memcpy(length, side->data + *offset, sizeof(uint32_t));
+    if (*offset + sizeof(uint32_t) + *length > side->length) {
+        return 0;
+    }
+    *text = side->data + *offset + sizeof(uint32_t);
+    *offset += sizeof(uint32_t) + *length;
+    return 1;
 }
 
-if (!last_inserted) {
-new_word->next = active_sent->word_head;
-if (active_sent->word_head) {
-active_sent->word_head->prev = new_word;
-}
-active_sent->word_head = new_word;
-if (!active_sent->word_tail) {
-active_sent->word_tail = new_word;
-}
-} else {
-new_word->next = last_inserted->next;
-new_word->prev = last_inserted;
-if (last_inserted->next) {
-last_inserted->next->prev = new_word;
-} else {
-active_sent->word_tail = new_word;
-}
-last_inserted->next = new_word;
-}
+// Whether the last staged sentence that will be merged has no delimiter
+static int staging_ends_unended(const FileContent *staging) {
+    const SentenceNode *last = staging->head;
+    for (const SentenceNode *node = staging->head; node; node = node->next) {
+        if (node->word_count > 0) last = node;
+    }
+    return last && last->delimiter == '\0';
+}
+
+// Splice a write session's staged sentences into the live document. The
+// target sentence takes the first staged sentence in place (keeping its
+// ID) and the rest are linked in right after it with new IDs; with no
+// target they are appended to the end.
+// Sentences left without words are dropped since they are never saved.
+// Staged words are copied into the live document's arena. Consumes the
+// staging document. Caller must hold the file lock exclusively.
+//
+// A staged sentence left without a delimiter would run into the sentence
+// after the target when the file is next loaded, so it takes that sentence
+// in now (unless another session is editing it). The document then reads
+// the same from memory as from its saved text, which the positions in the
+// undo history rely on.
+//
+// When delta is given it receives what the merge replaced, for the undo
+// history. It is left unset (position -1) if recording ran out of memory.
+// When splice is given it receives the change to the saved text, for the
+// write-ahead log; failing to record that fails the merge.
+int merge_sentence_edits(FileContent *live, SentenceNode *target, FileContent *staging,
+                         SentenceDelta *delta, FileSplice *splice) {
+    SentenceNode *staged = staging->head;
+    SentenceNode *insert_after = target ? target : live->tail;
+    SentenceNode *old_tail = live->tail;
+    int merged = 0;
+    int result = ERR_SUCCESS;
+    int recorded = ERR_SUCCESS;
+
+    // Appends have nothing after them to join
+    SentenceNode *joined = NULL;
+    if (target && target->next && !target->next->editor && staging_ends_unended(staging)) {
+        joined = target->next;
+    }
+    int replaced = joined ? 2 : 1;
 
-active_sent->word_count++;
-last_inserted = new_word;
-}
+    if (splice) {
+        file_splice_init(splice);
+        splice->offset = sentence_index_saved_offset(live, target);
+        if (target) {
+            result = splice_append_sentences(&splice->old_text, NULL, target, replaced);
+        }
+    }
 
-// Extract remaining words
-WordNode *remaining_words = NULL;
-char moved_delimiter = '\0';
+    if (delta) {
+        sentence_delta_init(delta);
+        delta->position = target ? sentence_index_rank(target) : live->sentence_count;
+        if (target) {
+            recorded = delta_append_sentence(&delta->old_text, target);
+            if (joined && recorded == ERR_SUCCESS) {
+                recorded = delta_append_sentence(&delta->old_text, joined);
+            }
+            delta->old_count = replaced;
+        }
+    }
 
-if (last_inserted && last_inserted->next) {
-remaining_words = last_inserted->next;
-last_inserted->next = NULL;
-if (remaining_words) {
-remaining_words->prev = NULL;
-}
+    if (target && result == ERR_SUCCESS) {
+        // The first staged sentence replaces the target's words in place so
+        // the node other sessions may reference stays valid
+        account_sentence(live, target, -1);
+        result = copy_sentence_words(&live->arena, target, staged);
+        account_sentence(live, target, 1);
+        staged = staged->next;
+        merged++;
+    }
 
-int remaining_count = 0;
-WordNode *tmp = remaining_words;
-while (tmp) {
-remaining_count++;
-tmp = tmp->next;
-}
+    for (; staged && result == ERR_SUCCESS; staged = staged->next) {
+        if (staged->word_count == 0) {
+            continue;
+        }
 
-if (original_delimiter != '\0') {
-moved_delimiter = original_delimiter;
-printf("  → Transferring original delimiter '%c' to moved words\n",
- moved_delimiter);
-}
+        SentenceNode *node = create_empty_sentence(&live->arena);
+        if (!node) {
+            result = ERR_OUT_OF_MEMORY;
+            break;
+        }
+        result = copy_sentence_words(&live->arena, node, staged);
+        sentence_index_insert_after(live, insert_after, node);
+        account_sentence(live, node, 1);
+        insert_after = node;
+        merged++;
+    }
 
-active_sent->word_tail = last_inserted;
-active_sent->word_count -= remaining_count;
+    // insert_after is now the last merged sentence
+    if (joined && result == ERR_SUCCESS) {
+        account_sentence(live, insert_after, -1);
+        account_sentence(live, joined, -1);
+        result = move_sentence_words(&live->arena, joined, 0, insert_after);
+        if (result == ERR_SUCCESS) {
+            insert_after->delimiter = joined->delimiter;
+            sentence_index_remove(live, insert_after, joined);
+            free_sentence_node(&live->arena, joined);
+        } else {
+            account_sentence(live, joined, 1);
+        }
+        account_sentence(live, insert_after, 1);
+    }
 
-printf("  → Extracted %d remaining words from sentence %d\n",
-remaining_count, current_sent);
-}
+    SentenceNode *first = target ? target : (old_tail ? old_tail->next : live->head);
+    if (delta) {
+        SentenceNode *node = first;
+        for (int i = 0; i < merged && recorded == ERR_SUCCESS; i++, node = node->next) {
+            recorded = delta_append_sentence(&delta->new_text, node);
+        }
+    }
 
-// End current sentence with new delimiter
-active_sent->delimiter = delimiter;
-printf("  → Sentence %d ended with '%c'\n", current_sent, delimiter);
-free(word);
+    if (splice && result == ERR_SUCCESS) {
+        result = splice_append_sentences(&splice->new_text, &splice->new_ids, first, merged);
+    }
 
-// Create new sentence
-pthread_mutex_lock(&file->file_lock);
+    if (delta) {
+        delta->new_count = merged;
+        if (recorded != ERR_SUCCESS) {
+            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                        "Out of memory recording undo history for '%s'", live->filename);
+            sentence_delta_free(delta);
+        }
+    }
 
-SentenceNode *new_sent = malloc(sizeof(SentenceNode));
-if (!new_sent) {
-pthread_mutex_unlock(&file->file_lock);
-pthread_mutex_unlock(&current->sentence_lock);
-for (int j = i + 1; j < word_count; j++) free(words[j]);
-return ERR_OUT_OF_MEMORY;
-}
+    free_file_content(staging);
 
-new_sent->word_head = NULL;
-new_sent->word_tail = NULL;
-new_sent->word_count = 0;
-new_sent->delimiter = '\0';
-new_sent->is_locked = 0;
-new_sent->locked_by[0] = '\0';
-pthread_mutex_init(&new_sent->sentence_lock, NULL);
-
-new_sent->next = active_sent->next;
-active_sent->next = new_sent;
-file->sentence_count++;
-current_sent++;
-
-pthread_mutex_unlock(&file->file_lock);
-
-if (remaining_words) {
-new_sent->word_head = remaining_words;
-
-WordNode *tail = remaining_words;
-int count = 1;
-while (tail->next) {
-tail = tail->next;
-count++;
+    // Long-lived cached documents shed the words earlier edits replaced
+    DocumentArena *arena = &live->arena;
+    if (arena->dead_bytes >= ARENA_COMPACT_MIN_DEAD_BYTES && arena->dead_bytes > arena->live_bytes) {
+        compact_file_content(live);
+    }
+
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                "Merged %d staged sentence(s) into '%s' (now %d sentences)",
+                merged, live->filename, live->sentence_count);
+    return result;
 }
-new_sent->word_tail = tail;
-new_sent->word_count = count;
 
-new_sent->delimiter = moved_delimiter;
+// Parse one sentence text of a delta and insert it after `after`
+static SentenceNode* insert_sentence_text(FileContent *file, SentenceNode *after,
+                                          const char *text, uint32_t length, uint32_t id) {
+    int word_capacity = 16;
+    int word_total = 0;
+    char delimiter = '\0';
+    TextToken *words = malloc((size_t)word_capacity * sizeof(TextToken));
+    if (!words) return NULL;
+
+    TextTokenizer tokenizer;
+    TextToken token;
+    text_tokenizer_init(&tokenizer, text, length, 1);
+    while (text_tokenizer_next(&tokenizer, &token)) {
+        if (token.type == TEXT_TOKEN_DELIMITER) {
+            delimiter = text[token.start];
+            break;
+        }
+        if (word_total == word_capacity) {
+            TextToken *grown = realloc(words, (size_t)word_capacity * 2 * sizeof(TextToken));
+            if (!grown) {
+                free(words);
+                return NULL;
+            }
+            words = grown;
+            word_capacity *= 2;
+        }
+        words[word_total++] = token;
+    }
 
-printf("  → Moved %d words to new sentence %d (delimiter='%c')\n",
-count, current_sent, moved_delimiter ? moved_delimiter : '0');
+    SentenceNode *node = insert_parsed_sentence(file, after, text, words, word_total, delimiter, id);
+    free(words);
+    return node;
+}
 
-if (moved_delimiter != '\0' && i < word_count - 1) {
-printf("  → Moved words have delimiter, creating sentence %d for remaining insertions\n",
- current_sent + 1);
+// Replace sentences [position, position + from_count), which must read
+// exactly as the `from` side of a delta and not be under edit, with the
+// sentences of the `to` side. As in a merge, the first sentence keeps its
+// ID and the others get new ones. Caller must hold the file lock
+// exclusively. On ERR_OUT_OF_MEMORY the document may be half changed.
+static int swap_sentences(FileContent *file, int position,
+                          const DynamicBuffer *from, int from_count,
+                          const DynamicBuffer *to, int to_count, FileSplice *splice) {
+    if (position < 0 || position + from_count > file->sentence_count) {
+        return ERR_UNDO_FAILED;
+    }
 
-pthread_mutex_lock(&file->file_lock);
+    SentenceNode *prev = position > 0 ? sentence_index_at(file, position - 1) : NULL;
+    SentenceNode *first = prev ? prev->next : file->head;
 
-SentenceNode *continuation_sent = malloc(sizeof(SentenceNode));
-if (!continuation_sent) {
-pthread_mutex_unlock(&file->file_lock);
-pthread_mutex_unlock(&current->sentence_lock);
-for (int j = i + 1; j < word_count; j++) free(words[j]);
-return ERR_OUT_OF_MEMORY;
-}
+    // Verify before touching anything
+    DynamicBuffer scratch;
+    if (dynbuf_init(&scratch, 256) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    size_t offset = 0;
+    SentenceNode *node = first;
+    int result = ERR_SUCCESS;
+    for (int i = 0; i < from_count && result == ERR_SUCCESS; i++, node = node->next) {
+        const char *text;
+        uint32_t length;
+        scratch.length = 0;
+        if (!delta_next_sentence(from, &offset, &text, &length) ||
+            append_sentence_text(&scratch, node) != ERR_SUCCESS ||
+            scratch.length != length || memcmp(scratch.data, text, length) != 0) {
+            result = ERR_UNDO_FAILED;
+        } else if (node->editor) {
+            result = ERR_FILE_LOCKED;
+        }
+    }
+    dynbuf_free(&scratch);
+    if (result != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Cannot swap sentences at %d of '%s' (error=%d)",
+                    position, file->filename, result);
+        return result;
+    }
 
-continuation_sent->word_head = NULL;
-continuation_sent->word_tail = NULL;
-continuation_sent->word_count = 0;
-continuation_sent->delimiter = '\0';
-continuation_sent->is_locked = 0;
-continuation_sent->locked_by[0] = '\0';
-pthread_mutex_init(&continuation_sent->sentence_lock, NULL);
-
-continuation_sent->next = new_sent->next;
-new_sent->next = continuation_sent;
-file->sentence_count++;
-current_sent++;
-
-pthread_mutex_unlock(&file->file_lock);
-
-printf("  → Created sentence #%d for continuation\n", current_sent);
-
-active_sent = continuation_sent;
-last_inserted = NULL;
-} else {
-printf("  → Created sentence #%d\n", current_sent);
-active_sent = new_sent;
-if (new_sent->word_tail) {
-last_inserted = new_sent->word_tail;
-} else {
-last_inserted = NULL;
-}
-}
-} else {
-printf("  → Created sentence #%d\n", current_sent);
-active_sent = new_sent;
-last_inserted = NULL;
-}
-}
-// Case 3: Delimiter in middle of word
-else {
-char before_delim[MAX_SENTENCE_LENGTH];
-char after_delim[MAX_SENTENCE_LENGTH];
-
-strncpy(before_delim, word, delimiter_pos);
-before_delim[delimiter_pos] = '\0';
-
-strcpy(after_delim, word + delimiter_pos + 1);
-
-if (strlen(before_delim) > 0) {
-WordNode *new_word = create_word_node(before_delim);
-if (!new_word) {
-free(word);
-pthread_mutex_unlock(&current->sentence_lock);
-for (int j = i + 1; j < word_count; j++) free(words[j]);
-return ERR_OUT_OF_MEMORY;
-}
+    if (splice) {
+        file_splice_init(splice);
+        splice->offset = sentence_index_saved_offset(file, first);
+        if (splice_append_sentences(&splice->old_text, NULL, first, from_count) != ERR_SUCCESS) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
 
-if (!last_inserted) {
-new_word->next = active_sent->word_head;
-if (active_sent->word_head) {
-active_sent->word_head->prev = new_word;
-}
-active_sent->word_head = new_word;
-if (!active_sent->word_tail) {
-active_sent->word_tail = new_word;
-}
-} else {
-new_word->next = last_inserted->next;
-new_word->prev = last_inserted;
-if (last_inserted->next) {
-last_inserted->next->prev = new_word;
-} else {
-active_sent->word_tail = new_word;
-}
-last_inserted->next = new_word;
-}
+    uint32_t kept_id = from_count > 0 ? first->id : 0;
+    node = first;
+    for (int i = 0; i < from_count; i++) {
+        SentenceNode *next = node->next;
+        account_sentence(file, node, -1);
+        sentence_index_remove(file, prev, node);
+        free_sentence_node(&file->arena, node);
+        node = next;
+    }
 
-active_sent->word_count++;
-last_inserted = new_word;
-}
+    SentenceNode *before = prev;
+    offset = 0;
+    for (int i = 0; i < to_count; i++) {
+        const char *text;
+        uint32_t length;
+        if (!delta_next_sentence(to, &offset, &text, &length)) {
+            return ERR_UNDO_FAILED;
+        }
+        prev = insert_sentence_text(file, prev, text, length, i == 0 ? kept_id : 0);
+        if (!prev) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
 
-WordNode *remaining_words = NULL;
-char moved_delimiter = '\0';
+    if (splice) {
+        first = before ? before->next : file->head;
+        if (splice_append_sentences(&splice->new_text, &splice->new_ids, first, to_count) != ERR_SUCCESS) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
 
-if (last_inserted && last_inserted->next) {
-remaining_words = last_inserted->next;
-last_inserted->next = NULL;
-if (remaining_words) {
-remaining_words->prev = NULL;
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                "Swapped sentences at %d of '%s': %d -> %d sentence(s)",
+                position, file->filename, from_count, to_count);
+    return ERR_SUCCESS;
 }
 
-int remaining_count = 0;
-WordNode *tmp = remaining_words;
-while (tmp) {
-remaining_count++;
-tmp = tmp->next;
+// Undo one commit: check that its sentences still read exactly as the
+// commit left them and that no write session is editing one, then put the
+// old sentences back in their place
+int revert_sentence_delta(FileContent *file, const SentenceDelta *delta, FileSplice *splice) {
+    return swap_sentences(file, delta->position, &delta->new_text, delta->new_count,
+                          &delta->old_text, delta->old_count, splice);
 }
 
-if (original_delimiter != '\0') {
-moved_delimiter = original_delimiter;
-printf("  → Transferring original delimiter '%c' to moved words (mid-split)\n",
- moved_delimiter);
+// Redo a commit revert_sentence_delta() took back
+int reapply_sentence_delta(FileContent *file, const SentenceDelta *delta) {
+    return swap_sentences(file, delta->position, &delta->old_text, delta->old_count,
+                          &delta->new_text, delta->new_count, NULL);
 }
 
-active_sent->word_tail = last_inserted;
-active_sent->word_count -= remaining_count;
-
-printf("  → Extracted %d remaining words (mid-word split)\n", remaining_count);
-}
+// ============================================================================
+// MULTI-WORD SENTENCE MODIFICATION
+// ============================================================================
 
-active_sent->delimiter = delimiter;
-printf("  → Sentence %d ended with '%c' (mid-word split)\n", current_sent, delimiter);
+// Create an empty sentence right after `after` (under the file lock)
+static SentenceNode* split_new_sentence(FileContent *file, SentenceNode *after) {
+    pthread_mutex_lock(&file->file_lock);
 
-pthread_mutex_lock(&file->file_lock);
+    SentenceNode *node = create_empty_sentence(&file->arena);
+    if (node) {
+        sentence_index_insert_after(file, after, node);
+    }
 
-SentenceNode *new_sent = malloc(sizeof(SentenceNode));
-if (!new_sent) {
-pthread_mutex_unlock(&file->file_lock);
-pthread_mutex_unlock(&current->sentence_lock);
-free(word);
-for (int j = i + 1; j < word_count; j++) free(words[j]);
-return ERR_OUT_OF_MEMORY;
+    pthread_mutex_unlock(&file->file_lock);
+    return node;
 }
 
-new_sent->word_head = NULL;
-new_sent->word_tail = NULL;
-new_sent->word_count = 0;
-new_sent->delimiter = '\0';
-new_sent->is_locked = 0;
-new_sent->locked_by[0] = '\0';
-pthread_mutex_init(&new_sent->sentence_lock, NULL);
-
-new_sent->next = active_sent->next;
-active_sent->next = new_sent;
-file->sentence_count++;
-current_sent++;
-
-pthread_mutex_unlock(&file->file_lock);
-
-if (remaining_words) {
-new_sent->word_head = remaining_words;
-
-WordNode *tail = remaining_words;
-int count = 1;
-while (tail->next) {
-tail = tail->next;
-count++;
-}
-new_sent->word_tail = tail;
-new_sent->word_count = count;
+// Insert the whitespace-separated words of new_content at word_index of a
+// sentence. A word containing a delimiter ends the sentence there: the words
+// after the insertion point move to a new sentence (keeping the original
+// delimiter), and typing continues in the sentence that follows.
+int modify_sentence_multiword(FileContent *file, int sentence_num, int word_index,
+                              const char *new_content, const char *username, int *new_sentence_num) {
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                "Multiword modify: file='%s', sentence=%d, word_index=%d, content='%s', user='%s'",
+                file->filename, sentence_num, word_index, new_content, username);
 
-new_sent->delimiter = moved_delimiter;
+    *new_sentence_num = sentence_num;
 
-printf("  → Moved %d words to new sentence %d (delimiter='%c')\n",
-count, current_sent, moved_delimiter ? moved_delimiter : '0');
+    SentenceNode *current = sentence_index_at(file, sentence_num);
+    if (!current) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Sentence index %d out of range (count=%d)",
+                    sentence_num, file->sentence_count);
+        return ERR_SENTENCE_INDEX_OUT_OF_RANGE;
+    }
 
-if (moved_delimiter != '\0' && (i < word_count - 1 || strlen(after_delim) > 0)) {
-printf("  → Moved words have delimiter, creating sentence %d for continuation\n",
- current_sent + 1);
+    // Allow word_index == word_count for appending
+    if (word_index < 0 || word_index > current->word_count) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                    "Word index %d out of range (word_count=%d, max allowed=%d)",
+                    word_index, current->word_count, current->word_count);
+        return ERR_WORD_INDEX_OUT_OF_RANGE;
+    }
 
-pthread_mutex_lock(&file->file_lock);
+    // Save original delimiter before modifications
+    char original_delimiter = current->delimiter;
+    int current_sent = sentence_num;
+    SentenceNode *active_sent = current;
+    int insert_pos = word_index;
+    int words_inserted = 0;
+    int result = ERR_SUCCESS;
+
+    // Edits touch this sentence and the ones split off after it, up to
+    // last_touched; their stats are taken out now and put back at the end
+    SentenceNode *last_touched = current;
+    account_sentence(file, current, -1);
+
+    // Words go in at the cursor; each delimiter ends the active sentence.
+    // One token of lookahead tells whether typing continues after it.
+    TextTokenizer tokenizer;
+    TextToken token;
+    TextToken next_token;
+    text_tokenizer_init(&tokenizer, new_content, strlen(new_content), 1);
+    int have_token = text_tokenizer_next(&tokenizer, &token);
+
+    for (; have_token; token = next_token) {
+        have_token = text_tokenizer_next(&tokenizer, &next_token);
+
+        if (token.type == TEXT_TOKEN_WORD) {
+            result = insert_sentence_word(&file->arena, active_sent, insert_pos,
+                                          new_content + token.start, token.length);
+            if (result != ERR_SUCCESS) break;
+            insert_pos++;
+            words_inserted++;
+            continue;
+        }
 
-SentenceNode *continuation_sent = malloc(sizeof(SentenceNode));
-if (!continuation_sent) {
-pthread_mutex_unlock(&file->file_lock);
-pthread_mutex_unlock(&current->sentence_lock);
-free(word);
-for (int j = i + 1; j < word_count; j++) free(words[j]);
-return ERR_OUT_OF_MEMORY;
-}
+        char delimiter = new_content[token.start];
+        int more_input = have_token;
+        printf("  → Delimiter '%c' found at offset %zu\n", delimiter, token.start);
 
-continuation_sent->word_head = NULL;
-continuation_sent->word_tail = NULL;
-continuation_sent->word_count = 0;
-continuation_sent->delimiter = '\0';
-continuation_sent->is_locked = 0;
-continuation_sent->locked_by[0] = '\0';
-pthread_mutex_init(&continuation_sent->sentence_lock, NULL);
-
-continuation_sent->next = new_sent->next;
-new_sent->next = continuation_sent;
-file->sentence_count++;
-current_sent++;
-
-pthread_mutex_unlock(&file->file_lock);
-
-printf("  → Created sentence #%d for continuation\n", current_sent);
-
-active_sent = continuation_sent;
-last_inserted = NULL;
-} else {
-printf("  → Created sentence #%d for text after delimiter\n", current_sent);
-active_sent = new_sent;
-if (new_sent->word_tail) {
-last_inserted = new_sent->word_tail;
-} else {
-last_inserted = NULL;
-}
-}
-} else {
-printf("  → Created sentence #%d for text after delimiter\n", current_sent);
-active_sent = new_sent;
-last_inserted = NULL;
-}
+        // Words after the cursor are carried over to the next sentence
+        int has_remaining = insert_pos > 0 && insert_pos < active_sent->word_count;
 
-if (strlen(after_delim) > 0) {
-free(word);
-words[i] = strdup(after_delim);
-i--;
-continue;
-}
+        active_sent->delimiter = delimiter;
+        printf("  → Sentence %d ended with '%c'\n", current_sent, delimiter);
 
-free(word);
-}
-}
+        SentenceNode *new_sent = split_new_sentence(file, active_sent);
+        if (!new_sent) {
+            result = ERR_OUT_OF_MEMORY;
+            break;
+        }
+        last_touched = new_sent;
+        current_sent++;
+
+        if (has_remaining) {
+            int remaining_count = active_sent->word_count - insert_pos;
+            result = move_sentence_words(&file->arena, active_sent, insert_pos, new_sent);
+            if (result != ERR_SUCCESS) break;
+            new_sent->delimiter = original_delimiter;
+
+            printf("  → Moved %d words to new sentence %d (delimiter='%c')\n",
+                   remaining_count, current_sent, original_delimiter ? original_delimiter : '0');
+
+            if (original_delimiter != '\0' && more_input) {
+                // The moved words are a finished sentence; keep typing after them
+                active_sent = split_new_sentence(file, new_sent);
+                if (!active_sent) {
+                    result = ERR_OUT_OF_MEMORY;
+                    break;
+                }
+                last_touched = active_sent;
+                current_sent++;
+                insert_pos = 0;
+                printf("  → Created sentence #%d for continuation\n", current_sent);
+            } else {
+                active_sent = new_sent;
+                insert_pos = new_sent->word_count;
+                printf("  → Created sentence #%d\n", current_sent);
+            }
+        } else {
+            active_sent = new_sent;
+            insert_pos = 0;
+            printf("  → Created sentence #%d\n", current_sent);
+        }
+    }
 
-pthread_mutex_unlock(&current->sentence_lock);
-*new_sentence_num = current_sent;
+    for (SentenceNode *sent = current; ; sent = sent->next) {
+        account_sentence(file, sent, 1);
+        if (sent == last_touched) break;
+    }
+
+    if (result != ERR_SUCCESS) {
+        return result;
+    }
+    *new_sentence_num = current_sent;
 
-log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
-"Multiword modify completed: inserted %d words, final_sentence=%d",
-word_count, current_sent);
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                "Multiword modify completed: inserted %d words, final_sentence=%d",
+                words_inserted, current_sent);
 
-return ERR_SUCCESS;
+    return ERR_SUCCESS;
 }
 
 
@@ -1035,13 +1162,19 @@ char* get_sentence_string(SentenceNode *sentence) {
         return NULL;
     }
 
-    char *result = word_list_to_string(sentence->word_head, sentence->delimiter);
-    if (result) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
-                    "Generated sentence string: words=%d, delimiter='%c', length=%zu",
-                    sentence->word_count, sentence->delimiter ? sentence->delimiter : '0',
-                    strlen(result));
+    DynamicBuffer buffer;
+    if (dynbuf_init(&buffer, 64) != ERR_SUCCESS) {
+        return NULL;
+    }
+    if (append_sentence_text(&buffer, sentence) != ERR_SUCCESS) {
+        dynbuf_free(&buffer);
+        return NULL;
     }
 
-    return result;
-}
\ No newline at end of file
+    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL,
+                "Generated sentence string: words=%d, delimiter='%c', length=%zu",
+                sentence->word_count, sentence->delimiter ? sentence->delimiter : '0',
+                buffer.length);
+
+    return buffer.data;
+}
@@ -31,49 +31,33 @@ int create_storage_directory(const char *storage_dir) {
     return ERR_SUCCESS;
 }
 
-// Create backup before modification (for UNDO)
-int ss_backup_file(const char *storage_dir, const char *filename) {
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Creating backup: storage_dir='%s', filename='%s'", 
-               storage_dir, filename);
-    
+// Put a .backup left by an older server back in place of the file (UNDO
+// for files with no version history yet). The backup is consumed, so it
+// can't later be mistaken for the version before a newer write. Caller
+// holds the file lock exclusively.
+int ss_restore_backup(const char *storage_dir, const char *filename) {
     char *file_path = get_file_path(storage_dir, filename);
     if (!file_path) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to allocate file path for backup: %s", filename);
         return ERR_OUT_OF_MEMORY;
     }
     
-    // Check if source file exists
-    if (access(file_path, F_OK) != 0) {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Source file does not exist, skipping backup: %s", file_path);
-        free(file_path);
-        return ERR_SUCCESS;  // Not an error if file doesn't exist yet
-    }
+    char backup_path[MAX_PATH_LENGTH + 16];
+    snprintf(backup_path, sizeof(backup_path), "%s%s", file_path, BACKUP_SUFFIX);
     
-    char backup_path[MAX_PATH_LENGTH];
-    snprintf(backup_path, sizeof(backup_path), "%s.backup", file_path);
-    
-    // Copy file to backup
-    char cmd[BUFFER_SIZE];
-    snprintf(cmd, sizeof(cmd), "cp %s %s", file_path, backup_path);
-    
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Executing backup command: %s", cmd);
-    
-    int result = system(cmd);
-    
-    if (result == 0) {
+    int result = ERR_SUCCESS;
+    if (rename(backup_path, file_path) != 0) {
+        result = errno == ENOENT ? ERR_FILE_NOT_FOUND : ERR_FILE_WRITE_FAILED;
+    }
+    if (result == ERR_SUCCESS) {
         log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-                   "Backup created successfully: %s -> %s", file_path, backup_path);
+                   "Backup restored: %s -> %s", backup_path, file_path);
     } else {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Backup failed: %s (system result=%d)", file_path, result);
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Backup restore failed: %s (error=%d)", backup_path, result);
     }
     
     free(file_path);
-    return (result == 0) ? ERR_SUCCESS : ERR_FILE_WRITE_FAILED;
+    return result;
 }
 
 // Get file path
@@ -97,25 +81,30 @@ char* get_file_path(const char *storage_dir, const char *filename) {
     return path;
 }
 
-// Get metadata file path
-char* get_metadata_path(const char *storage_dir, const char *filename) {
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Generating metadata path: storage_dir='%s', filename='%s'", 
-               storage_dir, filename);
-    
-    char *path = malloc(MAX_PATH_LENGTH);
-    if (!path) {
-        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Failed to allocate memory for metadata path");
-        return NULL;
-    }
-    
-    snprintf(path, MAX_PATH_LENGTH, "%s/%s.meta", storage_dir, filename);
-    
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Generated metadata path: %s", path);
-    
-    return path;
+static int has_suffix(const char *name, const char *suffix) {
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return len > suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+static int has_prefix(const char *name, const char *prefix) {
+    return strncmp(name, prefix, strlen(prefix)) == 0;
+}
+
+// Names the server keeps its own files under, next to the users' files.
+// A user file may not take one, or the server would read, overwrite or
+// delete it as its own.
+int is_reserved_storage_name(const char *filename) {
+    return has_prefix(filename, METADATA_STORE_FILE) ||
+           has_suffix(filename, ".meta") ||
+           strstr(filename, ".meta.tmp.") != NULL ||
+           has_prefix(filename, WAL_SEGMENT_PREFIX) ||
+           has_prefix(filename, WAL_CHECKPOINT_FILE) ||
+           has_suffix(filename, CHECKPOINT_SUFFIX) ||
+           has_suffix(filename, SENTENCE_ID_SUFFIX) ||
+           has_suffix(filename, VERSION_LOG_SUFFIX) ||
+           has_suffix(filename, BACKUP_SUFFIX) ||
+           has_suffix(filename, PARTIAL_SUFFIX);
 }
 
 // Create new file
@@ -129,6 +118,11 @@ int ss_create_file(const char *storage_dir, const char *filename, const char *ow
                    "Invalid filename rejected: '%s'", filename);
         return ERR_INVALID_FILENAME;
     }
+    if (is_reserved_storage_name(filename)) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Reserved filename rejected: '%s'", filename);
+        return ERR_INVALID_FILENAME;
+    }
     
     char *file_path = get_file_path(storage_dir, filename);
     if (!file_path) {
@@ -163,7 +157,6 @@ int ss_create_file(const char *storage_dir, const char *filename, const char *ow
     FileMetadata metadata = {0};
     strncpy(metadata.filename, filename, MAX_FILENAME_LENGTH - 1);
     strncpy(metadata.owner, owner, MAX_USERNAME_LENGTH - 1);
-    strncpy(metadata.path, file_path, MAX_PATH_LENGTH - 1);
     metadata.size = 0;
     metadata.word_count = 0;
     metadata.char_count = 0;
@@ -173,13 +166,6 @@ int ss_create_file(const char *storage_dir, const char *filename, const char *ow
     metadata.accessed_time = metadata.created_time;
     metadata.is_folder = 0;
     
-    // Initialize access rights (owner has full access)
-    for (int i = 0; i < MAX_USERS; i++) {
-        metadata.access_rights[i] = ACCESS_NONE;
-    }
-    // For simplicity, owner is at index 0 - you'll need a proper user mapping
-    metadata.access_rights[0] = ACCESS_OWNER;
-    
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Metadata initialized for file: %s", filename);
     
@@ -206,13 +192,10 @@ int ss_delete_file(const char *storage_dir, const char *filename) {
                storage_dir, filename);
     
     char *file_path = get_file_path(storage_dir, filename);
-    char *meta_path = get_metadata_path(storage_dir, filename);
     
-    if (!file_path || !meta_path) {
+    if (!file_path) {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                    "Memory allocation failed for delete paths: filename='%s'", filename);
-        free(file_path);
-        free(meta_path);
         return ERR_OUT_OF_MEMORY;
     }
     
@@ -221,7 +204,6 @@ int ss_delete_file(const char *storage_dir, const char *filename) {
         log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                    "File not found for deletion: %s", file_path);
         free(file_path);
-        free(meta_path);
         return ERR_FILE_NOT_FOUND;
     }
     
@@ -231,33 +213,30 @@ int ss_delete_file(const char *storage_dir, const char *filename) {
                    "Failed to delete file: %s (errno=%d: %s)", 
                    file_path, errno, strerror(errno));
         free(file_path);
-        free(meta_path);
         return ERR_FILE_DELETE_FAILED;
     }
     
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                "Data file deleted: %s", file_path);
     
-    // Delete metadata file
-    if (unlink(meta_path) != 0) {
+    // Delete metadata
+    if (delete_metadata(storage_dir, filename) != ERR_SUCCESS) {
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Metadata file deletion failed or not found: %s (errno=%d)", 
-                   meta_path, errno);
-    } else {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Metadata file deleted: %s", meta_path);
+                   "Metadata deletion failed or not found: %s", filename);
     }
     
-    // Delete backup file if exists
-    char backup_path[MAX_PATH_LENGTH];
-    snprintf(backup_path, sizeof(backup_path), "%s.backup", file_path);
+    // Delete undo history, sentence IDs, and any legacy backup
+    version_log_delete(storage_dir, filename);
+    char backup_path[STORAGE_PATH_LENGTH];
+    get_sentence_id_path(backup_path, sizeof(backup_path), storage_dir, filename);
+    unlink(backup_path);
+    snprintf(backup_path, sizeof(backup_path), "%s%s", file_path, BACKUP_SUFFIX);
     if (unlink(backup_path) == 0) {
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Backup file deleted: %s", backup_path);
     }
     
     free(file_path);
-    free(meta_path);
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "File deleted successfully: %s", filename);
@@ -265,11 +244,15 @@ int ss_delete_file(const char *storage_dir, const char *filename) {
     return ERR_SUCCESS;
 }
 
-// Read entire file
-int ss_read_file(const char *storage_dir, const char *filename, char *buffer, size_t buffer_size) {
+// Read entire file into a newly allocated, NUL-terminated buffer sized to
+// the file. Caller frees *content.
+int ss_read_file(const char *storage_dir, const char *filename, char **content, size_t *length) {
     log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "Reading file: storage_dir='%s', filename='%s', buffer_size=%zu", 
-               storage_dir, filename, buffer_size);
+               "Reading file: storage_dir='%s', filename='%s'", 
+               storage_dir, filename);
+    
+    *content = NULL;
+    if (length) *length = 0;
     
     char *file_path = get_file_path(storage_dir, filename);
     if (!file_path) {
@@ -278,8 +261,8 @@ int ss_read_file(const char *storage_dir, const char *filename, char *buffer, si
         return ERR_OUT_OF_MEMORY;
     }
     
-    FILE *fp = fopen(file_path, "r");
-    if (!fp) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
         log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
                    "File not found for reading: %s (errno=%d: %s)", 
                    file_path, errno, strerror(errno));
@@ -287,60 +270,93 @@ int ss_read_file(const char *storage_dir, const char *filename, char *buffer, si
         return ERR_FILE_NOT_FOUND;
     }
     
-    // Get file size
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    
-    log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-               "File opened for reading: %s (size=%ld bytes)", file_path, file_size);
-    
-    size_t bytes_read = fread(buffer, 1, buffer_size - 1, fp);
-    buffer[bytes_read] = '\0';
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "fstat failed: %s (errno=%d)", file_path, errno);
+        close(fd);
+        free(file_path);
+        return ERR_FILE_READ_FAILED;
+    }
     
-    fclose(fp);
+    size_t file_size = (size_t)st.st_size;
+    char *buffer = malloc(file_size + 1);
+    if (!buffer) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                   "Failed to allocate %zu bytes to read: %s", file_size + 1, file_path);
+        close(fd);
+        free(file_path);
+        return ERR_OUT_OF_MEMORY;
+    }
     
-    if (bytes_read < (size_t)file_size && file_size >= (long)buffer_size) {
-        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                   "File truncated during read: %s (file_size=%ld, buffer_size=%zu, read=%zu)", 
-                   filename, file_size, buffer_size, bytes_read);
+    size_t bytes_read = 0;
+    while (bytes_read < file_size) {
+        ssize_t n = read(fd, buffer + bytes_read, file_size - bytes_read);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
+                       "Read failed: %s (errno=%d: %s)", file_path, errno, strerror(errno));
+            free(buffer);
+            close(fd);
+            free(file_path);
+            return ERR_FILE_READ_FAILED;
+        }
+        if (n == 0) break;  // File shrank underneath us
+        bytes_read += (size_t)n;
     }
+    buffer[bytes_read] = '\0';
+    close(fd);
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "File read successfully: filename='%s', bytes_read=%zu", 
                filename, bytes_read);
     
     free(file_path);
+    *content = buffer;
+    if (length) *length = bytes_read;
+    
+    // Update access time (in memory; flushed to the metadata log in batches)
+    touch_metadata(storage_dir, filename, time(NULL));
     
-    // Update access time
+    return ERR_SUCCESS;
+}
+
+// Record a file's new size, counts and modified time; length and stats
+// describe the text it now holds (or will once the log is checkpointed)
+void ss_update_file_metadata(const char *storage_dir, const char *filename, size_t length,
+                             const TextStats *stats) {
     FileMetadata metadata;
     if (load_metadata(storage_dir, filename, &metadata) == ERR_SUCCESS) {
-        metadata.accessed_time = time(NULL);
-        save_metadata(storage_dir, &metadata);
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Access time updated for: %s", filename);
+        size_t old_size = metadata.size;
+        
+        metadata.modified_time = time(NULL);
+        metadata.size = length;
+        update_file_stats(&metadata, length, stats);
+        
+        int meta_result = save_metadata(storage_dir, &metadata);
+        if (meta_result != ERR_SUCCESS) {
+            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                       "Failed to save metadata after write: %s", filename);
+        } else {
+            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
+                       "Metadata updated: %s (size: %zu->%zu, words=%d, sentences=%d)", 
+                       filename, old_size, metadata.size, 
+                       metadata.word_count, metadata.sentence_count);
+        }
     } else {
-        log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                   "Could not update access time (metadata not found): %s", filename);
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
+                   "Could not load metadata for update: %s", filename);
     }
-    
-    return ERR_SUCCESS;
 }
 
-int ss_write_file(const char *storage_dir, const char *filename, const char *content) {
-    size_t content_length = strlen(content);
-    
+// Write a file and refresh its metadata. stats are the content's counts
+// when the caller keeps them (save_file_content does); NULL scans content.
+int ss_write_file(const char *storage_dir, const char *filename, const char *content, size_t content_length,
+                  const TextStats *stats) {
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "Writing file: storage_dir='%s', filename='%s', content_length=%zu", 
                storage_dir, filename, content_length);
     
-    // Create backup first
-    int backup_result = ss_backup_file(storage_dir, filename);
-    if (backup_result != ERR_SUCCESS) {
-        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                   "Backup creation failed, continuing with write: %s", filename);
-    }
-    
     char *file_path = get_file_path(storage_dir, filename);
     if (!file_path) {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
@@ -348,23 +364,29 @@ int ss_write_file(const char *storage_dir, const char *filename, const char *con
         return ERR_OUT_OF_MEMORY;
     }
     
-    FILE *fp = fopen(file_path, "w");
+    // Write the new version beside the file and rename it into place, so
+    // readers never see a partial file
+    char partial_path[MAX_PATH_LENGTH + 16];
+    snprintf(partial_path, sizeof(partial_path), "%s%s", file_path, PARTIAL_SUFFIX);
+    
+    FILE *fp = fopen(partial_path, "w");
     if (!fp) {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
                    "Failed to open file for writing: %s (errno=%d: %s)", 
-                   file_path, errno, strerror(errno));
+                   partial_path, errno, strerror(errno));
         free(file_path);
         return ERR_FILE_WRITE_FAILED;
     }
     
-    size_t len = strlen(content);
+    size_t len = content_length;
     size_t written = fwrite(content, 1, len, fp);
-    fclose(fp);
+    int close_result = fclose(fp);
     
-    if (written != len) {
+    if (written != len || close_result != 0 || rename(partial_path, file_path) != 0) {
         log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, 
-                   "Incomplete write: %s (expected=%zu, written=%zu)", 
-                   file_path, len, written);
+                   "Incomplete write: %s (expected=%zu, written=%zu, errno=%d)", 
+                   file_path, len, written, errno);
+        unlink(partial_path);
         free(file_path);
         return ERR_FILE_WRITE_FAILED;
     }
@@ -374,35 +396,12 @@ int ss_write_file(const char *storage_dir, const char *filename, const char *con
     
     free(file_path);
     
-    // Update metadata
-    FileMetadata metadata;
-    if (load_metadata(storage_dir, filename, &metadata) == ERR_SUCCESS) {
-        time_t old_modified = metadata.modified_time;
-        size_t old_size = metadata.size;
-        
-        metadata.modified_time = time(NULL);
-        metadata.size = len;
-        
-        int stats_result = update_file_stats(storage_dir, &metadata);
-        if (stats_result != ERR_SUCCESS) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Failed to update file stats: %s", filename);
-        }
-        
-        int meta_result = save_metadata(storage_dir, &metadata);
-        if (meta_result != ERR_SUCCESS) {
-            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                       "Failed to save metadata after write: %s", filename);
-        } else {
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "Metadata updated: %s (size: %zu->%zu, words=%d, sentences=%d)", 
-                       filename, old_size, metadata.size, 
-                       metadata.word_count, metadata.sentence_count);
-        }
-    } else {
-        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL, 
-                   "Could not load metadata for update: %s", filename);
+    TextStats scanned;
+    if (!stats) {
+        scanned = text_stats(content, len);
+        stats = &scanned;
     }
+    ss_update_file_metadata(storage_dir, filename, len, stats);
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
                "File write operation completed: filename='%s', size=%zu", 
@@ -427,8 +426,7 @@ int list_files(const char *storage_dir, char files[][MAX_FILENAME_LENGTH], int m
     
     struct dirent *entry;
     int count = 0;
-    int skipped_meta = 0;
-    int skipped_backup = 0;
+    int skipped_server = 0;
     int skipped_hidden = 0;
     
     while ((entry = readdir(dir)) != NULL && count < max_files) {
@@ -438,23 +436,24 @@ int list_files(const char *storage_dir, char files[][MAX_FILENAME_LENGTH], int m
             continue;
         }
         
-        // Skip .meta files
-        size_t len = strlen(entry->d_name);
-        if (len > 5 && strcmp(entry->d_name + len - 5, ".meta") == 0) {
-            skipped_meta++;
+        // Skip the server's own files: the metadata store, the write-ahead
+        // log, .meta files of older servers, backups, undo histories,
+        // sentence IDs, and temp files of an interrupted write or checkpoint
+        if (is_reserved_storage_name(entry->d_name)) {
+            skipped_server++;
             log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "Skipping metadata file: %s", entry->d_name);
+                       "Skipping server file: %s", entry->d_name);
             continue;
         }
-        if (len > 7 && strcmp(entry->d_name + len - 7, ".backup") == 0) {
-            skipped_backup++;
-            log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
-                       "Skipping backup file: %s", entry->d_name);
+        
+        // A name that doesn't fit couldn't be asked for by clients
+        size_t name_length = strlen(entry->d_name);
+        if (name_length >= MAX_FILENAME_LENGTH) {
+            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                       "Skipping file with too long a name: %s", entry->d_name);
             continue;
         }
-        
-        strncpy(files[count], entry->d_name, MAX_FILENAME_LENGTH - 1);
-        files[count][MAX_FILENAME_LENGTH - 1] = '\0';
+        memcpy(files[count], entry->d_name, name_length + 1);
         
         log_message(log_file, LOG_LEVEL_DEBUG, NULL, 0, NULL, 
                    "Listed file [%d]: %s", count, entry->d_name);
@@ -464,8 +463,8 @@ int list_files(const char *storage_dir, char files[][MAX_FILENAME_LENGTH], int m
     closedir(dir);
     
     log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL, 
-               "Directory listing complete: %d files found (skipped: %d meta, %d backup, %d hidden)", 
-               count, skipped_meta, skipped_backup, skipped_hidden);
+               "Directory listing complete: %d files found (skipped: %d server, %d hidden)", 
+               count, skipped_server, skipped_hidden);
     
     return count;
 }
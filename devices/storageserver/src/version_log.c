@@ -0,0 +1,336 @@
+#include "../include/storageserver.h"
+
+// ============================================================================
+// VERSION LOG
+// ============================================================================
+// A history is a sequence of VersionRecords, oldest first, each ending in
+// its own length so UNDO reads the newest ones from the end without
+// scanning. The live document holds its history in memory; every commit
+// and undo changes it under the commit gate, with the file lock held
+// exclusively, and logs the change in its write-ahead log record. A
+// checkpoint writes the history out as <file>.versions next to the text
+// it belongs to, and recovery replays the logged changes onto it.
+
+// FNV-1a
+static uint32_t checksum_bytes(uint32_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t record_checksum(const VersionRecord *header, const char *old_text, const char *new_text) {
+    VersionRecord copy = *header;
+    copy.checksum = 0;
+
+    uint32_t hash = checksum_bytes(2166136261u, &copy, sizeof(copy));
+    hash = checksum_bytes(hash, old_text, header->old_bytes);
+    return checksum_bytes(hash, new_text, header->new_bytes);
+}
+
+static void get_version_log_path(char *out, size_t size, const char *storage_dir, const char *filename) {
+    snprintf(out, size, "%s/%s%s", storage_dir, filename, VERSION_LOG_SUFFIX);
+}
+
+static size_t record_length(const VersionRecord *header) {
+    return sizeof(VersionRecord) + header->old_bytes + header->new_bytes + sizeof(uint32_t);
+}
+
+// Read the header of the record ending at `end` of a history. Returns 0
+// when there is none or it is damaged.
+static int record_before(const DynamicBuffer *history, size_t end, VersionRecord *header, size_t *start) {
+    uint32_t total;
+    if (end < sizeof(VersionRecord) + sizeof(uint32_t)) {
+        return 0;
+    }
+    memcpy(&total, history->data + end - sizeof(total), sizeof(total));
+    if (total < sizeof(VersionRecord) + sizeof(uint32_t) || total > end) {
+        return 0;
+    }
+
+    *start = end - total;
+    memcpy(header, history->data + *start, sizeof(VersionRecord));
+    return header->magic == VERSION_LOG_MAGIC && header->format == VERSION_LOG_FORMAT &&
+           record_length(header) == total;
+}
+
+// Load a record's sentence texts into delta and check its checksum
+static int read_record_delta(const DynamicBuffer *history, size_t start, const VersionRecord *header,
+                             SentenceDelta *delta) {
+    sentence_delta_init(delta);
+
+    const char *old_text = history->data + start + sizeof(VersionRecord);
+    const char *new_text = old_text + header->old_bytes;
+    if (record_checksum(header, old_text, new_text) != header->checksum) {
+        return ERR_FILE_CORRUPTED;
+    }
+    if (dynbuf_init(&delta->old_text, header->old_bytes + 1) != ERR_SUCCESS ||
+        dynbuf_init(&delta->new_text, header->new_bytes + 1) != ERR_SUCCESS ||
+        dynbuf_append(&delta->old_text, old_text, header->old_bytes) != ERR_SUCCESS ||
+        dynbuf_append(&delta->new_text, new_text, header->new_bytes) != ERR_SUCCESS) {
+        sentence_delta_free(delta);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    delta->position = (int)header->position;
+    delta->old_count = (int)header->old_count;
+    delta->new_count = (int)header->new_count;
+    return ERR_SUCCESS;
+}
+
+// Drop the records before `start`
+static void drop_oldest(DynamicBuffer *history, size_t start) {
+    memmove(history->data, history->data + start, history->length - start);
+    history->length -= start;
+}
+
+// ============================================================================
+// READING AND CHANGING A HISTORY
+// ============================================================================
+
+// Read <file>.versions into history, empty if there is none. Only the
+// newest records that read back whole are kept. Fails only when memory
+// runs out.
+int version_log_read(const char *storage_dir, const char *filename, DynamicBuffer *history) {
+    char path[STORAGE_PATH_LENGTH];
+    get_version_log_path(path, sizeof(path), storage_dir, filename);
+    memset(history, 0, sizeof(DynamicBuffer));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ERR_SUCCESS;
+    }
+
+    struct stat st;
+    size_t size = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    if (dynbuf_init(history, size + 1) != ERR_SUCCESS) {
+        close(fd);
+        return ERR_OUT_OF_MEMORY;
+    }
+    while (history->length < size) {
+        ssize_t n = pread(fd, history->data + history->length, size - history->length, (off_t)history->length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        history->length += (size_t)n;
+    }
+    close(fd);
+
+    size_t keep_from = history->length;
+    int kept = 0;
+    VersionRecord header;
+    size_t start;
+    while (record_before(history, keep_from, &header, &start)) {
+        keep_from = start;
+        kept++;
+    }
+    if (keep_from > 0) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Undo history of '%s' is damaged; keeping its newest %d record(s)", filename, kept);
+        drop_oldest(history, keep_from);
+    }
+    return ERR_SUCCESS;
+}
+
+// Read the live document's history if that hasn't happened yet. Caller
+// holds the file lock exclusively.
+int version_log_load(const char *storage_dir, FileContent *file) {
+    if (file->history_loaded) {
+        return ERR_SUCCESS;
+    }
+    int result = version_log_read(storage_dir, file->filename, &file->history);
+    if (result == ERR_SUCCESS) {
+        file->history_loaded = 1;
+    }
+    return result;
+}
+
+// Have the splice logging a merge add its reverse delta to the history,
+// or empty the history if the merge couldn't describe one. Call with the
+// history loaded.
+int version_log_record(const char *storage_dir, const FileContent *file, const SentenceDelta *delta,
+                       FileSplice *splice) {
+    if (delta->position < 0) {
+        splice->history_reset = 1;
+        return ERR_SUCCESS;
+    }
+
+    // Sequence numbers continue from the newest record
+    uint64_t sequence = 1;
+    VersionRecord last;
+    size_t start;
+    if (record_before(&file->history, file->history.length, &last, &start)) {
+        sequence = last.sequence + 1;
+    } else {
+        // A backup left by an older server predates this commit; UNDO goes
+        // through the history from here on
+        char backup_path[STORAGE_PATH_LENGTH];
+        snprintf(backup_path, sizeof(backup_path), "%s/%s%s", storage_dir, file->filename, BACKUP_SUFFIX);
+        unlink(backup_path);
+    }
+
+    VersionRecord header;
+    memset(&header, 0, sizeof(header));
+    header.magic = VERSION_LOG_MAGIC;
+    header.format = VERSION_LOG_FORMAT;
+    header.sequence = sequence;
+    header.commit_time = time(NULL);
+    header.position = (uint32_t)delta->position;
+    header.old_count = (uint32_t)delta->old_count;
+    header.new_count = (uint32_t)delta->new_count;
+    header.old_bytes = (uint32_t)delta->old_text.length;
+    header.new_bytes = (uint32_t)delta->new_text.length;
+    header.checksum = record_checksum(&header, delta->old_text.data, delta->new_text.data);
+
+    uint32_t total = (uint32_t)record_length(&header);
+    DynamicBuffer *record = &splice->history_record;
+    if (dynbuf_init(record, total) != ERR_SUCCESS ||
+        dynbuf_append(record, (const char *)&header, sizeof(header)) != ERR_SUCCESS ||
+        dynbuf_append(record, delta->old_text.data, header.old_bytes) != ERR_SUCCESS ||
+        dynbuf_append(record, delta->new_text.data, header.new_bytes) != ERR_SUCCESS ||
+        dynbuf_append(record, (const char *)&total, sizeof(total)) != ERR_SUCCESS) {
+        dynbuf_free(record);
+        return ERR_OUT_OF_MEMORY;
+    }
+    return ERR_SUCCESS;
+}
+
+// Make a logged change to a history: empty it if reset, drop the newest
+// `undo` records, then add `record` and trim. Logging and replay both go
+// through here, so the history a checkpoint writes is the one recovery
+// would rebuild. Can only fail to grow the history.
+int version_log_apply(DynamicBuffer *history, const char *record, size_t length, int undo, int reset) {
+    if (reset) {
+        history->length = 0;
+    }
+
+    VersionRecord header;
+    size_t start;
+    for (int i = 0; i < undo && record_before(history, history->length, &header, &start); i++) {
+        history->length = start;
+    }
+
+    if (length > 0 && dynbuf_append(history, record, length) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    // Trimming waits for some slack so it doesn't move the history on
+    // every commit
+    size_t keep_from = history->length;
+    int kept = 0;
+    while (kept <= VERSION_LOG_RETAIN + VERSION_LOG_COMPACT_SLACK &&
+           record_before(history, keep_from, &header, &start)) {
+        keep_from = start;
+        kept++;
+    }
+    if (kept > VERSION_LOG_RETAIN + VERSION_LOG_COMPACT_SLACK) {
+        keep_from = history->length;
+        for (int i = 0; i < VERSION_LOG_RETAIN && record_before(history, keep_from, &header, &start); i++) {
+            keep_from = start;
+        }
+        drop_oldest(history, keep_from);
+    }
+    return ERR_SUCCESS;
+}
+
+// ============================================================================
+// UNDO
+// ============================================================================
+
+// Step the live document back `levels` commits and log the change, each
+// level's record dropping its entry from the history. If any level can't
+// be reverted the ones already reverted are redone and the history is left
+// alone; if logging fails partway only the levels logged stay undone.
+// Caller holds the file lock exclusively; returns the log position to wait
+// for in *lsn.
+int undo_file_versions(StorageServerConfig *ctx, FileContent *live, int levels, uint64_t *lsn) {
+    *lsn = 0;
+
+    // More than a log ever keeps can't succeed; don't read it to find out
+    if (levels > VERSION_LOG_RETAIN + VERSION_LOG_COMPACT_SLACK) {
+        return ERR_NOTHING_TO_UNDO;
+    }
+
+    int result = version_log_load(ctx->storage_dir, live);
+    if (result != ERR_SUCCESS) {
+        return result;
+    }
+
+    SentenceDelta *deltas = calloc((size_t)levels, sizeof(SentenceDelta));
+    FileSplice *splices = calloc((size_t)levels, sizeof(FileSplice));
+    if (!deltas || !splices) {
+        free(deltas);
+        free(splices);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    size_t end = live->history.length;
+    int loaded = 0;
+    int reverted = 0;
+
+    while (loaded < levels) {
+        VersionRecord header;
+        size_t start;
+        if (!record_before(&live->history, end, &header, &start)) {
+            result = ERR_NOTHING_TO_UNDO;
+            break;
+        }
+        result = read_record_delta(&live->history, start, &header, &deltas[loaded]);
+        if (result != ERR_SUCCESS) break;
+        end = start;
+        loaded++;
+    }
+
+    wal_begin_commit(ctx);
+    while (result == ERR_SUCCESS && reverted < levels) {
+        result = revert_sentence_delta(live, &deltas[reverted], &splices[reverted]);
+        if (result == ERR_SUCCESS) {
+            splices[reverted].history_undo = 1;
+            reverted++;
+        }
+    }
+
+    // Levels both reverted and logged; the rest are put back, newest last
+    int logged = 0;
+    while (result == ERR_SUCCESS && logged < reverted) {
+        result = wal_log_splice(ctx, live, &splices[logged], lsn);
+        if (result == ERR_SUCCESS) logged++;
+    }
+    if (result != ERR_SUCCESS) {
+        // A revert that ran out of memory may have stopped halfway
+        int redone = reverted == levels || result != ERR_OUT_OF_MEMORY;
+        while (redone && reverted > logged) {
+            reverted--;
+            redone = reapply_sentence_delta(live, &deltas[reverted]) == ERR_SUCCESS;
+        }
+        if (!redone) {
+            wal_mark_failed(ctx, live->filename);
+        }
+    }
+    wal_end_commit(ctx);
+
+    if (logged > 0) {
+        size_t saved_length;
+        TextStats stats = document_text_stats(live, &saved_length);
+        ss_update_file_metadata(ctx->storage_dir, live->filename, saved_length, &stats);
+        content_cache_update_usage(ctx, live);
+    }
+
+    for (int i = 0; i < levels; i++) {
+        sentence_delta_free(&deltas[i]);
+        file_splice_free(&splices[i]);
+    }
+    free(deltas);
+    free(splices);
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Undo of '%s': %d/%d level(s), result=%d",
+               live->filename, logged, levels, result);
+    return result;
+}
+
+int version_log_delete(const char *storage_dir, const char *filename) {
+    char path[STORAGE_PATH_LENGTH];
+    get_version_log_path(path, sizeof(path), storage_dir, filename);
+    return (unlink(path) == 0 || errno == ENOENT) ? ERR_SUCCESS : ERR_FILE_DELETE_FAILED;
+}
@@ -0,0 +1,1320 @@
+#define _GNU_SOURCE     // pthread_rwlockattr_setkind_np for the commit gate
+#include "../include/storageserver.h"
+#include <dirent.h>
+
+// Document snapshot taken by a checkpoint under the commit gate
+typedef struct {
+    FileContent *file;
+    DynamicBuffer text;
+    DynamicBuffer ids;          // IDs of the saved sentences
+    uint32_t next_id;
+    DynamicBuffer history;
+    int has_history;            // Else .versions is left as it is
+    int renamed;
+} CheckpointFile;
+
+// Text of one file rebuilt from its base and the log at startup
+typedef struct RecoveredFile {
+    char filename[MAX_FILENAME_LENGTH];
+    DynamicBuffer text;         // Saved text with a trailing newline
+    uint32_t *ids;              // ID of each line of text, 0 if unknown
+    size_t id_count;
+    uint32_t next_id;
+    DynamicBuffer history;      // Undo history in the .versions format
+    int applied;                // Records applied
+    int stopped;                // A record didn't match; ignore the rest
+    struct RecoveredFile *next;
+} RecoveredFile;
+
+// ============================================================================
+// RECORDS AND FILES
+// ============================================================================
+
+// FNV-1a
+static uint32_t checksum_bytes(uint32_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t record_checksum(const WalRecord *record, const char *name, const char *old_text,
+                                const char *new_text, const void *ids, const char *history) {
+    WalRecord copy = *record;
+    copy.checksum = 0;
+
+    uint32_t hash = checksum_bytes(2166136261u, &copy, sizeof(copy));
+    hash = checksum_bytes(hash, name, record->name_length);
+    hash = checksum_bytes(hash, old_text, record->old_length);
+    hash = checksum_bytes(hash, new_text, record->new_length);
+    hash = checksum_bytes(hash, ids, (size_t)record->id_count * sizeof(uint32_t));
+    return checksum_bytes(hash, history, record->history_length);
+}
+
+// Newlines in data[0, length)
+static size_t count_lines(const char *data, size_t length) {
+    size_t lines = 0;
+    const char *end = data + length;
+    while (data < end && (data = memchr(data, '\n', (size_t)(end - data))) != NULL) {
+        lines++;
+        data++;
+    }
+    return lines;
+}
+
+static void get_segment_path(char *path, size_t size, const char *storage_dir, uint64_t generation) {
+    snprintf(path, size, "%s/%s%llu", storage_dir, WAL_SEGMENT_PREFIX, (unsigned long long)generation);
+}
+
+static void get_checkpoint_path(char *path, size_t size, const char *storage_dir, const char *filename) {
+    snprintf(path, size, "%s/%s%s", storage_dir, filename, CHECKPOINT_SUFFIX);
+}
+
+static void get_id_checkpoint_path(char *path, size_t size, const char *storage_dir, const char *filename) {
+    snprintf(path, size, "%s/%s%s%s", storage_dir, filename, SENTENCE_ID_SUFFIX, CHECKPOINT_SUFFIX);
+}
+
+static void get_history_checkpoint_path(char *path, size_t size, const char *storage_dir, const char *filename) {
+    snprintf(path, size, "%s/%s%s%s", storage_dir, filename, VERSION_LOG_SUFFIX, CHECKPOINT_SUFFIX);
+}
+
+// Make renames and unlinks in the storage directory durable
+static int sync_directory(const char *storage_dir) {
+    int fd = open(storage_dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return -1;
+    int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+static int compare_generations(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Generations of the log segments in the directory, ascending. Returns
+// NULL with *count = 0 when there are none.
+static uint64_t* list_segments(const char *storage_dir, int *count) {
+    *count = 0;
+    DIR *dir = opendir(storage_dir);
+    if (!dir) return NULL;
+
+    uint64_t *generations = NULL;
+    int capacity = 0;
+    size_t prefix_length = strlen(WAL_SEGMENT_PREFIX);
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, WAL_SEGMENT_PREFIX, prefix_length) != 0) continue;
+
+        char *end;
+        unsigned long long generation = strtoull(entry->d_name + prefix_length, &end, 10);
+        if (end == entry->d_name + prefix_length || *end != '\0') continue;
+
+        if (*count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 8;
+            uint64_t *grown = realloc(generations, (size_t)new_capacity * sizeof(uint64_t));
+            if (!grown) break;
+            generations = grown;
+            capacity = new_capacity;
+        }
+        generations[(*count)++] = generation;
+    }
+    closedir(dir);
+
+    if (*count > 1) {
+        qsort(generations, (size_t)*count, sizeof(uint64_t), compare_generations);
+    }
+    return generations;
+}
+
+static void delete_segments_through(const char *storage_dir, uint64_t generation) {
+    int count;
+    uint64_t *generations = list_segments(storage_dir, &count);
+
+    for (int i = 0; i < count && generations[i] <= generation; i++) {
+        char path[MAX_PATH_LENGTH + 32];
+        get_segment_path(path, sizeof(path), storage_dir, generations[i]);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                       "Failed to delete log segment %s (errno=%d)", path, errno);
+        }
+    }
+    free(generations);
+}
+
+// Read a whole file into a malloc'd buffer
+static int read_whole_file(const char *path, char **data, size_t *length) {
+    *data = NULL;
+    *length = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return ERR_FILE_OPEN_FAILED;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ERR_FILE_READ_FAILED;
+    }
+
+    char *buffer = malloc((size_t)st.st_size + 1);
+    if (!buffer) {
+        close(fd);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    size_t total = 0;
+    while (total < (size_t)st.st_size) {
+        ssize_t n = pread(fd, buffer + total, (size_t)st.st_size - total, (off_t)total);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += (size_t)n;
+    }
+    close(fd);
+
+    buffer[total] = '\0';
+    *data = buffer;
+    *length = total;
+    return ERR_SUCCESS;
+}
+
+static int write_synced_file(const char *path, const char *data, size_t length) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Failed to create %s (errno=%d: %s)", path, errno, strerror(errno));
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    int result = ERR_SUCCESS;
+    if (write_all(fd, data, length) != 0 || fsync(fd) != 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Failed to write %s (errno=%d: %s)", path, errno, strerror(errno));
+        result = ERR_FILE_WRITE_FAILED;
+    }
+    close(fd);
+
+    if (result != ERR_SUCCESS) unlink(path);
+    return result;
+}
+
+// Write <file>.ckpt with the text, <file>.sids.ckpt with the IDs of its
+// lines and <file>.versions.ckpt with its undo history if given, and sync
+// them
+static int write_checkpoint_file(const char *storage_dir, const char *filename,
+                                 const char *text, size_t length,
+                                 uint32_t next_id, const uint32_t *ids, size_t id_count,
+                                 const DynamicBuffer *history) {
+    char path[STORAGE_PATH_LENGTH];
+    DynamicBuffer image;
+    if (dynbuf_init(&image, sizeof(SentenceIdHeader) + id_count * sizeof(uint32_t) + 1) != ERR_SUCCESS ||
+        encode_sentence_ids(next_id, ids, (uint32_t)id_count, text, length, &image) != ERR_SUCCESS) {
+        dynbuf_free(&image);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    get_id_checkpoint_path(path, sizeof(path), storage_dir, filename);
+    int result = write_synced_file(path, image.data, image.length);
+    dynbuf_free(&image);
+
+    if (result == ERR_SUCCESS && history) {
+        get_history_checkpoint_path(path, sizeof(path), storage_dir, filename);
+        result = write_synced_file(path, history->data ? history->data : "", history->length);
+    }
+    if (result == ERR_SUCCESS) {
+        get_checkpoint_path(path, sizeof(path), storage_dir, filename);
+        result = write_synced_file(path, text, length);
+    }
+    return result;
+}
+
+// Rename the listed .ckpt files over their files, then delete the log
+// segments they make redundant and the manifest
+static void install_checkpoint_files(const char *storage_dir, uint64_t generation,
+                                     const char **filenames, int count) {
+    for (int i = 0; i < count; i++) {
+        char from[STORAGE_PATH_LENGTH];
+        char to[STORAGE_PATH_LENGTH];
+        get_checkpoint_path(from, sizeof(from), storage_dir, filenames[i]);
+        snprintf(to, sizeof(to), "%s/%s", storage_dir, filenames[i]);
+
+        // Already renamed if an earlier attempt got this far
+        if (rename(from, to) != 0 && errno != ENOENT) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Failed to install checkpoint of '%s' (errno=%d)", filenames[i], errno);
+        }
+
+        get_id_checkpoint_path(from, sizeof(from), storage_dir, filenames[i]);
+        get_sentence_id_path(to, sizeof(to), storage_dir, filenames[i]);
+        if (rename(from, to) != 0 && errno != ENOENT) {
+            log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                       "Failed to install sentence IDs of '%s' (errno=%d)", filenames[i], errno);
+        }
+
+        get_history_checkpoint_path(from, sizeof(from), storage_dir, filenames[i]);
+        snprintf(to, sizeof(to), "%s/%s%s", storage_dir, filenames[i], VERSION_LOG_SUFFIX);
+        if (rename(from, to) != 0 && errno != ENOENT) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Failed to install undo history of '%s' (errno=%d)", filenames[i], errno);
+        }
+    }
+    sync_directory(storage_dir);
+
+    delete_segments_through(storage_dir, generation);
+
+    char manifest_path[MAX_PATH_LENGTH + 32];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", storage_dir, WAL_CHECKPOINT_FILE);
+    unlink(manifest_path);
+    sync_directory(storage_dir);
+}
+
+// Record which .ckpt files replace segments up to `generation`, then
+// install them. Once the manifest is on disk the checkpoint is committed:
+// startup finishes the renames if the server dies halfway.
+static int commit_checkpoint(const char *storage_dir, uint64_t generation,
+                             const char **filenames, int count) {
+    char manifest_path[MAX_PATH_LENGTH + 32];
+    char tmp_path[MAX_PATH_LENGTH + 40];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", storage_dir, WAL_CHECKPOINT_FILE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", manifest_path);
+
+    DynamicBuffer manifest;
+    if (dynbuf_init(&manifest, 256) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    char line[64];
+    snprintf(line, sizeof(line), "%llu\n", (unsigned long long)generation);
+    int result = dynbuf_append_str(&manifest, line);
+    for (int i = 0; i < count && result == ERR_SUCCESS; i++) {
+        result = dynbuf_append_str(&manifest, filenames[i]);
+        if (result == ERR_SUCCESS) result = dynbuf_append_char(&manifest, '\n');
+    }
+
+    if (result == ERR_SUCCESS) {
+        int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            result = ERR_FILE_OPEN_FAILED;
+        } else {
+            if (write_all(fd, manifest.data, manifest.length) != 0 || fsync(fd) != 0) {
+                result = ERR_FILE_WRITE_FAILED;
+            }
+            close(fd);
+        }
+    }
+    dynbuf_free(&manifest);
+
+    if (result == ERR_SUCCESS && (rename(tmp_path, manifest_path) != 0 || sync_directory(storage_dir) != 0)) {
+        result = ERR_FILE_WRITE_FAILED;
+    }
+    if (result != ERR_SUCCESS) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Failed to write checkpoint manifest (errno=%d)", errno);
+        unlink(tmp_path);
+        return result;
+    }
+
+    install_checkpoint_files(storage_dir, generation, filenames, count);
+    return ERR_SUCCESS;
+}
+
+// ============================================================================
+// APPENDING AND FLUSHING
+// ============================================================================
+
+// Write a batch of records to the segment; fdatasync too unless mode is none
+static int write_batch(WriteAheadLog *wal, int fd, const char *data, size_t length) {
+    if (write_all(fd, data, length) != 0) return -1;
+    if (wal->mode != WAL_MODE_NONE && fdatasync(fd) != 0) return -1;
+    return 0;
+}
+
+// Notify waiters whose records are now durable, or all of them if the log
+// failed (log locked)
+static void notify_waiters_locked(WriteAheadLog *wal) {
+    WalWaiter **link = &wal->waiters;
+    while (*link) {
+        WalWaiter *waiter = *link;
+        if (waiter->lsn <= wal->durable_lsn || wal->failed) {
+            *link = waiter->next;
+            waiter->next = NULL;
+            waiter->queued = 0;
+            waiter->notify(waiter->arg);
+        } else {
+            link = &waiter->next;
+        }
+    }
+}
+
+static void fail_locked(WriteAheadLog *wal, const char *what) {
+    if (!wal->failed) {
+        log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL,
+                   "Write-ahead log %s failed (errno=%d); refusing further commits until restart",
+                   what, errno);
+    }
+    wal->failed = 1;
+    pthread_cond_broadcast(&wal->flushed);
+    notify_waiters_locked(wal);
+}
+
+// Add a record to the pending batch and hand out its LSN. In sync mode
+// the batch is written and synced before returning. Refused once the log
+// is closing: nothing would write the record out.
+static int append_record(WriteAheadLog *wal, WalRecord *record, const char *name, const char *old_text,
+                         const char *new_text, const void *ids, const char *history, uint64_t *lsn) {
+    pthread_mutex_lock(&wal->lock);
+    if (wal->failed || wal->closed || wal->fd < 0) {
+        pthread_mutex_unlock(&wal->lock);
+        return ERR_FILE_WRITE_FAILED;
+    }
+
+    record->lsn = wal->last_lsn + 1;
+    record->checksum = record_checksum(record, name, old_text, new_text, ids, history);
+
+    size_t mark = wal->pending.length;
+    if (dynbuf_append(&wal->pending, (const char*)record, sizeof(*record)) != ERR_SUCCESS ||
+        dynbuf_append(&wal->pending, name, record->name_length) != ERR_SUCCESS ||
+        dynbuf_append(&wal->pending, old_text, record->old_length) != ERR_SUCCESS ||
+        dynbuf_append(&wal->pending, new_text, record->new_length) != ERR_SUCCESS ||
+        dynbuf_append(&wal->pending, ids, (size_t)record->id_count * sizeof(uint32_t)) != ERR_SUCCESS ||
+        dynbuf_append(&wal->pending, history, record->history_length) != ERR_SUCCESS) {
+        wal->pending.length = mark;
+        pthread_mutex_unlock(&wal->lock);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    wal->last_lsn = record->lsn;
+    if (record->type == WAL_RECORD_SPLICE) wal->commits++;
+    size_t before = wal->segment_bytes;
+    wal->segment_bytes += wal->pending.length - mark;
+    *lsn = record->lsn;
+    if (before < WAL_CHECKPOINT_BYTES && wal->segment_bytes >= WAL_CHECKPOINT_BYTES) {
+        pthread_cond_signal(&wal->checkpoint_due);
+    }
+
+    int result = ERR_SUCCESS;
+    if (wal->mode == WAL_MODE_SYNC) {
+        if (write_batch(wal, wal->fd, wal->pending.data, wal->pending.length) != 0) {
+            fail_locked(wal, "sync");
+            result = ERR_FILE_WRITE_FAILED;
+        } else {
+            wal->written_lsn = wal->durable_lsn = wal->last_lsn;
+            wal->syncs++;
+        }
+        wal->pending.length = 0;
+    }
+    pthread_cond_signal(&wal->work);
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+// Writes out whatever accumulated while the previous batch was being
+// synced, so all commits that arrived during one fdatasync share the next.
+// Once closed, exits when nothing is left to write.
+static void* wal_flusher(void *arg) {
+    WriteAheadLog *wal = (WriteAheadLog*)arg;
+    DynamicBuffer batch = { NULL, 0, 0 };
+
+    pthread_mutex_lock(&wal->lock);
+    while (1) {
+        while ((wal->pending.length == 0 || wal->failed) && !wal->closed) {
+            pthread_cond_wait(&wal->work, &wal->lock);
+        }
+        if (wal->pending.length == 0 || wal->failed) {
+            break;
+        }
+
+        // Swap buffers so commits keep appending while this batch is written
+        DynamicBuffer swap = wal->pending;
+        wal->pending = batch;
+        wal->pending.length = 0;
+        batch = swap;
+
+        uint64_t batch_lsn = wal->last_lsn;
+        int fd = wal->fd;
+        wal->flushing = 1;
+        pthread_mutex_unlock(&wal->lock);
+
+        int written = write_batch(wal, fd, batch.data, batch.length);
+
+        pthread_mutex_lock(&wal->lock);
+        wal->flushing = 0;
+        if (written != 0) {
+            fail_locked(wal, "write");
+        } else {
+            wal->written_lsn = batch_lsn;
+            if (wal->mode != WAL_MODE_NONE) {
+                wal->durable_lsn = batch_lsn;
+                wal->syncs++;
+            }
+        }
+        pthread_cond_broadcast(&wal->flushed);
+        notify_waiters_locked(wal);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    dynbuf_free(&batch);
+    return NULL;
+}
+
+// Start segment generation+1 once everything pending is in the current
+// one. Returns the generation that was closed, or 0 if the new segment
+// could not be created (the old one stays current).
+static uint64_t rotate_segment(StorageServerConfig *ctx) {
+    WriteAheadLog *wal = &ctx->wal;
+
+    pthread_mutex_lock(&wal->lock);
+    while ((wal->pending.length > 0 || wal->flushing) && !wal->failed) {
+        pthread_cond_wait(&wal->flushed, &wal->lock);
+    }
+
+    uint64_t closed = 0;
+    char path[MAX_PATH_LENGTH + 32];
+    get_segment_path(path, sizeof(path), ctx->storage_dir, wal->generation + 1);
+    int fd = wal->failed ? -1 : open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+    if (fd >= 0) {
+        close(wal->fd);
+        closed = wal->generation;
+        wal->fd = fd;
+        wal->generation++;
+        wal->segment_bytes = 0;
+    } else if (!wal->failed) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Failed to create log segment %s (errno=%d)", path, errno);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return closed;
+}
+
+// ============================================================================
+// CHECKPOINTS
+// ============================================================================
+
+static int compare_checkpoint_files(const void *a, const void *b) {
+    const CheckpointFile *x = a;
+    const CheckpointFile *y = b;
+    return strcmp(x->file->filename, y->file->filename);
+}
+
+// Write every document changed in the current segment back to its file and
+// delete the segment. Commits are held off only while documents are
+// rendered; files are written and renamed after the gate is released.
+static int run_checkpoint(StorageServerConfig *ctx) {
+    WriteAheadLog *wal = &ctx->wal;
+
+    pthread_rwlock_wrlock(&wal->commit_gate);
+
+    int count;
+    FileContent **files = content_cache_dirty_files(ctx, &count);
+    CheckpointFile *snapshots = files ? calloc((size_t)count + 1, sizeof(CheckpointFile)) : NULL;
+    if (!snapshots) {
+        pthread_rwlock_unlock(&wal->commit_gate);
+        for (int i = 0; i < count; i++) {
+            content_cache_release(ctx, files[i]);
+        }
+        free(files);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    int result = ERR_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        snapshots[i].file = files[i];
+        if (result != ERR_SUCCESS) continue;
+        snapshots[i].next_id = files[i]->next_sentence_id;
+        if (dynbuf_init(&snapshots[i].text, 4096) != ERR_SUCCESS ||
+            render_saved_text(files[i], &snapshots[i].text) != ERR_SUCCESS ||
+            dynbuf_init(&snapshots[i].ids, 256) != ERR_SUCCESS ||
+            collect_saved_sentence_ids(files[i], &snapshots[i].ids) != ERR_SUCCESS) {
+            result = ERR_OUT_OF_MEMORY;
+        } else if (files[i]->history_loaded) {
+            snapshots[i].has_history = 1;
+            if (dynbuf_init(&snapshots[i].history, files[i]->history.length + 1) != ERR_SUCCESS ||
+                dynbuf_append(&snapshots[i].history, files[i]->history.data,
+                              files[i]->history.length) != ERR_SUCCESS) {
+                result = ERR_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    uint64_t generation = 0;
+    if (result == ERR_SUCCESS) {
+        generation = rotate_segment(ctx);
+        if (generation == 0) result = ERR_FILE_WRITE_FAILED;
+    }
+    if (result == ERR_SUCCESS) {
+        // From here on the files' commits go to the new segment, logged
+        // against the text being written out
+        for (int i = 0; i < count; i++) {
+            files[i]->wal_dirty = 0;
+            files[i]->wal_base_raw = 1;
+        }
+    }
+    pthread_rwlock_unlock(&wal->commit_gate);
+
+    if (result == ERR_SUCCESS) {
+        qsort(snapshots, (size_t)count, sizeof(CheckpointFile), compare_checkpoint_files);
+        for (int i = 0; i < count && result == ERR_SUCCESS; i++) {
+            CheckpointFile *snapshot = &snapshots[i];
+            result = write_checkpoint_file(ctx->storage_dir, snapshot->file->filename,
+                                           snapshot->text.data, snapshot->text.length, snapshot->next_id,
+                                           (const uint32_t*)snapshot->ids.data,
+                                           snapshot->ids.length / sizeof(uint32_t),
+                                           snapshot->has_history ? &snapshot->history : NULL);
+        }
+    }
+
+    if (result == ERR_SUCCESS) {
+        // Files deleted or replaced since the snapshot keep what they are now.
+        // Locks are taken in name order and held until the renames are done.
+        FileLockEntry **locks = calloc((size_t)count + 1, sizeof(FileLockEntry*));
+        const char **filenames = calloc((size_t)count + 1, sizeof(char*));
+        int installed = 0;
+
+        if (!locks || !filenames) {
+            result = ERR_OUT_OF_MEMORY;
+        }
+        for (int i = 0; i < count && result == ERR_SUCCESS; i++) {
+            locks[i] = acquire_file_lock(ctx, snapshots[i].file->filename, FILE_LOCK_EXCLUSIVE);
+            if (!locks[i]) {
+                result = ERR_OUT_OF_MEMORY;
+            } else if (!snapshots[i].file->is_stale) {
+                filenames[installed++] = snapshots[i].file->filename;
+                snapshots[i].renamed = 1;
+            }
+        }
+
+        if (result == ERR_SUCCESS) {
+            result = commit_checkpoint(ctx->storage_dir, generation, filenames, installed);
+        }
+        for (int i = 0; i < count && locks && locks[i]; i++) {
+            release_file_lock(ctx, locks[i]);
+        }
+        free(locks);
+        free(filenames);
+    }
+
+    if (result != ERR_SUCCESS && generation != 0) {
+        // The closed segment stays and the next checkpoint covers it too.
+        // Replay takes a file's base from its first record, which is in
+        // that segment, so wal_base_raw can stay as it is.
+        pthread_rwlock_wrlock(&wal->commit_gate);
+        for (int i = 0; i < count; i++) {
+            snapshots[i].file->wal_dirty = 1;
+        }
+        pthread_rwlock_unlock(&wal->commit_gate);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (result != ERR_SUCCESS || !snapshots[i].renamed) {
+            char path[STORAGE_PATH_LENGTH];
+            get_checkpoint_path(path, sizeof(path), ctx->storage_dir, snapshots[i].file->filename);
+            unlink(path);
+            get_id_checkpoint_path(path, sizeof(path), ctx->storage_dir, snapshots[i].file->filename);
+            unlink(path);
+            get_history_checkpoint_path(path, sizeof(path), ctx->storage_dir, snapshots[i].file->filename);
+            unlink(path);
+        }
+        dynbuf_free(&snapshots[i].text);
+        dynbuf_free(&snapshots[i].ids);
+        dynbuf_free(&snapshots[i].history);
+        content_cache_release(ctx, snapshots[i].file);
+    }
+    free(snapshots);
+    free(files);
+
+    if (result == ERR_SUCCESS) {
+        pthread_mutex_lock(&wal->lock);
+        wal->checkpoints++;
+        pthread_mutex_unlock(&wal->lock);
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                   "Checkpoint of log segment %llu: %d file(s) written",
+                   (unsigned long long)generation, count);
+    } else {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Checkpoint failed (error=%d); log segment kept", result);
+    }
+    return result;
+}
+
+// Checkpoint every WAL_CHECKPOINT_INTERVAL_SEC, or sooner once the
+// segment reaches WAL_CHECKPOINT_BYTES
+static void* wal_checkpointer(void *arg) {
+    StorageServerConfig *ctx = (StorageServerConfig*)arg;
+    WriteAheadLog *wal = &ctx->wal;
+
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += WAL_CHECKPOINT_INTERVAL_SEC;
+
+        pthread_mutex_lock(&wal->lock);
+        while (wal->segment_bytes < WAL_CHECKPOINT_BYTES && !wal->stopping &&
+               pthread_cond_timedwait(&wal->checkpoint_due, &wal->lock, &deadline) != ETIMEDOUT) {
+        }
+        // Commits after a failure were never acknowledged; leave the files
+        // as the log has them for restart to recover
+        int due = wal->segment_bytes > 0 && !wal->failed;
+        int stopping = wal->stopping;
+        pthread_mutex_unlock(&wal->lock);
+
+        // Restart replays the log, so shutdown need not checkpoint
+        if (stopping) {
+            break;
+        }
+
+        if (due) {
+            run_checkpoint(ctx);
+        }
+    }
+    return NULL;
+}
+
+// ============================================================================
+// RECOVERY
+// ============================================================================
+
+// Finish the renames of a checkpoint whose manifest made it to disk
+static void finish_interrupted_checkpoint(const char *storage_dir) {
+    char manifest_path[MAX_PATH_LENGTH + 32];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", storage_dir, WAL_CHECKPOINT_FILE);
+
+    char *manifest;
+    size_t length;
+    if (read_whole_file(manifest_path, &manifest, &length) != ERR_SUCCESS) {
+        return;
+    }
+
+    const char **filenames = calloc(length + 1, sizeof(char*));
+    char *line = manifest;
+    char *newline = strchr(line, '\n');
+    uint64_t generation = newline ? strtoull(line, NULL, 10) : 0;
+    int count = 0;
+
+    while (filenames && newline) {
+        *newline = '\0';
+        line = newline + 1;
+        newline = strchr(line, '\n');
+        if (newline && newline > line) {
+            filenames[count++] = line;
+        }
+    }
+
+    if (filenames && generation > 0) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Finishing interrupted checkpoint of log segment %llu (%d file(s))",
+                   (unsigned long long)generation, count);
+        install_checkpoint_files(storage_dir, generation, filenames, count);
+    } else {
+        unlink(manifest_path);
+    }
+    free(filenames);
+    free(manifest);
+}
+
+// .ckpt files not listed in a manifest belong to a checkpoint that never
+// committed
+static void remove_stray_checkpoint_files(const char *storage_dir) {
+    DIR *dir = opendir(storage_dir);
+    if (!dir) return;
+
+    size_t suffix_length = strlen(CHECKPOINT_SUFFIX);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len > suffix_length && strcmp(entry->d_name + len - suffix_length, CHECKPOINT_SUFFIX) == 0) {
+            char path[MAX_PATH_LENGTH + MAX_FILENAME_LENGTH + 2];
+            snprintf(path, sizeof(path), "%s/%s", storage_dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+
+    char tmp_path[MAX_PATH_LENGTH + 40];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.tmp", storage_dir, WAL_CHECKPOINT_FILE);
+    unlink(tmp_path);
+}
+
+// The text a file's first record in the log was computed against, and
+// the IDs of its lines
+static int load_recovery_base(const char *storage_dir, const char *filename, int reparsed,
+                              RecoveredFile *recovered) {
+    DynamicBuffer *text = &recovered->text;
+    int result;
+
+    if (reparsed) {
+        FileContent *file = load_file_content(storage_dir, filename);
+        if (!file) return ERR_FILE_NOT_FOUND;
+        DynamicBuffer ids = { NULL, 0, 0 };
+        result = dynbuf_init(text, 4096);
+        if (result == ERR_SUCCESS) result = render_saved_text(file, text);
+        if (result == ERR_SUCCESS) result = dynbuf_init(&ids, 256);
+        if (result == ERR_SUCCESS) result = collect_saved_sentence_ids(file, &ids);
+        recovered->next_id = file->next_sentence_id;
+        free_file_content(file);
+        if (result != ERR_SUCCESS) {
+            dynbuf_free(&ids);
+            return result;
+        }
+        recovered->ids = (uint32_t*)ids.data;
+        recovered->id_count = ids.length / sizeof(uint32_t);
+    } else {
+        char *content;
+        size_t length;
+        result = ss_read_file(storage_dir, filename, &content, &length);
+        if (result != ERR_SUCCESS) return result;
+        result = dynbuf_init(text, length + 2);
+        if (result == ERR_SUCCESS) result = dynbuf_append(text, content, length);
+
+        uint32_t count;
+        size_t lines = length > 0 ? count_lines(content, length) + 1 : 0;
+        if (result == ERR_SUCCESS &&
+            (read_sentence_ids(storage_dir, filename, content, length, &recovered->ids,
+                               &count, &recovered->next_id) != ERR_SUCCESS || count != lines)) {
+            free(recovered->ids);
+            recovered->ids = calloc(lines + 1, sizeof(uint32_t));
+            if (!recovered->ids) result = ERR_OUT_OF_MEMORY;
+        }
+        recovered->id_count = lines;
+        free(content);
+        if (result != ERR_SUCCESS) return result;
+    }
+
+    if (text->length > 0) {
+        return dynbuf_append_char(text, '\n');
+    }
+    return ERR_SUCCESS;
+}
+
+static void free_recovered_file(RecoveredFile *recovered) {
+    dynbuf_free(&recovered->text);
+    dynbuf_free(&recovered->history);
+    free(recovered->ids);
+    free(recovered);
+}
+
+// Replace the IDs of the lines a splice replaced. IDs missing from the
+// record (older servers) become 0, numbered afresh when the file is loaded.
+static int splice_line_ids(RecoveredFile *recovered, const WalRecord *record,
+                           const char *old_text, const char *new_text, const char *ids) {
+    size_t line = count_lines(recovered->text.data, (size_t)record->offset);
+    size_t old_lines = count_lines(old_text, record->old_length);
+    size_t new_lines = count_lines(new_text, record->new_length);
+    if (line + old_lines > recovered->id_count) {
+        return ERR_INVALID_PARAMETER;
+    }
+
+    size_t count = recovered->id_count - old_lines + new_lines;
+    if (new_lines > old_lines) {
+        uint32_t *grown = realloc(recovered->ids, (count + 1) * sizeof(uint32_t));
+        if (!grown) return ERR_OUT_OF_MEMORY;
+        recovered->ids = grown;
+    }
+    memmove(recovered->ids + line + new_lines, recovered->ids + line + old_lines,
+            (recovered->id_count - line - old_lines) * sizeof(uint32_t));
+    for (size_t i = 0; i < new_lines; i++) {
+        uint32_t id = 0;
+        if (record->id_count == new_lines) {
+            memcpy(&id, ids + i * sizeof(uint32_t), sizeof(uint32_t));
+        }
+        recovered->ids[line + i] = id;
+        if (id >= recovered->next_id) recovered->next_id = id + 1;
+    }
+    recovered->id_count = count;
+    return ERR_SUCCESS;
+}
+
+static RecoveredFile* find_recovered_file(RecoveredFile *list, const char *filename) {
+    for (; list; list = list->next) {
+        if (strcmp(list->filename, filename) == 0) return list;
+    }
+    return NULL;
+}
+
+static int apply_splice_record(const char *storage_dir, RecoveredFile **list, const WalRecord *record,
+                               const char *filename, const char *old_text, const char *new_text,
+                               const char *ids, const char *history) {
+    RecoveredFile *recovered = find_recovered_file(*list, filename);
+    if (!recovered) {
+        recovered = calloc(1, sizeof(RecoveredFile));
+        if (!recovered) return ERR_OUT_OF_MEMORY;
+        strcpy(recovered->filename, filename);
+
+        // The undo history on disk was written with the text
+        int result = load_recovery_base(storage_dir, filename, record->flags & WAL_FLAG_REPARSED_BASE,
+                                        recovered);
+        if (result == ERR_SUCCESS) {
+            result = version_log_read(storage_dir, filename, &recovered->history);
+        }
+        if (result != ERR_SUCCESS) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                       "Log replay: cannot read '%s' (error=%d); skipping its records", filename, result);
+            recovered->stopped = 1;
+        }
+        recovered->next = *list;
+        *list = recovered;
+    }
+    if (recovered->stopped) {
+        return ERR_SUCCESS;
+    }
+
+    DynamicBuffer *text = &recovered->text;
+    if (record->offset > text->length || record->old_length > text->length - record->offset ||
+        memcmp(text->data + record->offset, old_text, record->old_length) != 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Log replay: record %llu does not match '%s'; keeping the %d record(s) before it",
+                   (unsigned long long)record->lsn, filename, recovered->applied);
+        recovered->stopped = 1;
+        return ERR_SUCCESS;
+    }
+
+    int result = splice_line_ids(recovered, record, old_text, new_text, ids);
+    if (result != ERR_SUCCESS) {
+        return result;
+    }
+    if (record->new_length > record->old_length &&
+        dynbuf_reserve(text, record->new_length - record->old_length) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    size_t offset = (size_t)record->offset;
+    memmove(text->data + offset + record->new_length, text->data + offset + record->old_length,
+            text->length - offset - record->old_length);
+    memcpy(text->data + offset, new_text, record->new_length);
+    text->length = text->length - record->old_length + record->new_length;
+    text->data[text->length] = '\0';
+    recovered->applied++;
+    return version_log_apply(&recovered->history, history, record->history_length,
+                             (int)record->history_undo, record->flags & WAL_FLAG_HISTORY_RESET);
+}
+
+// Apply one segment's records. Stops at the first torn or corrupt record:
+// nothing after it was ever acknowledged.
+static int replay_segment(const char *storage_dir, uint64_t generation, RecoveredFile **list,
+                          int *replayed) {
+    char path[MAX_PATH_LENGTH + 32];
+    get_segment_path(path, sizeof(path), storage_dir, generation);
+
+    char *data;
+    size_t length;
+    int result = read_whole_file(path, &data, &length);
+    if (result != ERR_SUCCESS) return result;
+
+    size_t offset = 0;
+    while (offset + sizeof(WalRecord) <= length) {
+        WalRecord record;
+        memcpy(&record, data + offset, sizeof(record));
+
+        if (record.magic != WAL_RECORD_MAGIC || record.name_length == 0 ||
+            record.name_length >= MAX_FILENAME_LENGTH) {
+            break;
+        }
+        size_t record_length = sizeof(record) + record.name_length +
+                               (size_t)record.old_length + record.new_length +
+                               (size_t)record.id_count * sizeof(uint32_t) + record.history_length;
+        if (record_length > length - offset) {
+            break;
+        }
+
+        const char *name = data + offset + sizeof(record);
+        const char *old_text = name + record.name_length;
+        const char *new_text = old_text + record.old_length;
+        const char *ids = new_text + record.new_length;
+        const char *history = ids + (size_t)record.id_count * sizeof(uint32_t);
+        if (record_checksum(&record, name, old_text, new_text, ids, history) != record.checksum) {
+            break;
+        }
+
+        char filename[MAX_FILENAME_LENGTH];
+        memcpy(filename, name, record.name_length);
+        filename[record.name_length] = '\0';
+
+        if (record.type == WAL_RECORD_SPLICE) {
+            result = apply_splice_record(storage_dir, list, &record, filename, old_text, new_text, ids, history);
+            if (result != ERR_SUCCESS) break;
+        } else if (record.type == WAL_RECORD_RESET) {
+            for (RecoveredFile **link = list; *link; link = &(*link)->next) {
+                if (strcmp((*link)->filename, filename) == 0) {
+                    RecoveredFile *reset = *link;
+                    *link = reset->next;
+                    free_recovered_file(reset);
+                    break;
+                }
+            }
+        }
+
+        (*replayed)++;
+        offset += record_length;
+    }
+
+    if (result == ERR_SUCCESS && offset < length) {
+        log_message(log_file, LOG_LEVEL_WARNING, NULL, 0, NULL,
+                   "Log segment %s: ignoring %zu bytes of torn or corrupt records",
+                   path, length - offset);
+    }
+    free(data);
+    return result;
+}
+
+// Replay all segments into the files, the same way a checkpoint writes
+// them, and delete the segments
+static int recover_log(StorageServerConfig *ctx, uint64_t *next_generation) {
+    const char *storage_dir = ctx->storage_dir;
+
+    finish_interrupted_checkpoint(storage_dir);
+    remove_stray_checkpoint_files(storage_dir);
+
+    int segment_count;
+    uint64_t *generations = list_segments(storage_dir, &segment_count);
+    *next_generation = segment_count > 0 ? generations[segment_count - 1] + 1 : 1;
+    if (segment_count == 0) {
+        free(generations);
+        return ERR_SUCCESS;
+    }
+
+    RecoveredFile *list = NULL;
+    int replayed = 0;
+    int result = ERR_SUCCESS;
+    for (int i = 0; i < segment_count && result == ERR_SUCCESS; i++) {
+        result = replay_segment(storage_dir, generations[i], &list, &replayed);
+    }
+
+    int file_count = 0;
+    for (RecoveredFile *recovered = list; recovered; recovered = recovered->next) {
+        file_count++;
+    }
+    const char **filenames = calloc((size_t)file_count + 1, sizeof(char*));
+    if (!filenames && result == ERR_SUCCESS) result = ERR_OUT_OF_MEMORY;
+
+    // Files are written without the newline the log counts after the last sentence
+    int written = 0;
+    for (RecoveredFile *recovered = list; recovered && result == ERR_SUCCESS; recovered = recovered->next) {
+        if (recovered->applied == 0) continue;
+        size_t text_length = recovered->text.length;
+        if (text_length > 0) text_length--;
+
+        result = write_checkpoint_file(storage_dir, recovered->filename, recovered->text.data, text_length,
+                                       recovered->next_id, recovered->ids, recovered->id_count,
+                                       &recovered->history);
+        if (result == ERR_SUCCESS) filenames[written++] = recovered->filename;
+    }
+
+    if (result == ERR_SUCCESS) {
+        result = commit_checkpoint(storage_dir, generations[segment_count - 1], filenames, written);
+    }
+    if (result == ERR_SUCCESS) {
+        for (int i = 0; i < written; i++) {
+            RecoveredFile *recovered = find_recovered_file(list, filenames[i]);
+            size_t text_length = recovered->text.length > 0 ? recovered->text.length - 1 : 0;
+            TextStats stats = text_stats(recovered->text.data, text_length);
+            ss_update_file_metadata(storage_dir, recovered->filename, text_length, &stats);
+        }
+        log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+                   "Log recovery: %d record(s) in %d segment(s), %d file(s) rewritten",
+                   replayed, segment_count, written);
+    } else {
+        remove_stray_checkpoint_files(storage_dir);
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Log recovery failed (error=%d); segments left in place", result);
+    }
+
+    while (list) {
+        RecoveredFile *next = list->next;
+        free_recovered_file(list);
+        list = next;
+    }
+    free(filenames);
+    free(generations);
+    return result;
+}
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+int parse_wal_mode(const char *name, WalMode *mode) {
+    if (strcmp(name, "none") == 0) {
+        *mode = WAL_MODE_NONE;
+    } else if (strcmp(name, "group") == 0) {
+        *mode = WAL_MODE_GROUP;
+    } else if (strcmp(name, "sync") == 0) {
+        *mode = WAL_MODE_SYNC;
+    } else {
+        return ERR_INVALID_PARAMETER;
+    }
+    return ERR_SUCCESS;
+}
+
+const char* wal_mode_name(WalMode mode) {
+    switch (mode) {
+        case WAL_MODE_NONE: return "none";
+        case WAL_MODE_GROUP: return "group";
+        case WAL_MODE_SYNC: return "sync";
+    }
+    return "unknown";
+}
+
+// Recover the files from what the log holds, then start a new segment and
+// the flusher and checkpointer threads. Call before serving clients.
+int wal_open(StorageServerConfig *ctx, WalMode mode) {
+    WriteAheadLog *wal = &ctx->wal;
+    memset(wal, 0, sizeof(*wal));
+    wal->mode = mode;
+    wal->fd = -1;
+
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->work, NULL);
+    pthread_cond_init(&wal->flushed, NULL);
+    pthread_cond_init(&wal->checkpoint_due, NULL);
+
+    // Writer-preferring, so a checkpoint isn't starved by a steady stream
+    // of commits
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&wal->commit_gate, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    if (dynbuf_init(&wal->pending, 64 * 1024) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    int result = recover_log(ctx, &wal->generation);
+    if (result != ERR_SUCCESS) {
+        return result;
+    }
+
+    char path[MAX_PATH_LENGTH + 32];
+    get_segment_path(path, sizeof(path), ctx->storage_dir, wal->generation);
+    wal->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (wal->fd < 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL,
+                   "Failed to create log segment %s (errno=%d: %s)", path, errno, strerror(errno));
+        return ERR_FILE_OPEN_FAILED;
+    }
+    sync_directory(ctx->storage_dir);
+
+    if (mode != WAL_MODE_SYNC) {
+        if (pthread_create(&wal->flusher, NULL, wal_flusher, wal) != 0) {
+            log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, "Log flusher thread failed to start");
+            return ERR_INITIALIZATION_FAILED;
+        }
+        wal->has_flusher = 1;
+    }
+    if (pthread_create(&wal->checkpointer, NULL, wal_checkpointer, ctx) != 0) {
+        log_message(log_file, LOG_LEVEL_ERROR, NULL, 0, NULL, "Checkpointer thread failed to start");
+        return ERR_INITIALIZATION_FAILED;
+    }
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Write-ahead log opened: segment %llu, mode %s",
+               (unsigned long long)wal->generation, wal_mode_name(mode));
+    return ERR_SUCCESS;
+}
+
+// Bracket changing a document and logging the change, so a checkpoint
+// never snapshots one without the other
+void wal_begin_commit(StorageServerConfig *ctx) {
+    pthread_rwlock_rdlock(&ctx->wal.commit_gate);
+}
+
+void wal_end_commit(StorageServerConfig *ctx) {
+    pthread_rwlock_unlock(&ctx->wal.commit_gate);
+}
+
+// Log a change made to a document, and make the splice's change to its
+// undo history, which must be loaded, once logged. Returns in *lsn what to
+// pass to wal_wait_durable() before acknowledging it. Call between
+// wal_begin_commit() and wal_end_commit().
+int wal_log_splice(StorageServerConfig *ctx, FileContent *file, const FileSplice *splice, uint64_t *lsn) {
+    WriteAheadLog *wal = &ctx->wal;
+
+    int history_change = splice->history_record.length > 0 || splice->history_undo > 0 ||
+                         splice->history_reset;
+    if (splice->old_text.length == 0 && splice->new_text.length == 0 && !history_change) {
+        pthread_mutex_lock(&wal->lock);
+        *lsn = wal->last_lsn;
+        pthread_mutex_unlock(&wal->lock);
+        return ERR_SUCCESS;
+    }
+    if (splice->old_text.length > UINT32_MAX || splice->new_text.length > UINT32_MAX ||
+        splice->history_record.length > UINT32_MAX) {
+        return ERR_INVALID_PARAMETER;
+    }
+
+    // Room for the history change up front, so the document's history
+    // can't fall behind what was logged
+    if (dynbuf_reserve(&file->history, splice->history_record.length) != ERR_SUCCESS) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    WalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = WAL_RECORD_MAGIC;
+    record.type = WAL_RECORD_SPLICE;
+    record.flags = (file->wal_base_raw ? 0 : WAL_FLAG_REPARSED_BASE) |
+                   (splice->history_reset ? WAL_FLAG_HISTORY_RESET : 0);
+    record.name_length = (uint16_t)strlen(file->filename);
+    record.old_length = (uint32_t)splice->old_text.length;
+    record.new_length = (uint32_t)splice->new_text.length;
+    record.offset = splice->offset;
+    record.id_count = (uint32_t)(splice->new_ids.length / sizeof(uint32_t));
+    record.history_length = (uint32_t)splice->history_record.length;
+    record.history_undo = (uint32_t)splice->history_undo;
+
+    int result = append_record(wal, &record, file->filename,
+                               splice->old_text.data ? splice->old_text.data : "",
+                               splice->new_text.data ? splice->new_text.data : "",
+                               splice->new_ids.data ? splice->new_ids.data : "",
+                               splice->history_record.data ? splice->history_record.data : "", lsn);
+    if (result == ERR_SUCCESS) {
+        file->wal_dirty = 1;
+        version_log_apply(&file->history, splice->history_record.data, splice->history_record.length,
+                          splice->history_undo, splice->history_reset);
+    }
+    return result;
+}
+
+// The file was deleted or replaced on disk: void its earlier records and
+// drop the cached document. Caller holds the file lock exclusively (which
+// keeps a running checkpoint from writing the file back) and is not inside
+// wal_begin_commit(). The record takes no commit gate, so once the log is
+// closed it is refused rather than waiting on it; callers must not report
+// the change as done unless this succeeds.
+int wal_discard_file(StorageServerConfig *ctx, const char *filename) {
+    WalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = WAL_RECORD_MAGIC;
+    record.type = WAL_RECORD_RESET;
+    record.name_length = (uint16_t)strlen(filename);
+
+    uint64_t lsn;
+    int result = append_record(&ctx->wal, &record, filename, "", "", "", "", &lsn);
+    content_cache_invalidate(ctx, filename);
+
+    if (result == ERR_SUCCESS) {
+        result = wal_wait_durable(ctx, lsn);
+    }
+    return result;
+}
+
+// A document changed in memory but the change could neither be logged nor
+// taken back. Stop accepting commits; restart recovers what was logged.
+void wal_mark_failed(StorageServerConfig *ctx, const char *filename) {
+    pthread_mutex_lock(&ctx->wal.lock);
+    log_message(log_file, LOG_LEVEL_CRITICAL, NULL, 0, NULL,
+               "Document '%s' no longer matches the write-ahead log", filename);
+    fail_locked(&ctx->wal, "commit");
+    pthread_mutex_unlock(&ctx->wal.lock);
+}
+
+// Block until the record at lsn is synced (group mode only; sync mode
+// synced it already and none mode never waits)
+int wal_wait_durable(StorageServerConfig *ctx, uint64_t lsn) {
+    WriteAheadLog *wal = &ctx->wal;
+    if (wal->mode != WAL_MODE_GROUP) {
+        return ERR_SUCCESS;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    while (wal->durable_lsn < lsn && !wal->failed) {
+        pthread_cond_wait(&wal->flushed, &wal->lock);
+    }
+    int result = wal->durable_lsn >= lsn ? ERR_SUCCESS : ERR_FILE_WRITE_FAILED;
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+// wal_wait_durable() for callers that must not block: returns 1 with
+// *result set if the record is already settled, else queues the waiter,
+// whose notify runs once it is, and returns 0. Poll again after notify.
+int wal_poll_durable(StorageServerConfig *ctx, uint64_t lsn, WalWaiter *waiter, int *result) {
+    WriteAheadLog *wal = &ctx->wal;
+    if (wal->mode != WAL_MODE_GROUP) {
+        *result = ERR_SUCCESS;
+        return 1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    int settled = wal->durable_lsn >= lsn || wal->failed;
+    if (settled) {
+        *result = wal->durable_lsn >= lsn ? ERR_SUCCESS : ERR_FILE_WRITE_FAILED;
+    } else if (!waiter->queued) {
+        waiter->queued = 1;
+        waiter->lsn = lsn;
+        waiter->next = wal->waiters;
+        wal->waiters = waiter;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return settled;
+}
+
+// Forget a waiter whose connection went away; no notify runs after this
+void wal_cancel_durable(StorageServerConfig *ctx, WalWaiter *waiter) {
+    WriteAheadLog *wal = &ctx->wal;
+
+    pthread_mutex_lock(&wal->lock);
+    for (WalWaiter **link = &wal->waiters; waiter->queued && *link; link = &(*link)->next) {
+        if (*link == waiter) {
+            *link = waiter->next;
+            waiter->queued = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+}
+
+// Shutdown: let a running checkpoint finish, wait out commits that are
+// logging, then have the flusher write everything pending, in order, and
+// sync it. Commits started after this block for good, so call it once
+// the server has stopped taking requests.
+void wal_close(StorageServerConfig *ctx) {
+    WriteAheadLog *wal = &ctx->wal;
+    if (wal->fd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    wal->stopping = 1;
+    pthread_cond_broadcast(&wal->checkpoint_due);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->checkpointer, NULL);
+
+    pthread_rwlock_wrlock(&wal->commit_gate);
+
+    // Commits are done; a RESET still racing in is either pending already
+    // or refused from here on
+    pthread_mutex_lock(&wal->lock);
+    wal->closed = 1;
+    pthread_cond_broadcast(&wal->work);
+    pthread_mutex_unlock(&wal->lock);
+    if (wal->has_flusher) {
+        pthread_join(wal->flusher, NULL);
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    if (!wal->failed) {
+        fdatasync(wal->fd);
+    }
+    close(wal->fd);
+    wal->fd = -1;
+    dynbuf_free(&wal->pending);
+    pthread_mutex_unlock(&wal->lock);
+
+    log_message(log_file, LOG_LEVEL_INFO, NULL, 0, NULL,
+               "Write-ahead log closed at segment %llu (%lu commits)",
+               (unsigned long long)wal->generation, wal->commits);
+}
+
+void wal_get_stats(StorageServerConfig *ctx, WalStats *stats) {
+    WriteAheadLog *wal = &ctx->wal;
+
+    pthread_mutex_lock(&wal->lock);
+    stats->commits = wal->commits;
+    stats->syncs = wal->syncs;
+    stats->checkpoints = wal->checkpoints;
+    stats->generation = wal->generation;
+    stats->segment_bytes = wal->segment_bytes;
+    stats->mode = wal->mode;
+    pthread_mutex_unlock(&wal->lock);
+}
@@ -0,0 +1,270 @@
+#ifndef SS_TEST_HARNESS_H
+#define SS_TEST_HARNESS_H
+
+#include "../include/storageserver.h"
+
+// ============================================================================
+// TEST HARNESS
+// ============================================================================
+// CHECK() and test_report() for every test, and a storage server context
+// in a scratch directory, without the network. Commits and undos go
+// through the same calls, locks and logging that main.c makes for
+// WRITE ... ETIRW and UNDO.
+
+#define TEST_USER "tester"
+
+static int test_failures;
+static int test_checks;
+
+#define CHECK(cond, ...) do { \
+    test_checks++; \
+    if (!(cond)) { \
+        if (++test_failures <= 20) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+        } \
+    } \
+} while (0)
+
+// The editing code reports progress on stdout; tests report on stderr
+static inline void test_silence_stdout(void) {
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("stdout");
+        exit(1);
+    }
+}
+
+static inline int test_report(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d of %d checks failed\n", name, test_failures, test_checks);
+        return 1;
+    }
+    fprintf(stderr, "%s: %d checks passed\n", name, test_checks);
+    return 0;
+}
+
+// ============================================================================
+// FILES
+// ============================================================================
+
+static inline char* test_make_dir(void) {
+    static char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/ss_test.XXXXXX");
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    return dir;
+}
+
+static inline void test_remove_dir(const char *dir) {
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf '%s'", dir);
+    if (system(command) != 0) {
+        fprintf(stderr, "Failed to remove %s\n", dir);
+    }
+}
+
+static inline void test_write_file(const char *dir, const char *filename, const char *text) {
+    char path[MAX_PATH_LENGTH + MAX_FILENAME_LENGTH + 2];
+    snprintf(path, sizeof(path), "%s/%s", dir, filename);
+    FILE *file = fopen(path, "w");
+    if (!file || fputs(text, file) < 0 || fclose(file) != 0) {
+        perror(path);
+        exit(1);
+    }
+}
+
+// The file's bytes on disk; "" if it can't be read. Caller frees.
+static inline char* test_disk_text(const char *dir, const char *filename) {
+    char *content;
+    size_t length;
+    if (ss_read_file(dir, filename, &content, &length) != ERR_SUCCESS) {
+        return strdup("");
+    }
+    return content;
+}
+
+// What saving the document would write. Caller frees.
+static inline char* test_saved_text(const FileContent *doc) {
+    DynamicBuffer text;
+    dynbuf_init(&text, 256);
+    render_saved_text(doc, &text);
+    dynbuf_append_char(&text, '\0');
+    return text.data;
+}
+
+// ============================================================================
+// SERVER
+// ============================================================================
+
+// Set up what main() does before serving, recovering whatever the log in
+// dir holds
+static inline void test_open_server(StorageServerConfig *ctx, const char *dir, WalMode mode) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->id = 1;
+    strncpy(ctx->storage_dir, dir, MAX_PATH_LENGTH - 1);
+    ctx->is_running = 1;
+    pthread_mutex_init(&ctx->storage_lock, NULL);
+    init_file_locks(ctx);
+    init_content_cache(&ctx->content_cache, CONTENT_CACHE_BUDGET_BYTES);
+    init_sentence_locks(ctx);
+
+    if (create_storage_directory(dir) != ERR_SUCCESS ||
+        metadata_store_open(dir) != ERR_SUCCESS ||
+        wal_open(ctx, mode) != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to open storage in %s\n", dir);
+        exit(1);
+    }
+}
+
+// Shut down as main() does and start again: the documents in memory are
+// dropped, and the files come back from disk plus the replayed log
+static inline void test_restart_server(StorageServerConfig *ctx) {
+    wal_close(ctx);
+    destroy_content_cache(ctx);
+    init_content_cache(&ctx->content_cache, CONTENT_CACHE_BUDGET_BYTES);
+    if (wal_open(ctx, ctx->wal.mode) != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to reopen the write-ahead log\n");
+        exit(1);
+    }
+}
+
+static inline void test_close_server(StorageServerConfig *ctx) {
+    wal_close(ctx);
+    metadata_store_flush();
+    destroy_content_cache(ctx);
+}
+
+// ============================================================================
+// EDITS
+// ============================================================================
+
+static const char *test_words[] = {
+    "a", "bb", "c.", "d!", "e?x", ".", "f.g", "h", "?", "i.j.k", "l", "two words"
+};
+
+// A random sentence of doc to write, or NULL to append a new one where
+// the server would allow it
+static inline SentenceNode* test_pick_sentence(FileContent *doc) {
+    int count = doc->sentence_count;
+    SentenceNode *last = count > 0 ? get_sentence_node(doc, count - 1) : NULL;
+    int can_append = !last || is_sentence_delimiter(last->delimiter);
+    int sentence_num = rand() % (count + can_append);
+    return sentence_num < count ? get_sentence_node(doc, sentence_num) : NULL;
+}
+
+// One to three random word updates on a copy of target, as a WRITE
+// session stages them
+static inline FileContent* test_stage_edit(FileContent *doc, SentenceNode *target) {
+    FileContent *staging = create_staging_content(doc->filename, target);
+    if (!staging) return NULL;
+
+    int current = 0;
+    int updates = 1 + rand() % 3;
+    for (int i = 0; i < updates; i++) {
+        char content[128] = "";
+        int words = 1 + rand() % 3;
+        for (int w = 0; w < words; w++) {
+            if (w > 0) strcat(content, " ");
+            strcat(content, test_words[rand() % (int)(sizeof(test_words) / sizeof(test_words[0]))]);
+        }
+
+        SentenceNode *sentence = get_sentence_node(staging, current);
+        int word_index = rand() % ((sentence ? sentence->word_count : 0) + 1);
+        int next = current;
+        if (modify_sentence_multiword(staging, current, word_index, content, TEST_USER, &next) == ERR_SUCCESS) {
+            current = next;
+        }
+    }
+    return staging;
+}
+
+// start_write_session() and commit_write_session() with a random edit.
+// Returns the commit's result.
+static inline int test_commit_random_edit(StorageServerConfig *ctx, const char *filename) {
+    FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_SHARED);
+    FileContent *live = content_cache_acquire(ctx, filename);
+    if (!live) {
+        release_file_lock(ctx, file_lock);
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    SentenceNode *target = test_pick_sentence(live);
+    if (target && lock_sentence(live, target, TEST_USER) != ERR_SUCCESS) {
+        release_file_lock(ctx, file_lock);
+        content_cache_release(ctx, live);
+        return ERR_FILE_LOCKED;
+    }
+    FileContent *staging = test_stage_edit(live, target);
+    release_file_lock(ctx, file_lock);
+    if (!staging) {
+        if (target) unlock_sentence(live, target, TEST_USER);
+        content_cache_release(ctx, live);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_EXCLUSIVE);
+    SentenceDelta delta;
+    FileSplice splice;
+    uint64_t lsn = 0;
+    sentence_delta_init(&delta);
+    file_splice_init(&splice);
+
+    int result = version_log_load(ctx->storage_dir, live);
+    if (result != ERR_SUCCESS) {
+        free_file_content(staging);
+    } else {
+        wal_begin_commit(ctx);
+        result = merge_sentence_edits(live, target, staging, &delta, &splice);
+        if (result == ERR_SUCCESS) {
+            result = version_log_record(ctx->storage_dir, live, &delta, &splice);
+        }
+        if (result == ERR_SUCCESS) {
+            result = wal_log_splice(ctx, live, &splice, &lsn);
+        }
+        if (result != ERR_SUCCESS && (delta.position < 0 || delta.new_count > 0) &&
+            (delta.position < 0 || revert_sentence_delta(live, &delta, NULL) != ERR_SUCCESS)) {
+            wal_mark_failed(ctx, filename);
+        }
+        wal_end_commit(ctx);
+    }
+
+    if (result == ERR_SUCCESS) {
+        size_t saved_length;
+        TextStats stats = document_text_stats(live, &saved_length);
+        ss_update_file_metadata(ctx->storage_dir, filename, saved_length, &stats);
+        content_cache_update_usage(ctx, live);
+    }
+    sentence_delta_free(&delta);
+    file_splice_free(&splice);
+
+    if (target) unlock_sentence(live, target, TEST_USER);
+    release_file_lock(ctx, file_lock);
+    content_cache_release(ctx, live);
+    return result;
+}
+
+// The UNDO request: step the file back `levels` commits
+static inline int test_undo(StorageServerConfig *ctx, const char *filename, int levels) {
+    FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_EXCLUSIVE);
+    FileContent *live = content_cache_acquire(ctx, filename);
+    uint64_t lsn = 0;
+    int result = live ? undo_file_versions(ctx, live, levels, &lsn) : ERR_FILE_NOT_FOUND;
+    if (live) content_cache_release(ctx, live);
+    release_file_lock(ctx, file_lock);
+    return result;
+}
+
+// The live document's saved text, as READ would see it. Caller frees.
+static inline char* test_live_text(StorageServerConfig *ctx, const char *filename) {
+    FileLockEntry *file_lock = acquire_file_lock(ctx, filename, FILE_LOCK_SHARED);
+    FileContent *live = content_cache_acquire(ctx, filename);
+    char *text = live ? test_saved_text(live) : strdup("");
+    if (live) content_cache_release(ctx, live);
+    release_file_lock(ctx, file_lock);
+    return text;
+}
+
+#endif // SS_TEST_HARNESS_H
@@ -0,0 +1,77 @@
+#include "harness.h"
+
+// ============================================================================
+// STORAGE NAMES TEST
+// ============================================================================
+// CREATE must refuse every name the server keeps its own files under, or
+// the user's file would be read, overwritten or deleted as server state,
+// and LIST must leave those files out. Names that only look like them stay
+// usable.
+
+FILE* log_file;
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+static const char *reserved_names[] = {
+    // The metadata store, .meta files of older servers and their temp files
+    ".metadata", ".metadata.tmp", "notes.meta", "notes.meta.tmp.42",
+    // The write-ahead log: segments, the checkpoint manifest and its temp
+    // file, and files written by an unfinished checkpoint
+    ".wal.1", ".wal.12", ".checkpoint", ".checkpoint.tmp", "notes.ckpt",
+    // Backups, undo histories, sentence IDs, and temp files of an
+    // interrupted write
+    "notes.backup", "notes.versions", "notes.sids", "notes.sids.ckpt",
+    "notes.partial", "notes.backup.partial",
+};
+
+static const char *user_names[] = {
+    "notes", "notes.txt", "meta", "notes.meta.txt", "notes.metadata",
+    "wal", "notes.wal.1", "checkpoint", "notes.ckpt.txt",
+    "backup", "versions", "notes.versions.txt", "sids", "notes.sids.txt", "partial",
+};
+
+static int file_exists(const char *dir, const char *filename) {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", dir, filename);
+    return access(path, F_OK) == 0;
+}
+
+static int is_user_name(const char *filename) {
+    for (int i = 0; i < COUNT(user_names); i++) {
+        if (strcmp(filename, user_names[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    const char *dir = test_make_dir();
+    if (metadata_store_open(dir) != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to open storage in %s\n", dir);
+        return 1;
+    }
+
+    for (int i = 0; i < COUNT(reserved_names); i++) {
+        const char *name = reserved_names[i];
+        int existed = file_exists(dir, name);
+        CHECK(is_reserved_storage_name(name), "%s is not reserved", name);
+        CHECK(ss_create_file(dir, name, TEST_USER) == ERR_INVALID_FILENAME, "CREATE %s was not refused", name);
+        CHECK(file_exists(dir, name) == existed, "CREATE %s changed whether it exists", name);
+    }
+
+    for (int i = 0; i < COUNT(user_names); i++) {
+        const char *name = user_names[i];
+        CHECK(!is_reserved_storage_name(name), "%s is reserved", name);
+        CHECK(ss_create_file(dir, name, TEST_USER) == ERR_SUCCESS, "CREATE %s failed", name);
+    }
+
+    // The store itself is in dir now; LIST must show the user files only
+    static char files[64][MAX_FILENAME_LENGTH];
+    int count = list_files(dir, files, 64);
+    CHECK(count == COUNT(user_names), "LIST found %d files, expected %d", count, COUNT(user_names));
+    for (int i = 0; i < count; i++) {
+        CHECK(is_user_name(files[i]), "LIST showed %s", files[i]);
+    }
+
+    test_remove_dir(dir);
+    return test_report("storage_names_test");
+}
@@ -0,0 +1,243 @@
+#include "harness.h"
+
+// ============================================================================
+// TOKENIZER TEST
+// ============================================================================
+// The scalar, SSE2 and AVX2 block scanners must produce the same masks, and
+// counting and tokenizing must match a byte-at-a-time reference for every
+// length, so partial final blocks (padded by text_scan_at) are covered.
+// SIMD paths the CPU lacks are skipped.
+
+FILE* log_file;
+
+typedef struct {
+    const char *name;
+    TextScanFn scan;
+} ScanPath;
+
+static ScanPath paths[3];
+static int path_count;
+
+static void find_paths(void) {
+    paths[path_count++] = (ScanPath){"scalar", text_scan_block_scalar};
+#ifdef TEXT_SCAN_X86
+    if (__builtin_cpu_supports("sse2")) paths[path_count++] = (ScanPath){"sse2", text_scan_block_sse2};
+    if (__builtin_cpu_supports("avx2")) paths[path_count++] = (ScanPath){"avx2", text_scan_block_avx2};
+#endif
+}
+
+// Mostly the bytes the scanners care about, some of everything else
+static unsigned char random_byte(void) {
+    static const char interesting[] = " \t\n\v\f\r.!?\b\x0e\x1f-/>@aZ";
+    if (rand() % 4 == 0) return (unsigned char)(rand() % 256);
+    return (unsigned char)interesting[rand() % (int)(sizeof(interesting) - 1)];
+}
+
+static int is_reference_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static int is_reference_delimiter(unsigned char c) {
+    return c == '.' || c == '!' || c == '?';
+}
+
+// ============================================================================
+// BLOCK SCANS
+// ============================================================================
+
+static void check_block(const unsigned char *block) {
+    uint64_t want_ws = 0, want_delim = 0;
+    for (int i = 0; i < TEXT_SCAN_BLOCK; i++) {
+        want_ws |= (uint64_t)is_reference_space(block[i]) << i;
+        want_delim |= (uint64_t)is_reference_delimiter(block[i]) << i;
+    }
+
+    for (int p = 0; p < path_count; p++) {
+        uint64_t ws = ~want_ws, delim = ~want_delim;
+        paths[p].scan(block, &ws, &delim);
+        CHECK(ws == want_ws && delim == want_delim,
+              "%s scan: ws %016llx want %016llx, delim %016llx want %016llx", paths[p].name,
+              (unsigned long long)ws, (unsigned long long)want_ws,
+              (unsigned long long)delim, (unsigned long long)want_delim);
+    }
+}
+
+static void test_block_scans(void) {
+    unsigned char block[TEXT_SCAN_BLOCK];
+
+    // Every byte value in every lane
+    for (int c = 0; c < 256; c++) {
+        for (int lane = 0; lane < TEXT_SCAN_BLOCK; lane++) {
+            memset(block, 'x', sizeof(block));
+            block[lane] = (unsigned char)c;
+            check_block(block);
+        }
+    }
+
+    for (int round = 0; round < 20000; round++) {
+        for (int i = 0; i < TEXT_SCAN_BLOCK; i++) block[i] = random_byte();
+        check_block(block);
+    }
+}
+
+// Partial blocks: the tail is read as whitespace whatever follows it
+static void test_partial_blocks(void) {
+    unsigned char source[2 * TEXT_SCAN_BLOCK];
+
+    for (int round = 0; round < 200; round++) {
+        for (size_t i = 0; i < sizeof(source); i++) source[i] = random_byte();
+
+        for (size_t length = 1; length <= sizeof(source); length++) {
+            // Exact-size copy so reading past the end is caught by ASan
+            char *text = malloc(length);
+            memcpy(text, source, length);
+
+            for (size_t offset = 0; offset < length; offset += TEXT_SCAN_BLOCK) {
+                uint64_t want_ws = 0, want_delim = 0;
+                for (int i = 0; i < TEXT_SCAN_BLOCK; i++) {
+                    unsigned char c = offset + i < length ? (unsigned char)text[offset + i] : ' ';
+                    want_ws |= (uint64_t)is_reference_space(c) << i;
+                    want_delim |= (uint64_t)is_reference_delimiter(c) << i;
+                }
+                for (int p = 0; p < path_count; p++) {
+                    uint64_t ws, delim;
+                    text_scan_at(paths[p].scan, text, length, offset, &ws, &delim);
+                    CHECK(ws == want_ws && delim == want_delim,
+                          "%s text_scan_at(length=%zu, offset=%zu)", paths[p].name, length, offset);
+                }
+            }
+            free(text);
+        }
+    }
+}
+
+// ============================================================================
+// COUNTING AND TOKENIZING
+// ============================================================================
+
+static TextStats reference_stats(const char *text, size_t length) {
+    TextStats stats = {0, 0};
+    int in_word = 0;
+    int trailing_words = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (is_reference_delimiter(c)) {
+            stats.sentences++;
+            trailing_words = 0;
+            in_word = 0;
+        } else if (is_reference_space(c)) {
+            in_word = 0;
+        } else if (!in_word) {
+            stats.words++;
+            trailing_words = 1;
+            in_word = 1;
+        }
+    }
+    stats.sentences += (size_t)trailing_words;
+    return stats;
+}
+
+// The next token the tokenizer should produce from pos; 0 at the end
+static int reference_token(const char *text, size_t length, size_t *pos, int split_delimiters,
+                           TextToken *token) {
+    size_t at = *pos;
+    while (at < length && is_reference_space((unsigned char)text[at])) at++;
+    if (at >= length) return 0;
+
+    int is_delim = split_delimiters && is_reference_delimiter((unsigned char)text[at]);
+    size_t end = at + 1;
+    while (!is_delim && end < length) {
+        unsigned char c = (unsigned char)text[end];
+        if (is_reference_space(c) || (split_delimiters && is_reference_delimiter(c))) break;
+        end++;
+    }
+
+    token->type = is_delim ? TEXT_TOKEN_DELIMITER : TEXT_TOKEN_WORD;
+    token->start = at;
+    token->length = end - at;
+    *pos = end;
+    return 1;
+}
+
+static void check_tokens(const char *text, size_t length, TextScanFn scan, const char *path,
+                         int split_delimiters) {
+    TextTokenizer tok;
+    text_tokenizer_init(&tok, text, length, split_delimiters);
+    tok.scan = scan;
+
+    size_t pos = 0;
+    TextToken want = {0}, got = {0};
+    int index = 0;
+    for (;;) {
+        int want_more = reference_token(text, length, &pos, split_delimiters, &want);
+        int got_more = text_tokenizer_next(&tok, &got);
+        CHECK(want_more == got_more, "%s tokenizer(length=%zu, split=%d): token %d %s",
+              path, length, split_delimiters, index, want_more ? "missing" : "extra");
+        if (!want_more || !got_more) {
+            CHECK(got.type == TEXT_TOKEN_END || got_more, "%s tokenizer: end token type", path);
+            break;
+        }
+        CHECK(want.type == got.type && want.start == got.start && want.length == got.length,
+              "%s tokenizer(length=%zu, split=%d): token %d is %d@%zu+%zu, want %d@%zu+%zu",
+              path, length, split_delimiters, index, got.type, got.start, got.length,
+              want.type, want.start, want.length);
+        index++;
+    }
+}
+
+static void check_text(const char *source, size_t length) {
+    char *text = malloc(length ? length : 1);
+    memcpy(text, source, length);
+
+    TextStats want = reference_stats(text, length);
+    TextStats got = text_stats(text, length);
+    CHECK(want.words == got.words && want.sentences == got.sentences,
+          "text_stats(length=%zu): %zu words %zu sentences, want %zu and %zu",
+          length, got.words, got.sentences, want.words, want.sentences);
+
+    for (int p = 0; p < path_count; p++) {
+        check_tokens(text, length, paths[p].scan, paths[p].name, 0);
+        check_tokens(text, length, paths[p].scan, paths[p].name, 1);
+    }
+    free(text);
+}
+
+static void test_counting_and_tokenizing(void) {
+    char source[5 * TEXT_SCAN_BLOCK];
+
+    for (int round = 0; round < 100; round++) {
+        for (size_t i = 0; i < sizeof(source); i++) source[i] = (char)random_byte();
+        for (size_t length = 0; length <= sizeof(source); length++) {
+            check_text(source, length);
+        }
+    }
+
+    // Words and delimiters straddling block edges
+    static const char *edges[] = {"end.Next", "a b", "word!", "  x", "x  ", "?.!", "w\vv\ff"};
+    for (size_t e = 0; e < sizeof(edges) / sizeof(edges[0]); e++) {
+        for (size_t at = TEXT_SCAN_BLOCK - 8; at <= 2 * TEXT_SCAN_BLOCK; at++) {
+            size_t length = at + strlen(edges[e]);
+            memset(source, 'q', at);
+            for (size_t i = 0; i < at; i += 4) source[i] = ' ';
+            memcpy(source + at, edges[e], strlen(edges[e]));
+            check_text(source, length);
+            check_text(source, length - 1);
+        }
+    }
+}
+
+int main(void) {
+    srand(8);
+    find_paths();
+
+    printf("Scan paths:");
+    for (int p = 0; p < path_count; p++) printf(" %s", paths[p].name);
+    printf("\n");
+
+    test_block_scans();
+    test_partial_blocks();
+    test_counting_and_tokenizing();
+
+    return test_report("tokenizer_test");
+}
@@ -0,0 +1,165 @@
+#include "harness.h"
+
+// ============================================================================
+// UNDO TEST
+// ============================================================================
+// Random commits through the WRITE path, then UNDO of random numbers of
+// levels until the history is used up: after each undo the document must
+// read exactly as it did that many commits back, and after a restart the
+// file on disk must too. Reverting and reapplying merge deltas directly
+// checks swap_sentences() both ways.
+
+FILE* log_file;
+
+#define UNDO_ROUNDS 40
+#define DELTA_ROUNDS 200
+#define MAX_COMMITS VERSION_LOG_RETAIN
+
+static StorageServerConfig ctx;
+
+// A few sentences in saved form: one per line, the last maybe unended
+static void write_initial_text(const char *dir, const char *filename) {
+    char text[512] = "";
+    int sentences = rand() % 5;
+    for (int i = 0; i < sentences; i++) {
+        char sentence[64];
+        snprintf(sentence, sizeof(sentence), "%sw%d x%d%s", i ? "\n" : "", i, i,
+                 (const char *[]){".", "!", "?", ""}[rand() % 4]);
+        strcat(text, sentence);
+        if (sentence[strlen(sentence) - 1] != '.' && sentence[strlen(sentence) - 1] != '!' &&
+            sentence[strlen(sentence) - 1] != '?') {
+            break;
+        }
+    }
+    test_write_file(dir, filename, text);
+}
+
+static void free_states(char **states, int count) {
+    for (int i = 0; i < count; i++) free(states[i]);
+}
+
+// ============================================================================
+// MULTI-LEVEL UNDO THROUGH THE SERVER
+// ============================================================================
+
+static void undo_round(const char *dir, int round) {
+    char filename[MAX_FILENAME_LENGTH];
+    snprintf(filename, sizeof(filename), "doc%d.txt", round);
+    CHECK(ss_create_file(dir, filename, TEST_USER) == ERR_SUCCESS, "create %s", filename);
+    write_initial_text(dir, filename);
+
+    // states[i]: the document after i commits
+    char *states[MAX_COMMITS + 1];
+    int commits = 1 + rand() % MAX_COMMITS;
+    states[0] = test_live_text(&ctx, filename);
+    for (int i = 0; i < commits; i++) {
+        int result = test_commit_random_edit(&ctx, filename);
+        CHECK(result == ERR_SUCCESS, "round %d: commit %d failed (%d)", round, i, result);
+        states[i + 1] = test_live_text(&ctx, filename);
+    }
+
+    // Sometimes undo what the restart recovered rather than what was in memory
+    if (round % 3 == 0) {
+        test_restart_server(&ctx);
+        char *disk = test_disk_text(dir, filename);
+        CHECK(strcmp(disk, states[commits]) == 0,
+              "round %d: file after restart is\n%s\nwant\n%s", round, disk, states[commits]);
+        free(disk);
+    }
+
+    int remaining = commits;
+    while (remaining > 0) {
+        int levels = 1 + rand() % remaining;
+        int result = test_undo(&ctx, filename, levels);
+        CHECK(result == ERR_SUCCESS, "round %d: undo of %d from %d failed (%d)",
+              round, levels, remaining, result);
+        remaining -= levels;
+
+        char *text = test_live_text(&ctx, filename);
+        CHECK(strcmp(text, states[remaining]) == 0,
+              "round %d: after undo to %d the document is\n%s\nwant\n%s",
+              round, remaining, text, states[remaining]);
+        free(text);
+    }
+    CHECK(test_undo(&ctx, filename, 1) == ERR_NOTHING_TO_UNDO,
+          "round %d: undo past the first commit", round);
+
+    // What the undos logged must replay to the original file
+    test_restart_server(&ctx);
+    char *disk = test_disk_text(dir, filename);
+    CHECK(strcmp(disk, states[0]) == 0,
+          "round %d: file after undo and restart is\n%s\nwant\n%s", round, disk, states[0]);
+    free(disk);
+
+    free_states(states, commits + 1);
+}
+
+// ============================================================================
+// REVERT AND REAPPLY
+// ============================================================================
+
+static void delta_round(const char *dir, int round) {
+    char filename[MAX_FILENAME_LENGTH];
+    snprintf(filename, sizeof(filename), "delta%d.txt", round);
+    write_initial_text(dir, filename);
+    FileContent *doc = load_file_content(dir, filename);
+    CHECK(doc != NULL, "round %d: load", round);
+    if (!doc) return;
+
+    char *states[MAX_COMMITS + 1];
+    SentenceDelta deltas[MAX_COMMITS];
+    int commits = 1 + rand() % MAX_COMMITS;
+    states[0] = test_saved_text(doc);
+    for (int i = 0; i < commits; i++) {
+        SentenceNode *target = test_pick_sentence(doc);
+        FileContent *staging = test_stage_edit(doc, target);
+        CHECK(merge_sentence_edits(doc, target, staging, &deltas[i], NULL) == ERR_SUCCESS,
+              "round %d: merge %d", round, i);
+        states[i + 1] = test_saved_text(doc);
+    }
+
+    for (int i = commits - 1; i >= 0; i--) {
+        CHECK(revert_sentence_delta(doc, &deltas[i], NULL) == ERR_SUCCESS, "round %d: revert %d", round, i);
+        char *text = test_saved_text(doc);
+        CHECK(strcmp(text, states[i]) == 0, "round %d: revert %d gave\n%s\nwant\n%s",
+              round, i, text, states[i]);
+        free(text);
+    }
+
+    // A delta only reverts over exactly what it put there
+    if (commits > 1 && strcmp(states[0], states[2]) != 0 && strcmp(states[1], states[2]) != 0) {
+        CHECK(revert_sentence_delta(doc, &deltas[1], NULL) != ERR_SUCCESS,
+              "round %d: reverted a delta that is not the newest", round);
+    }
+
+    for (int i = 0; i < commits; i++) {
+        CHECK(reapply_sentence_delta(doc, &deltas[i]) == ERR_SUCCESS, "round %d: reapply %d", round, i);
+        char *text = test_saved_text(doc);
+        CHECK(strcmp(text, states[i + 1]) == 0, "round %d: reapply %d gave\n%s\nwant\n%s",
+              round, i, text, states[i + 1]);
+        free(text);
+    }
+
+    for (int i = 0; i < commits; i++) sentence_delta_free(&deltas[i]);
+    free_states(states, commits + 1);
+    free_file_content(doc);
+}
+
+int main(void) {
+    test_silence_stdout();
+    const char *dir = test_make_dir();
+
+    srand(12);
+    for (int round = 0; round < DELTA_ROUNDS; round++) {
+        delta_round(dir, round);
+    }
+
+    test_open_server(&ctx, dir, WAL_MODE_NONE);
+    for (int round = 0; round < UNDO_ROUNDS; round++) {
+        undo_round(dir, round);
+    }
+    test_close_server(&ctx);
+
+    test_remove_dir(dir);
+    return test_report("undo_test");
+}
@@ -0,0 +1,433 @@
+#include "harness.h"
+#include <sys/wait.h>
+
+// ============================================================================
+// WRITE-AHEAD LOG TEST
+// ============================================================================
+// A child process commits random edits and undos with the log in sync mode
+// and dies without shutting down; the parent then recovers the directory
+// and checks every file and its sentence IDs against what the child had
+// acknowledged, then undoes the round's commits one level at a time. The log's tail is sometimes torn or followed by garbage,
+// and a file is sometimes changed behind the log's back. Interrupted and
+// uncommitted checkpoints are set up on disk by hand.
+
+FILE* log_file;
+
+#define CRASH_ROUNDS 24
+#define CRASH_FILES 3
+#define CRASH_COMMITS 30
+#define INITIAL_TEXT "First sentence here.\nSecond one!"
+
+static StorageServerConfig ctx;
+
+typedef enum {
+    TAIL_INTACT,        // The child died after its last commit
+    TAIL_GARBAGE,       // A record was half written when it died
+    TAIL_TORN,          // The disk lost the end of the segment
+    TAIL_TAMPERED       // File 0 was rewritten without the log knowing
+} CrashTail;
+
+// What the child acknowledged: a file's text and IDs once the log segment
+// had reached segment_bytes, after a commit (undone = 0), an undo of
+// `undone` levels, or before the round's first change (-1)
+typedef struct {
+    int file;
+    int undone;
+    uint64_t segment_bytes;
+    char *text;
+    uint32_t *ids;
+    uint32_t id_count;
+} AckedState;
+
+static void crash_filename(char *filename, size_t size, int file) {
+    snprintf(filename, size, "crash%d.txt", file);
+}
+
+// The IDs of the live document's saved sentences, as its .sids file holds them
+static uint32_t* live_ids(StorageServerConfig *server, const char *filename, uint32_t *count) {
+    DynamicBuffer ids;
+    dynbuf_init(&ids, 256);
+    FileLockEntry *file_lock = acquire_file_lock(server, filename, FILE_LOCK_SHARED);
+    FileContent *live = content_cache_acquire(server, filename);
+    if (live) {
+        collect_saved_sentence_ids(live, &ids);
+        content_cache_release(server, live);
+    }
+    release_file_lock(server, file_lock);
+    *count = (uint32_t)(ids.length / sizeof(uint32_t));
+    return (uint32_t*)ids.data;
+}
+
+static int read_exact(int fd, void *data, size_t length) {
+    size_t total = 0;
+    while (total < length) {
+        ssize_t n = read(fd, (char*)data + total, length - total);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        total += (size_t)n;
+    }
+    return 0;
+}
+
+// ============================================================================
+// THE CRASHING SERVER
+// ============================================================================
+
+static void send_state(int fd, int file, int undone) {
+    char filename[MAX_FILENAME_LENGTH];
+    crash_filename(filename, sizeof(filename), file);
+
+    struct stat st;
+    fstat(ctx.wal.fd, &st);
+    uint64_t segment_bytes = (uint64_t)st.st_size;
+    char *text = test_live_text(&ctx, filename);
+    uint32_t text_length = (uint32_t)strlen(text);
+    uint32_t id_count;
+    uint32_t *ids = live_ids(&ctx, filename, &id_count);
+
+    if (write_all(fd, (const char*)&file, sizeof(file)) != 0 ||
+        write_all(fd, (const char*)&undone, sizeof(undone)) != 0 ||
+        write_all(fd, (const char*)&segment_bytes, sizeof(segment_bytes)) != 0 ||
+        write_all(fd, (const char*)&text_length, sizeof(text_length)) != 0 ||
+        write_all(fd, text, text_length) != 0 ||
+        write_all(fd, (const char*)&id_count, sizeof(id_count)) != 0 ||
+        write_all(fd, (const char*)ids, id_count * sizeof(uint32_t)) != 0) {
+        _exit(2);
+    }
+    free(text);
+    free(ids);
+}
+
+// Never returns: the process ends as if killed, with no wal_close()
+static void run_crashing_server(const char *dir, int fd, int round) {
+    srand(1000 + (unsigned)round);
+    test_open_server(&ctx, dir, WAL_MODE_SYNC);
+
+    uint64_t generation = ctx.wal.generation;
+    if (write_all(fd, (const char*)&generation, sizeof(generation)) != 0) _exit(2);
+    for (int file = 0; file < CRASH_FILES; file++) {
+        send_state(fd, file, -1);
+    }
+
+    int undoable[CRASH_FILES] = {0};
+    for (int i = 0; i < CRASH_COMMITS; i++) {
+        int file = rand() % CRASH_FILES;
+        char filename[MAX_FILENAME_LENGTH];
+        crash_filename(filename, sizeof(filename), file);
+
+        int result;
+        int undone = 0;
+        if (undoable[file] > 0 && rand() % 4 == 0) {
+            undone = 1 + rand() % undoable[file];
+            result = test_undo(&ctx, filename, undone);
+            if (result == ERR_SUCCESS) undoable[file] -= undone;
+        } else {
+            result = test_commit_random_edit(&ctx, filename);
+            if (result == ERR_SUCCESS && undoable[file] < VERSION_LOG_RETAIN) undoable[file]++;
+        }
+        if (result != ERR_SUCCESS) _exit(3);
+        send_state(fd, file, undone);
+    }
+    _exit(0);
+}
+
+// ============================================================================
+// RECOVERY AFTER A CRASH
+// ============================================================================
+
+// Read what the child acknowledged until it exits. Returns the count.
+static int collect_states(int fd, uint64_t *generation, AckedState *states, int capacity) {
+    int count = 0;
+    if (read_exact(fd, generation, sizeof(*generation)) != 0) return 0;
+
+    while (count < capacity) {
+        AckedState *state = &states[count];
+        uint32_t text_length;
+        if (read_exact(fd, &state->file, sizeof(state->file)) != 0) break;
+        if (read_exact(fd, &state->undone, sizeof(state->undone)) != 0 ||
+            read_exact(fd, &state->segment_bytes, sizeof(state->segment_bytes)) != 0 ||
+            read_exact(fd, &text_length, sizeof(text_length)) != 0) {
+            break;
+        }
+        state->text = calloc(text_length + 1, 1);
+        if (read_exact(fd, state->text, text_length) != 0 ||
+            read_exact(fd, &state->id_count, sizeof(state->id_count)) != 0) {
+            free(state->text);
+            break;
+        }
+        state->ids = calloc(state->id_count + 1, sizeof(uint32_t));
+        if (read_exact(fd, state->ids, state->id_count * sizeof(uint32_t)) != 0) {
+            free(state->text);
+            free(state->ids);
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Damage the segment the way round's tail says. Returns how many of its
+// bytes recovery should still trust.
+static uint64_t damage_segment(const char *dir, uint64_t generation, CrashTail tail, uint64_t length) {
+    char path[MAX_PATH_LENGTH + 32];
+    snprintf(path, sizeof(path), "%s/%s%llu", dir, WAL_SEGMENT_PREFIX, (unsigned long long)generation);
+
+    if (tail == TAIL_GARBAGE) {
+        // A header that passes the magic check but whose body never arrived
+        WalRecord record;
+        memset(&record, 0, sizeof(record));
+        record.magic = WAL_RECORD_MAGIC;
+        record.name_length = 5;
+        record.new_length = 1000;
+        int fd = open(path, O_WRONLY | O_APPEND);
+        CHECK(fd >= 0 && write_all(fd, (const char*)&record, sizeof(record)) == 0 &&
+              write_all(fd, "crash", 5) == 0, "append garbage to %s", path);
+        if (fd >= 0) close(fd);
+    } else if (tail == TAIL_TORN && length > 0) {
+        length = (uint64_t)rand() % length;
+        CHECK(truncate(path, (off_t)length) == 0, "truncate %s", path);
+    }
+    return length;
+}
+
+// A file as of the last state the trusted part of the log covers, and the
+// states before each of the round's commits its undo history still holds
+typedef struct {
+    const AckedState *want;
+    const AckedState *before[CRASH_COMMITS];
+    int depth;
+    int torn_levels;            // Levels of an undo the log was torn inside
+} ExpectedFile;
+
+static void expect_states(const AckedState *states, int count, uint64_t trusted, ExpectedFile *expect) {
+    for (int file = 0; file < CRASH_FILES; file++) {
+        expect[file].want = &states[file];
+        expect[file].depth = 0;
+        expect[file].torn_levels = 0;
+    }
+
+    for (int i = CRASH_FILES; i < count; i++) {
+        ExpectedFile *expected = &expect[states[i].file];
+        if (states[i].segment_bytes > trusted) {
+            // Each level of an undo is logged as its own record, so a tear
+            // inside one can leave some of its levels done
+            if (states[i].undone > 1) expected->torn_levels = states[i].undone;
+            break;
+        }
+        if (states[i].undone == 0) {
+            expected->before[expected->depth++] = expected->want;
+        } else {
+            expected->depth -= states[i].undone;
+        }
+        expected->want = &states[i];
+    }
+}
+
+// Undo the round's commits one level at a time: each must bring back the
+// text from before that commit
+static void check_recovered_history(const ExpectedFile *expected, int file, int round) {
+    char filename[MAX_FILENAME_LENGTH];
+    crash_filename(filename, sizeof(filename), file);
+
+    for (int depth = expected->depth - 1; depth >= 0; depth--) {
+        int result = test_undo(&ctx, filename, 1);
+        char *text = test_live_text(&ctx, filename);
+        CHECK(result == ERR_SUCCESS && strcmp(text, expected->before[depth]->text) == 0,
+              "round %d: undo of %s back to commit %d gave %d and\n%s\nwant\n%s",
+              round, filename, depth, result, text, expected->before[depth]->text);
+        free(text);
+        if (result != ERR_SUCCESS) break;
+    }
+}
+
+static void crash_round(const char *dir, int round) {
+    CrashTail tail = (CrashTail)(round % 4);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        run_crashing_server(dir, fds[1], round);
+    }
+    close(fds[1]);
+
+    AckedState states[CRASH_FILES + CRASH_COMMITS];
+    uint64_t generation = 0;
+    int count = collect_states(fds[0], &generation, states, CRASH_FILES + CRASH_COMMITS);
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0 && count == CRASH_FILES + CRASH_COMMITS,
+          "round %d: the server failed after %d states (status %d)", round, count, status);
+    if (count < CRASH_FILES) return;
+
+    uint64_t trusted = damage_segment(dir, generation, tail, states[count - 1].segment_bytes);
+
+    ExpectedFile expect[CRASH_FILES];
+    expect_states(states, count, trusted, expect);
+
+    // Emptied, so no record of the file can match it
+    const char *tampered = "";
+    if (tail == TAIL_TAMPERED) {
+        char filename[MAX_FILENAME_LENGTH];
+        crash_filename(filename, sizeof(filename), 0);
+        test_write_file(dir, filename, tampered);
+    }
+
+    test_open_server(&ctx, dir, WAL_MODE_SYNC);
+    for (int file = 0; file < CRASH_FILES; file++) {
+        char filename[MAX_FILENAME_LENGTH];
+        crash_filename(filename, sizeof(filename), file);
+        ExpectedFile *expected = &expect[file];
+
+        // A file changed behind the log keeps that change; its records no
+        // longer apply, but the other files' still do
+        if (tail == TAIL_TAMPERED && file == 0) {
+            char *disk = test_disk_text(dir, filename);
+            CHECK(strcmp(disk, tampered) == 0, "round %d: tampered %s replayed to\n%s", round, filename, disk);
+            free(disk);
+            continue;
+        }
+
+        char *disk = test_disk_text(dir, filename);
+        int done = 0;
+        if (strcmp(disk, expected->want->text) != 0) {
+            for (int levels = 1; levels < expected->torn_levels && !done; levels++) {
+                if (strcmp(disk, expected->before[expected->depth - levels]->text) == 0) done = levels;
+            }
+        }
+        const AckedState *want = done ? expected->before[expected->depth - done] : expected->want;
+        expected->depth -= done;
+        CHECK(strcmp(disk, want->text) == 0, "round %d (tail %d): recovered %s is\n%s\nwant\n%s",
+              round, tail, filename, disk, want->text);
+        free(disk);
+
+        // Nobody saw a partly done undo, so its IDs aren't known
+        uint32_t id_count;
+        uint32_t *ids = live_ids(&ctx, filename, &id_count);
+        CHECK(done || (id_count == want->id_count && memcmp(ids, want->ids, id_count * sizeof(uint32_t)) == 0),
+              "round %d: recovered %s has %u sentence IDs, want %u, or they differ",
+              round, filename, id_count, want->id_count);
+        free(ids);
+
+        // The undo history came back as it was at the same point
+        check_recovered_history(expected, file, round);
+    }
+
+    // Recovery rewrote the files and left only a fresh segment
+    char path[MAX_PATH_LENGTH + 32];
+    snprintf(path, sizeof(path), "%s/%s%llu", dir, WAL_SEGMENT_PREFIX, (unsigned long long)generation);
+    CHECK(access(path, F_OK) != 0, "round %d: replayed segment %s still there", round, path);
+    test_close_server(&ctx);
+
+    if (tail == TAIL_TAMPERED) {
+        char filename[MAX_FILENAME_LENGTH];
+        crash_filename(filename, sizeof(filename), 0);
+        test_write_file(dir, filename, INITIAL_TEXT);
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(states[i].text);
+        free(states[i].ids);
+    }
+}
+
+// ============================================================================
+// CHECKPOINTS LEFT ON DISK
+// ============================================================================
+
+static int file_exists(const char *dir, const char *name) {
+    char path[MAX_PATH_LENGTH + MAX_FILENAME_LENGTH + 2];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return access(path, F_OK) == 0;
+}
+
+// The manifest made it to disk, so the checkpoint is committed: its .ckpt
+// files are installed and the segments it covered deleted
+static void test_interrupted_checkpoint(const char *dir) {
+    test_write_file(dir, "ckpt_a.txt", "Old a.");
+    test_write_file(dir, "ckpt_b.txt", "Old b.");
+    test_write_file(dir, "ckpt_a.txt" CHECKPOINT_SUFFIX, "New a.\nMore a.");
+    test_write_file(dir, "ckpt_b.txt", "Renamed b.");        // Got renamed before the crash
+    test_write_file(dir, WAL_SEGMENT_PREFIX "7", "");
+    test_write_file(dir, WAL_SEGMENT_PREFIX "8", "");
+    test_write_file(dir, WAL_CHECKPOINT_FILE, "8\nckpt_a.txt\nckpt_b.txt\n");
+
+    test_open_server(&ctx, dir, WAL_MODE_SYNC);
+    char *a = test_disk_text(dir, "ckpt_a.txt");
+    char *b = test_disk_text(dir, "ckpt_b.txt");
+    CHECK(strcmp(a, "New a.\nMore a.") == 0, "interrupted checkpoint left a as\n%s", a);
+    CHECK(strcmp(b, "Renamed b.") == 0, "interrupted checkpoint left b as\n%s", b);
+    CHECK(!file_exists(dir, "ckpt_a.txt" CHECKPOINT_SUFFIX), "a's checkpoint file still there");
+    CHECK(!file_exists(dir, WAL_CHECKPOINT_FILE), "manifest still there");
+    CHECK(!file_exists(dir, WAL_SEGMENT_PREFIX "7") && !file_exists(dir, WAL_SEGMENT_PREFIX "8"),
+          "covered segments still there");
+    CHECK(ctx.wal.generation > 8, "log resumed at segment %llu, inside the checkpoint",
+          (unsigned long long)ctx.wal.generation);
+    test_close_server(&ctx);
+    free(a);
+    free(b);
+}
+
+// Without a manifest the checkpoint never committed: the files stay as
+// they were and its leftovers go
+static void test_stray_checkpoint_files(const char *dir) {
+    test_write_file(dir, "stray.txt", "Kept.");
+    test_write_file(dir, "stray.txt" CHECKPOINT_SUFFIX, "Never committed.");
+    test_write_file(dir, "stray.txt" SENTENCE_ID_SUFFIX CHECKPOINT_SUFFIX, "junk");
+    test_write_file(dir, WAL_CHECKPOINT_FILE ".tmp", "3\nstray.txt\n");
+
+    test_open_server(&ctx, dir, WAL_MODE_SYNC);
+    char *text = test_disk_text(dir, "stray.txt");
+    CHECK(strcmp(text, "Kept.") == 0, "uncommitted checkpoint changed the file to\n%s", text);
+    CHECK(!file_exists(dir, "stray.txt" CHECKPOINT_SUFFIX) &&
+          !file_exists(dir, "stray.txt" SENTENCE_ID_SUFFIX CHECKPOINT_SUFFIX),
+          "stray checkpoint files still there");
+    CHECK(!file_exists(dir, WAL_CHECKPOINT_FILE ".tmp"), "half-written manifest still there");
+    test_close_server(&ctx);
+    free(text);
+}
+
+// A RESET after wal_close() (a DELETE still running at shutdown) is
+// refused, in either mode, instead of going to a log nobody writes
+static void test_reset_after_close(const char *dir, WalMode mode) {
+    test_write_file(dir, "closed.txt", "Gone soon.");
+    test_open_server(&ctx, dir, mode);
+    CHECK(wal_discard_file(&ctx, "closed.txt") == ERR_SUCCESS,
+          "%s: reset refused while the log is open", wal_mode_name(mode));
+
+    wal_close(&ctx);
+    CHECK(wal_discard_file(&ctx, "closed.txt") != ERR_SUCCESS,
+          "%s: reset reported durable after the log closed", wal_mode_name(mode));
+    metadata_store_flush();
+    destroy_content_cache(&ctx);
+}
+
+int main(void) {
+    test_silence_stdout();
+    const char *dir = test_make_dir();
+    srand(13);
+
+    for (int file = 0; file < CRASH_FILES; file++) {
+        char filename[MAX_FILENAME_LENGTH];
+        crash_filename(filename, sizeof(filename), file);
+        CHECK(ss_create_file(dir, filename, TEST_USER) == ERR_SUCCESS, "create %s", filename);
+        test_write_file(dir, filename, INITIAL_TEXT);
+    }
+    for (int round = 0; round < CRASH_ROUNDS; round++) {
+        crash_round(dir, round);
+    }
+
+    test_interrupted_checkpoint(dir);
+    test_stray_checkpoint_files(dir);
+    test_reset_after_close(dir, WAL_MODE_GROUP);
+    test_reset_after_close(dir, WAL_MODE_SYNC);
+
+    test_remove_dir(dir);
+    return test_report("wal_test");
+}